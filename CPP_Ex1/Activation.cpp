@@ -18,13 +18,13 @@
 
 // ------------------------------ includes ------------------------------
 #include "Activation.h"
-#include <math.h>
+#include "ActivationKernels.h"
 
 
 // ------------------------ class implementation ------------------------
 
 /**
-* Constructor for the Activation class, Accepts activation type (Relu/Softmax)
+* Constructor for the Activation class, Accepts activation type
 * and defines this instance’s activation accordingly
 * @param actType The activation type needed to apply on given matrix
 */
@@ -38,67 +38,107 @@ Activation::Activation(ActivationType actType) : type(actType){}
 */
 Matrix Activation::operator()(const Matrix &other) const
 {
-    if(type == Relu)
-    {
-        return _reluFunc(other);
-    }
+    Matrix newMatrix = other;
+    apply(newMatrix);
 
-    return _softmaxFunc(other);
+    return newMatrix;
 }
 
 
 /**
-* Apply Relu activation type on given matrix
-* @param other The given matrix
-* @return The same matrix after activating Relu
+* Applies activation function on input matrix in place, without allocating
+* @param other The given matrix, overwritten with the result
 */
-Matrix Activation::_reluFunc(const Matrix &other)
+void Activation::apply(Matrix &other) const
 {
-    Matrix newMatrix(other.getRows(), other.getCols());
+    apply(other.data(), other.getRows(), other.getCols());
+}
 
-    for(int i = 0 ; i < other.getRows() * other.getCols() ; i++)
-    {
-        if(other[i] >= 0)
-        {
-            newMatrix[i] = other[i];
-        }
 
-        else
-        {
-            newMatrix[i] = INITIALIZE_VALUE;
-        }
+/**
+* Applies activation function in place on a row-major buffer, SoftMax column by column
+* @param values The rows*cols values, overwritten with the result
+* @param rows The number of rows
+* @param cols The number of columns, one sample per column
+*/
+void Activation::apply(float *values, int rows, int cols) const
+{
+    switch(type)
+    {
+        case Relu:
+            kernels::applyRelu(values, rows * cols);
+            break;
+        case Softmax:
+            kernels::softmaxColumns(values, rows, cols);
+            break;
+        case Sigmoid:
+            kernels::applySigmoid(values, rows * cols);
+            break;
+        case Tanh:
+            kernels::applyTanh(values, rows * cols);
+            break;
+        case Gelu:
+            kernels::applyGelu(values, rows * cols);
+            break;
     }
-
-    return newMatrix;
 }
 
 
 /**
-* Apply SoftMax activation type on given matrix
-* @param other The given matrix
-* @return The same matrix after activating SoftMax
+* Turns the gradient of the loss by the activation output into the gradient by its input,
+* in place. The derivative is taken from the output alone, SoftMax column by column.
+* @param output The output of the activation
+* @param gradient The gradient by the output, overwritten with the gradient by the input
+* @throws std::invalid_argument If the shapes differ or the activation is GELU
 */
-Matrix Activation::_softmaxFunc(const Matrix &other)
+void Activation::backward(const Matrix &output, Matrix &gradient) const
 {
-    Matrix newMatrix(other.getRows(), other.getCols());
-
-    for(int i = 0 ; i < other.getCols() ; i++)
+    int rows = output.getRows();
+    int cols = output.getCols();
+    if(gradient.getRows() != rows || gradient.getCols() != cols)
     {
-        float sum = 0;
-
-        for(int j = 0 ; j < other.getRows() ; j++)
-        {
-            sum += std::exp(other(j, i));
-        }
-
-        sum = 1 / sum;
-
-        for(int k = 0 ; k < other.getRows() ; k++)
-        {
-            newMatrix(k, i) = sum * std::exp(other(k, i));
-        }
+        throw std::invalid_argument(INVALID_MATRIX_ADDITION_DIMENSIONS_MSG);
     }
 
-    return newMatrix;
+    const float *y = output.data();
+    float *g = gradient.data();
+    long int size = (long int) rows * cols;
+    switch(type)
+    {
+        case Relu:
+            for(long int i = 0 ; i < size ; i++)
+            {
+                g[i] = y[i] > 0 ? g[i] : 0;
+            }
+            break;
+        case Softmax:
+            for(int j = 0 ; j < cols ; j++)
+            {
+                float dot = 0;
+                for(int i = 0 ; i < rows ; i++)
+                {
+                    dot += g[(long int) i * cols + j] * y[(long int) i * cols + j];
+                }
+                for(int i = 0 ; i < rows ; i++)
+                {
+                    long int at = (long int) i * cols + j;
+                    g[at] = y[at] * (g[at] - dot);
+                }
+            }
+            break;
+        case Sigmoid:
+            for(long int i = 0 ; i < size ; i++)
+            {
+                g[i] *= y[i] * (1 - y[i]);
+            }
+            break;
+        case Tanh:
+            for(long int i = 0 ; i < size ; i++)
+            {
+                g[i] *= 1 - y[i] * y[i];
+            }
+            break;
+        case Gelu:
+            throw std::invalid_argument(UNSUPPORTED_ACTIVATION_GRADIENT_MSG);
+    }
 }
-
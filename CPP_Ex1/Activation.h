@@ -23,6 +23,17 @@
 #include "Matrix.h"
 
 
+// -------------------------- const definitions -------------------------
+
+/*
+ * @def UNSUPPORTED_ACTIVATION_GRADIENT_MSG "Error: The activation gradient can't be taken
+ *      from its output"
+ * @brief Error msg when backpropagating through an activation, such as GELU, whose
+ *        derivative needs the values before the activation
+ */
+#define UNSUPPORTED_ACTIVATION_GRADIENT_MSG "Error: The activation gradient can't be taken from its output"
+
+
 // -------------------------- class definitions -------------------------
 
 /**
@@ -32,7 +43,10 @@
 enum ActivationType
 {
     Relu,
-    Softmax
+    Softmax,
+    Sigmoid,
+    Tanh,
+    Gelu
 };
 
 
@@ -44,24 +58,10 @@ class Activation
 private:
     ActivationType type;
 
-    /**
-     * Apply Relu activation type on given matrix
-     * @param other The given matrix
-     * @return The same matrix after activating Relu
-     */
-    static Matrix _reluFunc(const Matrix &other);
-
-    /**
-     * Apply SoftMax activation type on given matrix
-     * @param other The given matrix
-     * @return The same matrix after activating SoftMax
-     */
-    static Matrix _softmaxFunc(const Matrix &other);
-
 public:
 
     /**
-     * Constructor for the Activation class, Accepts activation type (Relu/Softmax)
+     * Constructor for the Activation class, Accepts activation type
      * and defines this instance’s activation accordingly
      * @param actType The activation type needed to apply on given matrix
      */
@@ -69,9 +69,9 @@ public:
 
     /**
      * Getter function of the activation type as inline function
-     * @return This activation type (Relu/SoftMax)
+     * @return This activation type
      */
-    const ActivationType &getActivationType(){ return type; }
+    const ActivationType &getActivationType() const { return type; }
 
     /**
      * Applies activation function on input matrix, does not change input
@@ -80,6 +80,30 @@ public:
      */
     Matrix operator()(const Matrix &other) const;
 
+    /**
+     * Applies activation function on input matrix in place, without allocating
+     * @param other The given matrix, overwritten with the result
+     */
+    void apply(Matrix &other) const;
+
+    /**
+     * Applies activation function in place on a row-major buffer, SoftMax column by column
+     * @param values The rows*cols values, overwritten with the result
+     * @param rows The number of rows
+     * @param cols The number of columns, one sample per column
+     */
+    void apply(float *values, int rows, int cols) const;
+
+    /**
+     * Turns the gradient of the loss by the activation output into the gradient by its
+     * input, in place. The derivative is taken from the output alone, SoftMax column by
+     * column.
+     * @param output The output of the activation
+     * @param gradient The gradient by the output, overwritten with the gradient by the input
+     * @throws std::invalid_argument If the shapes differ or the activation is GELU
+     */
+    void backward(const Matrix &output, Matrix &gradient) const;
+
 };
 
 #endif //ACTIVATION_H
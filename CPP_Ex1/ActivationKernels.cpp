@@ -0,0 +1,872 @@
+/**
+ * @file ActivationKernels.cpp
+ * @author  Liron Gershuny <liron.gershuny@mail.huji.ac.il>
+ * @version 1.0
+ * @date 25 Dec 2019
+ *
+ * @brief Define the SIMD kernels of the activation functions.
+ *
+ * @section LICENSE
+ * This program is not a free software; bla bla bla...
+ *
+ * @section DESCRIPTION
+ * The exponential follows the classic Cephes reduction: e^x = 2^n * e^r with
+ * n = round(x / ln 2), r taken with a two part ln 2 so it stays exact, and e^r from a
+ * degree 6 polynomial. 2^n is built straight in the exponent bits. Sigmoid, tanh and GELU
+ * are rewritten in terms of that exponential, so every level shares one approximation.
+ * Input  : A buffer of layer outputs
+ * Process: Branch free elementwise passes, and column reductions for softmax
+ * Output : The activated values, written over the input
+ */
+
+// ------------------------------ includes ------------------------------
+#include "ActivationKernels.h"
+#include "MatrixKernels.h"
+#include "KernelCommon.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+
+
+// -------------------------- const definitions -------------------------
+
+/*
+ * @def EXP_MAX_INPUT 88.0f
+ * @brief Larger inputs are clamped, e^88 is still a normal float
+ */
+#define EXP_MAX_INPUT 88.0f
+
+/*
+ * @def EXP_MIN_INPUT -87.0f
+ * @brief Smaller inputs are clamped, e^-87 is the smallest power the exponent bits reach
+ *        without building a denormal
+ */
+#define EXP_MIN_INPUT -87.0f
+
+/*
+ * The reduction constants: log2(e), and ln 2 split so n * EXP_LN2_HI is exact
+ */
+#define EXP_LOG2E 1.44269504088896341f
+#define EXP_LN2_HI 0.693359375f
+#define EXP_LN2_LO -2.12194440e-4f
+
+/*
+ * The coefficients of e^r - 1 - r over r^2, highest degree first
+ */
+#define EXP_P0 1.9875691500e-4f
+#define EXP_P1 1.3981999507e-3f
+#define EXP_P2 8.3334519073e-3f
+#define EXP_P3 4.1665795894e-2f
+#define EXP_P4 1.6666665459e-1f
+#define EXP_P5 5.0000001201e-1f
+
+/*
+ * @def TANH_SMALL_INPUT 0.625f
+ * @brief Below this magnitude tanh is taken from its odd polynomial instead of e^2x
+ */
+#define TANH_SMALL_INPUT 0.625f
+
+/*
+ * The coefficients of (tanh(x) - x) / x^3 in x^2, highest degree first
+ */
+#define TANH_P0 -5.70498872745e-3f
+#define TANH_P1 2.06390887954e-2f
+#define TANH_P2 -5.37397155531e-2f
+#define TANH_P3 1.33314422036e-1f
+#define TANH_P4 -3.33332819422e-1f
+
+/*
+ * The GELU tanh approximation written as a sigmoid: 2 * sqrt(2 / pi), and the cubic term
+ */
+#define GELU_SCALE 1.5957691216057308f
+#define GELU_CUBIC 0.044715f
+
+/*
+ * @def AVX512_ALL_LANES
+ * @brief The mask of every lane. The plain forms of several AVX-512 intrinsics read an
+ *        undefined source register that GCC warns about, so their masked forms are used
+ */
+#define AVX512_ALL_LANES ((__mmask16) 0xFFFF)
+
+
+// ------------------------ static helpers ------------------------------
+
+/**
+ * @enum ElementwiseOp
+ * @brief The activations applied one element at a time.
+ */
+enum ElementwiseOp
+{
+    OpRelu,
+    OpSigmoid,
+    OpTanh,
+    OpGelu
+};
+
+
+/**
+ * The scalar exponential, the same approximation and clamping as the vector ones so the
+ * tails of the vector loops agree with their bodies.
+ * @param x The input
+ * @return e^x
+ */
+static inline float expScalar(float x)
+{
+    // A NaN passes through the vector clamps and comes out as NaN, like here
+    if(std::isnan(x))
+    {
+        return x;
+    }
+    x = x > EXP_MAX_INPUT ? EXP_MAX_INPUT : x;
+    x = x < EXP_MIN_INPUT ? EXP_MIN_INPUT : x;
+
+    float fx = std::floor(x * EXP_LOG2E + 0.5f);
+    x -= fx * EXP_LN2_HI;
+    x -= fx * EXP_LN2_LO;
+
+    float y = EXP_P0;
+    y = y * x + EXP_P1;
+    y = y * x + EXP_P2;
+    y = y * x + EXP_P3;
+    y = y * x + EXP_P4;
+    y = y * x + EXP_P5;
+    y = y * (x * x) + x + 1.0f;
+
+    int32_t bits = ((int32_t) fx + 127) << 23;
+    float scale;
+    std::memcpy(&scale, &bits, sizeof(scale));
+    return y * scale;
+}
+
+
+/**
+ * The scalar version of every elementwise activation.
+ * @param x The input
+ * @return The activated value
+ */
+template <ElementwiseOp OP>
+static inline float activateScalar(float x)
+{
+    if constexpr(OP == OpRelu)
+    {
+        return !(x >= 0) ? 0 : x;
+    }
+    else if constexpr(OP == OpSigmoid)
+    {
+        return 1.0f / (1.0f + expScalar(-x));
+    }
+    else if constexpr(OP == OpTanh)
+    {
+        float ax = std::fabs(x);
+        if(ax < TANH_SMALL_INPUT)
+        {
+            float z = x * x;
+            float p = TANH_P0;
+            p = p * z + TANH_P1;
+            p = p * z + TANH_P2;
+            p = p * z + TANH_P3;
+            p = p * z + TANH_P4;
+            return x + x * z * p;
+        }
+        return std::copysign(1.0f - 2.0f / (expScalar(2.0f * ax) + 1.0f), x);
+    }
+    else
+    {
+        float u = GELU_SCALE * x * (1.0f + GELU_CUBIC * x * x);
+        return x / (1.0f + expScalar(-u));
+    }
+}
+
+
+/**
+ * Apply an elementwise activation to n values without SIMD.
+ */
+template <ElementwiseOp OP>
+static void mapScalar(float *x, int n)
+{
+    for(int i = 0 ; i < n ; i++)
+    {
+        x[i] = activateScalar<OP>(x[i]);
+    }
+}
+
+
+/**
+ * SoftMax of one column without SIMD, the column elements stride floats apart.
+ */
+static void softmaxColumnScalar(float *c, int m, long int stride)
+{
+    float max = c[0];
+    for(int i = 1 ; i < m ; i++)
+    {
+        max = std::max(max, c[i * stride]);
+    }
+
+    float sum = 0;
+    for(int i = 0 ; i < m ; i++)
+    {
+        c[i * stride] = expScalar(c[i * stride] - max);
+        sum += c[i * stride];
+    }
+
+    sum = 1 / sum;
+    for(int i = 0 ; i < m ; i++)
+    {
+        c[i * stride] *= sum;
+    }
+}
+
+
+#ifdef KERNELS_X86
+
+/**
+ * SSE2 exponential of four lanes, floor is emulated since it needs SSE4.1.
+ */
+__attribute__((target("sse2")))
+static inline __m128 expSse2(__m128 x)
+{
+    // min and max return their second operand when either is NaN, so a NaN passes through
+    x = _mm_min_ps(_mm_set1_ps(EXP_MAX_INPUT), x);
+    x = _mm_max_ps(_mm_set1_ps(EXP_MIN_INPUT), x);
+
+    __m128 one = _mm_set1_ps(1.0f);
+    __m128 fx = _mm_add_ps(_mm_mul_ps(x, _mm_set1_ps(EXP_LOG2E)), _mm_set1_ps(0.5f));
+    __m128 truncated = _mm_cvtepi32_ps(_mm_cvttps_epi32(fx));
+    fx = _mm_sub_ps(truncated, _mm_and_ps(_mm_cmpgt_ps(truncated, fx), one));
+    x = _mm_sub_ps(x, _mm_mul_ps(fx, _mm_set1_ps(EXP_LN2_HI)));
+    x = _mm_sub_ps(x, _mm_mul_ps(fx, _mm_set1_ps(EXP_LN2_LO)));
+
+    __m128 y = _mm_set1_ps(EXP_P0);
+    y = _mm_add_ps(_mm_mul_ps(y, x), _mm_set1_ps(EXP_P1));
+    y = _mm_add_ps(_mm_mul_ps(y, x), _mm_set1_ps(EXP_P2));
+    y = _mm_add_ps(_mm_mul_ps(y, x), _mm_set1_ps(EXP_P3));
+    y = _mm_add_ps(_mm_mul_ps(y, x), _mm_set1_ps(EXP_P4));
+    y = _mm_add_ps(_mm_mul_ps(y, x), _mm_set1_ps(EXP_P5));
+    y = _mm_add_ps(_mm_add_ps(_mm_mul_ps(y, _mm_mul_ps(x, x)), x), one);
+
+    __m128i bits = _mm_slli_epi32(_mm_add_epi32(_mm_cvttps_epi32(fx), _mm_set1_epi32(127)), 23);
+    return _mm_mul_ps(y, _mm_castsi128_ps(bits));
+}
+
+
+/**
+ * SSE2 version of every elementwise activation, see activateScalar.
+ */
+template <ElementwiseOp OP>
+__attribute__((target("sse2")))
+static inline __m128 activateSse2(__m128 x)
+{
+    __m128 zero = _mm_setzero_ps();
+    __m128 one = _mm_set1_ps(1.0f);
+    if constexpr(OP == OpRelu)
+    {
+        // max returns its second operand for NaNs, so a NaN becomes 0 like in the scalar code
+        return _mm_max_ps(x, zero);
+    }
+    else if constexpr(OP == OpSigmoid)
+    {
+        return _mm_div_ps(one, _mm_add_ps(one, expSse2(_mm_sub_ps(zero, x))));
+    }
+    else if constexpr(OP == OpTanh)
+    {
+        __m128 signMask = _mm_set1_ps(-0.0f);
+        __m128 ax = _mm_andnot_ps(signMask, x);
+        __m128 z = _mm_mul_ps(x, x);
+        __m128 p = _mm_set1_ps(TANH_P0);
+        p = _mm_add_ps(_mm_mul_ps(p, z), _mm_set1_ps(TANH_P1));
+        p = _mm_add_ps(_mm_mul_ps(p, z), _mm_set1_ps(TANH_P2));
+        p = _mm_add_ps(_mm_mul_ps(p, z), _mm_set1_ps(TANH_P3));
+        p = _mm_add_ps(_mm_mul_ps(p, z), _mm_set1_ps(TANH_P4));
+        __m128 small = _mm_add_ps(x, _mm_mul_ps(_mm_mul_ps(x, z), p));
+
+        __m128 e = expSse2(_mm_add_ps(ax, ax));
+        __m128 large = _mm_sub_ps(one, _mm_div_ps(_mm_set1_ps(2.0f), _mm_add_ps(e, one)));
+        large = _mm_or_ps(large, _mm_and_ps(signMask, x));
+
+        __m128 isSmall = _mm_cmplt_ps(ax, _mm_set1_ps(TANH_SMALL_INPUT));
+        return _mm_or_ps(_mm_and_ps(isSmall, small), _mm_andnot_ps(isSmall, large));
+    }
+    else
+    {
+        __m128 cubic = _mm_add_ps(one, _mm_mul_ps(_mm_set1_ps(GELU_CUBIC), _mm_mul_ps(x, x)));
+        __m128 u = _mm_mul_ps(_mm_mul_ps(_mm_set1_ps(GELU_SCALE), x), cubic);
+        return _mm_div_ps(x, _mm_add_ps(one, expSse2(_mm_sub_ps(zero, u))));
+    }
+}
+
+
+/**
+ * SSE2 elementwise activation of n values.
+ */
+template <ElementwiseOp OP>
+__attribute__((target("sse2")))
+static void mapSse2(float *x, int n)
+{
+    int i = 0;
+    for( ; i + 4 <= n ; i += 4)
+    {
+        _mm_storeu_ps(x + i, activateSse2<OP>(_mm_loadu_ps(x + i)));
+    }
+    for( ; i < n ; i++)
+    {
+        x[i] = activateScalar<OP>(x[i]);
+    }
+}
+
+
+/**
+ * SSE2 SoftMax of a single contiguous column, vectorized along its rows.
+ */
+__attribute__((target("sse2")))
+static void softmaxVectorSse2(float *x, int m)
+{
+    int i = 0;
+    float max = x[0];
+    if(m >= 4)
+    {
+        __m128 lanes = _mm_loadu_ps(x);
+        for(i = 4 ; i + 4 <= m ; i += 4)
+        {
+            lanes = _mm_max_ps(lanes, _mm_loadu_ps(x + i));
+        }
+        alignas(16) float values[4];
+        _mm_store_ps(values, lanes);
+        max = *std::max_element(values, values + 4);
+    }
+    for( ; i < m ; i++)
+    {
+        max = std::max(max, x[i]);
+    }
+
+    __m128 shift = _mm_set1_ps(max);
+    __m128 lanes = _mm_setzero_ps();
+    for(i = 0 ; i + 4 <= m ; i += 4)
+    {
+        __m128 e = expSse2(_mm_sub_ps(_mm_loadu_ps(x + i), shift));
+        _mm_storeu_ps(x + i, e);
+        lanes = _mm_add_ps(lanes, e);
+    }
+    alignas(16) float values[4];
+    _mm_store_ps(values, lanes);
+    float sum = values[0] + values[1] + values[2] + values[3];
+    for( ; i < m ; i++)
+    {
+        x[i] = expScalar(x[i] - max);
+        sum += x[i];
+    }
+
+    kernels::scale(x, 1 / sum, x, m);
+}
+
+
+/**
+ * SSE2 SoftMax of every column of an m*n matrix, four columns at a time so every load
+ * is contiguous. The max and the sum of the four columns stay in registers.
+ */
+__attribute__((target("sse2")))
+static void softmaxRowsSse2(float *c, int m, int n)
+{
+    __m128 one = _mm_set1_ps(1.0f);
+    int j = 0;
+    for( ; j + 4 <= n ; j += 4)
+    {
+        __m128 max = _mm_loadu_ps(c + j);
+        for(int i = 1 ; i < m ; i++)
+        {
+            max = _mm_max_ps(max, _mm_loadu_ps(c + (long int) i * n + j));
+        }
+
+        __m128 sum = _mm_setzero_ps();
+        for(int i = 0 ; i < m ; i++)
+        {
+            float *p = c + (long int) i * n + j;
+            __m128 e = expSse2(_mm_sub_ps(_mm_loadu_ps(p), max));
+            _mm_storeu_ps(p, e);
+            sum = _mm_add_ps(sum, e);
+        }
+
+        __m128 inverse = _mm_div_ps(one, sum);
+        for(int i = 0 ; i < m ; i++)
+        {
+            float *p = c + (long int) i * n + j;
+            _mm_storeu_ps(p, _mm_mul_ps(_mm_loadu_ps(p), inverse));
+        }
+    }
+    for( ; j < n ; j++)
+    {
+        softmaxColumnScalar(c + j, m, n);
+    }
+}
+
+
+/**
+ * AVX2 exponential of eight lanes.
+ */
+__attribute__((target("avx2,fma")))
+static inline __m256 expAvx2(__m256 x)
+{
+    x = _mm256_min_ps(_mm256_set1_ps(EXP_MAX_INPUT), x);
+    x = _mm256_max_ps(_mm256_set1_ps(EXP_MIN_INPUT), x);
+
+    __m256 fx = _mm256_floor_ps(_mm256_fmadd_ps(x, _mm256_set1_ps(EXP_LOG2E),
+                                                _mm256_set1_ps(0.5f)));
+    x = _mm256_fnmadd_ps(fx, _mm256_set1_ps(EXP_LN2_HI), x);
+    x = _mm256_fnmadd_ps(fx, _mm256_set1_ps(EXP_LN2_LO), x);
+
+    __m256 y = _mm256_set1_ps(EXP_P0);
+    y = _mm256_fmadd_ps(y, x, _mm256_set1_ps(EXP_P1));
+    y = _mm256_fmadd_ps(y, x, _mm256_set1_ps(EXP_P2));
+    y = _mm256_fmadd_ps(y, x, _mm256_set1_ps(EXP_P3));
+    y = _mm256_fmadd_ps(y, x, _mm256_set1_ps(EXP_P4));
+    y = _mm256_fmadd_ps(y, x, _mm256_set1_ps(EXP_P5));
+    y = _mm256_add_ps(_mm256_fmadd_ps(y, _mm256_mul_ps(x, x), x), _mm256_set1_ps(1.0f));
+
+    __m256i bits = _mm256_slli_epi32(_mm256_add_epi32(_mm256_cvttps_epi32(fx),
+                                                      _mm256_set1_epi32(127)), 23);
+    return _mm256_mul_ps(y, _mm256_castsi256_ps(bits));
+}
+
+
+/**
+ * AVX2 version of every elementwise activation, see activateScalar.
+ */
+template <ElementwiseOp OP>
+__attribute__((target("avx2,fma")))
+static inline __m256 activateAvx2(__m256 x)
+{
+    __m256 zero = _mm256_setzero_ps();
+    __m256 one = _mm256_set1_ps(1.0f);
+    if constexpr(OP == OpRelu)
+    {
+        return _mm256_max_ps(x, zero);
+    }
+    else if constexpr(OP == OpSigmoid)
+    {
+        return _mm256_div_ps(one, _mm256_add_ps(one, expAvx2(_mm256_sub_ps(zero, x))));
+    }
+    else if constexpr(OP == OpTanh)
+    {
+        __m256 signMask = _mm256_set1_ps(-0.0f);
+        __m256 ax = _mm256_andnot_ps(signMask, x);
+        __m256 z = _mm256_mul_ps(x, x);
+        __m256 p = _mm256_set1_ps(TANH_P0);
+        p = _mm256_fmadd_ps(p, z, _mm256_set1_ps(TANH_P1));
+        p = _mm256_fmadd_ps(p, z, _mm256_set1_ps(TANH_P2));
+        p = _mm256_fmadd_ps(p, z, _mm256_set1_ps(TANH_P3));
+        p = _mm256_fmadd_ps(p, z, _mm256_set1_ps(TANH_P4));
+        __m256 small = _mm256_fmadd_ps(_mm256_mul_ps(x, z), p, x);
+
+        __m256 e = expAvx2(_mm256_add_ps(ax, ax));
+        __m256 large = _mm256_sub_ps(one, _mm256_div_ps(_mm256_set1_ps(2.0f),
+                                                        _mm256_add_ps(e, one)));
+        large = _mm256_or_ps(large, _mm256_and_ps(signMask, x));
+
+        __m256 isSmall = _mm256_cmp_ps(ax, _mm256_set1_ps(TANH_SMALL_INPUT), _CMP_LT_OQ);
+        return _mm256_blendv_ps(large, small, isSmall);
+    }
+    else
+    {
+        __m256 cubic = _mm256_fmadd_ps(_mm256_set1_ps(GELU_CUBIC), _mm256_mul_ps(x, x), one);
+        __m256 u = _mm256_mul_ps(_mm256_mul_ps(_mm256_set1_ps(GELU_SCALE), x), cubic);
+        return _mm256_div_ps(x, _mm256_add_ps(one, expAvx2(_mm256_sub_ps(zero, u))));
+    }
+}
+
+
+/**
+ * AVX2 elementwise activation of n values.
+ */
+template <ElementwiseOp OP>
+__attribute__((target("avx2,fma")))
+static void mapAvx2(float *x, int n)
+{
+    int i = 0;
+    for( ; i + 8 <= n ; i += 8)
+    {
+        _mm256_storeu_ps(x + i, activateAvx2<OP>(_mm256_loadu_ps(x + i)));
+    }
+    for( ; i < n ; i++)
+    {
+        x[i] = activateScalar<OP>(x[i]);
+    }
+}
+
+
+/**
+ * AVX2 SoftMax of a single contiguous column, vectorized along its rows.
+ */
+__attribute__((target("avx2,fma")))
+static void softmaxVectorAvx2(float *x, int m)
+{
+    int i = 0;
+    float max = x[0];
+    if(m >= 8)
+    {
+        __m256 lanes = _mm256_loadu_ps(x);
+        for(i = 8 ; i + 8 <= m ; i += 8)
+        {
+            lanes = _mm256_max_ps(lanes, _mm256_loadu_ps(x + i));
+        }
+        alignas(32) float values[8];
+        _mm256_store_ps(values, lanes);
+        max = *std::max_element(values, values + 8);
+    }
+    for( ; i < m ; i++)
+    {
+        max = std::max(max, x[i]);
+    }
+
+    __m256 shift = _mm256_set1_ps(max);
+    __m256 lanes = _mm256_setzero_ps();
+    for(i = 0 ; i + 8 <= m ; i += 8)
+    {
+        __m256 e = expAvx2(_mm256_sub_ps(_mm256_loadu_ps(x + i), shift));
+        _mm256_storeu_ps(x + i, e);
+        lanes = _mm256_add_ps(lanes, e);
+    }
+    alignas(32) float values[8];
+    _mm256_store_ps(values, lanes);
+    float sum = 0;
+    for(float value : values)
+    {
+        sum += value;
+    }
+    for( ; i < m ; i++)
+    {
+        x[i] = expScalar(x[i] - max);
+        sum += x[i];
+    }
+
+    kernels::scale(x, 1 / sum, x, m);
+}
+
+
+/**
+ * AVX2 SoftMax of every column of an m*n matrix, eight columns at a time.
+ */
+__attribute__((target("avx2,fma")))
+static void softmaxRowsAvx2(float *c, int m, int n)
+{
+    __m256 one = _mm256_set1_ps(1.0f);
+    int j = 0;
+    for( ; j + 8 <= n ; j += 8)
+    {
+        __m256 max = _mm256_loadu_ps(c + j);
+        for(int i = 1 ; i < m ; i++)
+        {
+            max = _mm256_max_ps(max, _mm256_loadu_ps(c + (long int) i * n + j));
+        }
+
+        __m256 sum = _mm256_setzero_ps();
+        for(int i = 0 ; i < m ; i++)
+        {
+            float *p = c + (long int) i * n + j;
+            __m256 e = expAvx2(_mm256_sub_ps(_mm256_loadu_ps(p), max));
+            _mm256_storeu_ps(p, e);
+            sum = _mm256_add_ps(sum, e);
+        }
+
+        __m256 inverse = _mm256_div_ps(one, sum);
+        for(int i = 0 ; i < m ; i++)
+        {
+            float *p = c + (long int) i * n + j;
+            _mm256_storeu_ps(p, _mm256_mul_ps(_mm256_loadu_ps(p), inverse));
+        }
+    }
+    for( ; j < n ; j++)
+    {
+        softmaxColumnScalar(c + j, m, n);
+    }
+}
+
+
+/**
+ * AVX-512 exponential of sixteen lanes.
+ */
+__attribute__((target("avx512f")))
+static inline __m512 expAvx512(__m512 x)
+{
+    x = _mm512_mask_min_ps(x, AVX512_ALL_LANES, _mm512_set1_ps(EXP_MAX_INPUT), x);
+    x = _mm512_mask_max_ps(x, AVX512_ALL_LANES, _mm512_set1_ps(EXP_MIN_INPUT), x);
+
+    __m512 fx = _mm512_fmadd_ps(x, _mm512_set1_ps(EXP_LOG2E), _mm512_set1_ps(0.5f));
+    fx = _mm512_mask_roundscale_ps(fx, AVX512_ALL_LANES, fx,
+                                   _MM_FROUND_TO_NEG_INF | _MM_FROUND_NO_EXC);
+    x = _mm512_fnmadd_ps(fx, _mm512_set1_ps(EXP_LN2_HI), x);
+    x = _mm512_fnmadd_ps(fx, _mm512_set1_ps(EXP_LN2_LO), x);
+
+    __m512 y = _mm512_set1_ps(EXP_P0);
+    y = _mm512_fmadd_ps(y, x, _mm512_set1_ps(EXP_P1));
+    y = _mm512_fmadd_ps(y, x, _mm512_set1_ps(EXP_P2));
+    y = _mm512_fmadd_ps(y, x, _mm512_set1_ps(EXP_P3));
+    y = _mm512_fmadd_ps(y, x, _mm512_set1_ps(EXP_P4));
+    y = _mm512_fmadd_ps(y, x, _mm512_set1_ps(EXP_P5));
+    y = _mm512_add_ps(_mm512_fmadd_ps(y, _mm512_mul_ps(x, x), x), _mm512_set1_ps(1.0f));
+
+    __m512i bits = _mm512_mask_cvttps_epi32(_mm512_setzero_si512(), AVX512_ALL_LANES, fx);
+    bits = _mm512_add_epi32(bits, _mm512_set1_epi32(127));
+    bits = _mm512_mask_slli_epi32(bits, AVX512_ALL_LANES, bits, 23);
+    return _mm512_mul_ps(y, _mm512_castsi512_ps(bits));
+}
+
+
+/**
+ * AVX-512 version of every elementwise activation, see activateScalar. The bitwise float
+ * operations need AVX-512 DQ, so the sign is handled on the integer view of the lanes.
+ */
+template <ElementwiseOp OP>
+__attribute__((target("avx512f")))
+static inline __m512 activateAvx512(__m512 x)
+{
+    __m512 zero = _mm512_setzero_ps();
+    __m512 one = _mm512_set1_ps(1.0f);
+    if constexpr(OP == OpRelu)
+    {
+        return _mm512_mask_max_ps(zero, AVX512_ALL_LANES, x, zero);
+    }
+    else if constexpr(OP == OpSigmoid)
+    {
+        return _mm512_div_ps(one, _mm512_add_ps(one, expAvx512(_mm512_sub_ps(zero, x))));
+    }
+    else if constexpr(OP == OpTanh)
+    {
+        __m512i signMask = _mm512_set1_epi32(INT32_MIN);
+        __m512i bits = _mm512_castps_si512(x);
+        __m512 ax = _mm512_castsi512_ps(_mm512_mask_andnot_epi32(bits, AVX512_ALL_LANES,
+                                                                 signMask, bits));
+        __m512 z = _mm512_mul_ps(x, x);
+        __m512 p = _mm512_set1_ps(TANH_P0);
+        p = _mm512_fmadd_ps(p, z, _mm512_set1_ps(TANH_P1));
+        p = _mm512_fmadd_ps(p, z, _mm512_set1_ps(TANH_P2));
+        p = _mm512_fmadd_ps(p, z, _mm512_set1_ps(TANH_P3));
+        p = _mm512_fmadd_ps(p, z, _mm512_set1_ps(TANH_P4));
+        __m512 small = _mm512_fmadd_ps(_mm512_mul_ps(x, z), p, x);
+
+        __m512 e = expAvx512(_mm512_add_ps(ax, ax));
+        __m512 large = _mm512_sub_ps(one, _mm512_div_ps(_mm512_set1_ps(2.0f),
+                                                        _mm512_add_ps(e, one)));
+        large = _mm512_castsi512_ps(_mm512_or_si512(_mm512_castps_si512(large),
+                                                    _mm512_and_si512(signMask, bits)));
+
+        __mmask16 isSmall = _mm512_cmp_ps_mask(ax, _mm512_set1_ps(TANH_SMALL_INPUT),
+                                               _CMP_LT_OQ);
+        return _mm512_mask_blend_ps(isSmall, large, small);
+    }
+    else
+    {
+        __m512 cubic = _mm512_fmadd_ps(_mm512_set1_ps(GELU_CUBIC), _mm512_mul_ps(x, x), one);
+        __m512 u = _mm512_mul_ps(_mm512_mul_ps(_mm512_set1_ps(GELU_SCALE), x), cubic);
+        return _mm512_div_ps(x, _mm512_add_ps(one, expAvx512(_mm512_sub_ps(zero, u))));
+    }
+}
+
+
+/**
+ * AVX-512 elementwise activation of n values, the tail handled by a masked pass.
+ */
+template <ElementwiseOp OP>
+__attribute__((target("avx512f")))
+static void mapAvx512(float *x, int n)
+{
+    int i = 0;
+    for( ; i + 16 <= n ; i += 16)
+    {
+        _mm512_storeu_ps(x + i, activateAvx512<OP>(_mm512_loadu_ps(x + i)));
+    }
+    if(i < n)
+    {
+        __mmask16 mask = (__mmask16) ((1u << (n - i)) - 1);
+        _mm512_mask_storeu_ps(x + i, mask,
+                              activateAvx512<OP>(_mm512_maskz_loadu_ps(mask, x + i)));
+    }
+}
+
+
+/**
+ * AVX-512 SoftMax of a single contiguous column, vectorized along its rows. The lanes past
+ * the end are masked out of every reduction.
+ */
+__attribute__((target("avx512f")))
+static void softmaxVectorAvx512(float *x, int m)
+{
+    __m512 lowest = _mm512_set1_ps(-INFINITY);
+    __m512 lanes = lowest;
+    for(int i = 0 ; i < m ; i += 16)
+    {
+        __mmask16 mask = m - i >= 16 ? AVX512_ALL_LANES : (__mmask16) ((1u << (m - i)) - 1);
+        lanes = _mm512_mask_max_ps(lanes, AVX512_ALL_LANES, lanes,
+                                   _mm512_mask_loadu_ps(lowest, mask, x + i));
+    }
+    alignas(64) float values[16];
+    _mm512_store_ps(values, lanes);
+    __m512 shift = _mm512_set1_ps(*std::max_element(values, values + 16));
+
+    lanes = _mm512_setzero_ps();
+    for(int i = 0 ; i < m ; i += 16)
+    {
+        __mmask16 mask = m - i >= 16 ? AVX512_ALL_LANES : (__mmask16) ((1u << (m - i)) - 1);
+        __m512 e = expAvx512(_mm512_sub_ps(_mm512_maskz_loadu_ps(mask, x + i), shift));
+        _mm512_mask_storeu_ps(x + i, mask, e);
+        lanes = _mm512_mask_add_ps(lanes, mask, lanes, e);
+    }
+    _mm512_store_ps(values, lanes);
+    float sum = 0;
+    for(float value : values)
+    {
+        sum += value;
+    }
+
+    kernels::scale(x, 1 / sum, x, m);
+}
+
+
+/**
+ * AVX-512 SoftMax of every column of an m*n matrix, sixteen columns at a time, the last
+ * block masked.
+ */
+__attribute__((target("avx512f")))
+static void softmaxRowsAvx512(float *c, int m, int n)
+{
+    __m512 lowest = _mm512_set1_ps(-INFINITY);
+    __m512 one = _mm512_set1_ps(1.0f);
+    for(int j = 0 ; j < n ; j += 16)
+    {
+        __mmask16 mask = n - j >= 16 ? AVX512_ALL_LANES : (__mmask16) ((1u << (n - j)) - 1);
+
+        __m512 max = lowest;
+        for(int i = 0 ; i < m ; i++)
+        {
+            __m512 row = _mm512_mask_loadu_ps(lowest, mask, c + (long int) i * n + j);
+            max = _mm512_mask_max_ps(max, AVX512_ALL_LANES, max, row);
+        }
+
+        __m512 sum = _mm512_setzero_ps();
+        for(int i = 0 ; i < m ; i++)
+        {
+            float *p = c + (long int) i * n + j;
+            __m512 e = expAvx512(_mm512_sub_ps(_mm512_maskz_loadu_ps(mask, p), max));
+            _mm512_mask_storeu_ps(p, mask, e);
+            sum = _mm512_add_ps(sum, e);
+        }
+
+        // The masked out lanes hold garbage and are never stored
+        __m512 inverse = _mm512_div_ps(one, sum);
+        for(int i = 0 ; i < m ; i++)
+        {
+            float *p = c + (long int) i * n + j;
+            _mm512_mask_storeu_ps(p, mask, _mm512_mul_ps(_mm512_maskz_loadu_ps(mask, p), inverse));
+        }
+    }
+}
+
+#endif
+
+
+/**
+ * Dispatch an elementwise activation to the active SIMD level.
+ * @param x The values, overwritten
+ * @param n The number of values
+ */
+template <ElementwiseOp OP>
+static void map(float *x, int n)
+{
+    switch(kernels::getSimdLevel())
+    {
+#ifdef KERNELS_X86
+        case kernels::Avx512:
+            mapAvx512<OP>(x, n);
+            return;
+        case kernels::Avx2:
+            mapAvx2<OP>(x, n);
+            return;
+        case kernels::Sse2:
+            mapSse2<OP>(x, n);
+            return;
+#endif
+        default:
+            mapScalar<OP>(x, n);
+    }
+}
+
+
+// ----------------------- function implementation ----------------------
+
+/**
+* Apply ReLU in place, x = max(x, 0). A NaN becomes 0, like in the fused dense kernels.
+* @param x The values, overwritten
+* @param n The number of values
+*/
+void kernels::applyRelu(float *x, int n)
+{
+    map<OpRelu>(x, n);
+}
+
+
+/**
+* Apply the logistic function in place, x = 1 / (1 + exp(-x)).
+* @param x The values, overwritten
+* @param n The number of values
+*/
+void kernels::applySigmoid(float *x, int n)
+{
+    map<OpSigmoid>(x, n);
+}
+
+
+/**
+* Apply the hyperbolic tangent in place.
+* @param x The values, overwritten
+* @param n The number of values
+*/
+void kernels::applyTanh(float *x, int n)
+{
+    map<OpTanh>(x, n);
+}
+
+
+/**
+* Apply GELU in place with the tanh approximation.
+* @param x The values, overwritten
+* @param n The number of values
+*/
+void kernels::applyGelu(float *x, int n)
+{
+    map<OpGelu>(x, n);
+}
+
+
+/**
+* Apply SoftMax in place to every column of a matrix, shifted by the column max. A single
+* column is vectorized along its rows, a batch across its columns.
+* @param c The m*n row-major matrix, one sample per column, overwritten
+* @param m The number of rows of C
+* @param n The number of columns of C
+*/
+void kernels::softmaxColumns(float *c, int m, int n)
+{
+    if(m <= 0 || n <= 0)
+    {
+        return;
+    }
+
+    switch(getSimdLevel())
+    {
+#ifdef KERNELS_X86
+        case Avx512:
+            n == 1 ? softmaxVectorAvx512(c, m) : softmaxRowsAvx512(c, m, n);
+            return;
+        case Avx2:
+            n == 1 ? softmaxVectorAvx2(c, m) : softmaxRowsAvx2(c, m, n);
+            return;
+        case Sse2:
+            n == 1 ? softmaxVectorSse2(c, m) : softmaxRowsSse2(c, m, n);
+            return;
+#endif
+        default:
+            for(int j = 0 ; j < n ; j++)
+            {
+                softmaxColumnScalar(c + j, m, n);
+            }
+    }
+}
@@ -0,0 +1,74 @@
+/**
+ * @file ActivationKernels.h
+ * @author  Liron Gershuny <liron.gershuny@mail.huji.ac.il>
+ * @version 1.0
+ * @date 25 Dec 2019
+ *
+ * @brief Define the SIMD kernels of the activation functions.
+ *
+ * @section LICENSE
+ * This program is not a free software; bla bla bla...
+ *
+ * @section DESCRIPTION
+ * Every activation is applied in place over contiguous floats, with the same runtime
+ * dispatch as the matrix kernels. The exponential is a polynomial approximation evaluated
+ * in vector registers, within a couple of ulps of std::exp over the range it is used on.
+ * Input  : A buffer of layer outputs
+ * Process: Branch free elementwise passes, and column reductions for softmax
+ * Output : The activated values, written over the input
+ */
+
+#ifndef ACTIVATION_KERNELS_H
+#define ACTIVATION_KERNELS_H
+
+
+// ------------------------- function definitions -----------------------
+
+namespace kernels
+{
+    /**
+     * Apply ReLU in place, x = max(x, 0). A NaN becomes 0, like in the fused dense kernels.
+     * @param x The values, overwritten
+     * @param n The number of values
+     */
+    void applyRelu(float *x, int n);
+
+
+    /**
+     * Apply the logistic function in place, x = 1 / (1 + exp(-x)).
+     * @param x The values, overwritten
+     * @param n The number of values
+     */
+    void applySigmoid(float *x, int n);
+
+
+    /**
+     * Apply the hyperbolic tangent in place. Small inputs use an odd polynomial so the
+     * result keeps its relative precision around zero.
+     * @param x The values, overwritten
+     * @param n The number of values
+     */
+    void applyTanh(float *x, int n);
+
+
+    /**
+     * Apply GELU in place with the tanh approximation,
+     * x = x / (1 + exp(-2 * sqrt(2 / pi) * (x + 0.044715 * x^3))).
+     * @param x The values, overwritten
+     * @param n The number of values
+     */
+    void applyGelu(float *x, int n);
+
+
+    /**
+     * Apply SoftMax in place to every column of a matrix. The column max is subtracted
+     * before the exponential so no input overflows, and every exponential is computed
+     * once and kept in the matrix until it is normalized.
+     * @param c The m*n row-major matrix, one sample per column, overwritten
+     * @param m The number of rows of C
+     * @param n The number of columns of C
+     */
+    void softmaxColumns(float *c, int m, int n);
+}
+
+#endif //ACTIVATION_KERNELS_H
@@ -0,0 +1,173 @@
+/**
+ * @file BoundedQueue.h
+ * @author  Liron Gershuny <liron.gershuny@mail.huji.ac.il>
+ * @version 1.0
+ * @date 25 Dec 2019
+ *
+ * @brief Define a fixed capacity lock free queue for handing work between threads.
+ *
+ * @section LICENSE
+ * This program is not a free software; bla bla bla...
+ *
+ * @section DESCRIPTION
+ * A ring of cells, each with a sequence number that tells whether it is free to write or
+ * ready to read in the current lap. Producers and consumers claim a position with a
+ * compare and swap on their own counter and never take a lock, and a full queue refuses
+ * new items, which is what slows a fast producer down to the pace of its consumer.
+ * Input  : Items from any number of producer threads
+ * Process: Stores them in a ring in the order they were claimed
+ * Output : The items to any number of consumer threads, first in first out
+ */
+
+#ifndef BOUNDED_QUEUE_H
+#define BOUNDED_QUEUE_H
+
+// ------------------------------ includes ------------------------------
+#include <atomic>
+#include <cstddef>
+#include <memory>
+
+
+// -------------------------- const definitions -------------------------
+
+/*
+ * @def QUEUE_CACHE_LINE 64
+ * @brief The counters and every cell get their own cache line, so the producers and the
+ *        consumers don't invalidate each other's lines
+ */
+#define QUEUE_CACHE_LINE 64
+
+
+// -------------------------- class definitions -------------------------
+
+/**
+ * A multi producer multi consumer queue of at most a power of two items. T is copied in
+ * and out of the cells, so it should be small, e.g. a pointer.
+ */
+template <typename T>
+class BoundedQueue
+{
+private:
+
+    /**
+     * @struct Cell
+     * @brief One item of the ring, and the position it may be written or read at
+     */
+    struct alignas(QUEUE_CACHE_LINE) Cell
+    {
+        std::atomic<size_t> sequence;
+        T value;
+    };
+
+    std::unique_ptr<Cell[]> cells;
+    size_t mask;
+    alignas(QUEUE_CACHE_LINE) std::atomic<size_t> pushPosition;
+    alignas(QUEUE_CACHE_LINE) std::atomic<size_t> popPosition;
+
+public:
+
+    /**
+     * Constructor of an empty queue.
+     * @param minCapacity The least number of items the queue holds, rounded up to a power
+     *                    of two
+     */
+    explicit BoundedQueue(size_t minCapacity) : pushPosition(0), popPosition(0)
+    {
+        size_t capacity = 2;
+        while(capacity < minCapacity)
+        {
+            capacity *= 2;
+        }
+
+        cells.reset(new Cell[capacity]);
+        mask = capacity - 1;
+        for(size_t i = 0 ; i < capacity ; i++)
+        {
+            cells[i].sequence.store(i, std::memory_order_relaxed);
+        }
+    }
+
+
+    BoundedQueue(const BoundedQueue &) = delete;
+    BoundedQueue &operator=(const BoundedQueue &) = delete;
+
+
+    /**
+     * Getter of the capacity.
+     * @return The number of items the queue holds when it is full
+     */
+    size_t capacity() const { return mask + 1; }
+
+
+    /**
+     * Append an item unless the queue is full.
+     * @param value The item
+     * @return Whether the item was appended
+     */
+    bool tryPush(const T &value)
+    {
+        size_t position = pushPosition.load(std::memory_order_relaxed);
+        while(true)
+        {
+            Cell &cell = cells[position & mask];
+            size_t sequence = cell.sequence.load(std::memory_order_acquire);
+            long int lag = (long int) (sequence - position);
+            if(lag == 0)
+            {
+                if(pushPosition.compare_exchange_weak(position, position + 1,
+                                                      std::memory_order_relaxed))
+                {
+                    cell.value = value;
+                    cell.sequence.store(position + 1, std::memory_order_release);
+                    return true;
+                }
+            }
+            else if(lag < 0)
+            {
+                return false;
+            }
+            else
+            {
+                position = pushPosition.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+
+    /**
+     * Take the oldest item unless the queue is empty.
+     * @param value Receives the item
+     * @return Whether an item was taken
+     */
+    bool tryPop(T &value)
+    {
+        size_t position = popPosition.load(std::memory_order_relaxed);
+        while(true)
+        {
+            Cell &cell = cells[position & mask];
+            size_t sequence = cell.sequence.load(std::memory_order_acquire);
+            long int lag = (long int) (sequence - (position + 1));
+            if(lag == 0)
+            {
+                if(popPosition.compare_exchange_weak(position, position + 1,
+                                                     std::memory_order_relaxed))
+                {
+                    value = cell.value;
+                    cell.sequence.store(position + mask + 1, std::memory_order_release);
+                    return true;
+                }
+            }
+            else if(lag < 0)
+            {
+                return false;
+            }
+            else
+            {
+                position = popPosition.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+};
+
+#endif //BOUNDED_QUEUE_H
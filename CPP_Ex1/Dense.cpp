@@ -18,6 +18,82 @@
 
 // ------------------------------ includes ------------------------------
 #include "Dense.h"
+#include "MatrixKernels.h"
+#include "LowPrecisionKernels.h"
+#include "SparseKernels.h"
+#include "Profiler.h"
+#include <algorithm>
+#include <utility>
+
+
+// -------------------------- const definitions -------------------------
+
+/*
+ * @def PRECISION_COUNT 4
+ * @brief The number of WeightPrecision values
+ */
+#define PRECISION_COUNT 4
+
+/*
+ * @def DENSE_SPARSE_DENSITY 0.15
+ * @brief The share of non zero weights under which SparseAuto compresses a layer. A
+ *        compressed weight costs an index and a scattered load of the input, so only
+ *        layers that are mostly zeros are faster compressed
+ */
+#define DENSE_SPARSE_DENSITY 0.15
+
+/*
+ * @def DENSE_SPARSE_GEMV_BYTES (1 << 20)
+ * @brief The size of the float weights above which a single sample reads the compressed
+ *        weights. Smaller layers stay in the cache, where the fused kernel walks every
+ *        weight faster than the compressed one picks out the non zeros
+ */
+#define DENSE_SPARSE_GEMV_BYTES (1 << 20)
+
+/*
+ * @def DENSE_INT8_MIN_WEIGHTS 16384
+ * @brief The number of weights under which an Int8 layer keeps reading the float weights.
+ *        The float weights of a smaller layer stay in the cache, so the int8 ones save no
+ *        memory traffic and quantizing the input only adds to the time
+ */
+#define DENSE_INT8_MIN_WEIGHTS 16384
+
+static const char *const precisionNames[PRECISION_COUNT] = {"float32", "int8", "float16",
+                                                            "bfloat16"};
+
+
+// ------------------------ function implementation ---------------------
+
+/**
+* Getter of a printable name of a weight precision, the same name parsePrecision accepts
+* @param precision The weight precision
+* @return The name of the precision
+*/
+const char *precisionName(WeightPrecision precision)
+{
+    return precisionNames[precision];
+}
+
+
+/**
+* Find the weight precision of the given name
+* @param name The name of the precision, as returned by precisionName
+* @param precision Receives the precision
+* @return true - the name is known
+*         false - no precision has that name
+*/
+bool parsePrecision(const std::string &name, WeightPrecision &precision)
+{
+    for(int i = 0 ; i < PRECISION_COUNT ; i++)
+    {
+        if(name == precisionNames[i])
+        {
+            precision = (WeightPrecision) i;
+            return true;
+        }
+    }
+    return false;
+}
 
 
 // ------------------------ class implementation ------------------------
@@ -27,23 +103,707 @@
 * @param w A matrix that represent the weights of the layer
 * @param bias A matrix that represent the biases of the layer
 * @param activationType An activation class object that can generate operations on matrix
+* @throws std::invalid_argument If the bias isn't a column with a row per weights row
 */
 Dense::Dense(const Matrix &w, const Matrix &bias, ActivationType activationType) : weightsLayer(w),
-biasLayer(bias), activationFunc(activationType) {}
+weightsShape({weightsLayer.getRows(), weightsLayer.getCols()}), biasLayer(bias),
+activationFunc(activationType), mode(Fused), precision(Float32), sparseMode(SparseAuto),
+weightsStale(false), trainable(true)
+{
+    _checkBias();
+    _prepareWeights();
+}
+
+
+/**
+* A constructor for the class that takes over the given weights and biases instead of
+* copying them
+* @param w A matrix that represent the weights of the layer
+* @param bias A matrix that represent the biases of the layer
+* @param activationType An activation class object that can generate operations on matrix
+* @throws std::invalid_argument If the bias isn't a column with a row per weights row
+*/
+Dense::Dense(Matrix &&w, Matrix &&bias, ActivationType activationType) :
+weightsLayer(std::move(w)), weightsShape({weightsLayer.getRows(), weightsLayer.getCols()}),
+biasLayer(std::move(bias)), activationFunc(activationType), mode(Fused), precision(Float32),
+sparseMode(SparseAuto), weightsStale(false), trainable(true)
+{
+    _checkBias();
+    _prepareWeights();
+}
+
 
 /**
 * Applies the layer on input and returns output matrix.
-* @param other Given matrix to be applied by the layer
+* @param other Given matrix or view to be applied by the layer
 * @return Output matrix after applying the layer
 */
-Matrix Dense::operator()(const Matrix &other) const
+Matrix Dense::operator()(const MatrixView &other) const
 {
-    Matrix newMatrix = other;
-
-    newMatrix = weightsLayer * other;
-    newMatrix += biasLayer;
-    newMatrix = activationFunc(newMatrix);
+    Matrix newMatrix(weightsShape.rows, other.getCols());
+    (*this)(other, newMatrix);
 
     return newMatrix;
 }
 
+
+/**
+* Applies the layer on input into an existing output matrix, reusing its buffer.
+* Every column of the input is a separate sample, the bias is added to each of them.
+* In Fused mode a column input is handled by a single kernel that adds the bias and
+* applies ReLU while walking the output, a batch gets the bias and ReLU in a single
+* pass after the product. Softmax still needs its own column reduction. Strided views,
+* such as some columns of a batch, are read in place. Until a stale copy of the weights is
+* rebuilt the float weights are read instead.
+* @param other Given matrix or view to be applied by the layer
+* @param result The matrix that receives the layer output, must not overlap other
+* @param activate Whether to apply the activation, false leaves the pre-activation values
+*/
+void Dense::operator()(const MatrixView &other, Matrix &result, bool activate) const
+{
+    if(weightsStale)
+    {
+        applyFloat(other, result, activate);
+        return;
+    }
+
+    bool relu = activate && activationFunc.getActivationType() == Relu;
+    bool separateActivation = activate && !relu;
+#if MLP_PROFILE
+    double inputs = (double) other.getRows() * other.getCols();
+    double outputs = (double) weightsShape.rows * other.getCols();
+    double productBytes = getWeightsBytes() + (inputs + outputs) * sizeof(float);
+#endif
+
+    WeightPrecision active = _activePrecision();
+    if(active != Float32)
+    {
+        {
+            PROFILE_SCOPE(active == Int8 ? "int8 product" : "half product",
+                          PROFILER_NO_LAYER, 2 * outputs * other.getRows(), productBytes);
+            if(active == Int8)
+            {
+                _forwardInt8(other, result, relu);
+            }
+            else
+            {
+                _forwardHalf(other, result, relu);
+            }
+        }
+        if(separateActivation)
+        {
+            PROFILE_SCOPE("activation", PROFILER_NO_LAYER, outputs, 2 * outputs * sizeof(float));
+            activationFunc.apply(result);
+        }
+        return;
+    }
+
+    if(mode == Fused && other.getCols() == 1 && other.getRows() == weightsShape.cols
+       && other.isContiguous() && !other.overlaps(result))
+    {
+        if(isSparse() && (long int) weightsShape.rows * weightsShape.cols *
+                         sizeof(float) > DENSE_SPARSE_GEMV_BYTES)
+        {
+            PROFILE_SCOPE("sparse gemv", PROFILER_NO_LAYER, 2.0 * sparseValues.size(),
+                          productBytes);
+            result.resize(weightsShape.rows, 1);
+            kernels::sparseDenseForward(sparseRowStart.data(), sparseCols.data(),
+                                        sparseValues.data(), other.data(), biasLayer.data(),
+                                        result.data(), 1, weightsShape.rows, relu);
+        }
+        else
+        {
+            PROFILE_SCOPE("fused gemv", PROFILER_NO_LAYER, 2 * outputs * other.getRows(),
+                          productBytes);
+            result.resize(weightsShape.rows, 1);
+            kernels::denseForward(weightsLayer.data(), other.data(), biasLayer.data(),
+                                  result.data(), weightsShape.rows,
+                                  weightsShape.cols, relu);
+        }
+        if(separateActivation)
+        {
+            PROFILE_SCOPE("activation", PROFILER_NO_LAYER, outputs, 2 * outputs * sizeof(float));
+            activationFunc.apply(result);
+        }
+        return;
+    }
+
+    {
+        PROFILE_SCOPE(isSparse() ? "sparse gemm" : "gemm", PROFILER_NO_LAYER, isSparse() ?
+                      2.0 * sparseValues.size() * other.getCols() : 2 * outputs * other.getRows(),
+                      productBytes);
+        _multiply(other, result);
+    }
+    if(mode == Fused && relu)
+    {
+        PROFILE_SCOPE("bias relu", PROFILER_NO_LAYER, 2 * outputs,
+                      (2 * outputs + weightsShape.rows) * sizeof(float));
+        _addBias(result, true);
+        return;
+    }
+
+    {
+        PROFILE_SCOPE("bias", PROFILER_NO_LAYER, outputs,
+                      (2 * outputs + weightsShape.rows) * sizeof(float));
+        _addBias(result, false);
+    }
+    if(activate)
+    {
+        PROFILE_SCOPE("activation", PROFILER_NO_LAYER, outputs, 2 * outputs * sizeof(float));
+        activationFunc.apply(result);
+    }
+}
+
+
+/**
+* Applies the layer reading the float weights directly, whatever the precision and the
+* sparse mode, the way training sees the layer. The product reads the weights and the
+* input in place, the bias and ReLU are applied in a single pass after it.
+* @param other Given matrix or view to be applied by the layer
+* @param result The matrix that receives the layer output, must not overlap other
+* @param activate Whether to apply the activation, false leaves the pre-activation values
+* @throws std::invalid_argument If the input doesn't match the layer or the float weights
+*         were released
+*/
+void Dense::applyFloat(const MatrixView &other, Matrix &result, bool activate) const
+{
+    _checkFloatWeights();
+    int rows = weightsShape.rows;
+    int cols = weightsShape.cols;
+    int count = other.getCols();
+    if(other.getRows() != cols || other.overlaps(result))
+    {
+        throw std::invalid_argument(INVALID_MATRIX_MULTIPLICATION_DIMENSIONS_MSG);
+    }
+
+    bool relu = activate && activationFunc.getActivationType() == Relu;
+    {
+        PROFILE_SCOPE("float gemm", PROFILER_NO_LAYER, 2.0 * rows * cols * count,
+                      ((double) rows * cols + (double) cols * count + (double) rows * count) *
+                      sizeof(float));
+        result.resize(rows, count);
+        kernels::gemmStrided(weightsLayer.data(), cols, 1, other.data(), other.getRowStride(),
+                             other.getColStride(), result.data(), rows, count, cols);
+    }
+    {
+        PROFILE_SCOPE(relu ? "bias relu" : "bias", PROFILER_NO_LAYER, 2.0 * rows * count,
+                      (2.0 * rows * count + rows) * sizeof(float));
+        _addBias(result, relu);
+    }
+    if(activate && !relu)
+    {
+        PROFILE_SCOPE("activation", PROFILER_NO_LAYER, (double) rows * count,
+                      2.0 * rows * count * sizeof(float));
+        activationFunc.apply(result);
+    }
+}
+
+
+/**
+* Backpropagates through the layer for a batch it was applied on. The gradient by the
+* output first goes through the activation, then gives the gradient by the weights, the
+* bias and, optionally, the input. The weights gradient is a product of the output gradient
+* and the transposed input, summed over the samples.
+* @param input The input the layer was applied on, one sample per column
+* @param output The output the layer produced for it, unused when activate is false
+* @param gradient The gradient of the loss by the output, overwritten with the gradient by
+*                 the values before the activation
+* @param gradients Receives the gradients by the weights and the bias
+* @param inputGradient Receives the gradient by the input, nullptr to skip it, such as for
+*                      the first layer. Must not be gradient
+* @param activate Whether the activation was applied, false when the gradient is already
+*                 taken before it, such as a Softmax folded into the loss
+* @throws std::invalid_argument If the shapes don't match the layer or the float weights
+*         were released
+*/
+void Dense::backward(const MatrixView &input, const Matrix &output, Matrix &gradient,
+                     LayerGradients &gradients, Matrix *inputGradient, bool activate) const
+{
+    _checkFloatWeights();
+    int rows = weightsShape.rows;
+    int cols = weightsShape.cols;
+    int count = input.getCols();
+    if(input.getRows() != cols || gradient.getRows() != rows || gradient.getCols() != count)
+    {
+        throw std::invalid_argument(INVALID_MATRIX_MULTIPLICATION_DIMENSIONS_MSG);
+    }
+
+    if(activate)
+    {
+        PROFILE_SCOPE("activation gradient", PROFILER_NO_LAYER, (double) rows * count,
+                      3.0 * rows * count * sizeof(float));
+        activationFunc.backward(output, gradient);
+    }
+
+    {
+        PROFILE_SCOPE("weights gradient", PROFILER_NO_LAYER, 2.0 * rows * cols * count,
+                      ((double) rows * count + (double) cols * count + (double) rows * cols) *
+                      sizeof(float));
+        gradients.weights.resize(rows, cols);
+        kernels::gemmStrided(gradient.data(), count, 1, input.data(), input.getColStride(),
+                             input.getRowStride(), gradients.weights.data(), rows, cols, count);
+
+        gradients.bias.resize(rows, 1);
+        for(int i = 0 ; i < rows ; i++)
+        {
+            const float *row = gradient.row(i);
+            float sum = 0;
+            for(int j = 0 ; j < count ; j++)
+            {
+                sum += row[j];
+            }
+            gradients.bias[i] = sum;
+        }
+    }
+
+    if(inputGradient != nullptr)
+    {
+        PROFILE_SCOPE("input gradient", PROFILER_NO_LAYER, 2.0 * rows * cols * count,
+                      ((double) rows * count + (double) cols * count + (double) rows * cols) *
+                      sizeof(float));
+        inputGradient->resize(cols, count);
+        kernels::gemmStrided(weightsLayer.data(), 1, cols, gradient.data(), count, 1,
+                             inputGradient->data(), cols, count, rows);
+    }
+}
+
+
+/**
+* Add a step to the weights and the bias, such as one computed by an optimizer. The copy of
+* the weights the forward pass reads is only marked stale, so a training step costs no
+* conversion, until prepareWeights rebuilds it the forward pass reads the float weights.
+* Not safe while other threads run the layer.
+* @param weightsStep The change of every weight
+* @param biasStep The change of every bias
+* @throws std::invalid_argument If the steps don't match the weights and the bias or the
+*         float weights were released
+*/
+void Dense::updateParameters(const Matrix &weightsStep, const Matrix &biasStep)
+{
+    _checkFloatWeights();
+    if(weightsStep.getRows() != weightsShape.rows ||
+       weightsStep.getCols() != weightsShape.cols ||
+       biasStep.getRows() != biasLayer.getRows() || biasStep.getCols() != biasLayer.getCols())
+    {
+        throw std::invalid_argument(INVALID_MATRIX_ADDITION_DIMENSIONS_MSG);
+    }
+
+    weightsLayer += weightsStep;
+    biasLayer += biasStep;
+    weightsStale = true;
+}
+
+
+/**
+* Rebuild the copy of the weights the forward pass reads if updateParameters left it stale,
+* otherwise do nothing. Not safe while other threads run the layer.
+*/
+void Dense::prepareWeights()
+{
+    if(weightsStale)
+    {
+        _convertWeights();
+    }
+}
+
+
+/**
+* Setter of the weight precision. Int8 quantizes every row of the weights with its own
+* scale, layers under DENSE_INT8_MIN_WEIGHTS weights keep reading the float ones.
+* Float16 and BFloat16 round every weight to 16 bits, which halves the bytes read but
+* widens every weight back on the fly: while the weights fit in the cache a single image
+* is still somewhat slower than with Float32, and a batch about twice as slow. All of
+* them release the packed or compressed float copy, Float32 restores it. A trainable
+* layer keeps its float weights so it can always be switched back, one that isn't
+* releases them too, which is what cuts the memory of Int8 weights by about 4.
+* @param newPrecision The precision the forward pass should read the weights in
+* @throws std::invalid_argument If the float weights were already released
+*/
+void Dense::setPrecision(WeightPrecision newPrecision)
+{
+    if(newPrecision == precision)
+    {
+        return;
+    }
+
+    _checkFloatWeights();
+    precision = newPrecision;
+    _convertWeights();
+}
+
+
+/**
+* Getter of whether the float weights are still held, false once a layer that isn't
+* trainable reads a lower precision copy of them
+* @return true - getWeights returns the float weights
+*/
+bool Dense::hasFloatWeights() const
+{
+    return trainable || _activePrecision() == Float32;
+}
+
+
+/**
+* Setter of whether the layer keeps its float weights. Layers start out trainable, an
+* inference only layer that isn't releases the float weights whenever the forward pass
+* reads a lower precision copy of them, from then on it can't be trained, switched to
+* another precision or made trainable again.
+* @param newTrainable Whether the layer should keep its float weights
+* @throws std::invalid_argument If the layer is made trainable after releasing them
+*/
+void Dense::setTrainable(bool newTrainable)
+{
+    if(newTrainable == trainable)
+    {
+        return;
+    }
+
+    _checkFloatWeights();
+    trainable = newTrainable;
+    if(_activePrecision() != Float32)
+    {
+        _convertWeights();
+    }
+}
+
+
+/**
+* Throw std::invalid_argument(RELEASED_WEIGHTS_MSG) if the float weights were released
+*/
+void Dense::_checkFloatWeights() const
+{
+    if(!hasFloatWeights())
+    {
+        throw std::invalid_argument(RELEASED_WEIGHTS_MSG);
+    }
+}
+
+
+/**
+* Throw std::invalid_argument(INVALID_MATRIX_ADDITION_DIMENSIONS_MSG) unless the bias is a
+* column with a row per weights row, which every kernel reads it as
+*/
+void Dense::_checkBias() const
+{
+    if(biasLayer.getRows() != weightsShape.rows || biasLayer.getCols() != 1)
+    {
+        throw std::invalid_argument(INVALID_MATRIX_ADDITION_DIMENSIONS_MSG);
+    }
+}
+
+
+/**
+* Getter of the precision the forward pass reads the weights in. Int8 layers with fewer
+* than DENSE_INT8_MIN_WEIGHTS weights read the float weights, every other layer reads its
+* precision
+* @return The precision of the weights the forward pass reads
+*/
+WeightPrecision Dense::_activePrecision() const
+{
+    if(precision == Int8 && (long int) weightsShape.rows * weightsShape.cols <
+                            DENSE_INT8_MIN_WEIGHTS)
+    {
+        return Float32;
+    }
+    return precision;
+}
+
+
+/**
+* Build the copy of the weights the forward pass reads in the current precision from the
+* float weights, releasing every other copy, and the float weights themselves when the
+* layer isn't trainable and doesn't read them.
+*/
+void Dense::_convertWeights()
+{
+    weightsStale = false;
+    std::vector<float>().swap(packedWeights);
+    std::vector<int8_t>().swap(int8Weights);
+    std::vector<float>().swap(int8Scales);
+    std::vector<uint16_t>().swap(halfWeights);
+    std::vector<int>().swap(sparseRowStart);
+    std::vector<int>().swap(sparseCols);
+    std::vector<float>().swap(sparseValues);
+
+    int rows = weightsShape.rows;
+    int cols = weightsShape.cols;
+    PROFILE_SCOPE("convert weights", PROFILER_NO_LAYER, 0, (double) rows * cols * sizeof(float));
+    switch(_activePrecision())
+    {
+        case Int8:
+            int8Weights.resize((long int) rows * kernels::int8RowStride(cols));
+            int8Scales.resize(rows);
+            kernels::quantizeRows(weightsLayer.data(), rows, cols, int8Weights.data(),
+                                  int8Scales.data());
+            break;
+        case Float16:
+        case BFloat16:
+            halfWeights.resize((long int) rows * cols);
+            kernels::narrowToHalf(weightsLayer.data(), (long int) rows * cols,
+                                  precision == Float16 ? kernels::Fp16 : kernels::Bf16,
+                                  halfWeights.data());
+            break;
+        default:
+            _prepareWeights();
+            return;
+    }
+
+    if(!trainable)
+    {
+        weightsLayer = Matrix();
+    }
+}
+
+
+/**
+* Getter of how many bytes of weights the forward pass reads in the current precision
+* @return The size of the weights in the current precision, scales included
+*/
+long int Dense::getWeightsBytes() const
+{
+    WeightPrecision active = _activePrecision();
+    if(active == Int8)
+    {
+        return (long int) (int8Weights.size() * sizeof(int8_t) +
+                           int8Scales.size() * sizeof(float));
+    }
+    if(active != Float32)
+    {
+        return (long int) (halfWeights.size() * sizeof(uint16_t));
+    }
+
+    if(isSparse())
+    {
+        return (long int) (sparseRowStart.size() * sizeof(int) + sparseCols.size() * sizeof(int)
+                           + sparseValues.size() * sizeof(float));
+    }
+    return (long int) weightsShape.rows * weightsShape.cols * sizeof(float);
+}
+
+
+/**
+* Setter of the sparse mode. Layers start out SparseAuto, which compresses the float
+* weights when less than DENSE_SPARSE_DENSITY of them aren't zero, SparseOff and SparseOn
+* force either layout. The other precisions are never compressed. A single sample of a
+* layer small enough to stay in the cache still reads the float weights, the fused kernel
+* is faster there.
+* @param newMode Whether the layer may compress its weights
+*/
+void Dense::setSparseMode(SparseMode newMode)
+{
+    if(newMode == sparseMode)
+    {
+        return;
+    }
+
+    sparseMode = newMode;
+    if(_activePrecision() == Float32)
+    {
+        _prepareWeights();
+    }
+}
+
+
+/**
+* Add the bias column to every column of the layer output, optionally with ReLU
+* @param result The layer output after the weights product
+* @param relu Whether to apply ReLU together with the bias
+*/
+void Dense::_addBias(Matrix &result, bool relu) const
+{
+    if(result.getCols() == 1 || biasLayer.getCols() != 1 ||
+       biasLayer.getRows() != result.getRows())
+    {
+        result += biasLayer;
+        if(relu)
+        {
+            activationFunc.apply(result);
+        }
+        return;
+    }
+
+    kernels::addBias(result.data(), biasLayer.data(), result.getRows(), result.getCols(), relu);
+}
+
+
+/**
+* Lay the weights out once in the panel order of the blocked product, so batches never
+* repack them, or compress them when few of them aren't zero. Pruned weights are exact
+* zeros, so the decision is made once here, when the layer is loaded.
+*/
+void Dense::_prepareWeights()
+{
+    int rows = weightsShape.rows;
+    int cols = weightsShape.cols;
+    long int size = (long int) rows * cols;
+    long int nonZeros = kernels::countNonZeros(weightsLayer.data(), size);
+    bool sparse = sparseMode == SparseOn ||
+                  (sparseMode == SparseAuto && nonZeros < DENSE_SPARSE_DENSITY * size);
+
+    std::vector<float>().swap(packedWeights);
+    std::vector<int>().swap(sparseRowStart);
+    std::vector<int>().swap(sparseCols);
+    std::vector<float>().swap(sparseValues);
+    if(sparse)
+    {
+        PROFILE_SCOPE("compress weights", PROFILER_NO_LAYER, 0,
+                      (size + nonZeros * 2.0) * sizeof(float));
+        sparseRowStart.resize(rows + 1);
+        sparseCols.resize(nonZeros);
+        sparseValues.resize(nonZeros);
+        kernels::compressRows(weightsLayer.data(), rows, cols, sparseRowStart.data(),
+                              sparseCols.data(), sparseValues.data());
+        return;
+    }
+
+    PROFILE_SCOPE("pack weights", PROFILER_NO_LAYER, 0, 2.0 * size * sizeof(float));
+    packedWeights.resize(kernels::packedWeightsSize(rows, cols));
+    kernels::packWeights(weightsLayer.data(), rows, cols, packedWeights.data());
+}
+
+
+/**
+* Multiply the weights by the layer input, using the prepared weights for batches
+* @param other Given matrix to be applied by the layer
+* @param result The matrix that receives the product
+*/
+void Dense::_multiply(const MatrixView &other, Matrix &result) const
+{
+    if(other.getRows() != weightsShape.cols || other.overlaps(result))
+    {
+        weightsLayer.multiplyInto(other, result);
+        return;
+    }
+    if(isSparse())
+    {
+        _multiplySparse(other, result);
+        return;
+    }
+
+    result.resize(weightsShape.rows, other.getCols());
+    kernels::gemmPacked(weightsLayer.data(), packedWeights.data(), other.data(),
+                        other.getRowStride(), other.getColStride(), result.data(),
+                        weightsShape.rows, other.getCols(), weightsShape.cols);
+}
+
+
+/**
+* Multiply the compressed weights by the layer input. Every non zero adds a scaled row of
+* the input to a row of the output, so a batch whose rows aren't contiguous, such as a
+* transposed batch of images, is first copied into a row-major buffer. A single sample
+* that is a strided column, such as one column of a batch, takes the same path, which
+* reads it with its row stride
+* @param other Given matrix to be applied by the layer, must match the weights and not
+*              overlap result
+* @param result The matrix that receives the product
+*/
+void Dense::_multiplySparse(const MatrixView &other, Matrix &result) const
+{
+    int rows = weightsShape.rows;
+    int cols = weightsShape.cols;
+    int count = other.getCols();
+    result.resize(rows, count);
+    if(count == 1 && other.getRowStride() == 1)
+    {
+        kernels::sparseDenseForward(sparseRowStart.data(), sparseCols.data(),
+                                    sparseValues.data(), other.data(), nullptr, result.data(),
+                                    1, rows, false);
+        return;
+    }
+
+    const float *samples = other.data();
+    int rowStride = other.getRowStride();
+    if(count > 1 && other.getColStride() != 1)
+    {
+        // Every thread copies its batches into its own buffer, which only grows
+        thread_local std::vector<float> rowMajor;
+        rowMajor.resize(std::max<size_t>(rowMajor.size(), (size_t) cols * count));
+        for(int p = 0 ; p < cols ; p++)
+        {
+            const float *row = other.data() + (long int) p * other.getRowStride();
+            for(int j = 0 ; j < count ; j++)
+            {
+                rowMajor[(long int) p * count + j] = row[(long int) j * other.getColStride()];
+            }
+        }
+        samples = rowMajor.data();
+        rowStride = count;
+    }
+
+    kernels::sparseGemm(sparseRowStart.data(), sparseCols.data(), sparseValues.data(), samples,
+                        rowStride, 1, result.data(), rows, count);
+}
+
+
+/**
+* Quantize every column of the input with its own scale and run the int8 weights on all of
+* them at once, the bias and ReLU are applied by the kernel
+* @param other Given matrix to be applied by the layer
+* @param result The matrix that receives the layer output
+* @param relu Whether to apply ReLU together with the bias
+*/
+void Dense::_forwardInt8(const MatrixView &other, Matrix &result, bool relu) const
+{
+    int rows = weightsShape.rows;
+    int cols = weightsShape.cols;
+    int count = other.getCols();
+    if(other.getRows() != cols || other.overlaps(result))
+    {
+        throw std::invalid_argument(INVALID_MATRIX_MULTIPLICATION_DIMENSIONS_MSG);
+    }
+
+    // Every thread quantizes its input into its own buffers, which only grow
+    thread_local std::vector<int8_t> columns;
+    thread_local std::vector<float> scales;
+    int stride = kernels::int8RowStride(cols);
+    columns.resize(std::max<size_t>(columns.size(), (size_t) stride * count));
+    scales.resize(std::max<size_t>(scales.size(), count));
+    kernels::quantizeColumns(other.data(), cols, count, other.getRowStride(),
+                             other.getColStride(), columns.data(), scales.data());
+
+    result.resize(rows, count);
+    kernels::denseForwardInt8(int8Weights.data(), int8Scales.data(), columns.data(),
+                              scales.data(), count, biasLayer.data(), result.data(), rows, cols,
+                              relu);
+}
+
+
+/**
+* Run the 16 bit weights on the input, widening them in the kernel. A batch is first
+* transposed so every sample is contiguous, the bias and ReLU are applied by the kernel
+* @param other Given matrix to be applied by the layer
+* @param result The matrix that receives the layer output
+* @param relu Whether to apply ReLU together with the bias
+*/
+void Dense::_forwardHalf(const MatrixView &other, Matrix &result, bool relu) const
+{
+    int rows = weightsShape.rows;
+    int cols = weightsShape.cols;
+    int count = other.getCols();
+    if(other.getRows() != cols || other.overlaps(result))
+    {
+        throw std::invalid_argument(INVALID_MATRIX_MULTIPLICATION_DIMENSIONS_MSG);
+    }
+
+    const float *samples = other.data();
+    if(count > 1 || !other.isContiguous())
+    {
+        // Every thread transposes its batches into its own buffer, which only grows
+        thread_local std::vector<float> transposed;
+        transposed.resize(std::max<size_t>(transposed.size(), (size_t) cols * count));
+        for(int p = 0 ; p < cols ; p++)
+        {
+            const float *row = other.data() + (long int) p * other.getRowStride();
+            for(int j = 0 ; j < count ; j++)
+            {
+                transposed[(long int) j * cols + p] = row[(long int) j * other.getColStride()];
+            }
+        }
+        samples = transposed.data();
+    }
+
+    result.resize(rows, count);
+    kernels::denseForwardHalf(halfWeights.data(),
+                              precision == Float16 ? kernels::Fp16 : kernels::Bf16, samples,
+                              count, biasLayer.data(), result.data(), rows, cols, relu);
+}
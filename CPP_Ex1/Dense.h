@@ -21,11 +21,89 @@
 
 // ------------------------------ includes ------------------------------
 #include "Matrix.h"
+#include "MatrixView.h"
 #include "Activation.h"
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// -------------------------- const definitions -------------------------
+
+/*
+ * @def RELEASED_WEIGHTS_MSG "Error: The layer released its float weights"
+ * @brief Error msg when a layer that isn't trainable is trained, switched to another
+ *        precision or made trainable again after releasing its float weights
+ */
+#define RELEASED_WEIGHTS_MSG "Error: The layer released its float weights"
 
 
 // -------------------------- class definitions -------------------------
 
+/**
+ * @enum EvaluationMode
+ * @brief How a layer walks its output: one kernel per step, or a single fused pass.
+ */
+enum EvaluationMode
+{
+    Separate,
+    Fused
+};
+
+
+/**
+ * @enum WeightPrecision
+ * @brief How a layer stores the weights its forward pass reads.
+ */
+enum WeightPrecision
+{
+    Float32,
+    Int8,
+    Float16,
+    BFloat16
+};
+
+
+/**
+ * @enum SparseMode
+ * @brief Whether a layer keeps its float weights in compressed rows of their non zeros.
+ */
+enum SparseMode
+{
+    SparseAuto,
+    SparseOff,
+    SparseOn
+};
+
+
+/**
+ * Getter of a printable name of a weight precision, the same name parsePrecision accepts
+ * @param precision The weight precision
+ * @return The name of the precision
+ */
+const char *precisionName(WeightPrecision precision);
+
+
+/**
+ * Find the weight precision of the given name
+ * @param name The name of the precision, as returned by precisionName
+ * @param precision Receives the precision
+ * @return true - the name is known
+ *         false - no precision has that name
+ */
+bool parsePrecision(const std::string &name, WeightPrecision &precision);
+
+
+/**
+ * @struct LayerGradients
+ * @brief The gradient of a loss by the weights and by the bias of one layer
+ */
+typedef struct LayerGradients
+{
+    Matrix weights;
+    Matrix bias;
+} LayerGradients;
+
+
 /**
  * This class represent a layer of the MlpNetwork and it used to
  * set and activate layer operations at the net.
@@ -34,8 +112,92 @@ class Dense
 {
 private:
     Matrix weightsLayer;
+    MatrixDims weightsShape;
     Matrix biasLayer;
     Activation activationFunc;
+    EvaluationMode mode;
+    WeightPrecision precision;
+    std::vector<float> packedWeights;
+    std::vector<int8_t> int8Weights;
+    std::vector<float> int8Scales;
+    std::vector<uint16_t> halfWeights;
+    SparseMode sparseMode;
+    std::vector<int> sparseRowStart;
+    std::vector<int> sparseCols;
+    std::vector<float> sparseValues;
+    bool weightsStale;
+    bool trainable;
+
+    /**
+     * Lay the weights out once in the panel order of the blocked product, so batches never
+     * repack them, or compress them when few of them aren't zero
+     */
+    void _prepareWeights();
+
+    /**
+     * Getter of the precision the forward pass reads the weights in, float for Int8 layers
+     * too small to gain from it
+     * @return The precision of the weights the forward pass reads
+     */
+    WeightPrecision _activePrecision() const;
+
+    /**
+     * Build the copy of the weights the forward pass reads in the current precision from
+     * the float weights, releasing every other copy, and the float weights themselves when
+     * the layer isn't trainable and doesn't read them
+     */
+    void _convertWeights();
+
+    /**
+     * Throw std::invalid_argument(RELEASED_WEIGHTS_MSG) if the float weights were released
+     */
+    void _checkFloatWeights() const;
+
+    /**
+     * Throw std::invalid_argument(INVALID_MATRIX_ADDITION_DIMENSIONS_MSG) unless the bias is
+     * a column with a row per weights row, which every kernel reads it as
+     */
+    void _checkBias() const;
+
+    /**
+     * Multiply the weights by the layer input, using the prepared weights for batches
+     * @param other Given matrix to be applied by the layer
+     * @param result The matrix that receives the product
+     */
+    void _multiply(const MatrixView &other, Matrix &result) const;
+
+    /**
+     * Multiply the compressed weights by the layer input, a batch whose rows aren't
+     * contiguous is first copied into a row-major buffer
+     * @param other Given matrix to be applied by the layer
+     * @param result The matrix that receives the product
+     */
+    void _multiplySparse(const MatrixView &other, Matrix &result) const;
+
+    /**
+     * Add the bias column to every column of the layer output, optionally with ReLU
+     * @param result The layer output after the weights product
+     * @param relu Whether to apply ReLU together with the bias
+     */
+    void _addBias(Matrix &result, bool relu) const;
+
+    /**
+     * Quantize every column of the input with its own scale and run the int8 weights on all
+     * of them at once, the bias and ReLU are applied by the kernel
+     * @param other Given matrix to be applied by the layer
+     * @param result The matrix that receives the layer output
+     * @param relu Whether to apply ReLU together with the bias
+     */
+    void _forwardInt8(const MatrixView &other, Matrix &result, bool relu) const;
+
+    /**
+     * Run the 16 bit weights on the input, widening them in the kernel. A batch is first
+     * transposed so every sample is contiguous, the bias and ReLU are applied by the kernel
+     * @param other Given matrix to be applied by the layer
+     * @param result The matrix that receives the layer output
+     * @param relu Whether to apply ReLU together with the bias
+     */
+    void _forwardHalf(const MatrixView &other, Matrix &result, bool relu) const;
 
 public:
 
@@ -44,17 +206,46 @@ public:
      * @param w A matrix that represent the weights of the layer
      * @param bias A matrix that represent the biases of the layer
      * @param activationType An activation class object that can generate operations on matrix
+     * @throws std::invalid_argument If the bias isn't a column with a row per weights row
      */
     Dense(const Matrix &w, const Matrix &bias, ActivationType activationType);
 
 
     /**
-     * Getter function of the weights matrix as inline function
+     * A constructor for the class that takes over the given weights and biases instead of
+     * copying them
+     * @param w A matrix that represent the weights of the layer
+     * @param bias A matrix that represent the biases of the layer
+     * @param activationType An activation class object that can generate operations on matrix
+     * @throws std::invalid_argument If the bias isn't a column with a row per weights row
+     */
+    Dense(Matrix &&w, Matrix &&bias, ActivationType activationType);
+
+
+    /**
+     * Getter function of the weights matrix as inline function, a 1x1 placeholder once
+     * the float weights are released, see setTrainable
      * @return The weights matrix layer
      */
     const Matrix &getWeights() const { return weightsLayer; }
 
 
+    /**
+     * Getter function of the number of inputs as inline function, valid even after the
+     * float weights are released
+     * @return The number of columns of the weights
+     */
+    int getInputSize() const { return weightsShape.cols; }
+
+
+    /**
+     * Getter function of the number of outputs as inline function, valid even after the
+     * float weights are released
+     * @return The number of rows of the weights
+     */
+    int getOutputSize() const { return weightsShape.rows; }
+
+
     /**
      * Getter function of the bias matrix as inline function
      * @return The bias matrix layer
@@ -66,15 +257,180 @@ public:
      * Getter function of the activation function as inline function
      * @return The activation type of the layer
      */
-    ActivationType getActivation() { return activationFunc.getActivationType(); }
+    ActivationType getActivation() const { return activationFunc.getActivationType(); }
+
+
+    /**
+     * Getter function of the evaluation mode as inline function
+     * @return The way the layer is evaluated
+     */
+    EvaluationMode getEvaluationMode() const { return mode; }
+
+
+    /**
+     * Setter function of the evaluation mode as inline function. Layers start out Fused,
+     * Separate runs the product, the bias and the activation one after the other.
+     * @param newMode The way the layer should be evaluated
+     */
+    void setEvaluationMode(EvaluationMode newMode) { mode = newMode; }
+
+
+    /**
+     * Getter function of the weight precision as inline function
+     * @return The precision the forward pass reads the weights in
+     */
+    WeightPrecision getPrecision() const { return precision; }
+
+
+    /**
+     * Setter of the weight precision. Int8 quantizes every row of the weights with its own
+     * scale, layers under DENSE_INT8_MIN_WEIGHTS weights keep reading the float ones.
+     * Float16 and BFloat16 round every weight to 16 bits, which halves the bytes read but
+     * widens every weight back on the fly: while the weights fit in the cache a single image
+     * is still somewhat slower than with Float32, and a batch about twice as slow. All of
+     * them release the packed or compressed float copy, Float32 restores it. A trainable
+     * layer keeps its float weights so it can always be switched back, one that isn't
+     * releases them too, which is what cuts the memory of Int8 weights by about 4.
+     * @param newPrecision The precision the forward pass should read the weights in
+     * @throws std::invalid_argument If the float weights were already released
+     */
+    void setPrecision(WeightPrecision newPrecision);
+
+
+    /**
+     * Getter function of whether the layer keeps its float weights as inline function
+     * @return true - the layer can be trained and switched between precisions
+     */
+    bool isTrainable() const { return trainable; }
+
+
+    /**
+     * Getter of whether the float weights are still held, false once a layer that isn't
+     * trainable reads a lower precision copy of them
+     * @return true - getWeights returns the float weights
+     */
+    bool hasFloatWeights() const;
+
+
+    /**
+     * Setter of whether the layer keeps its float weights. Layers start out trainable, an
+     * inference only layer that isn't releases the float weights whenever the forward pass
+     * reads a lower precision copy of them, from then on it can't be trained, switched to
+     * another precision or made trainable again.
+     * @param newTrainable Whether the layer should keep its float weights
+     * @throws std::invalid_argument If the layer is made trainable after releasing them
+     */
+    void setTrainable(bool newTrainable);
+
+
+    /**
+     * Getter function of the sparse mode as inline function
+     * @return Whether the layer may compress its weights
+     */
+    SparseMode getSparseMode() const { return sparseMode; }
+
+
+    /**
+     * Setter of the sparse mode. Layers start out SparseAuto, which compresses the float
+     * weights when less than DENSE_SPARSE_DENSITY of them aren't zero, SparseOff and
+     * SparseOn force either layout. The other precisions are never compressed. A
+     * single sample of a layer small enough to stay in the cache still reads the float
+     * weights, the fused kernel is faster there.
+     * @param newMode Whether the layer may compress its weights
+     */
+    void setSparseMode(SparseMode newMode);
+
+
+    /**
+     * Getter function of whether the forward pass reads compressed weights as inline function
+     * @return true - the weights are kept in compressed rows of their non zeros
+     */
+    bool isSparse() const { return !sparseRowStart.empty(); }
+
+
+    /**
+     * Getter of how many bytes of weights the forward pass reads in the current precision
+     * @return The size of the weights in the current precision, scales included
+     */
+    long int getWeightsBytes() const;
 
 
     /**
      * Applies the layer on input and returns output matrix.
-     * @param other Given matrix to be applied by the layer
+     * @param other Given matrix or view to be applied by the layer
      * @return Output matrix after applying the layer
      */
-    Matrix operator()(const Matrix& other) const;
+    Matrix operator()(const MatrixView &other) const;
+
+
+    /**
+     * Applies the layer on input into an existing output matrix, reusing its buffer.
+     * Every column of the input is a separate sample, the bias is added to each of them.
+     * In Fused mode a column input is handled by a single kernel that adds the bias and
+     * applies ReLU while walking the output, a batch gets the bias and ReLU in a single
+     * pass after the product. Softmax still needs its own column reduction. Strided views,
+     * such as some columns of a batch, are read in place.
+     * @param other Given matrix or view to be applied by the layer
+     * @param result The matrix that receives the layer output, must not overlap other
+     * @param activate Whether to apply the activation, false leaves the pre-activation
+     *                 values, such as the logits of a Softmax layer
+     */
+    void operator()(const MatrixView &other, Matrix &result, bool activate = true) const;
+
+
+    /**
+     * Backpropagates through the layer for a batch it was applied on. The gradient by the
+     * output first goes through the activation, then gives the gradient by the weights,
+     * the bias and, optionally, the input. The weights gradient is a product of the output
+     * gradient and the transposed input, summed over the samples.
+     * @param input The input the layer was applied on, one sample per column
+     * @param output The output the layer produced for it, unused when activate is false
+     * @param gradient The gradient of the loss by the output, overwritten with the gradient
+     *                 by the values before the activation
+     * @param gradients Receives the gradients by the weights and the bias
+     * @param inputGradient Receives the gradient by the input, nullptr to skip it, such as
+     *                      for the first layer. Must not be gradient
+     * @param activate Whether the activation was applied, false when the gradient is
+     *                 already taken before it, such as a Softmax folded into the loss
+     * @throws std::invalid_argument If the shapes don't match the layer or the float
+     *         weights were released
+     */
+    void backward(const MatrixView &input, const Matrix &output, Matrix &gradient,
+                  LayerGradients &gradients, Matrix *inputGradient,
+                  bool activate = true) const;
+
+
+    /**
+     * Applies the layer reading the float weights directly, whatever the precision and the
+     * sparse mode, the way training sees the layer.
+     * @param other Given matrix or view to be applied by the layer
+     * @param result The matrix that receives the layer output, must not overlap other
+     * @param activate Whether to apply the activation, false leaves the pre-activation
+     *                 values
+     * @throws std::invalid_argument If the input doesn't match the layer or the float
+     *         weights were released
+     */
+    void applyFloat(const MatrixView &other, Matrix &result, bool activate = true) const;
+
+
+    /**
+     * Add a step to the weights and the bias, such as one computed by an optimizer. The
+     * copy of the weights the forward pass reads is only marked stale, until prepareWeights
+     * rebuilds it the forward pass reads the float weights. Not safe while other threads
+     * run the layer.
+     * @param weightsStep The change of every weight
+     * @param biasStep The change of every bias
+     * @throws std::invalid_argument If the steps don't match the weights and the bias or
+     *         the float weights were released
+     */
+    void updateParameters(const Matrix &weightsStep, const Matrix &biasStep);
+
+
+    /**
+     * Rebuild the copy of the weights the forward pass reads if updateParameters left it
+     * stale, otherwise do nothing. Not safe while other threads run the layer.
+     */
+    void prepareWeights();
 
 };
 #endif //CPP_EX1_DENSE_H
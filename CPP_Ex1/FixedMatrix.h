@@ -0,0 +1,164 @@
+/**
+ * @file FixedMatrix.h
+ * @author  Liron Gershuny <liron.gershuny@mail.huji.ac.il>
+ * @version 1.0
+ * @date 25 Dec 2019
+ *
+ * @brief Define a matrix whose dimensions are fixed at compile time.
+ *
+ * @section LICENSE
+ * This program is not a free software; bla bla bla...
+ *
+ * @section DESCRIPTION
+ * The values of a FixedMatrix live inside the object itself, aligned like the buffers of
+ * MatrixPool, and its dimensions are constants. Loops over them have a known trip count,
+ * so the compiler can unroll and vectorize them, and no shape is ever checked at runtime.
+ * A FixedMatrix is read as a MatrixView, so all Matrix arithmetic accepts it, and can be
+ * copied from and to a Matrix.
+ * Input  : Values, or a Matrix or view of the same dimensions
+ * Process: Stores them inline
+ * Output : Unchecked access to the values
+ */
+
+#ifndef FIXED_MATRIX_H
+#define FIXED_MATRIX_H
+
+// ------------------------------ includes ------------------------------
+#include "Matrix.h"
+#include "MatrixPool.h"
+#include "MatrixView.h"
+
+
+// -------------------------- const definitions -------------------------
+
+/*
+ * @def INVALID_FIXED_DIMENSIONS_MSG "Error: The matrix doesn't have the fixed dimensions"
+ * @brief Error msg when copying a matrix into a FixedMatrix of other dimensions
+ */
+#define INVALID_FIXED_DIMENSIONS_MSG "Error: The matrix doesn't have the fixed dimensions"
+
+
+// -------------------------- class definitions -------------------------
+
+/**
+ * A ROWS x COLS row-major matrix stored inline. Large ones should not live on the stack,
+ * e.g. a network made of them is created with std::make_unique.
+ */
+template <int ROWS, int COLS>
+class FixedMatrix
+{
+    static_assert(ROWS > 0 && COLS > 0, "A FixedMatrix needs positive dimensions");
+
+private:
+    alignas(MATRIX_POOL_ALIGNMENT) float values[ROWS * COLS];
+
+public:
+
+    /**
+     * Constructor of a zero matrix.
+     */
+    FixedMatrix() : values()
+    {
+    }
+
+
+    /**
+     * Constructor that copies a matrix or a view of the same dimensions, throws otherwise.
+     * @param view The values to copy
+     */
+    explicit FixedMatrix(const MatrixView &view)
+    {
+        if(view.getRows() != ROWS || view.getCols() != COLS)
+        {
+            throw std::invalid_argument(INVALID_FIXED_DIMENSIONS_MSG);
+        }
+
+        for(int i = 0 ; i < ROWS ; i++)
+        {
+            const float *row = view.data() + (long int) i * view.getRowStride();
+            for(int j = 0 ; j < COLS ; j++)
+            {
+                values[i * COLS + j] = row[(long int) j * view.getColStride()];
+            }
+        }
+    }
+
+
+    /**
+     * Getter of the matrix number of rows.
+     * @return The number of rows
+     */
+    static constexpr int getRows() { return ROWS; }
+
+
+    /**
+     * Getter of the matrix number of columns.
+     * @return The number of columns
+     */
+    static constexpr int getCols() { return COLS; }
+
+
+    /**
+     * Getter of the underlying row-major values.
+     * @return A pointer to the first element
+     */
+    float *data() { return values; }
+
+
+    /**
+     * Const getter of the underlying row-major values.
+     * @return A pointer to the first element
+     */
+    const float *data() const { return values; }
+
+
+    /**
+     * The unchecked parenthesis indexing operator
+     * @param i The index of the row
+     * @param j The index of the column
+     * @return The i,j element in the matrix
+     */
+    float &operator()(int i, int j) { return values[i * COLS + j]; }
+
+
+    /**
+     * The unchecked const parenthesis indexing operator
+     * @param i The index of the row
+     * @param j The index of the column
+     * @return The i,j element in the matrix
+     */
+    const float &operator()(int i, int j) const { return values[i * COLS + j]; }
+
+
+    /**
+     * The unchecked brackets indexing operator
+     * @param i The row-major index of the element
+     * @return The i'th element in the matrix
+     */
+    float &operator[](int i) { return values[i]; }
+
+
+    /**
+     * The unchecked const brackets indexing operator
+     * @param i The row-major index of the element
+     * @return The i'th element in the matrix
+     */
+    const float &operator[](int i) const { return values[i]; }
+
+
+    /**
+     * A view of the whole matrix, so it can take part in Matrix arithmetic.
+     * @return The view
+     */
+    operator MatrixView() const { return MatrixView(values, ROWS, COLS, COLS, 1); }
+
+
+    /**
+     * Copy the values into a new dynamic Matrix.
+     * @return The matrix
+     */
+    Matrix toMatrix() const { return Matrix(MatrixView(*this)); }
+
+};
+
+#endif //FIXED_MATRIX_H
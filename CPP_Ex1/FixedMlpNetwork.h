@@ -0,0 +1,343 @@
+/**
+ * @file FixedMlpNetwork.h
+ * @author  Liron Gershuny <liron.gershuny@mail.huji.ac.il>
+ * @version 1.0
+ * @date 25 Dec 2019
+ *
+ * @brief Define an MlpNetwork whose layer widths are fixed at compile time.
+ *
+ * @section LICENSE
+ * This program is not a free software; bla bla bla...
+ *
+ * @section DESCRIPTION
+ * FixedMlpNetwork<784, 128, 64, 20, 10> is a chain of dense layers built from FixedMatrix,
+ * one template level per layer. Small layers are written as loops of constant trip count
+ * over weights stored column after column, so the compiler unrolls them completely and
+ * keeps the whole output in vector registers. Large layers still go through the runtime
+ * dispatched kernel, which is faster than anything the compiler can do for a baseline
+ * target. The activations live on the stack, so a network is immutable once loaded and
+ * may be used from any number of threads.
+ * Input  : A dynamic MlpNetwork of the same topology, then images
+ * Process: Copies the float weights once, then runs every layer on each image
+ * Output : The most probable digit of every image
+ */
+
+#ifndef FIXED_MLP_NETWORK_H
+#define FIXED_MLP_NETWORK_H
+
+// ------------------------------ includes ------------------------------
+#include "FixedMatrix.h"
+#include "MatrixKernels.h"
+#include "MlpNetwork.h"
+#include "Digit.h"
+
+
+// -------------------------- const definitions -------------------------
+
+/*
+ * @def FIXED_UNROLL_MAX_WORK 4096
+ * @brief Layers with up to this many weights are fully unrolled, larger ones use the
+ *        dispatched kernels
+ */
+#define FIXED_UNROLL_MAX_WORK 4096
+
+
+// -------------------------- class definitions -------------------------
+
+/**
+ * A dense layer from IN inputs to OUT outputs. Unrolled layers keep their weights
+ * transposed, IN rows of OUT values, so every input scales one contiguous weights row
+ * into the outputs. The others keep the OUT x IN layout of the dispatched kernel.
+ */
+template <int IN, int OUT>
+class FixedDense
+{
+public:
+
+    /*
+     * Whether the layer is small enough to be unrolled
+     */
+    static constexpr bool UNROLLED = (long int) IN * OUT <= FIXED_UNROLL_MAX_WORK;
+
+private:
+    FixedMatrix<UNROLLED ? IN : OUT, UNROLLED ? OUT : IN> weights;
+    FixedMatrix<OUT, 1> bias;
+    Activation activation;
+
+public:
+
+    /**
+     * Constructor of a zero layer with ReLU.
+     */
+    FixedDense() : activation(Relu)
+    {
+    }
+
+
+    /**
+     * Copy the float weights, the bias and the activation of a dynamic layer of the same
+     * shape, throws std::invalid_argument if the shapes differ or the layer released its
+     * float weights.
+     * @param layer The layer to copy
+     */
+    void load(const Dense &layer)
+    {
+        if(!layer.hasFloatWeights())
+        {
+            throw std::invalid_argument(RELEASED_WEIGHTS_MSG);
+        }
+        const Matrix &w = layer.getWeights();
+        if(w.getRows() != OUT || w.getCols() != IN)
+        {
+            throw std::invalid_argument(INVALID_TOPOLOGY_MSG);
+        }
+
+        MatrixView source(w);
+        weights = decltype(weights)(UNROLLED ? source.transpose() : source);
+        bias = FixedMatrix<OUT, 1>(layer.getBias());
+        activation = Activation(layer.getActivation());
+    }
+
+
+    /**
+     * Applies the layer on one input.
+     * @param x The IN inputs
+     * @param y The OUT outputs, overwritten
+     */
+    void operator()(const float *x, float *y) const
+    {
+        bool relu = activation.getActivationType() == Relu;
+        if constexpr(UNROLLED)
+        {
+            alignas(MATRIX_POOL_ALIGNMENT) float sums[OUT] = {};
+            for(int p = 0 ; p < IN ; p++)
+            {
+                const float *row = weights.data() + p * OUT;
+                float value = x[p];
+                for(int i = 0 ; i < OUT ; i++)
+                {
+                    sums[i] += row[i] * value;
+                }
+            }
+
+            for(int i = 0 ; i < OUT ; i++)
+            {
+                float value = sums[i] + bias[i];
+                y[i] = relu && !(value >= 0) ? 0 : value;
+            }
+        }
+        else
+        {
+            kernels::denseForward(weights.data(), x, bias.data(), y, OUT, IN, relu);
+        }
+
+        if(!relu)
+        {
+            activation.apply(y, OUT, 1);
+        }
+    }
+};
+
+
+/**
+ * Applies a whole fixed network on one sample and picks the most probable class, shared by
+ * every level of FixedMlpNetwork that may be the outermost one. Like MlpNetwork it takes
+ * the first class on ties, whatever the last activation, so outputs that are all negative
+ * or NaN still give the class MlpNetwork gives.
+ * @param network The network, a FixedMlpNetwork
+ * @param image The input, INPUT_SIZE values in any shape
+ * @return The max probability digit struct
+ */
+template <typename NETWORK>
+Digit fixedPredict(const NETWORK &network, const MatrixView &image)
+{
+    if(image.getRows() * image.getCols() != NETWORK::INPUT_SIZE)
+    {
+        throw std::invalid_argument(INVALID_INPUT_DIMENSIONS_MSG);
+    }
+
+    if(!image.isContiguous())
+    {
+        return network(FixedMatrix<NETWORK::INPUT_SIZE, 1>(Matrix(image).vectorize()));
+    }
+
+    alignas(MATRIX_POOL_ALIGNMENT) float probabilities[NETWORK::OUTPUT_SIZE];
+    network.forward(image.data(), probabilities);
+
+    unsigned int value = 0;
+    float probability = probabilities[0];
+    for(int i = 1 ; i < NETWORK::OUTPUT_SIZE ; i++)
+    {
+        if(probabilities[i] > probability)
+        {
+            probability = probabilities[i];
+            value = i;
+        }
+    }
+
+    return Digit{value, probability};
+}
+
+
+/**
+ * A network of dense layers of the given widths, from the input size to the number of
+ * classes. Every level of the template holds one layer and the rest of the network.
+ */
+template <int IN, int OUT, int... REST>
+class FixedMlpNetwork
+{
+public:
+
+    /*
+     * The number of values in one sample, the number of classes and the number of layers
+     */
+    static constexpr int INPUT_SIZE = IN;
+    static constexpr int OUTPUT_SIZE = FixedMlpNetwork<OUT, REST...>::OUTPUT_SIZE;
+    static constexpr int LAYER_COUNT = 1 + FixedMlpNetwork<OUT, REST...>::LAYER_COUNT;
+
+private:
+    FixedDense<IN, OUT> layer;
+    FixedMlpNetwork<OUT, REST...> next;
+
+public:
+
+    /**
+     * Constructor of a zero network.
+     */
+    FixedMlpNetwork() = default;
+
+
+    /**
+     * Constructor that copies the float weights of a dynamic network of the same
+     * topology, throws std::invalid_argument if the topologies differ.
+     * @param network The network to copy
+     */
+    explicit FixedMlpNetwork(const MlpNetwork &network)
+    {
+        if(network.getLayerCount() != LAYER_COUNT)
+        {
+            throw std::invalid_argument(INVALID_TOPOLOGY_MSG);
+        }
+        load(network, 0);
+    }
+
+
+    /**
+     * Copy the layers of a dynamic network, starting from the given one.
+     * @param network The network to copy
+     * @param first The index of the layer of this level
+     */
+    void load(const MlpNetwork &network, int first)
+    {
+        layer.load(network.getLayer(first));
+        next.load(network, first + 1);
+    }
+
+
+    /**
+     * Run every layer on one sample.
+     * @param x The INPUT_SIZE inputs
+     * @param y The OUTPUT_SIZE outputs, overwritten
+     */
+    void forward(const float *x, float *y) const
+    {
+        alignas(MATRIX_POOL_ALIGNMENT) float hidden[OUT];
+        layer(x, hidden);
+        next.forward(hidden, y);
+    }
+
+
+    /**
+     * Applies the entire network on one sample.
+     * @param image The input, INPUT_SIZE values in any shape
+     * @return The max probability digit struct
+     */
+    Digit operator()(const MatrixView &image) const
+    {
+        return fixedPredict(*this, image);
+    }
+};
+
+
+/**
+ * The last level of a FixedMlpNetwork, a single layer.
+ */
+template <int IN, int OUT>
+class FixedMlpNetwork<IN, OUT>
+{
+public:
+
+    /*
+     * The number of values in one sample, the number of classes and the number of layers
+     */
+    static constexpr int INPUT_SIZE = IN;
+    static constexpr int OUTPUT_SIZE = OUT;
+    static constexpr int LAYER_COUNT = 1;
+
+private:
+    FixedDense<IN, OUT> layer;
+
+public:
+
+    /**
+     * Constructor of a zero network.
+     */
+    FixedMlpNetwork() = default;
+
+
+    /**
+     * Constructor that copies the float weights of a dynamic network of a single layer of
+     * the same shape, throws std::invalid_argument if the topologies differ.
+     * @param network The network to copy
+     */
+    explicit FixedMlpNetwork(const MlpNetwork &network)
+    {
+        if(network.getLayerCount() != LAYER_COUNT)
+        {
+            throw std::invalid_argument(INVALID_TOPOLOGY_MSG);
+        }
+        load(network, 0);
+    }
+
+
+    /**
+     * Copy the last layer of a dynamic network.
+     * @param network The network to copy
+     * @param first The index of the layer of this level
+     */
+    void load(const MlpNetwork &network, int first)
+    {
+        layer.load(network.getLayer(first));
+    }
+
+
+    /**
+     * Run the layer on one sample.
+     * @param x The IN inputs
+     * @param y The OUT outputs, overwritten
+     */
+    void forward(const float *x, float *y) const
+    {
+        layer(x, y);
+    }
+
+
+    /**
+     * Applies the network on one sample.
+     * @param image The input, INPUT_SIZE values in any shape
+     * @return The max probability digit struct
+     */
+    Digit operator()(const MatrixView &image) const
+    {
+        return fixedPredict(*this, image);
+    }
+};
+
+
+/**
+ * The MNIST network with the shapes of the per layer files.
+ */
+typedef FixedMlpNetwork<weightsDims[0].cols, weightsDims[0].rows, weightsDims[1].rows,
+                        weightsDims[2].rows, weightsDims[3].rows> MnistFixedNetwork;
+
+#endif //FIXED_MLP_NETWORK_H
@@ -0,0 +1,123 @@
+/**
+ * @file InferenceEngine.cpp
+ * @author  Liron Gershuny <liron.gershuny@mail.huji.ac.il>
+ * @version 1.0
+ * @date 25 Dec 2019
+ *
+ * @brief Define a class that runs an MlpNetwork over large batches on many cores.
+ *
+ * @section LICENSE
+ * This program is not a free software; bla bla bla...
+ *
+ * @section DESCRIPTION
+ * The engine cuts a batch of images into fixed size sub batches and classifies them on a
+ * work stealing thread pool, every worker with its own layer buffers.
+ * Input  : A batch of images
+ * Process: Runs the network on every sub batch in parallel
+ * Output : The max probability digit of every image
+ */
+
+// ------------------------------ includes ------------------------------
+#include "InferenceEngine.h"
+#include <algorithm>
+
+
+// ------------------------ class implementation ------------------------
+
+/**
+* A constructor of InferenceEngine.
+* @param mlp The network to run, must outlive the engine
+* @param threadCount The number of worker threads, 0 for one per hardware thread
+* @param chunk The number of images in every sub batch
+*/
+InferenceEngine::InferenceEngine(const MlpNetwork &mlp, int threadCount, int chunk) :
+network(mlp), pool(threadCount), chunkSize(std::max(1, chunk)), buffers(pool.getThreadCount())
+{
+    for(WorkerBuffers &local : buffers)
+    {
+        local.input.resize(network.getInputSize(), chunkSize);
+        network.planBuffers(local.outputs, chunkSize);
+    }
+}
+
+
+/**
+* Classify a batch of images in parallel. Every worker reads its columns of the batch in
+* place.
+* @param images A input size x N matrix or view, column j holds the j'th vectorized
+*               image, e.g. the transpose of a matrix with one image per row
+* @param mode Whether a final Softmax is applied, see OutputMode
+* @return The max probability digit of every image, in column order
+*/
+std::vector<Digit> InferenceEngine::predictBatch(const MatrixView &images, OutputMode mode)
+{
+    MatrixView batch(images);
+
+    return _run(images.getCols(), [batch](int begin, int end, Matrix &)
+    {
+        return batch.colSlice(begin, end - begin);
+    }, mode);
+}
+
+
+/**
+* Classify an array of images in parallel.
+* @param images The images, each of them holding input size values in any shape
+* @param count The number of images
+* @param mode Whether a final Softmax is applied, see OutputMode
+* @return The max probability digit of every image, in array order
+*/
+std::vector<Digit> InferenceEngine::predictBatch(const Matrix *images, int count,
+                                                 OutputMode mode)
+{
+    int imageSize = network.getInputSize();
+    for(int j = 0 ; j < count ; j++)
+    {
+        if(images[j].getRows() * images[j].getCols() != imageSize)
+        {
+            throw std::invalid_argument(INVALID_INPUT_DIMENSIONS_MSG);
+        }
+    }
+
+    return _run(count, [imageSize, images](int begin, int end, Matrix &input) -> MatrixView
+    {
+        int width = end - begin;
+        input.resize(imageSize, width);
+        float *batch = input.data();
+        for(int j = 0 ; j < width ; j++)
+        {
+            const float *image = images[begin + j].data();
+            for(int i = 0 ; i < imageSize ; i++)
+            {
+                batch[(long int) i * width + j] = image[i];
+            }
+        }
+        return input;
+    }, mode);
+}
+
+
+/**
+* Classify every image by handing sub batches to the workers in parallel
+* @param count The number of images
+* @param gather Returns the view of images [begin, end), copying them into the given
+*               worker matrix first if they are not already a batch
+* @param mode Whether a final Softmax is applied
+* @return The max probability digit of every image
+*/
+template <typename Gather>
+std::vector<Digit> InferenceEngine::_run(int count, const Gather &gather, OutputMode mode)
+{
+    std::vector<Digit> digits(std::max(0, count));
+    Digit *out = digits.data();
+
+    pool.parallelFor(count, chunkSize, [this, &gather, out, mode](int begin, int end,
+                                                                 int worker)
+    {
+        WorkerBuffers &local = buffers[worker];
+        network.predictBatch(gather(begin, end, local.input), local.outputs, out + begin,
+                             mode);
+    });
+
+    return digits;
+}
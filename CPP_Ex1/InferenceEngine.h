@@ -0,0 +1,116 @@
+/**
+ * @file InferenceEngine.h
+ * @author  Liron Gershuny <liron.gershuny@mail.huji.ac.il>
+ * @version 1.0
+ * @date 25 Dec 2019
+ *
+ * @brief Define a class that runs an MlpNetwork over large batches on many cores.
+ *
+ * @section LICENSE
+ * This program is not a free software; bla bla bla...
+ *
+ * @section DESCRIPTION
+ * The engine cuts a batch of images into fixed size sub batches and classifies them on a
+ * work stealing thread pool, every worker with its own layer buffers.
+ * Input  : A batch of images
+ * Process: Runs the network on every sub batch in parallel
+ * Output : The max probability digit of every image
+ */
+
+#ifndef INFERENCE_ENGINE_H
+#define INFERENCE_ENGINE_H
+
+// ------------------------------ includes ------------------------------
+#include "Matrix.h"
+#include "MlpNetwork.h"
+#include "ThreadPool.h"
+#include <vector>
+
+
+// -------------------------- const definitions -------------------------
+
+/*
+ * @def ENGINE_CHUNK_SIZE 64
+ * @brief The default number of images in every sub batch, wide enough for the blocked GEMM
+ */
+#define ENGINE_CHUNK_SIZE 64
+
+
+// -------------------------- class definitions -------------------------
+
+/**
+ * Multi threaded batch inference on top of an existing MlpNetwork. The sub batches only
+ * depend on the chunk size, so the digits are the same for any number of threads.
+ */
+class InferenceEngine
+{
+private:
+
+    /**
+     * @struct WorkerBuffers
+     * @brief The gathered sub batch of an image array and the layer outputs of one worker
+     */
+    struct WorkerBuffers
+    {
+        Matrix input;
+        ForwardBuffers outputs;
+    };
+
+    const MlpNetwork &network;
+    ThreadPool pool;
+    int chunkSize;
+    std::vector<WorkerBuffers> buffers;
+
+    /**
+     * Classify every image by handing sub batches to the workers in parallel
+     * @param count The number of images
+     * @param gather Returns the view of images [begin, end), copying them into the given
+     *               worker matrix first if they are not already a batch
+     * @param mode Whether a final Softmax is applied
+     * @return The max probability digit of every image
+     */
+    template <typename Gather>
+    std::vector<Digit> _run(int count, const Gather &gather, OutputMode mode);
+
+public:
+
+    /**
+     * A constructor of InferenceEngine.
+     * @param mlp The network to run, must outlive the engine
+     * @param threadCount The number of worker threads, 0 for one per hardware thread
+     * @param chunk The number of images in every sub batch
+     */
+    explicit InferenceEngine(const MlpNetwork &mlp, int threadCount = 0,
+                             int chunk = ENGINE_CHUNK_SIZE);
+
+
+    /**
+     * Getter of the number of worker threads.
+     * @return The number of workers, including the calling thread
+     */
+    int getThreadCount() const { return pool.getThreadCount(); }
+
+
+    /**
+     * Classify a batch of images in parallel.
+     * @param images A input size x N matrix or view, column j holds the j'th vectorized
+     *               image, e.g. the transpose of a matrix with one image per row
+     * @param mode Whether a final Softmax is applied, see OutputMode
+     * @return The max probability digit of every image, in column order
+     */
+    std::vector<Digit> predictBatch(const MatrixView &images, OutputMode mode = Probabilities);
+
+
+    /**
+     * Classify an array of images in parallel.
+     * @param images The images, each of them holding input size values in any shape
+     * @param count The number of images
+     * @param mode Whether a final Softmax is applied, see OutputMode
+     * @return The max probability digit of every image, in array order
+     */
+    std::vector<Digit> predictBatch(const Matrix *images, int count,
+                                    OutputMode mode = Probabilities);
+
+};
+
+#endif //INFERENCE_ENGINE_H
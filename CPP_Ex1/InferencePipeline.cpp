@@ -0,0 +1,430 @@
+/**
+ * @file InferencePipeline.cpp
+ * @author  Liron Gershuny <liron.gershuny@mail.huji.ac.il>
+ * @version 1.0
+ * @date 25 Dec 2019
+ *
+ * @brief Define a pipeline that loads, classifies and emits images in concurrent stages.
+ *
+ * @section LICENSE
+ * This program is not a free software; bla bla bla...
+ *
+ * @section DESCRIPTION
+ * Images come either from a manifest, a text file with the path of one raw image per line,
+ * or from a stream of raw images written back to back. They move through the source, the
+ * loader, the inference and the writer stages in batches held by a fixed set of slots,
+ * joined by lock free bounded queues.
+ * Input  : A manifest or an image stream, "-" for the standard input
+ * Process: Loads, classifies and emits batches concurrently
+ * Output : Every batch with the digit of every image, in input order
+ */
+
+// ------------------------------ includes ------------------------------
+#include "InferencePipeline.h"
+#include "ModelFile.h"
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <stdexcept>
+#include <thread>
+#include <utility>
+
+
+// ------------------------------ functions -----------------------------
+
+/**
+* Remove the white space around a manifest line, including the carriage return of files
+* written on windows.
+* @param line The line
+* @return The path the line holds, empty for a blank line
+*/
+static std::string trimLine(const std::string &line)
+{
+    const char *blanks = " \t\r\n";
+    size_t begin = line.find_first_not_of(blanks);
+    if(begin == std::string::npos)
+    {
+        return std::string();
+    }
+    return line.substr(begin, line.find_last_not_of(blanks) - begin + 1);
+}
+
+/**
+* Wait a little before retrying a queue, spinning at first and then giving the core away.
+* @param tries The number of failed tries so far, incremented
+*/
+static void backOff(int &tries)
+{
+    tries++;
+    if(tries <= PIPELINE_SPIN_COUNT)
+    {
+        return;
+    }
+    if(tries <= 2 * PIPELINE_SPIN_COUNT)
+    {
+        std::this_thread::yield();
+        return;
+    }
+    std::this_thread::sleep_for(std::chrono::microseconds(PIPELINE_SLEEP_MICROSECONDS));
+}
+
+
+// ------------------------ class implementation ------------------------
+
+/**
+* Constructor of the pipeline, allocates all the slots. Every queue can hold all the slots
+* and the end markers of all the producers at once, so a push only waits for a stage that
+* is behind, never for room.
+* @param mlp The network to run, must outlive the pipeline
+* @param loaders The number of threads reading the image files of a manifest
+* @param batchImages The largest number of images of a batch
+* @param engineThreads The number of inference threads, 0 for one per hardware thread
+*/
+InferencePipeline::InferencePipeline(const MlpNetwork &mlp, int loaders, int batchImages,
+                                     int engineThreads) :
+engine(mlp, engineThreads), imageSize(mlp.getInputSize()), batchSize(std::max(1, batchImages)),
+loaderCount(std::max(1, loaders)), freeSlots(2 * loaderCount + PIPELINE_SPARE_SLOTS),
+listed(freeSlots.capacity()), loaded(freeSlots.capacity()), classified(freeSlots.capacity()),
+aborted(false)
+{
+    for(int i = 0 ; i < loaderCount + PIPELINE_SPARE_SLOTS ; i++)
+    {
+        slots.emplace_back(new ImageBatch());
+        slots.back()->images.resize(batchSize, imageSize);
+        slots.back()->digits.reserve(batchSize);
+    }
+}
+
+
+/**
+* Classify every image of the input and emit the batches. The calling thread is the
+* inference stage, the other stages get their own threads for the length of the call.
+* @param path The manifest or the stream, "-" for the standard input
+* @param kind Whether the input is a manifest or a stream
+* @param emit The sink of the batches
+* @throws std::runtime_error If the input can't be opened or is a truncated stream, or the
+*         first error of any stage, after all the stages stopped
+*/
+void InferencePipeline::run(const std::string &path, ImageSource kind, const BatchSink &emit)
+{
+    std::ifstream file;
+    std::istream *input = &std::cin;
+    if(path != "-")
+    {
+        file.open(path, kind == Stream ? std::ios::in | std::ios::binary : std::ios::in);
+        if(!file.is_open())
+        {
+            throw std::runtime_error(INVALID_IMAGE_SOURCE_MSG);
+        }
+        input = &file;
+    }
+
+    ImageBatch *slot = nullptr;
+    for(SlotQueue *queue : {&freeSlots, &listed, &loaded, &classified})
+    {
+        while(queue->tryPop(slot))
+        {
+        }
+    }
+    for(std::unique_ptr<ImageBatch> &owned : slots)
+    {
+        freeSlots.tryPush(owned.get());
+    }
+    aborted.store(false);
+    failure = nullptr;
+
+    std::vector<std::thread> stages;
+    stages.emplace_back(&InferencePipeline::_sourceStage, this, std::ref(*input), kind);
+    int producers = 1;
+    if(kind == Manifest)
+    {
+        producers = loaderCount;
+        for(int i = 0 ; i < loaderCount ; i++)
+        {
+            stages.emplace_back(&InferencePipeline::_loaderStage, this);
+        }
+    }
+    stages.emplace_back(&InferencePipeline::_writerStage, this, std::cref(emit));
+
+    _inferStage(producers);
+    for(std::thread &stage : stages)
+    {
+        stage.join();
+    }
+
+    if(failure)
+    {
+        std::rethrow_exception(failure);
+    }
+}
+
+
+/**
+* Record the exception being handled and make every stage give up. Only the first
+* exception is kept.
+*/
+void InferencePipeline::_fail()
+{
+    {
+        std::lock_guard<std::mutex> guard(failureLock);
+        if(!failure)
+        {
+            failure = std::current_exception();
+        }
+    }
+    aborted.store(true);
+}
+
+
+/**
+* Append a slot to a queue, waiting while it is full
+* @param queue The queue
+* @param slot The slot, nullptr to tell the next stage a producer is done
+* @return Whether the slot was appended, false once the pipeline failed
+*/
+bool InferencePipeline::_push(SlotQueue &queue, ImageBatch *slot)
+{
+    int tries = 0;
+    while(!queue.tryPush(slot))
+    {
+        if(aborted.load(std::memory_order_relaxed))
+        {
+            return false;
+        }
+        backOff(tries);
+    }
+    return true;
+}
+
+
+/**
+* Take a slot from a queue, waiting while it is empty
+* @param queue The queue
+* @param slot Receives the slot
+* @return Whether a slot was taken, false once the pipeline failed
+*/
+bool InferencePipeline::_pop(SlotQueue &queue, ImageBatch *&slot)
+{
+    int tries = 0;
+    while(!queue.tryPop(slot))
+    {
+        if(aborted.load(std::memory_order_relaxed))
+        {
+            return false;
+        }
+        backOff(tries);
+    }
+    return true;
+}
+
+
+/**
+* The source stage, fills free slots with the next manifest paths or stream images. A
+* stream needs no decoding, so its batches skip the loaders and are read in one call. The
+* stage ends by sending one end marker to every consumer.
+* @param input The manifest or the stream
+* @param kind Whether the input is a manifest or a stream
+*/
+void InferencePipeline::_sourceStage(std::istream &input, ImageSource kind)
+{
+    try
+    {
+        SlotQueue &next = kind == Manifest ? listed : loaded;
+        size_t imageBytes = (size_t) imageSize * sizeof(float);
+        long int sequence = 0;
+        long int lineNumber = 0;
+        ImageBatch *slot = nullptr;
+        while(_pop(freeSlots, slot))
+        {
+            slot->names.clear();
+            slot->lines.clear();
+            slot->failed.clear();
+            slot->digits.clear();
+            slot->sequence = sequence;
+            slot->count = 0;
+
+            bool more = true;
+            if(kind == Manifest)
+            {
+                std::string line;
+                while((int) slot->names.size() < batchSize && std::getline(input, line))
+                {
+                    std::string imagePath = trimLine(line);
+                    if(!imagePath.empty())
+                    {
+                        slot->names.push_back(std::move(imagePath));
+                        slot->lines.push_back(lineNumber);
+                    }
+                    lineNumber++;
+                }
+                more = !slot->names.empty();
+            }
+            else
+            {
+                input.read((char *) slot->images.data(),
+                           (std::streamsize) (imageBytes * batchSize));
+                size_t bytes = (size_t) input.gcount();
+                if(bytes % imageBytes != 0)
+                {
+                    throw std::runtime_error(TRUNCATED_IMAGE_STREAM_MSG);
+                }
+                slot->count = (int) (bytes / imageBytes);
+                more = slot->count > 0;
+            }
+
+            if(!more)
+            {
+                freeSlots.tryPush(slot);
+                break;
+            }
+            if(!_push(next, slot))
+            {
+                return;
+            }
+            sequence++;
+        }
+
+        int consumers = kind == Manifest ? loaderCount : 1;
+        for(int i = 0 ; i < consumers ; i++)
+        {
+            _push(next, nullptr);
+        }
+    }
+    catch(...)
+    {
+        _fail();
+    }
+}
+
+
+/**
+* A loader stage, reads the image files of listed manifest batches straight into the rows
+* of their slot. The paths that can't be read move to the failed list, the others stay in
+* the names and the lines in the order of their rows.
+*/
+void InferencePipeline::_loaderStage()
+{
+    try
+    {
+        std::vector<std::string> paths;
+        std::vector<long int> lines;
+        ImageBatch *slot = nullptr;
+        while(_pop(listed, slot))
+        {
+            if(slot == nullptr)
+            {
+                _push(loaded, nullptr);
+                return;
+            }
+
+            paths.swap(slot->names);
+            lines.swap(slot->lines);
+            slot->names.clear();
+            slot->lines.clear();
+            for(size_t i = 0 ; i < paths.size() ; i++)
+            {
+                if(ModelFile::readRawTensor(paths[i], slot->images.row(slot->count), imageSize))
+                {
+                    slot->names.push_back(std::move(paths[i]));
+                    slot->lines.push_back(lines[i]);
+                    slot->count++;
+                }
+                else
+                {
+                    slot->failed.push_back(std::move(paths[i]));
+                }
+            }
+
+            if(!_push(loaded, slot))
+            {
+                return;
+            }
+        }
+    }
+    catch(...)
+    {
+        _fail();
+    }
+}
+
+
+/**
+* The inference stage, classifies loaded batches. A batch holds one image per row, so the
+* engine reads it through a transposed view, one image per column.
+* @param producers The number of stages that feed it, each ending with a nullptr
+*/
+void InferencePipeline::_inferStage(int producers)
+{
+    try
+    {
+        ImageBatch *slot = nullptr;
+        while(_pop(loaded, slot))
+        {
+            if(slot == nullptr)
+            {
+                if(--producers == 0)
+                {
+                    _push(classified, nullptr);
+                    return;
+                }
+                continue;
+            }
+
+            if(slot->count > 0)
+            {
+                MatrixView images = MatrixView(slot->images).rowSlice(0, slot->count);
+                slot->digits = engine.predictBatch(images.transpose());
+            }
+            if(!_push(classified, slot))
+            {
+                return;
+            }
+        }
+    }
+    catch(...)
+    {
+        _fail();
+    }
+}
+
+
+/**
+* The writer stage, puts the classified batches back in input order and emits them. The
+* loaders may finish batches out of order, so a batch waits here until all the batches
+* before it were emitted, then its slot goes back to the source.
+* @param emit The sink of the batches
+*/
+void InferencePipeline::_writerStage(const BatchSink &emit)
+{
+    try
+    {
+        std::map<long int, ImageBatch *> waiting;
+        long int nextSequence = 0;
+        long int emitted = 0;
+        ImageBatch *slot = nullptr;
+        while(_pop(classified, slot) && slot != nullptr)
+        {
+            waiting[slot->sequence] = slot;
+            for(auto it = waiting.find(nextSequence) ; it != waiting.end() ;
+                it = waiting.find(nextSequence))
+            {
+                ImageBatch *ready = it->second;
+                waiting.erase(it);
+                ready->first = emitted;
+                emit(*ready);
+                emitted += ready->count;
+                nextSequence++;
+                if(!_push(freeSlots, ready))
+                {
+                    return;
+                }
+            }
+        }
+    }
+    catch(...)
+    {
+        _fail();
+    }
+}
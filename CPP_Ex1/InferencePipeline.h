@@ -0,0 +1,239 @@
+/**
+ * @file InferencePipeline.h
+ * @author  Liron Gershuny <liron.gershuny@mail.huji.ac.il>
+ * @version 1.0
+ * @date 25 Dec 2019
+ *
+ * @brief Define a pipeline that loads, classifies and emits images in concurrent stages.
+ *
+ * @section LICENSE
+ * This program is not a free software; bla bla bla...
+ *
+ * @section DESCRIPTION
+ * Images come either from a manifest, a text file with the path of one raw image per line,
+ * or from a stream of raw images written back to back. They move through the stages in
+ * batches held by a fixed set of slots:
+ *
+ *   source  : reads the manifest paths, or the stream images, into a free slot
+ *   loaders : read the image files of a manifest batch into its rows, several at once
+ *   infer   : classifies a loaded batch with an InferenceEngine, on the calling thread
+ *   writer  : hands the batches to the caller's sink in input order and frees the slot
+ *
+ * The stages are joined by lock free bounded queues. A stage that runs ahead of the
+ * others runs out of free slots and waits, so the memory use is fixed, and the disk stays
+ * busy while the cores classify.
+ * Input  : A manifest or an image stream, "-" for the standard input
+ * Process: Loads, classifies and emits batches concurrently
+ * Output : Every batch with the digit of every image, in input order
+ */
+
+#ifndef INFERENCE_PIPELINE_H
+#define INFERENCE_PIPELINE_H
+
+// ------------------------------ includes ------------------------------
+#include <atomic>
+#include <exception>
+#include <functional>
+#include <istream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "Matrix.h"
+#include "MlpNetwork.h"
+#include "InferenceEngine.h"
+#include "BoundedQueue.h"
+
+
+// -------------------------- const definitions -------------------------
+
+/*
+ * @def PIPELINE_BATCH_SIZE 2048
+ * @brief The default number of images in every batch, enough to keep every worker of the
+ *        engine busy for a while
+ */
+#define PIPELINE_BATCH_SIZE 2048
+
+/*
+ * @def PIPELINE_LOADER_THREADS 4
+ * @brief The default number of threads reading the image files of a manifest
+ */
+#define PIPELINE_LOADER_THREADS 4
+
+/*
+ * @def PIPELINE_SPARE_SLOTS 4
+ * @brief The slots beyond one per loader, for the batch being read by the source, the one
+ *        being classified, the one being written and one waiting between two stages
+ */
+#define PIPELINE_SPARE_SLOTS 4
+
+/*
+ * @def PIPELINE_SPIN_COUNT 64
+ * @brief The number of times a stage retries a queue before it starts to yield and sleep
+ */
+#define PIPELINE_SPIN_COUNT 64
+
+/*
+ * @def PIPELINE_SLEEP_MICROSECONDS 100
+ * @brief How long a stage sleeps between two tries once it stopped spinning
+ */
+#define PIPELINE_SLEEP_MICROSECONDS 100
+
+/*
+ * @def INVALID_IMAGE_SOURCE_MSG "Error: Can't open the images source"
+ * @brief The error of a manifest or a stream that can't be opened
+ */
+#define INVALID_IMAGE_SOURCE_MSG "Error: Can't open the images source"
+
+/*
+ * @def TRUNCATED_IMAGE_STREAM_MSG "Error: The image stream ends in the middle of an image"
+ * @brief The error of a stream whose size isn't a whole number of images
+ */
+#define TRUNCATED_IMAGE_STREAM_MSG "Error: The image stream ends in the middle of an image"
+
+
+// -------------------------- class definitions -------------------------
+
+/**
+ * @enum ImageSource
+ * @brief How the images are given to the pipeline.
+ */
+enum ImageSource
+{
+    Manifest,
+    Stream
+};
+
+
+/**
+ * @struct ImageBatch
+ * @brief A batch of images, with the names they are reported under and their digits
+ */
+struct ImageBatch
+{
+    /** count x image size, row i holds the i'th image of the batch, more rows are spare */
+    Matrix images;
+    /** The manifest path of every image, empty for a stream */
+    std::vector<std::string> names;
+    /** The line of the manifest, from 0, of every image in names, empty for a stream */
+    std::vector<long int> lines;
+    /** The manifest paths of this part of the manifest that could not be loaded */
+    std::vector<std::string> failed;
+    /** The digit of every image */
+    std::vector<Digit> digits;
+    /** The index in the output of the first image of the batch, of the images read */
+    long int first = 0;
+    /** The position of the batch in the input */
+    long int sequence = 0;
+    /** The number of images of the batch */
+    int count = 0;
+};
+
+
+/**
+ * Classifies every image of a manifest or a stream in batches, with the reading, the
+ * inference and the output of different batches overlapping in time.
+ */
+class InferencePipeline
+{
+public:
+
+    /**
+     * Receives every classified batch, in input order, on the writer thread
+     * @param batch The batch, valid until the sink returns
+     */
+    typedef std::function<void(const ImageBatch &batch)> BatchSink;
+
+private:
+    typedef BoundedQueue<ImageBatch *> SlotQueue;
+
+    InferenceEngine engine;
+    int imageSize;
+    int batchSize;
+    int loaderCount;
+    std::vector<std::unique_ptr<ImageBatch>> slots;
+    SlotQueue freeSlots;
+    SlotQueue listed;
+    SlotQueue loaded;
+    SlotQueue classified;
+    std::atomic<bool> aborted;
+    std::mutex failureLock;
+    std::exception_ptr failure;
+
+    /**
+     * Record the exception being handled and make every stage give up
+     */
+    void _fail();
+
+    /**
+     * Append a slot to a queue, waiting while it is full
+     * @param queue The queue
+     * @param slot The slot, nullptr to tell the next stage a producer is done
+     * @return Whether the slot was appended, false once the pipeline failed
+     */
+    bool _push(SlotQueue &queue, ImageBatch *slot);
+
+    /**
+     * Take a slot from a queue, waiting while it is empty
+     * @param queue The queue
+     * @param slot Receives the slot
+     * @return Whether a slot was taken, false once the pipeline failed
+     */
+    bool _pop(SlotQueue &queue, ImageBatch *&slot);
+
+    /**
+     * The source stage, fills free slots with the next manifest paths or stream images
+     * @param input The manifest or the stream
+     * @param kind Whether the input is a manifest or a stream
+     */
+    void _sourceStage(std::istream &input, ImageSource kind);
+
+    /**
+     * A loader stage, reads the image files of listed manifest batches
+     */
+    void _loaderStage();
+
+    /**
+     * The inference stage, classifies loaded batches
+     * @param producers The number of stages that feed it, each ending with a nullptr
+     */
+    void _inferStage(int producers);
+
+    /**
+     * The writer stage, puts the classified batches back in input order and emits them
+     * @param emit The sink of the batches
+     */
+    void _writerStage(const BatchSink &emit);
+
+public:
+
+    /**
+     * Constructor of the pipeline, allocates all the slots.
+     * @param mlp The network to run, must outlive the pipeline
+     * @param loaders The number of threads reading the image files of a manifest
+     * @param batchImages The largest number of images of a batch
+     * @param engineThreads The number of inference threads, 0 for one per hardware thread
+     */
+    explicit InferencePipeline(const MlpNetwork &mlp, int loaders = PIPELINE_LOADER_THREADS,
+                               int batchImages = PIPELINE_BATCH_SIZE, int engineThreads = 0);
+
+
+    InferencePipeline(const InferencePipeline &) = delete;
+    InferencePipeline &operator=(const InferencePipeline &) = delete;
+
+
+    /**
+     * Classify every image of the input and emit the batches. Images of a manifest that
+     * can't be read are listed in the failed paths of their batch and get no digit.
+     * @param path The manifest or the stream, "-" for the standard input
+     * @param kind Whether the input is a manifest or a stream
+     * @param emit The sink of the batches
+     * @throws std::runtime_error If the input can't be opened or is a truncated stream, or
+     *         the first error of any stage, after all the stages stopped
+     */
+    void run(const std::string &path, ImageSource kind, const BatchSink &emit);
+
+};
+
+#endif //INFERENCE_PIPELINE_H
@@ -0,0 +1,98 @@
+/**
+ * @file KernelCommon.h
+ * @author  Liron Gershuny <liron.gershuny@mail.huji.ac.il>
+ * @version 1.0
+ * @date 25 Dec 2019
+ *
+ * @brief Define the helpers that the kernel sources share, not part of any public API.
+ *
+ * @section LICENSE
+ * This program is not a free software; bla bla bla...
+ *
+ * @section DESCRIPTION
+ * Only the kernel translation units include this header. It detects an x86 build, and
+ * holds the end of a dense layer row and the horizontal sums of the vector registers, so
+ * the float, low precision and sparse kernels finish their rows the same way.
+ * Input  : Dot products and vector registers
+ * Process: Adds the bias, applies ReLU, sums the lanes
+ * Output : Finished output elements
+ */
+
+#ifndef KERNEL_COMMON_H
+#define KERNEL_COMMON_H
+
+// ------------------------------ includes ------------------------------
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define KERNELS_X86
+#endif
+
+
+// ------------------------ static helpers ------------------------------
+
+/**
+ * The end of a dense layer row: add the bias and clamp negatives when ReLU is fused. A NaN
+ * is clamped to 0 too.
+ * @param value The dot product of the row with the input
+ * @param bias The bias vector, or nullptr for a plain product
+ * @param i The index of the row
+ * @param relu Whether to apply ReLU
+ * @return The finished output element
+ */
+static inline float denseEpilogue(float value, const float *bias, int i, bool relu)
+{
+    if(bias != nullptr)
+    {
+        value += bias[i];
+    }
+    if(relu && !(value >= 0))
+    {
+        value = 0;
+    }
+    return value;
+}
+
+
+#ifdef KERNELS_X86
+
+/**
+ * Sum the four lanes of an SSE register.
+ */
+__attribute__((target("sse2")))
+static inline float hsumSse2(__m128 v)
+{
+    __m128 shuf = _mm_shuffle_ps(v, v, _MM_SHUFFLE(2, 3, 0, 1));
+    __m128 sums = _mm_add_ps(v, shuf);
+    shuf = _mm_movehl_ps(shuf, sums);
+    return _mm_cvtss_f32(_mm_add_ss(sums, shuf));
+}
+
+
+/**
+ * Sum the eight lanes of an AVX register.
+ */
+__attribute__((target("avx2")))
+static inline float hsumAvx2(__m256 v)
+{
+    __m128 low = _mm256_castps256_ps128(v);
+    __m128 high = _mm256_extractf128_ps(v, 1);
+    return hsumSse2(_mm_add_ps(low, high));
+}
+
+
+/**
+ * Sum the sixteen lanes of an AVX-512 register.
+ */
+__attribute__((target("avx512f")))
+static inline float hsumAvx512(__m512 v)
+{
+    // The masked extract avoids the undefined source register of the plain intrinsics
+    __m512d wide = _mm512_castps_pd(v);
+    __m256d low = _mm512_mask_extractf64x4_pd(_mm256_setzero_pd(), 0xF, wide, 0);
+    __m256d high = _mm512_mask_extractf64x4_pd(_mm256_setzero_pd(), 0xF, wide, 1);
+    return hsumAvx2(_mm256_add_ps(_mm256_castpd_ps(low), _mm256_castpd_ps(high)));
+}
+
+#endif //KERNELS_X86
+
+#endif //KERNEL_COMMON_H
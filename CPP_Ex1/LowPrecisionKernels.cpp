@@ -0,0 +1,1472 @@
+/**
+ * @file LowPrecisionKernels.cpp
+ * @author  Liron Gershuny <liron.gershuny@mail.huji.ac.il>
+ * @version 1.0
+ * @date 25 Dec 2019
+ *
+ * @brief Define the dense layer kernels that read weights stored in fewer than 32 bits.
+ *
+ * @section LICENSE
+ * This program is not a free software; bla bla bla...
+ *
+ * @section DESCRIPTION
+ * Int8 weights are quantized once, row by row, and the layer input is quantized per
+ * sample right before the product. The products are accumulated in integers and scaled
+ * back to floats before the bias and the activation. Half precision weights are stored in
+ * 16 bits and widened to floats in registers, right before they are multiplied.
+ * Input  : Quantized or half precision weights and a float input
+ * Process: Integer or widened float dot products, dispatched at runtime
+ * Output : The float layer output written into a caller supplied buffer
+ */
+
+// ------------------------------ includes ------------------------------
+#include "LowPrecisionKernels.h"
+#include "MatrixKernels.h"
+#include "KernelCommon.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+
+// -------------------------- const definitions -------------------------
+
+/*
+ * @def HALF_PANEL_SAMPLES 32
+ * @brief The number of samples a batched half precision product sweeps every row of
+ *        weights over at once, about 100 KB of 784 value samples that stay in the L2 cache
+ */
+#define HALF_PANEL_SAMPLES 32
+
+
+// ------------------------ static helpers ------------------------------
+
+/**
+ * Whether the CPU has the AVX-512 integer dot product instructions, checked once.
+ * @return true if VNNI can be used together with AVX-512 BW
+ */
+static bool hasAvx512Vnni()
+{
+#ifdef KERNELS_X86
+    static bool supported = __builtin_cpu_supports("avx512bw") &&
+                            __builtin_cpu_supports("avx512vnni");
+    return supported;
+#else
+    return false;
+#endif
+}
+
+
+/**
+ * Whether the CPU can convert fp16 values in AVX registers, checked once.
+ * @return true if F16C can be used
+ */
+static bool hasF16c()
+{
+#ifdef KERNELS_X86
+    static bool supported = __builtin_cpu_supports("f16c");
+    return supported;
+#else
+    return false;
+#endif
+}
+
+
+/**
+ * The end of a quantized dense layer row: scale the integer sum back, then add the bias
+ * and clamp negatives when ReLU is fused.
+ * @param sum The integer dot product of the row with the input
+ * @param scale The product of the row scale and the input scale
+ * @param bias The bias vector, or nullptr for a plain product
+ * @param i The index of the row
+ * @param relu Whether to apply ReLU
+ * @return The finished output element
+ */
+static inline float int8Epilogue(int32_t sum, float scale, const float *bias, int i, bool relu)
+{
+    return denseEpilogue((float) sum * scale, bias, i, relu);
+}
+
+
+/**
+ * Round a scaled value to the nearest quantization level, halves away from zero.
+ * @param value The value already divided by its scale
+ * @return The level, clamped to [-INT8_MAX_LEVEL, INT8_MAX_LEVEL]
+ */
+static inline int8_t quantizeValue(float value)
+{
+    int level = (int) (value + (value >= 0 ? 0.5f : -0.5f));
+    return (int8_t) std::max(-INT8_MAX_LEVEL, std::min(INT8_MAX_LEVEL, level));
+}
+
+
+/**
+ * Scalar int8 dot product, the fallback of every quantized path.
+ * @param a The first vector
+ * @param b The second vector
+ * @param n The number of elements
+ * @return The exact dot product
+ */
+static int32_t dotInt8Scalar(const int8_t *a, const int8_t *b, int n)
+{
+    int32_t result = 0;
+    for(int i = 0 ; i < n ; i++)
+    {
+        result += (int32_t) a[i] * b[i];
+    }
+    return result;
+}
+
+
+/**
+ * Widen one 16 bit value to a float. bf16 is the upper half of a float, fp16 has its own
+ * exponent range and subnormals.
+ * @param value The stored bits
+ * @param format The 16 bit encoding of the value
+ * @return The exact float value
+ */
+static float widenScalar(uint16_t value, kernels::HalfFormat format)
+{
+    uint32_t bits = (uint32_t) value << 16;
+    if(format == kernels::Fp16)
+    {
+        uint32_t sign = (uint32_t) (value & 0x8000u) << 16;
+        uint32_t exponent = (value >> 10) & 0x1Fu;
+        uint32_t mantissa = value & 0x3FFu;
+        if(exponent == 0)
+        {
+            float subnormal = std::ldexp((float) mantissa, -24);
+            return sign ? -subnormal : subnormal;
+        }
+        exponent = exponent == 0x1Fu ? 0xFFu : exponent + 112;
+        bits = sign | exponent << 23 | mantissa << 13;
+    }
+
+    float result;
+    std::memcpy(&result, &bits, sizeof(result));
+    return result;
+}
+
+
+/**
+ * Round a float to the nearest fp16 value, ties to even. Values beyond the fp16 range
+ * become infinities.
+ * @param value The float to narrow
+ * @return The fp16 bits
+ */
+static uint16_t narrowFp16(float value)
+{
+    uint32_t bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+    uint32_t sign = (bits >> 16) & 0x8000u;
+    uint32_t magnitude = bits & 0x7FFFFFFFu;
+
+    if(magnitude > 0x7F800000u)
+    {
+        return (uint16_t) (sign | 0x7E00u);
+    }
+    if(magnitude >= 0x477FF000u)
+    {
+        // 65520 and above round past the largest finite fp16 value
+        return (uint16_t) (sign | 0x7C00u);
+    }
+    if(magnitude < 0x38800000u)
+    {
+        // Below the smallest normal fp16 value the result is a multiple of 2^-24
+        return (uint16_t) (sign | (uint32_t) std::nearbyint(std::fabs(value) * 16777216.0f));
+    }
+
+    uint32_t rounded = magnitude + 0xFFFu + ((magnitude >> 13) & 1u);
+    return (uint16_t) (sign | ((rounded - 0x38000000u) >> 13));
+}
+
+
+/**
+ * Round a float to the nearest bf16 value, ties to even.
+ * @param value The float to narrow
+ * @return The bf16 bits
+ */
+static uint16_t narrowBf16(float value)
+{
+    uint32_t bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+    if((bits & 0x7FFFFFFFu) > 0x7F800000u)
+    {
+        return (uint16_t) ((bits >> 16) | 0x40u);
+    }
+    return (uint16_t) ((bits + 0x7FFFu + ((bits >> 16) & 1u)) >> 16);
+}
+
+
+/**
+ * Scalar half precision dense layer, the fallback of the vector paths.
+ * @param a The m*k weights in the given format
+ * @param format The 16 bit encoding of A
+ * @param x The n samples, k contiguous values each
+ * @param n The number of samples
+ * @param bias The bias vector, or nullptr for none
+ * @param y The m*n row-major output
+ * @param m The number of rows of A
+ * @param k The number of columns of A
+ * @param relu Whether to apply ReLU
+ */
+static void gemvHalfScalar(const uint16_t *a, kernels::HalfFormat format, const float *x, int n,
+                           const float *bias, float *y, int m, int k, bool relu)
+{
+    for(int i = 0 ; i < m ; i++)
+    {
+        const uint16_t *row = a + (long int) i * k;
+        for(int j = 0 ; j < n ; j++)
+        {
+            const float *sample = x + (long int) j * k;
+            float sum = 0;
+            for(int p = 0 ; p < k ; p++)
+            {
+                sum += widenScalar(row[p], format) * sample[p];
+            }
+            y[(long int) i * n + j] = denseEpilogue(sum, bias, i, relu);
+        }
+    }
+}
+
+
+#ifdef KERNELS_X86
+
+/**
+ * Sum the eight 32 bit lanes of an AVX2 register.
+ */
+__attribute__((target("avx2")))
+static int32_t hsumEpi32Avx2(__m256i v)
+{
+    __m128i sum = _mm_add_epi32(_mm256_castsi256_si128(v), _mm256_extracti128_si256(v, 1));
+    sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, _MM_SHUFFLE(1, 0, 3, 2)));
+    sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, _MM_SHUFFLE(2, 3, 0, 1)));
+    return _mm_cvtsi128_si32(sum);
+}
+
+
+/**
+ * Multiply 32 int8 pairs and add them into eight 32 bit lanes. maddubs wants an unsigned
+ * operand, so the sign of x is moved onto w. With both magnitudes at most 127 the 16 bit
+ * pair sums can't saturate.
+ */
+__attribute__((target("avx2")))
+static inline __m256i dotStepAvx2(__m256i acc, __m256i w, __m256i x, __m256i ones)
+{
+    __m256i products = _mm256_maddubs_epi16(_mm256_sign_epi8(x, x), _mm256_sign_epi8(w, x));
+    return _mm256_add_epi32(acc, _mm256_madd_epi16(products, ones));
+}
+
+
+/**
+ * AVX2 int8 matrix vector product with the dense layer epilogue. Four rows share every
+ * load of x.
+ */
+__attribute__((target("avx2")))
+static void gemvInt8Avx2(const int8_t *a, const float *scales, const int8_t *x, float xScale,
+                         const float *bias, float *y, int yStride, int m, int stride, bool relu)
+{
+    __m256i ones = _mm256_set1_epi16(1);
+    int i = 0;
+    for( ; i + 4 <= m ; i += 4)
+    {
+        const int8_t *r0 = a + (long int) i * stride;
+        const int8_t *r1 = r0 + stride;
+        const int8_t *r2 = r1 + stride;
+        const int8_t *r3 = r2 + stride;
+        __m256i acc0 = _mm256_setzero_si256();
+        __m256i acc1 = _mm256_setzero_si256();
+        __m256i acc2 = _mm256_setzero_si256();
+        __m256i acc3 = _mm256_setzero_si256();
+        for(int p = 0 ; p < stride ; p += 32)
+        {
+            __m256i xv = _mm256_loadu_si256((const __m256i *) (x + p));
+            acc0 = dotStepAvx2(acc0, _mm256_loadu_si256((const __m256i *) (r0 + p)), xv, ones);
+            acc1 = dotStepAvx2(acc1, _mm256_loadu_si256((const __m256i *) (r1 + p)), xv, ones);
+            acc2 = dotStepAvx2(acc2, _mm256_loadu_si256((const __m256i *) (r2 + p)), xv, ones);
+            acc3 = dotStepAvx2(acc3, _mm256_loadu_si256((const __m256i *) (r3 + p)), xv, ones);
+        }
+        int32_t sums[4] = {hsumEpi32Avx2(acc0), hsumEpi32Avx2(acc1),
+                           hsumEpi32Avx2(acc2), hsumEpi32Avx2(acc3)};
+        for(int r = 0 ; r < 4 ; r++)
+        {
+            y[(long int) (i + r) * yStride] = int8Epilogue(sums[r], scales[i + r] * xScale,
+                                                           bias, i + r, relu);
+        }
+    }
+    for( ; i < m ; i++)
+    {
+        const int8_t *row = a + (long int) i * stride;
+        __m256i acc = _mm256_setzero_si256();
+        for(int p = 0 ; p < stride ; p += 32)
+        {
+            acc = dotStepAvx2(acc, _mm256_loadu_si256((const __m256i *) (row + p)),
+                              _mm256_loadu_si256((const __m256i *) (x + p)), ones);
+        }
+        y[(long int) i * yStride] = int8Epilogue(hsumEpi32Avx2(acc), scales[i] * xScale,
+                                                 bias, i, relu);
+    }
+}
+
+
+/**
+ * Sum the sixteen 32 bit lanes of an AVX-512 register.
+ */
+__attribute__((target("avx512f")))
+static int32_t hsumEpi32Avx512(__m512i v)
+{
+    // The masked extracts avoid the undefined source register of the plain intrinsics
+    __m256i low = _mm512_mask_extracti64x4_epi64(_mm256_setzero_si256(), 0xF, v, 0);
+    __m256i high = _mm512_mask_extracti64x4_epi64(_mm256_setzero_si256(), 0xF, v, 1);
+    __m256i sum = _mm256_add_epi32(low, high);
+    __m128i half = _mm_add_epi32(_mm256_castsi256_si128(sum),
+                                 _mm256_extracti128_si256(sum, 1));
+    half = _mm_add_epi32(half, _mm_shuffle_epi32(half, _MM_SHUFFLE(1, 0, 3, 2)));
+    half = _mm_add_epi32(half, _mm_shuffle_epi32(half, _MM_SHUFFLE(2, 3, 0, 1)));
+    return _mm_cvtsi128_si32(half);
+}
+
+
+/**
+ * Multiply 64 int8 pairs and add them into sixteen 32 bit lanes with a single VNNI
+ * instruction, moving the sign of x onto w the same way as the AVX2 path.
+ */
+__attribute__((target("avx512f,avx512bw,avx512vnni")))
+static inline __m512i dotStepVnni(__m512i acc, __m512i w, __m512i x)
+{
+    __mmask64 negative = _mm512_movepi8_mask(x);
+    __m512i signedW = _mm512_mask_sub_epi8(w, negative, _mm512_setzero_si512(), w);
+    return _mm512_dpbusd_epi32(acc, _mm512_abs_epi8(x), signedW);
+}
+
+
+/**
+ * AVX-512 VNNI int8 matrix vector product with the dense layer epilogue. Four rows share
+ * every load of x.
+ */
+__attribute__((target("avx512f,avx512bw,avx512vnni")))
+static void gemvInt8Vnni(const int8_t *a, const float *scales, const int8_t *x, float xScale,
+                         const float *bias, float *y, int yStride, int m, int stride, bool relu)
+{
+    int i = 0;
+    for( ; i + 4 <= m ; i += 4)
+    {
+        const int8_t *r0 = a + (long int) i * stride;
+        const int8_t *r1 = r0 + stride;
+        const int8_t *r2 = r1 + stride;
+        const int8_t *r3 = r2 + stride;
+        __m512i acc0 = _mm512_setzero_si512();
+        __m512i acc1 = _mm512_setzero_si512();
+        __m512i acc2 = _mm512_setzero_si512();
+        __m512i acc3 = _mm512_setzero_si512();
+        for(int p = 0 ; p < stride ; p += 64)
+        {
+            __m512i xv = _mm512_loadu_si512(x + p);
+            acc0 = dotStepVnni(acc0, _mm512_loadu_si512(r0 + p), xv);
+            acc1 = dotStepVnni(acc1, _mm512_loadu_si512(r1 + p), xv);
+            acc2 = dotStepVnni(acc2, _mm512_loadu_si512(r2 + p), xv);
+            acc3 = dotStepVnni(acc3, _mm512_loadu_si512(r3 + p), xv);
+        }
+        int32_t sums[4] = {hsumEpi32Avx512(acc0), hsumEpi32Avx512(acc1),
+                           hsumEpi32Avx512(acc2), hsumEpi32Avx512(acc3)};
+        for(int r = 0 ; r < 4 ; r++)
+        {
+            y[(long int) (i + r) * yStride] = int8Epilogue(sums[r], scales[i + r] * xScale,
+                                                           bias, i + r, relu);
+        }
+    }
+    for( ; i < m ; i++)
+    {
+        const int8_t *row = a + (long int) i * stride;
+        __m512i acc = _mm512_setzero_si512();
+        for(int p = 0 ; p < stride ; p += 64)
+        {
+            acc = dotStepVnni(acc, _mm512_loadu_si512(row + p), _mm512_loadu_si512(x + p));
+        }
+        y[(long int) i * yStride] = int8Epilogue(hsumEpi32Avx512(acc), scales[i] * xScale,
+                                                 bias, i, relu);
+    }
+}
+
+/**
+ * AVX-512 VNNI tile of four quantized weight rows times four quantized samples, with the
+ * dense layer epilogue. dpbusd wants an unsigned operand, so the samples are offset by 128
+ * with a flip of their sign bits, shared by the four rows, and 128 times the sum of every
+ * weight row is taken back from its dot products. The sums stay exact in 32 bits.
+ */
+__attribute__((target("avx512f,avx512bw,avx512vnni")))
+static void int8TileVnni(const int8_t *a, const float *scales, const int8_t *x,
+                         const float *xScales, const float *bias, float *y, int n, int stride,
+                         bool relu)
+{
+    __m512i offset = _mm512_set1_epi8((char) 0x80);
+    __m512i c00 = _mm512_setzero_si512(), c01 = _mm512_setzero_si512();
+    __m512i c02 = _mm512_setzero_si512(), c03 = _mm512_setzero_si512();
+    __m512i c10 = _mm512_setzero_si512(), c11 = _mm512_setzero_si512();
+    __m512i c12 = _mm512_setzero_si512(), c13 = _mm512_setzero_si512();
+    __m512i c20 = _mm512_setzero_si512(), c21 = _mm512_setzero_si512();
+    __m512i c22 = _mm512_setzero_si512(), c23 = _mm512_setzero_si512();
+    __m512i c30 = _mm512_setzero_si512(), c31 = _mm512_setzero_si512();
+    __m512i c32 = _mm512_setzero_si512(), c33 = _mm512_setzero_si512();
+    __m512i o0 = _mm512_setzero_si512(), o1 = _mm512_setzero_si512();
+    __m512i o2 = _mm512_setzero_si512(), o3 = _mm512_setzero_si512();
+
+    for(int p = 0 ; p < stride ; p += 64)
+    {
+        __m512i x0 = _mm512_xor_si512(_mm512_loadu_si512(x + p), offset);
+        __m512i x1 = _mm512_xor_si512(_mm512_loadu_si512(x + stride + p), offset);
+        __m512i x2 = _mm512_xor_si512(_mm512_loadu_si512(x + 2 * stride + p), offset);
+        __m512i x3 = _mm512_xor_si512(_mm512_loadu_si512(x + 3 * stride + p), offset);
+        __m512i w = _mm512_loadu_si512(a + p);
+        o0 = _mm512_dpbusd_epi32(o0, offset, w);
+        c00 = _mm512_dpbusd_epi32(c00, x0, w);
+        c01 = _mm512_dpbusd_epi32(c01, x1, w);
+        c02 = _mm512_dpbusd_epi32(c02, x2, w);
+        c03 = _mm512_dpbusd_epi32(c03, x3, w);
+        w = _mm512_loadu_si512(a + stride + p);
+        o1 = _mm512_dpbusd_epi32(o1, offset, w);
+        c10 = _mm512_dpbusd_epi32(c10, x0, w);
+        c11 = _mm512_dpbusd_epi32(c11, x1, w);
+        c12 = _mm512_dpbusd_epi32(c12, x2, w);
+        c13 = _mm512_dpbusd_epi32(c13, x3, w);
+        w = _mm512_loadu_si512(a + 2 * stride + p);
+        o2 = _mm512_dpbusd_epi32(o2, offset, w);
+        c20 = _mm512_dpbusd_epi32(c20, x0, w);
+        c21 = _mm512_dpbusd_epi32(c21, x1, w);
+        c22 = _mm512_dpbusd_epi32(c22, x2, w);
+        c23 = _mm512_dpbusd_epi32(c23, x3, w);
+        w = _mm512_loadu_si512(a + 3 * stride + p);
+        o3 = _mm512_dpbusd_epi32(o3, offset, w);
+        c30 = _mm512_dpbusd_epi32(c30, x0, w);
+        c31 = _mm512_dpbusd_epi32(c31, x1, w);
+        c32 = _mm512_dpbusd_epi32(c32, x2, w);
+        c33 = _mm512_dpbusd_epi32(c33, x3, w);
+    }
+
+    __m512i tile[4][4] = {{c00, c01, c02, c03}, {c10, c11, c12, c13},
+                          {c20, c21, c22, c23}, {c30, c31, c32, c33}};
+    __m512i offsets[4] = {o0, o1, o2, o3};
+    for(int r = 0 ; r < 4 ; r++)
+    {
+        int32_t rowOffset = hsumEpi32Avx512(offsets[r]);
+        for(int c = 0 ; c < 4 ; c++)
+        {
+            y[(long int) r * n + c] = int8Epilogue(hsumEpi32Avx512(tile[r][c]) - rowOffset,
+                                                   scales[r] * xScales[c], bias, r, relu);
+        }
+    }
+}
+
+
+/**
+ * AVX-512 VNNI int8 dense layer, walked in tiles of four rows times four samples. The rows
+ * and samples past the last whole tile go through the matrix vector product.
+ */
+__attribute__((target("avx512f,avx512bw,avx512vnni")))
+static void gemmInt8Vnni(const int8_t *a, const float *scales, const int8_t *x,
+                         const float *xScales, int n, const float *bias, float *y, int m,
+                         int stride, bool relu)
+{
+    int tileRows = m - m % 4;
+    int j = 0;
+    for( ; j + 4 <= n ; j += 4)
+    {
+        const int8_t *samples = x + (long int) j * stride;
+        for(int i = 0 ; i < tileRows ; i += 4)
+        {
+            int8TileVnni(a + (long int) i * stride, scales + i, samples, xScales + j,
+                         bias == nullptr ? nullptr : bias + i, y + (long int) i * n + j, n,
+                         stride, relu);
+        }
+        for(int c = 0 ; c < 4 && tileRows < m ; c++)
+        {
+            gemvInt8Vnni(a + (long int) tileRows * stride, scales + tileRows,
+                         samples + (long int) c * stride, xScales[j + c],
+                         bias == nullptr ? nullptr : bias + tileRows,
+                         y + (long int) tileRows * n + j + c, n, m - tileRows, stride, relu);
+        }
+    }
+    for( ; j < n ; j++)
+    {
+        gemvInt8Vnni(a, scales, x + (long int) j * stride, xScales[j], bias, y + j, n, m,
+                     stride, relu);
+    }
+}
+
+
+/**
+ * Load eight 16 bit weights and widen them to floats.
+ */
+template <kernels::HalfFormat FORMAT>
+__attribute__((target("avx2,f16c")))
+static inline __m256 widenAvx2(const uint16_t *a)
+{
+    __m128i raw = _mm_loadu_si128((const __m128i *) a);
+    if(FORMAT == kernels::Fp16)
+    {
+        return _mm256_cvtph_ps(raw);
+    }
+    return _mm256_castsi256_ps(_mm256_slli_epi32(_mm256_cvtepu16_epi32(raw), 16));
+}
+
+
+/**
+ * Widen the last k % 8 weights of a row. A row of at least eight weights reads its last
+ * eight and keeps the lanes of the mask, a shorter one is copied into a zero padded buffer.
+ * @param row The row of k weights
+ * @param k The length of the row
+ * @param mask The lanes of the tail, as computed by tailMaskAvx2
+ * @return The widened tail, zero in the other lanes
+ */
+template <kernels::HalfFormat FORMAT>
+__attribute__((target("avx2,f16c")))
+static inline __m256 widenTailAvx2(const uint16_t *row, int k, __m256 mask)
+{
+    if(k >= 8)
+    {
+        return _mm256_and_ps(widenAvx2<FORMAT>(row + k - 8), mask);
+    }
+    uint16_t padded[8] = {0};
+    std::memcpy(padded, row, (size_t) k * sizeof(uint16_t));
+    return widenAvx2<FORMAT>(padded);
+}
+
+
+/**
+ * The lanes widenTailAvx2 leaves the tail of a row in: the upper k % 8 lanes of the last
+ * eight values, or the lower k lanes of a row shorter than eight.
+ * @param k The length of the row
+ * @return All ones in the lanes of the tail, zeros elsewhere
+ */
+__attribute__((target("avx2")))
+static inline __m256 tailMaskAvx2(int k)
+{
+    __m256i lanes = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+    if(k >= 8)
+    {
+        return _mm256_castsi256_ps(_mm256_cmpgt_epi32(lanes, _mm256_set1_epi32(7 - k % 8)));
+    }
+    return _mm256_castsi256_ps(_mm256_cmpgt_epi32(_mm256_set1_epi32(k), lanes));
+}
+
+
+/**
+ * AVX2 half precision product of a single sample, four rows at a time like the float
+ * GEMV. Every load of the sample is shared by the four rows, and the last partial step
+ * reads zero padded copies, so no weight is widened by the scalar code.
+ */
+template <kernels::HalfFormat FORMAT>
+__attribute__((target("avx2,fma,f16c")))
+static void gemvHalfRowsAvx2(const uint16_t *a, const float *x, const float *bias, float *y,
+                             int m, int k, bool relu)
+{
+    int tail = k % 8;
+    int body = k - tail;
+    __m256 mask = tailMaskAvx2(k);
+    __m256 xTail = _mm256_maskload_ps(k >= 8 ? x + k - 8 : x, _mm256_castps_si256(mask));
+    int i = 0;
+    for( ; i + 4 <= m ; i += 4)
+    {
+        const uint16_t *r0 = a + (long int) i * k;
+        const uint16_t *r1 = r0 + k;
+        const uint16_t *r2 = r1 + k;
+        const uint16_t *r3 = r2 + k;
+        __m256 acc0 = _mm256_setzero_ps();
+        __m256 acc1 = _mm256_setzero_ps();
+        __m256 acc2 = _mm256_setzero_ps();
+        __m256 acc3 = _mm256_setzero_ps();
+        for(int p = 0 ; p < body ; p += 8)
+        {
+            __m256 xv = _mm256_loadu_ps(x + p);
+            acc0 = _mm256_fmadd_ps(widenAvx2<FORMAT>(r0 + p), xv, acc0);
+            acc1 = _mm256_fmadd_ps(widenAvx2<FORMAT>(r1 + p), xv, acc1);
+            acc2 = _mm256_fmadd_ps(widenAvx2<FORMAT>(r2 + p), xv, acc2);
+            acc3 = _mm256_fmadd_ps(widenAvx2<FORMAT>(r3 + p), xv, acc3);
+        }
+        if(tail)
+        {
+            acc0 = _mm256_fmadd_ps(widenTailAvx2<FORMAT>(r0, k, mask), xTail, acc0);
+            acc1 = _mm256_fmadd_ps(widenTailAvx2<FORMAT>(r1, k, mask), xTail, acc1);
+            acc2 = _mm256_fmadd_ps(widenTailAvx2<FORMAT>(r2, k, mask), xTail, acc2);
+            acc3 = _mm256_fmadd_ps(widenTailAvx2<FORMAT>(r3, k, mask), xTail, acc3);
+        }
+        y[i] = denseEpilogue(hsumAvx2(acc0), bias, i, relu);
+        y[i + 1] = denseEpilogue(hsumAvx2(acc1), bias, i + 1, relu);
+        y[i + 2] = denseEpilogue(hsumAvx2(acc2), bias, i + 2, relu);
+        y[i + 3] = denseEpilogue(hsumAvx2(acc3), bias, i + 3, relu);
+    }
+    for( ; i < m ; i++)
+    {
+        const uint16_t *row = a + (long int) i * k;
+        __m256 acc = _mm256_setzero_ps();
+        for(int p = 0 ; p < body ; p += 8)
+        {
+            acc = _mm256_fmadd_ps(widenAvx2<FORMAT>(row + p), _mm256_loadu_ps(x + p), acc);
+        }
+        if(tail)
+        {
+            acc = _mm256_fmadd_ps(widenTailAvx2<FORMAT>(row, k, mask), xTail, acc);
+        }
+        y[i] = denseEpilogue(hsumAvx2(acc), bias, i, relu);
+    }
+}
+
+
+/**
+ * AVX2 tile of ROWS weight rows times COLS samples. Every widened weight is used for all
+ * the samples and every sample load for all the rows. The last partial step reads zero
+ * padded copies like gemvHalfRowsAvx2, so no weight is widened by the scalar code.
+ */
+template <kernels::HalfFormat FORMAT, int ROWS, int COLS>
+__attribute__((target("avx2,fma,f16c")))
+static void halfTileAvx2(const uint16_t *a, const float *x, int k, __m256 mask,
+                         const float *bias, float *y, int n, int i, bool relu)
+{
+    __m256 acc[ROWS][COLS];
+    for(int r = 0 ; r < ROWS ; r++)
+    {
+        for(int c = 0 ; c < COLS ; c++)
+        {
+            acc[r][c] = _mm256_setzero_ps();
+        }
+    }
+
+    int body = k - k % 8;
+    for(int p = 0 ; p < body ; p += 8)
+    {
+        __m256 w[ROWS];
+        for(int r = 0 ; r < ROWS ; r++)
+        {
+            w[r] = widenAvx2<FORMAT>(a + (long int) r * k + p);
+        }
+        for(int c = 0 ; c < COLS ; c++)
+        {
+            __m256 xv = _mm256_loadu_ps(x + (long int) c * k + p);
+            for(int r = 0 ; r < ROWS ; r++)
+            {
+                acc[r][c] = _mm256_fmadd_ps(w[r], xv, acc[r][c]);
+            }
+        }
+    }
+    if(body < k)
+    {
+        __m256 w[ROWS];
+        for(int r = 0 ; r < ROWS ; r++)
+        {
+            w[r] = widenTailAvx2<FORMAT>(a + (long int) r * k, k, mask);
+        }
+        for(int c = 0 ; c < COLS ; c++)
+        {
+            const float *sample = x + (long int) c * k;
+            __m256 xv = _mm256_maskload_ps(k >= 8 ? sample + k - 8 : sample,
+                                           _mm256_castps_si256(mask));
+            for(int r = 0 ; r < ROWS ; r++)
+            {
+                acc[r][c] = _mm256_fmadd_ps(w[r], xv, acc[r][c]);
+            }
+        }
+    }
+
+    for(int r = 0 ; r < ROWS ; r++)
+    {
+        for(int c = 0 ; c < COLS ; c++)
+        {
+            y[(long int) r * n + c] = denseEpilogue(hsumAvx2(acc[r][c]), bias, i + r, relu);
+        }
+    }
+}
+
+
+/**
+ * AVX2 half precision dense layer. The samples are taken in panels of HALF_PANEL_SAMPLES
+ * that stay in the cache while every row of weights is swept over them in tiles of two
+ * rows times four samples, instead of streaming the whole batch again for every pair of
+ * rows. A single sample goes through the row blocked GEMV.
+ */
+template <kernels::HalfFormat FORMAT>
+__attribute__((target("avx2,fma,f16c")))
+static void gemvHalfAvx2(const uint16_t *a, const float *x, int n, const float *bias, float *y,
+                         int m, int k, bool relu)
+{
+    if(n == 1)
+    {
+        gemvHalfRowsAvx2<FORMAT>(a, x, bias, y, m, k, relu);
+        return;
+    }
+
+    __m256 mask = tailMaskAvx2(k);
+    for(int jc = 0 ; jc < n ; jc += HALF_PANEL_SAMPLES)
+    {
+        int end = std::min(n, jc + HALF_PANEL_SAMPLES);
+        int i = 0;
+        for( ; i + 2 <= m ; i += 2)
+        {
+            const uint16_t *rows = a + (long int) i * k;
+            int j = jc;
+            for( ; j + 4 <= end ; j += 4)
+            {
+                halfTileAvx2<FORMAT, 2, 4>(rows, x + (long int) j * k, k, mask, bias,
+                                           y + (long int) i * n + j, n, i, relu);
+            }
+            for( ; j < end ; j++)
+            {
+                halfTileAvx2<FORMAT, 2, 1>(rows, x + (long int) j * k, k, mask, bias,
+                                           y + (long int) i * n + j, n, i, relu);
+            }
+        }
+        for( ; i < m ; i++)
+        {
+            for(int j = jc ; j < end ; j++)
+            {
+                halfTileAvx2<FORMAT, 1, 1>(a + (long int) i * k, x + (long int) j * k, k, mask,
+                                           bias, y + (long int) i * n + j, n, i, relu);
+            }
+        }
+    }
+}
+
+
+/**
+ * Load sixteen 16 bit weights and widen them to floats.
+ */
+template <kernels::HalfFormat FORMAT>
+__attribute__((target("avx512f")))
+static inline __m512 widenAvx512(const uint16_t *a)
+{
+    // The zero masked forms avoid the undefined source register of the plain intrinsics
+    __m256i raw = _mm256_loadu_si256((const __m256i *) a);
+    if(FORMAT == kernels::Fp16)
+    {
+        return _mm512_maskz_cvtph_ps(0xFFFF, raw);
+    }
+    __m512i wide = _mm512_maskz_cvtepu16_epi32(0xFFFF, raw);
+    return _mm512_castsi512_ps(_mm512_maskz_slli_epi32(0xFFFF, wide, 16));
+}
+
+
+/**
+ * Widen the last k % 16 weights of a row, the same way as widenTailAvx2.
+ * @param row The row of k weights
+ * @param k The length of the row
+ * @param mask The lanes of the tail, the upper k % 16 lanes, or the lower k lanes of a row
+ *             shorter than sixteen
+ * @return The widened tail, zero in the other lanes
+ */
+template <kernels::HalfFormat FORMAT>
+__attribute__((target("avx512f")))
+static inline __m512 widenTailAvx512(const uint16_t *row, int k, __mmask16 mask)
+{
+    if(k >= 16)
+    {
+        return _mm512_maskz_mov_ps(mask, widenAvx512<FORMAT>(row + k - 16));
+    }
+    uint16_t padded[16] = {0};
+    std::memcpy(padded, row, (size_t) k * sizeof(uint16_t));
+    return widenAvx512<FORMAT>(padded);
+}
+
+
+/**
+ * The lanes widenTailAvx512 leaves the tail of a row in, like tailMaskAvx2.
+ * @param k The length of the row
+ * @return The upper k % 16 lanes, or the lower k lanes of a row shorter than sixteen
+ */
+static inline __mmask16 tailMaskAvx512(int k)
+{
+    if(k >= 16)
+    {
+        return (__mmask16) (0xFFFFu << (16 - k % 16));
+    }
+    return (__mmask16) ((1u << k) - 1);
+}
+
+
+/**
+ * AVX-512 half precision product of a single sample, four rows at a time like the float
+ * GEMV, with the same zero padded last step as the AVX2 one.
+ */
+template <kernels::HalfFormat FORMAT>
+__attribute__((target("avx512f")))
+static void gemvHalfRowsAvx512(const uint16_t *a, const float *x, const float *bias, float *y,
+                               int m, int k, bool relu)
+{
+    int tail = k % 16;
+    int body = k - tail;
+    __mmask16 mask = tailMaskAvx512(k);
+    __m512 xTail = _mm512_maskz_loadu_ps(mask, k >= 16 ? x + k - 16 : x);
+    int i = 0;
+    for( ; i + 4 <= m ; i += 4)
+    {
+        const uint16_t *r0 = a + (long int) i * k;
+        const uint16_t *r1 = r0 + k;
+        const uint16_t *r2 = r1 + k;
+        const uint16_t *r3 = r2 + k;
+        __m512 acc0 = _mm512_setzero_ps();
+        __m512 acc1 = _mm512_setzero_ps();
+        __m512 acc2 = _mm512_setzero_ps();
+        __m512 acc3 = _mm512_setzero_ps();
+        for(int p = 0 ; p < body ; p += 16)
+        {
+            __m512 xv = _mm512_loadu_ps(x + p);
+            acc0 = _mm512_fmadd_ps(widenAvx512<FORMAT>(r0 + p), xv, acc0);
+            acc1 = _mm512_fmadd_ps(widenAvx512<FORMAT>(r1 + p), xv, acc1);
+            acc2 = _mm512_fmadd_ps(widenAvx512<FORMAT>(r2 + p), xv, acc2);
+            acc3 = _mm512_fmadd_ps(widenAvx512<FORMAT>(r3 + p), xv, acc3);
+        }
+        if(tail)
+        {
+            acc0 = _mm512_fmadd_ps(widenTailAvx512<FORMAT>(r0, k, mask), xTail, acc0);
+            acc1 = _mm512_fmadd_ps(widenTailAvx512<FORMAT>(r1, k, mask), xTail, acc1);
+            acc2 = _mm512_fmadd_ps(widenTailAvx512<FORMAT>(r2, k, mask), xTail, acc2);
+            acc3 = _mm512_fmadd_ps(widenTailAvx512<FORMAT>(r3, k, mask), xTail, acc3);
+        }
+        y[i] = denseEpilogue(hsumAvx512(acc0), bias, i, relu);
+        y[i + 1] = denseEpilogue(hsumAvx512(acc1), bias, i + 1, relu);
+        y[i + 2] = denseEpilogue(hsumAvx512(acc2), bias, i + 2, relu);
+        y[i + 3] = denseEpilogue(hsumAvx512(acc3), bias, i + 3, relu);
+    }
+    for( ; i < m ; i++)
+    {
+        const uint16_t *row = a + (long int) i * k;
+        __m512 acc = _mm512_setzero_ps();
+        for(int p = 0 ; p < body ; p += 16)
+        {
+            acc = _mm512_fmadd_ps(widenAvx512<FORMAT>(row + p), _mm512_loadu_ps(x + p), acc);
+        }
+        if(tail)
+        {
+            acc = _mm512_fmadd_ps(widenTailAvx512<FORMAT>(row, k, mask), xTail, acc);
+        }
+        y[i] = denseEpilogue(hsumAvx512(acc), bias, i, relu);
+    }
+}
+
+
+/**
+ * AVX-512 tile of ROWS weight rows times COLS samples, with the same zero padded last step
+ * as halfTileAvx2.
+ */
+template <kernels::HalfFormat FORMAT, int ROWS, int COLS>
+__attribute__((target("avx512f")))
+static void halfTileAvx512(const uint16_t *a, const float *x, int k, __mmask16 mask,
+                           const float *bias, float *y, int n, int i, bool relu)
+{
+    __m512 acc[ROWS][COLS];
+    for(int r = 0 ; r < ROWS ; r++)
+    {
+        for(int c = 0 ; c < COLS ; c++)
+        {
+            acc[r][c] = _mm512_setzero_ps();
+        }
+    }
+
+    int body = k - k % 16;
+    for(int p = 0 ; p < body ; p += 16)
+    {
+        __m512 w[ROWS];
+        for(int r = 0 ; r < ROWS ; r++)
+        {
+            w[r] = widenAvx512<FORMAT>(a + (long int) r * k + p);
+        }
+        for(int c = 0 ; c < COLS ; c++)
+        {
+            __m512 xv = _mm512_loadu_ps(x + (long int) c * k + p);
+            for(int r = 0 ; r < ROWS ; r++)
+            {
+                acc[r][c] = _mm512_fmadd_ps(w[r], xv, acc[r][c]);
+            }
+        }
+    }
+    if(body < k)
+    {
+        __m512 w[ROWS];
+        for(int r = 0 ; r < ROWS ; r++)
+        {
+            w[r] = widenTailAvx512<FORMAT>(a + (long int) r * k, k, mask);
+        }
+        for(int c = 0 ; c < COLS ; c++)
+        {
+            const float *sample = x + (long int) c * k;
+            __m512 xv = _mm512_maskz_loadu_ps(mask, k >= 16 ? sample + k - 16 : sample);
+            for(int r = 0 ; r < ROWS ; r++)
+            {
+                acc[r][c] = _mm512_fmadd_ps(w[r], xv, acc[r][c]);
+            }
+        }
+    }
+
+    for(int r = 0 ; r < ROWS ; r++)
+    {
+        for(int c = 0 ; c < COLS ; c++)
+        {
+            y[(long int) r * n + c] = denseEpilogue(hsumAvx512(acc[r][c]), bias, i + r, relu);
+        }
+    }
+}
+
+
+/**
+ * AVX-512 half precision dense layer, swept over panels of samples like gemvHalfAvx2 in
+ * tiles of four rows times four samples. A single sample goes through the row blocked
+ * GEMV.
+ */
+template <kernels::HalfFormat FORMAT>
+__attribute__((target("avx512f")))
+static void gemvHalfAvx512(const uint16_t *a, const float *x, int n, const float *bias,
+                           float *y, int m, int k, bool relu)
+{
+    if(n == 1)
+    {
+        gemvHalfRowsAvx512<FORMAT>(a, x, bias, y, m, k, relu);
+        return;
+    }
+
+    __mmask16 mask = tailMaskAvx512(k);
+    for(int jc = 0 ; jc < n ; jc += HALF_PANEL_SAMPLES)
+    {
+        int end = std::min(n, jc + HALF_PANEL_SAMPLES);
+        int i = 0;
+        for( ; i + 4 <= m ; i += 4)
+        {
+            const uint16_t *rows = a + (long int) i * k;
+            int j = jc;
+            for( ; j + 4 <= end ; j += 4)
+            {
+                halfTileAvx512<FORMAT, 4, 4>(rows, x + (long int) j * k, k, mask, bias,
+                                             y + (long int) i * n + j, n, i, relu);
+            }
+            for( ; j < end ; j++)
+            {
+                halfTileAvx512<FORMAT, 4, 1>(rows, x + (long int) j * k, k, mask, bias,
+                                             y + (long int) i * n + j, n, i, relu);
+            }
+        }
+        for( ; i < m ; i++)
+        {
+            for(int j = jc ; j < end ; j++)
+            {
+                halfTileAvx512<FORMAT, 1, 1>(a + (long int) i * k, x + (long int) j * k, k, mask,
+                                             bias, y + (long int) i * n + j, n, i, relu);
+            }
+        }
+    }
+}
+
+
+/**
+ * The largest of the eight float lanes of an AVX register.
+ */
+__attribute__((target("avx2")))
+static float hmaxPsAvx2(__m256 v)
+{
+    __m128 max = _mm_max_ps(_mm256_castps256_ps128(v), _mm256_extractf128_ps(v, 1));
+    max = _mm_max_ps(max, _mm_movehl_ps(max, max));
+    max = _mm_max_ss(max, _mm_shuffle_ps(max, max, 1));
+    return _mm_cvtss_f32(max);
+}
+
+
+/**
+ * Eight quantization levels of scaled values, in the low half of the result, rounded and
+ * clamped like quantizeValue.
+ */
+__attribute__((target("avx2")))
+static inline __m128i quantizeAvx2(__m256 scaled)
+{
+    __m256 half = _mm256_or_ps(_mm256_and_ps(scaled, _mm256_set1_ps(-0.0f)),
+                               _mm256_set1_ps(0.5f));
+    __m256i level = _mm256_cvttps_epi32(_mm256_add_ps(scaled, half));
+    level = _mm256_max_epi32(_mm256_set1_epi32(-INT8_MAX_LEVEL),
+                             _mm256_min_epi32(_mm256_set1_epi32(INT8_MAX_LEVEL), level));
+    __m128i words = _mm_packs_epi32(_mm256_castsi256_si128(level),
+                                    _mm256_extracti128_si256(level, 1));
+    return _mm_packs_epi16(words, words);
+}
+
+
+/**
+ * AVX2 quantization of samples that are contiguous columns, see quantizeColumnsAvx512.
+ */
+__attribute__((target("avx2")))
+static void quantizeColumnsAvx2(const float *x, int k, int n, int csx, int8_t *q, int stride,
+                                float *inverses)
+{
+    __m256 absMask = _mm256_castsi256_ps(_mm256_set1_epi32(0x7FFFFFFF));
+    for(int j = 0 ; j < n ; j++)
+    {
+        const float *column = x + (long int) j * csx;
+        int8_t *out = q + (long int) j * stride;
+        __m256 maxAbs = _mm256_setzero_ps();
+        int p = 0;
+        for( ; p + 8 <= k ; p += 8)
+        {
+            maxAbs = _mm256_max_ps(maxAbs, _mm256_and_ps(_mm256_loadu_ps(column + p), absMask));
+        }
+        float columnMax = hmaxPsAvx2(maxAbs);
+        for( ; p < k ; p++)
+        {
+            columnMax = std::max(columnMax, std::fabs(column[p]));
+        }
+
+        float inverse = columnMax > 0 ? INT8_MAX_LEVEL / columnMax : 0;
+        __m256 inverseVector = _mm256_set1_ps(inverse);
+        for(p = 0 ; p + 8 <= k ; p += 8)
+        {
+            __m256 scaled = _mm256_mul_ps(_mm256_loadu_ps(column + p), inverseVector);
+            _mm_storel_epi64((__m128i *) (out + p), quantizeAvx2(scaled));
+        }
+        for( ; p < k ; p++)
+        {
+            out[p] = quantizeValue(column[p] * inverse);
+        }
+        inverses[j] = inverse;
+    }
+}
+
+
+/**
+ * AVX2 quantization of samples laid out as the columns of a row-major matrix, see
+ * quantizeRowsAvx512.
+ */
+__attribute__((target("avx2")))
+static void quantizeRowsAvx2(const float *x, int k, int n, int rsx, int8_t *q, int stride,
+                             float *inverses)
+{
+    __m256 absMask = _mm256_castsi256_ps(_mm256_set1_epi32(0x7FFFFFFF));
+    std::fill(inverses, inverses + n, 0.0f);
+    for(int p = 0 ; p < k ; p++)
+    {
+        const float *row = x + (long int) p * rsx;
+        int j = 0;
+        for( ; j + 8 <= n ; j += 8)
+        {
+            _mm256_storeu_ps(inverses + j, _mm256_max_ps(_mm256_loadu_ps(inverses + j),
+                    _mm256_and_ps(_mm256_loadu_ps(row + j), absMask)));
+        }
+        for( ; j < n ; j++)
+        {
+            inverses[j] = std::max(inverses[j], std::fabs(row[j]));
+        }
+    }
+    for(int j = 0 ; j < n ; j++)
+    {
+        inverses[j] = inverses[j] > 0 ? INT8_MAX_LEVEL / inverses[j] : 0;
+    }
+
+    alignas(16) int8_t levels[16];
+    for(int p = 0 ; p < k ; p++)
+    {
+        const float *row = x + (long int) p * rsx;
+        int j = 0;
+        for( ; j + 8 <= n ; j += 8)
+        {
+            __m256 scaled = _mm256_mul_ps(_mm256_loadu_ps(row + j), _mm256_loadu_ps(inverses + j));
+            _mm_store_si128((__m128i *) levels, quantizeAvx2(scaled));
+            for(int t = 0 ; t < 8 ; t++)
+            {
+                q[(long int) (j + t) * stride + p] = levels[t];
+            }
+        }
+        for( ; j < n ; j++)
+        {
+            q[(long int) j * stride + p] = quantizeValue(row[j] * inverses[j]);
+        }
+    }
+}
+
+
+
+/**
+ * The largest of the sixteen float lanes of an AVX-512 register.
+ */
+__attribute__((target("avx512f")))
+static float hmaxPsAvx512(__m512 v)
+{
+    // The masked extracts avoid the undefined source register of the plain intrinsics
+    __m512d wide = _mm512_castps_pd(v);
+    __m256d low = _mm512_mask_extractf64x4_pd(_mm256_setzero_pd(), 0xF, wide, 0);
+    __m256d high = _mm512_mask_extractf64x4_pd(_mm256_setzero_pd(), 0xF, wide, 1);
+    return hmaxPsAvx2(_mm256_max_ps(_mm256_castpd_ps(low), _mm256_castpd_ps(high)));
+}
+
+
+/**
+ * The absolute values of sixteen floats, clearing the sign bits.
+ */
+__attribute__((target("avx512f")))
+static inline __m512 absAvx512(__m512 v)
+{
+    return _mm512_castsi512_ps(_mm512_and_si512(_mm512_castps_si512(v),
+                                                _mm512_set1_epi32(0x7FFFFFFF)));
+}
+
+
+/**
+ * Sixteen quantization levels of scaled values, rounded and clamped like quantizeValue:
+ * adding a half with the sign of the value and truncating rounds halves away from zero.
+ */
+__attribute__((target("avx512f")))
+static inline __m128i quantizeAvx512(__m512 scaled)
+{
+    // The zero masked forms avoid the undefined source register of the plain intrinsics
+    __m512i sign = _mm512_and_si512(_mm512_castps_si512(scaled),
+                                    _mm512_set1_epi32((int) 0x80000000));
+    __m512 half = _mm512_castsi512_ps(_mm512_or_si512(sign, _mm512_set1_epi32(0x3F000000)));
+    __m512i level = _mm512_maskz_cvttps_epi32(0xFFFF, _mm512_maskz_add_ps(0xFFFF, scaled,
+                                                                          half));
+    level = _mm512_maskz_min_epi32(0xFFFF, level, _mm512_set1_epi32(INT8_MAX_LEVEL));
+    level = _mm512_maskz_max_epi32(0xFFFF, level, _mm512_set1_epi32(-INT8_MAX_LEVEL));
+    return _mm512_maskz_cvtepi32_epi8(0xFFFF, level);
+}
+
+
+/**
+ * AVX-512 quantization of samples that are contiguous columns, such as the transposed
+ * batch of images, one column at a time. Leaves the inverse scales in inverses.
+ */
+__attribute__((target("avx512f")))
+static void quantizeColumnsAvx512(const float *x, int k, int n, int csx, int8_t *q,
+                                  int stride, float *inverses)
+{
+    __mmask16 tail = (__mmask16) ((1u << (k % 16)) - 1);
+    int body = k - k % 16;
+    alignas(16) int8_t levels[16];
+    for(int j = 0 ; j < n ; j++)
+    {
+        const float *column = x + (long int) j * csx;
+        int8_t *out = q + (long int) j * stride;
+        __m512 maxAbs = absAvx512(_mm512_maskz_loadu_ps(tail, column + body));
+        for(int p = 0 ; p < body ; p += 16)
+        {
+            maxAbs = _mm512_maskz_max_ps(0xFFFF, maxAbs, absAvx512(_mm512_loadu_ps(column + p)));
+        }
+        float columnMax = hmaxPsAvx512(maxAbs);
+
+        float inverse = columnMax > 0 ? INT8_MAX_LEVEL / columnMax : 0;
+        __m512 inverseVector = _mm512_set1_ps(inverse);
+        for(int p = 0 ; p < body ; p += 16)
+        {
+            __m512 scaled = _mm512_maskz_mul_ps(0xFFFF, _mm512_loadu_ps(column + p),
+                                                inverseVector);
+            _mm_storeu_si128((__m128i *) (out + p), quantizeAvx512(scaled));
+        }
+        __m512 scaled = _mm512_maskz_mul_ps(0xFFFF, _mm512_maskz_loadu_ps(tail, column + body),
+                                            inverseVector);
+        _mm_store_si128((__m128i *) levels, quantizeAvx512(scaled));
+        std::memcpy(out + body, levels, (size_t) (k - body));
+        inverses[j] = inverse;
+    }
+}
+
+
+/**
+ * AVX-512 quantization of samples laid out as the columns of a row-major matrix, such as
+ * the output of a batched layer. Both passes walk X row by row, sixteen samples at a time,
+ * and the levels are written out to the quantized row of every sample. Leaves the inverse
+ * scales in inverses.
+ */
+__attribute__((target("avx512f")))
+static void quantizeRowsAvx512(const float *x, int k, int n, int rsx, int8_t *q, int stride,
+                               float *inverses)
+{
+    std::fill(inverses, inverses + n, 0.0f);
+    for(int p = 0 ; p < k ; p++)
+    {
+        const float *row = x + (long int) p * rsx;
+        int j = 0;
+        for( ; j + 16 <= n ; j += 16)
+        {
+            __m512 maxAbs = _mm512_maskz_max_ps(0xFFFF, _mm512_loadu_ps(inverses + j),
+                                                absAvx512(_mm512_loadu_ps(row + j)));
+            _mm512_storeu_ps(inverses + j, maxAbs);
+        }
+        for( ; j < n ; j++)
+        {
+            inverses[j] = std::max(inverses[j], std::fabs(row[j]));
+        }
+    }
+    for(int j = 0 ; j < n ; j++)
+    {
+        inverses[j] = inverses[j] > 0 ? INT8_MAX_LEVEL / inverses[j] : 0;
+    }
+
+    alignas(16) int8_t levels[16];
+    for(int p = 0 ; p < k ; p++)
+    {
+        const float *row = x + (long int) p * rsx;
+        int j = 0;
+        for( ; j + 16 <= n ; j += 16)
+        {
+            __m512 scaled = _mm512_maskz_mul_ps(0xFFFF, _mm512_loadu_ps(row + j),
+                                                _mm512_loadu_ps(inverses + j));
+            _mm_store_si128((__m128i *) levels, quantizeAvx512(scaled));
+            for(int t = 0 ; t < 16 ; t++)
+            {
+                q[(long int) (j + t) * stride + p] = levels[t];
+            }
+        }
+        for( ; j < n ; j++)
+        {
+            q[(long int) j * stride + p] = quantizeValue(row[j] * inverses[j]);
+        }
+    }
+}
+
+#endif //KERNELS_X86
+
+
+// ------------------------ function implementation ---------------------
+
+/**
+* The number of int8 values every quantized row of k values takes.
+* @param k The number of values in the row
+* @return The padded row stride
+*/
+int kernels::int8RowStride(int k)
+{
+    return (k + INT8_ROW_ALIGNMENT - 1) / INT8_ROW_ALIGNMENT * INT8_ROW_ALIGNMENT;
+}
+
+
+/**
+* Quantize every row of a matrix symmetrically, q = round(a / scale) with the scale
+* chosen so the largest magnitude of the row maps to INT8_MAX_LEVEL.
+* @param a The m*k row-major matrix
+* @param m The number of rows of A
+* @param k The number of columns of A
+* @param q The output, m rows of int8RowStride(k) values, the padding zeroed
+* @param scales The output, the scale of every row
+*/
+void kernels::quantizeRows(const float *a, int m, int k, int8_t *q, float *scales)
+{
+    int stride = int8RowStride(k);
+    for(int i = 0 ; i < m ; i++)
+    {
+        const float *row = a + (long int) i * k;
+        int8_t *out = q + (long int) i * stride;
+
+        float maxAbs = 0;
+        for(int p = 0 ; p < k ; p++)
+        {
+            maxAbs = std::max(maxAbs, std::fabs(row[p]));
+        }
+
+        scales[i] = maxAbs / INT8_MAX_LEVEL;
+        float inverse = maxAbs > 0 ? INT8_MAX_LEVEL / maxAbs : 0;
+        for(int p = 0 ; p < k ; p++)
+        {
+            out[p] = quantizeValue(row[p] * inverse);
+        }
+        std::memset(out + k, 0, stride - k);
+    }
+}
+
+
+/**
+* Quantize every column of a matrix the same way as a row, one scale per column. The
+* columns are written out as rows, so every sample of a batch becomes one contiguous
+* quantized vector.
+* @param x The k*n matrix, one sample per column
+* @param k The number of rows of X
+* @param n The number of columns of X
+* @param rsx The row stride of X
+* @param csx The column stride of X
+* @param q The output, n rows of int8RowStride(k) values, the padding zeroed
+* @param scales The output, the scale of every column
+*/
+void kernels::quantizeColumns(const float *x, int k, int n, int rsx, int csx, int8_t *q,
+                              float *scales)
+{
+    int stride = int8RowStride(k);
+    for(int j = 0 ; j < n ; j++)
+    {
+        std::memset(q + (long int) j * stride + k, 0, stride - k);
+    }
+
+    // Every path leaves the inverse scales in scales, which are turned into scales last
+    bool quantized = false;
+    switch(getSimdLevel())
+    {
+#ifdef KERNELS_X86
+        case Avx512:
+            if(rsx == 1)
+            {
+                quantizeColumnsAvx512(x, k, n, csx, q, stride, scales);
+                quantized = true;
+            }
+            else if(csx == 1)
+            {
+                quantizeRowsAvx512(x, k, n, rsx, q, stride, scales);
+                quantized = true;
+            }
+            break;
+        case Avx2:
+            if(rsx == 1)
+            {
+                quantizeColumnsAvx2(x, k, n, csx, q, stride, scales);
+                quantized = true;
+            }
+            else if(csx == 1)
+            {
+                quantizeRowsAvx2(x, k, n, rsx, q, stride, scales);
+                quantized = true;
+            }
+            break;
+#endif
+        default:
+            break;
+    }
+
+    if(!quantized)
+    {
+        // Both passes walk X row by row, scales holds the column maxima and then their inverses
+        std::fill(scales, scales + n, 0.0f);
+        for(int p = 0 ; p < k ; p++)
+        {
+            const float *row = x + (long int) p * rsx;
+            for(int j = 0 ; j < n ; j++)
+            {
+                scales[j] = std::max(scales[j], std::fabs(row[(long int) j * csx]));
+            }
+        }
+        for(int j = 0 ; j < n ; j++)
+        {
+            scales[j] = scales[j] > 0 ? INT8_MAX_LEVEL / scales[j] : 0;
+        }
+        for(int p = 0 ; p < k ; p++)
+        {
+            const float *row = x + (long int) p * rsx;
+            for(int j = 0 ; j < n ; j++)
+            {
+                q[(long int) j * stride + p] = quantizeValue(row[(long int) j * csx] * scales[j]);
+            }
+        }
+    }
+
+    for(int j = 0 ; j < n ; j++)
+    {
+        scales[j] = scales[j] > 0 ? 1 / scales[j] : 0;
+    }
+}
+
+
+/**
+* A whole dense layer Y = act(A * X + bias) on int8 weights and int8 samples. Every
+* dot product is exact in 32 bit integers and is scaled back to float before the bias.
+* @param a The m quantized rows of A, int8RowStride(k) values each
+* @param scales The scale of every row of A
+* @param x The n quantized samples, int8RowStride(k) values each
+* @param xScales The scale of every sample
+* @param n The number of samples
+* @param bias The bias vector of m elements, or nullptr for none
+* @param y The m*n row-major output, column j for sample j, overwritten
+* @param m The number of rows of A
+* @param k The number of columns of A
+* @param relu Whether to apply ReLU to the output
+*/
+void kernels::denseForwardInt8(const int8_t *a, const float *scales, const int8_t *x,
+                               const float *xScales, int n, const float *bias, float *y,
+                               int m, int k, bool relu)
+{
+    int stride = int8RowStride(k);
+    switch(getSimdLevel())
+    {
+#ifdef KERNELS_X86
+        case Avx512:
+            if(hasAvx512Vnni())
+            {
+                gemmInt8Vnni(a, scales, x, xScales, n, bias, y, m, stride, relu);
+                return;
+            }
+            break;
+        default:
+            break;
+#endif
+    }
+
+    // One sample at a time, every kernel walks all the rows for it
+    for(int j = 0 ; j < n ; j++)
+    {
+        const int8_t *sample = x + (long int) j * stride;
+        switch(getSimdLevel())
+        {
+#ifdef KERNELS_X86
+            case Avx512:
+            case Avx2:
+                gemvInt8Avx2(a, scales, sample, xScales[j], bias, y + j, n, m, stride, relu);
+                break;
+#endif
+            default:
+                for(int i = 0 ; i < m ; i++)
+                {
+                    int32_t sum = dotInt8Scalar(a + (long int) i * stride, sample, stride);
+                    y[(long int) i * n + j] = int8Epilogue(sum, scales[i] * xScales[j], bias, i,
+                                                           relu);
+                }
+        }
+    }
+}
+
+
+/**
+* Round floats to the nearest 16 bit value of the given format, ties to even.
+* @param a The values to narrow
+* @param n The number of values
+* @param format The 16 bit encoding to produce
+* @param out The output, n values
+*/
+void kernels::narrowToHalf(const float *a, long int n, HalfFormat format, uint16_t *out)
+{
+    for(long int i = 0 ; i < n ; i++)
+    {
+        out[i] = format == Fp16 ? narrowFp16(a[i]) : narrowBf16(a[i]);
+    }
+}
+
+
+/**
+* A whole dense layer Y = act(A * X + bias) with A stored in 16 bits. Every weight is
+* widened once per tile of samples and multiplied in float, so the result only
+* differs from the float kernel by the rounding of the stored weights.
+* @param a The m*k row-major weights matrix in the given format
+* @param format The 16 bit encoding of A
+* @param x The n samples, k contiguous values each
+* @param n The number of samples
+* @param bias The bias vector of m elements, or nullptr for none
+* @param y The m*n row-major output, column j for sample j, overwritten
+* @param m The number of rows of A
+* @param k The number of columns of A
+* @param relu Whether to apply ReLU to the output
+*/
+void kernels::denseForwardHalf(const uint16_t *a, HalfFormat format, const float *x, int n,
+                               const float *bias, float *y, int m, int k, bool relu)
+{
+    switch(getSimdLevel())
+    {
+#ifdef KERNELS_X86
+        case Avx512:
+            if(format == Fp16)
+            {
+                gemvHalfAvx512<Fp16>(a, x, n, bias, y, m, k, relu);
+                return;
+            }
+            gemvHalfAvx512<Bf16>(a, x, n, bias, y, m, k, relu);
+            return;
+        case Avx2:
+            if(format == Bf16)
+            {
+                gemvHalfAvx2<Bf16>(a, x, n, bias, y, m, k, relu);
+                return;
+            }
+            if(hasF16c())
+            {
+                gemvHalfAvx2<Fp16>(a, x, n, bias, y, m, k, relu);
+                return;
+            }
+            break;
+#endif
+        default:
+            break;
+    }
+
+    gemvHalfScalar(a, format, x, n, bias, y, m, k, relu);
+}
@@ -0,0 +1,143 @@
+/**
+ * @file LowPrecisionKernels.h
+ * @author  Liron Gershuny <liron.gershuny@mail.huji.ac.il>
+ * @version 1.0
+ * @date 25 Dec 2019
+ *
+ * @brief Define the dense layer kernels that read weights stored in fewer than 32 bits.
+ *
+ * @section LICENSE
+ * This program is not a free software; bla bla bla...
+ *
+ * @section DESCRIPTION
+ * Int8 weights are quantized once, row by row, and the layer input is quantized per
+ * sample right before the product. The products are accumulated in integers and scaled
+ * back to floats before the bias and the activation. Half precision weights are stored in
+ * 16 bits and widened to floats in registers, right before they are multiplied.
+ * Input  : Quantized or half precision weights and a float input
+ * Process: Integer or widened float dot products, dispatched at runtime
+ * Output : The float layer output written into a caller supplied buffer
+ */
+
+#ifndef LOW_PRECISION_KERNELS_H
+#define LOW_PRECISION_KERNELS_H
+
+// ------------------------------ includes ------------------------------
+#include <cstdint>
+
+
+// -------------------------- const definitions -------------------------
+
+/*
+ * @def INT8_ROW_ALIGNMENT 64
+ * @brief Quantized rows are zero padded to a multiple of this many values, so the vector
+ *        loops never need a tail
+ */
+#define INT8_ROW_ALIGNMENT 64
+
+/*
+ * @def INT8_MAX_LEVEL 127
+ * @brief The largest quantized magnitude, -128 is never used so negating a value is exact
+ */
+#define INT8_MAX_LEVEL 127
+
+
+// ------------------------- function definitions -----------------------
+
+namespace kernels
+{
+    /**
+     * @enum HalfFormat
+     * @brief The 16 bit float encodings weights can be stored in.
+     */
+    enum HalfFormat
+    {
+        Fp16,
+        Bf16
+    };
+
+
+    /**
+     * The number of int8 values every quantized row of k values takes.
+     * @param k The number of values in the row
+     * @return The padded row stride
+     */
+    int int8RowStride(int k);
+
+
+    /**
+     * Quantize every row of a matrix symmetrically, q = round(a / scale) with the scale
+     * chosen so the largest magnitude of the row maps to INT8_MAX_LEVEL.
+     * @param a The m*k row-major matrix
+     * @param m The number of rows of A
+     * @param k The number of columns of A
+     * @param q The output, m rows of int8RowStride(k) values, the padding zeroed
+     * @param scales The output, the scale of every row
+     */
+    void quantizeRows(const float *a, int m, int k, int8_t *q, float *scales);
+
+
+    /**
+     * Quantize every column of a matrix the same way as a row, one scale per column. The
+     * columns are written out as rows, so every sample of a batch becomes one contiguous
+     * quantized vector.
+     * @param x The k*n matrix, one sample per column
+     * @param k The number of rows of X
+     * @param n The number of columns of X
+     * @param rsx The row stride of X
+     * @param csx The column stride of X
+     * @param q The output, n rows of int8RowStride(k) values, the padding zeroed
+     * @param scales The output, the scale of every column
+     */
+    void quantizeColumns(const float *x, int k, int n, int rsx, int csx, int8_t *q,
+                         float *scales);
+
+
+    /**
+     * A whole dense layer Y = act(A * X + bias) on int8 weights and int8 samples. Every
+     * dot product is exact in 32 bit integers and is scaled back to float before the bias.
+     * @param a The m quantized rows of A, int8RowStride(k) values each
+     * @param scales The scale of every row of A
+     * @param x The n quantized samples, int8RowStride(k) values each
+     * @param xScales The scale of every sample
+     * @param n The number of samples
+     * @param bias The bias vector of m elements, or nullptr for none
+     * @param y The m*n row-major output, column j for sample j, overwritten
+     * @param m The number of rows of A
+     * @param k The number of columns of A
+     * @param relu Whether to apply ReLU to the output
+     */
+    void denseForwardInt8(const int8_t *a, const float *scales, const int8_t *x,
+                          const float *xScales, int n, const float *bias, float *y, int m,
+                          int k, bool relu);
+
+
+    /**
+     * Round floats to the nearest 16 bit value of the given format, ties to even.
+     * @param a The values to narrow
+     * @param n The number of values
+     * @param format The 16 bit encoding to produce
+     * @param out The output, n values
+     */
+    void narrowToHalf(const float *a, long int n, HalfFormat format, uint16_t *out);
+
+
+    /**
+     * A whole dense layer Y = act(A * X + bias) with A stored in 16 bits. Every weight is
+     * widened once per tile of samples and multiplied in float, so the result only
+     * differs from the float kernel by the rounding of the stored weights.
+     * @param a The m*k row-major weights matrix in the given format
+     * @param format The 16 bit encoding of A
+     * @param x The n samples, k contiguous values each
+     * @param n The number of samples
+     * @param bias The bias vector of m elements, or nullptr for none
+     * @param y The m*n row-major output, column j for sample j, overwritten
+     * @param m The number of rows of A
+     * @param k The number of columns of A
+     * @param relu Whether to apply ReLU to the output
+     */
+    void denseForwardHalf(const uint16_t *a, HalfFormat format, const float *x, int n,
+                          const float *bias, float *y, int m, int k, bool relu);
+}
+
+#endif //LOW_PRECISION_KERNELS_H
@@ -0,0 +1,137 @@
+/**
+ * @file MappedFile.cpp
+ * @author  Liron Gershuny <liron.gershuny@mail.huji.ac.il>
+ * @version 1.0
+ * @date 25 Dec 2019
+ *
+ * @brief Define a read only memory mapping of a whole file.
+ *
+ * @section LICENSE
+ * This program is not a free software; bla bla bla...
+ *
+ * @section DESCRIPTION
+ * The class maps a binary file into memory so weights and images can be copied or viewed
+ * in one go instead of being read through a stream value by value.
+ * Input  : A file path
+ * Process: Maps the file, or reads it whole where mapping is not available
+ * Output : A pointer to the file bytes and their count
+ */
+
+// ------------------------------ includes ------------------------------
+#include "MappedFile.h"
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define MAPPED_FILE_POSIX
+#else
+#include <fstream>
+#endif
+
+
+// ------------------------ class implementation ------------------------
+
+/**
+* Constructor that opens the given file, check isOpen for the result.
+* @param path The path of the file
+*/
+MappedFile::MappedFile(const std::string &path) : MappedFile()
+{
+    open(path);
+}
+
+
+/**
+* Destructor, unmaps the file.
+*/
+MappedFile::~MappedFile()
+{
+    close();
+}
+
+
+/**
+* Map the given file, closing the previous one.
+* @param path The path of the file
+* @return true - the file is mapped
+*         false - the file could not be opened or mapped
+*/
+bool MappedFile::open(const std::string &path)
+{
+    close();
+
+#ifdef MAPPED_FILE_POSIX
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if(fd < 0)
+    {
+        return false;
+    }
+
+    struct stat info;
+    if(fstat(fd, &info) != 0 || !S_ISREG(info.st_mode))
+    {
+        ::close(fd);
+        return false;
+    }
+
+    length = (size_t) info.st_size;
+    if(length > 0)
+    {
+        void *address = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+        if(address == MAP_FAILED)
+        {
+            ::close(fd);
+            length = 0;
+            return false;
+        }
+        madvise(address, length, MADV_SEQUENTIAL);
+        bytes = (const char *) address;
+        mapped = true;
+    }
+
+    // The mapping stays valid after the descriptor is closed
+    ::close(fd);
+#else
+    std::ifstream is(path, std::ios::in | std::ios::binary | std::ios::ate);
+    if(!is.is_open())
+    {
+        return false;
+    }
+
+    length = (size_t) is.tellg();
+    fallback.resize(length);
+    is.seekg(0, std::ios_base::beg);
+    if(length > 0 && !is.read(fallback.data(), length))
+    {
+        fallback.clear();
+        length = 0;
+        return false;
+    }
+    bytes = fallback.data();
+#endif
+
+    opened = true;
+    return true;
+}
+
+
+/**
+* Unmap the file, does nothing when no file is open.
+*/
+void MappedFile::close()
+{
+#ifdef MAPPED_FILE_POSIX
+    if(mapped)
+    {
+        munmap((void *) bytes, length);
+    }
+#endif
+
+    fallback.clear();
+    bytes = nullptr;
+    length = 0;
+    opened = false;
+    mapped = false;
+}
@@ -0,0 +1,105 @@
+/**
+ * @file MappedFile.h
+ * @author  Liron Gershuny <liron.gershuny@mail.huji.ac.il>
+ * @version 1.0
+ * @date 25 Dec 2019
+ *
+ * @brief Define a read only memory mapping of a whole file.
+ *
+ * @section LICENSE
+ * This program is not a free software; bla bla bla...
+ *
+ * @section DESCRIPTION
+ * The class maps a binary file into memory so weights and images can be copied or viewed
+ * in one go instead of being read through a stream value by value.
+ * Input  : A file path
+ * Process: Maps the file, or reads it whole where mapping is not available
+ * Output : A pointer to the file bytes and their count
+ */
+
+#ifndef MAPPED_FILE_H
+#define MAPPED_FILE_H
+
+// ------------------------------ includes ------------------------------
+#include <cstddef>
+#include <string>
+#include <vector>
+
+
+// -------------------------- class definitions -------------------------
+
+/**
+ * A read only view of a whole file. The mapping lives as long as the object.
+ */
+class MappedFile
+{
+private:
+    const char *bytes;
+    size_t length;
+    bool opened;
+    bool mapped;
+    std::vector<char> fallback;
+
+public:
+
+    /**
+     * Default constructor of a closed file.
+     */
+    MappedFile() : bytes(nullptr), length(0), opened(false), mapped(false) {}
+
+
+    /**
+     * Constructor that opens the given file, check isOpen for the result.
+     * @param path The path of the file
+     */
+    explicit MappedFile(const std::string &path);
+
+
+    /**
+     * Destructor, unmaps the file.
+     */
+    ~MappedFile();
+
+
+    MappedFile(const MappedFile &) = delete;
+    MappedFile &operator=(const MappedFile &) = delete;
+
+
+    /**
+     * Map the given file, closing the previous one.
+     * @param path The path of the file
+     * @return true - the file is mapped
+     *         false - the file could not be opened or mapped
+     */
+    bool open(const std::string &path);
+
+
+    /**
+     * Unmap the file, does nothing when no file is open.
+     */
+    void close();
+
+
+    /**
+     * Getter of whether a file is open.
+     * @return Whether a file is open
+     */
+    bool isOpen() const { return opened; }
+
+
+    /**
+     * Getter of the file contents.
+     * @return A pointer to the first byte of the file
+     */
+    const char *data() const { return bytes; }
+
+
+    /**
+     * Getter of the file size.
+     * @return The number of bytes in the file
+     */
+    size_t size() const { return length; }
+
+};
+
+#endif //MAPPED_FILE_H
@@ -20,36 +20,47 @@
 
 // ------------------------------ includes ------------------------------
 #include "Matrix.h"
+#include "MatrixKernels.h"
+#include "MatrixPool.h"
+#include "MatrixView.h"
+#include <algorithm>
+#include <new>
+#include <string>
+#include <utility>
 
 
 // ------------------------ class implementation ------------------------
 
 /**
-* Constructor for matrix of rows*cols dimensions. Init all elements to zero.
-* @param rows The number of rows
-* @param cols The number of columns
+* Take a buffer from the pool for the current dimensions and store it and its capacity.
+* The previous buffer must already have been released. Throws std::bad_alloc if the
+* allocation fails.
 */
-Matrix::Matrix(int rows, int cols) : dimensions({rows, cols})
+void Matrix::_allocate()
 {
-    if(rows <= 0 || cols <= 0)
-    {
-        std::cerr << INVALID_MATRIX_INIT_DIMENSIONS_MSG << std::endl;
-        exit(EXIT_STATUS);
-    }
-
-    dimensions.rows = rows;
-    dimensions.cols = cols;
-    pMatrix = new float[rows * cols];
+    pMatrix = MatrixPool::acquire(dimensions.rows * dimensions.cols, capacity);
     if(pMatrix == nullptr)
     {
-        std::cerr << ALLOCATION_FAILED_MSG << std::endl;
-        exit(EXIT_STATUS);
+        throw std::bad_alloc();
     }
+}
+
 
-    for(int i = 0 ; i < rows * cols ; i++)
+/**
+* Constructor for matrix of rows*cols dimensions. Init all elements to zero. The buffer
+* comes from MatrixPool and is aligned to MATRIX_POOL_ALIGNMENT bytes.
+* @param rows The number of rows
+* @param cols The number of columns
+*/
+Matrix::Matrix(int rows, int cols) : dimensions({rows, cols}), pMatrix(nullptr), capacity(0)
+{
+    if(rows <= 0 || cols <= 0)
     {
-        pMatrix[i] = INITIALIZE_VALUE;
+        throw std::invalid_argument(INVALID_MATRIX_INIT_DIMENSIONS_MSG);
     }
+
+    _allocate();
+    std::fill_n(pMatrix, rows * cols, (float) INITIALIZE_VALUE);
 }
 
 
@@ -57,25 +68,53 @@ Matrix::Matrix(int rows, int cols) : dimensions({rows, cols})
 * Copy constructor that construct matrix from given matrix.
 * @param m The given matrix needed to be copied
 */
-Matrix::Matrix(const Matrix &m) : Matrix(m.dimensions.rows, m.dimensions.cols)
+Matrix::Matrix(const Matrix &m) : dimensions(m.dimensions), pMatrix(nullptr), capacity(0)
 {
-    for(int i = 0 ; i < dimensions.rows * dimensions.cols ; i++)
-    {
-        pMatrix[i] = m.pMatrix[i];
-    }
+    _allocate();
+    std::copy_n(m.pMatrix, dimensions.rows * dimensions.cols, pMatrix);
 }
 
 
 /**
-* A destructor of matrix. Will delete all allocated memory.
+* Constructor that copies the values of a view into a new contiguous matrix.
+* @param view The view to copy, in its own shape
 */
-Matrix::~Matrix()
+Matrix::Matrix(const MatrixView &view) : dimensions({view.getRows(), view.getCols()}),
+pMatrix(nullptr), capacity(0)
 {
-    if(pMatrix != nullptr)
+    _allocate();
+    for(int i = 0 ; i < dimensions.rows ; i++)
     {
-        delete [] pMatrix;
+        for(int j = 0 ; j < dimensions.cols ; j++)
+        {
+            pMatrix[(long int) i * dimensions.cols + j] =
+                    view.data()[(long int) i * view.getRowStride() +
+                                (long int) j * view.getColStride()];
+        }
     }
+}
 
+
+/**
+* Move constructor that takes over the buffer of the given matrix without copying it.
+* The given matrix is left empty and may only be assigned to or destroyed.
+* @param m The given matrix needed to be moved
+*/
+Matrix::Matrix(Matrix &&m) noexcept : dimensions(m.dimensions), pMatrix(m.pMatrix),
+capacity(m.capacity)
+{
+    m.dimensions = {0, 0};
+    m.pMatrix = nullptr;
+    m.capacity = 0;
+}
+
+
+/**
+* A destructor of matrix. Gives the buffer back to the pool.
+*/
+Matrix::~Matrix()
+{
+    MatrixPool::release(pMatrix, capacity);
     pMatrix = nullptr;
 }
 
@@ -93,6 +132,31 @@ Matrix &Matrix::vectorize()
 }
 
 
+/**
+* Change the matrix dimensions to rows*cols. The buffer is reused whenever it is large
+* enough for the new dimensions, otherwise a new zeroed buffer is allocated. A reused
+* buffer keeps its old values.
+* @param rows The new number of rows
+* @param cols The new number of columns
+*/
+void Matrix::resize(int rows, int cols)
+{
+    if(rows <= 0 || cols <= 0)
+    {
+        throw std::invalid_argument(INVALID_MATRIX_INIT_DIMENSIONS_MSG);
+    }
+
+    if(rows * cols > capacity)
+    {
+        *this = Matrix(rows, cols);
+        return;
+    }
+
+    dimensions.rows = rows;
+    dimensions.cols = cols;
+}
+
+
 /**
 * Prints matrix elements, no return value. Prints space after each element (incl. last
 * element in the row), prints newline after each row (incl. last row)
@@ -101,9 +165,10 @@ void Matrix::plainPrint() const
 {
     for(int i = 0 ; i < dimensions.rows ; i++)
     {
+        const float *values = row(i);
         for(int j = 0 ; j < dimensions.cols ; j++)
         {
-            std::cout << pMatrix[i * dimensions.cols + j] << " ";
+            std::cout << values[j] << " ";
         }
 
         std::cout << std::endl;
@@ -112,7 +177,8 @@ void Matrix::plainPrint() const
 
 
 /**
-* Assignment operator overriding of one matrix to another
+* Assignment operator overriding of one matrix to another. The buffer of *this is kept
+* whenever it is large enough for the other matrix.
 * @param other The matrix we want to assign to *this
 * @return The matrix after assign it with other matrix
 */
@@ -123,135 +189,130 @@ Matrix &Matrix::operator=(const Matrix &other)
         return *this;
     }
 
-    delete [] pMatrix;
-    dimensions.rows = other.dimensions.rows;
-    dimensions.cols = other.dimensions.cols;
-    pMatrix = new float[other.dimensions.rows * other.dimensions.cols];
-    if(pMatrix == nullptr)
+    dimensions = other.dimensions;
+    if(dimensions.rows * dimensions.cols > capacity)
     {
-        std::cerr << ALLOCATION_FAILED_MSG << std::endl;
-        exit(EXIT_STATUS);
+        MatrixPool::release(pMatrix, capacity);
+        _allocate();
     }
 
-    for(int i = 0 ; i < dimensions.rows * dimensions.cols ; i++)
-    {
-        pMatrix[i] = other.pMatrix[i];
-    }
+    std::copy_n(other.pMatrix, dimensions.rows * dimensions.cols, pMatrix);
 
     return *this;
 }
 
 
 /**
-* Matrix multiplication operator overriding between two matrix
-* @param other A matrix we want to multiply ours with
-* @return Our matrix after multiplication with the given one
+* Move assignment operator, exchanges the buffers of the two matrices
+* @param other The matrix we want to move into *this
+* @return The matrix after taking over the other matrix buffer
 */
-Matrix Matrix::operator*(Matrix const &other) const
+Matrix &Matrix::operator=(Matrix &&other) noexcept
 {
-    if(dimensions.cols != other.dimensions.rows)
-    {
-        std::cerr << INVALID_MATRIX_MULTIPLICATION_DIMENSIONS_MSG << std::endl;
-        exit(EXIT_STATUS);
-    }
-
-    Matrix newMatrix(dimensions.rows, other.dimensions.cols);
-
-    for(int i = 0 ; i < dimensions.rows ; i++)
-    {
-        for(int j = 0 ; j < other.dimensions.cols ; j++)
-        {
-            float result = 0;
-            for(int k = 0 ; k < dimensions.cols ; k++)
-            {
-                result = result + pMatrix[i * dimensions.cols + k] *
-                         other.pMatrix[k * other.dimensions.cols + j];
-            }
-            newMatrix.pMatrix[i * other.dimensions.cols + j] = result;
-        }
-    }
-
-    return newMatrix;
+    std::swap(dimensions, other.dimensions);
+    std::swap(pMatrix, other.pMatrix);
+    std::swap(capacity, other.capacity);
+    return *this;
 }
 
 
 /**
-* Scalar multiplication on the right operator overriding
-* @param scalar The given scalar we want to multiply our matrix with
-* @return Our matrix after multiply it with the given scalar from the right
+* Matrix multiplication into an existing matrix, so repeated products reuse its buffer.
+* The result is resized if needed and must not be one of the operands.
+* @param other A matrix we want to multiply ours with
+* @param result The matrix that receives the product
 */
-Matrix Matrix::operator*(const float &scalar) const
+void Matrix::multiplyInto(const Matrix &other, Matrix &result) const
 {
-    Matrix newMatrix(dimensions.rows, dimensions.cols);
+    if(dimensions.cols != other.dimensions.rows)
+    {
+        throw std::invalid_argument(INVALID_MATRIX_MULTIPLICATION_DIMENSIONS_MSG);
+    }
 
-    for(int i = 0 ; i < dimensions.rows * dimensions.cols ; i++)
+    if(&result == this || &result == &other)
     {
-        newMatrix.pMatrix[i] = pMatrix[i] * scalar;
+        result = *this * other;
+        return;
     }
 
-    return newMatrix;
+    result.resize(dimensions.rows, other.dimensions.cols);
+    kernels::gemm(pMatrix, other.pMatrix, result.pMatrix, dimensions.rows,
+                  other.dimensions.cols, dimensions.cols);
 }
 
 
 /**
-* Scalar multiplication on the left operator overriding
-* @param scalar The given scalar we want to multiply given matrix with
-* @param other The given matrix to multiply it from the left
-* @return A new matrix represents the given matrix multiply be the scalar from the left
+* Matrix multiplication by a view into an existing matrix, see multiplyInto above.
+* @param other A view we want to multiply ours with
+* @param result The matrix that receives the product
 */
-Matrix operator*(const float &scalar, const Matrix &other)
+void Matrix::multiplyInto(const MatrixView &other, Matrix &result) const
 {
-    Matrix newMatrix(other.dimensions.rows , other.dimensions.cols);
+    if(dimensions.cols != other.getRows())
+    {
+        throw std::invalid_argument(INVALID_MATRIX_MULTIPLICATION_DIMENSIONS_MSG);
+    }
 
-    for( int i = 0 ; i < other.dimensions.rows * other.dimensions.cols ; i++)
+    if(&result == this || other.overlaps(result))
     {
-        newMatrix.pMatrix[i] = other.pMatrix[i] * scalar;
+        result = MatrixView(*this) * other;
+        return;
     }
 
-    return newMatrix;
+    result.resize(dimensions.rows, other.getCols());
+    kernels::gemmStrided(pMatrix, dimensions.cols, 1, other.data(), other.getRowStride(),
+                         other.getColStride(), result.pMatrix, dimensions.rows, other.getCols(),
+                         dimensions.cols);
 }
 
 
 /**
-* Matrix addition operator overriding between two matrix
+* Matrix addition accumulation operator overriding of given matrix to ours
 * @param other The second matrix we want to add to ours
-* @return A new matrix represents the addition of our matrix with the given one
+* @return Our matrix after addition of the given one
 */
-Matrix Matrix::operator+(const Matrix &other) const
+Matrix &Matrix::operator+=(const Matrix &other)
 {
     if(dimensions.rows != other.dimensions.rows || dimensions.cols != other.dimensions.cols)
     {
-        std::cerr << INVALID_MATRIX_ADDITION_DIMENSIONS_MSG << std::endl;
-        exit(EXIT_STATUS);
+        throw std::invalid_argument(INVALID_MATRIX_ADDITION_DIMENSIONS_MSG);
     }
 
-    Matrix newMatrix(dimensions.rows, dimensions.cols);
-
-    for(int i = 0 ; i < dimensions.rows * dimensions.cols ; i++)
-    {
-        newMatrix.pMatrix[i] = pMatrix[i] + other.pMatrix[i];
-    }
+    kernels::add(pMatrix, other.pMatrix, pMatrix, dimensions.rows * dimensions.cols);
 
-    return newMatrix;
+    return *this;
 }
 
 
 /**
-* Matrix addition accumulation operator overriding of given matrix to ours
-* @param other The second matrix we want to add to ours
+* Matrix addition accumulation of the values of a view to ours
+* @param other The view we want to add to ours
 * @return Our matrix after addition of the given one
 */
-Matrix &Matrix::operator+=(const Matrix &other)
+Matrix &Matrix::operator+=(const MatrixView &other)
 {
-    if(dimensions.rows != other.dimensions.rows || dimensions.cols != other.dimensions.cols)
+    if(dimensions.rows != other.getRows() || dimensions.cols != other.getCols())
+    {
+        throw std::invalid_argument(INVALID_MATRIX_ADDITION_DIMENSIONS_MSG);
+    }
+
+    if(other.overlaps(*this) && !(other.isContiguous() && other.data() == pMatrix))
+    {
+        return *this += Matrix(other);
+    }
+
+    if(other.isContiguous())
     {
-        std::cerr << INVALID_MATRIX_ADDITION_DIMENSIONS_MSG << std::endl;
-        exit(EXIT_STATUS);
+        kernels::add(pMatrix, other.data(), pMatrix, dimensions.rows * dimensions.cols);
+        return *this;
     }
 
-    for(int i = 0 ; i < dimensions.rows * dimensions.cols ; i++)
+    for(int i = 0 ; i < dimensions.rows ; i++)
     {
-        pMatrix[i] += other.pMatrix[i];
+        for(int j = 0 ; j < dimensions.cols ; j++)
+        {
+            pMatrix[(long int) i * dimensions.cols + j] += other(i, j);
+        }
     }
 
     return *this;
@@ -259,55 +320,51 @@ Matrix &Matrix::operator+=(const Matrix &other)
 
 
 /**
-* The non-const implementation of parenthesis indexing operator
-* to get the m(i,j) element in the matrix
+* The checked access to the m(i,j) element in the matrix, throws std::out_of_range for
+* indices outside the matrix
 * @param i The index of the row
 * @param j The index of the column
 * @return The i,j element in the matrix
 */
-float &Matrix::operator()(const int i, const int j)
+float &Matrix::at(const int i, const int j)
 {
     if(i < 0 || i >= dimensions.rows || j < 0 || j >= dimensions.cols)
     {
-        std::cerr << INVALID_INPUT_DIMENSIONS_MSG << std::endl;
-        exit(EXIT_STATUS);
+        throw std::out_of_range(INVALID_INPUT_DIMENSIONS_MSG);
     }
 
-    return pMatrix[i * dimensions.cols + j];
+    return pMatrix[(long int) i * dimensions.cols + j];
 }
 
 
 /**
-* The const implementation of parenthesis indexing operator
-* to get the m(i,j) element in the matrix
+* The const checked access to the m(i,j) element in the matrix, see at(i, j) above
 * @param i The index of the row
 * @param j The index of the column
 * @return The i,j element in the matrix
 */
-const float &Matrix::operator()(const int i, const int j) const
+const float &Matrix::at(const int i, const int j) const
 {
     if(i < 0 || i >= dimensions.rows || j < 0 || j >= dimensions.cols)
     {
-        std::cerr << INVALID_INPUT_DIMENSIONS_MSG << std::endl;
-        exit(EXIT_STATUS);
+        throw std::out_of_range(INVALID_INPUT_DIMENSIONS_MSG);
     }
 
-    return pMatrix[i * dimensions.cols + j];
+    return pMatrix[(long int) i * dimensions.cols + j];
 }
 
 
 /**
-* The non-const implementation of brackets indexing operator
-* give an excess to the m[i] element in the matrix
+* The checked access to the m[i] element in the matrix, throws std::out_of_range for
+* an index outside the matrix
 * @param i The index we want to get excess to
 * @return The i'th element in the matrix
 */
-float &Matrix::operator[](const int i)
+float &Matrix::at(const int i)
 {
     if(i < 0 || i >= dimensions.rows * dimensions.cols)
     {
-        std::cerr << INVALID_INPUT_DIMENSIONS_MSG << std::endl;
-        exit(EXIT_STATUS);
+        throw std::out_of_range(INVALID_INPUT_DIMENSIONS_MSG);
     }
 
     return pMatrix[i];
@@ -315,17 +372,15 @@ float &Matrix::operator[](const int i)
 
 
 /**
-* The const implementation of brackets indexing operator
-* give an excess to the m[i] element in the matrix
+* The const checked access to the m[i] element in the matrix, see at(i) above
 * @param i The index we want to get excess to
 * @return The i'th element in the matrix
 */
-const float &Matrix::operator[](const int i) const
+const float &Matrix::at(const int i) const
 {
     if(i < 0 || i >= dimensions.rows * dimensions.cols)
     {
-        std::cerr << INVALID_INPUT_DIMENSIONS_MSG << std::endl;
-        exit(EXIT_STATUS);
+        throw std::out_of_range(INVALID_INPUT_DIMENSIONS_MSG);
     }
 
     return pMatrix[i];
@@ -347,19 +402,14 @@ std::istream &operator>>(std::istream &is, Matrix &other)
     unsigned int matrixSize = other.dimensions.rows * other.dimensions.cols * sizeof(float);
     if((unsigned int) length != matrixSize)
     {
-        std::cerr << FILE_DIMENSIONS_DOESNT_MATCH_MSG << std::endl;
-        exit(EXIT_STATUS);
+        throw std::runtime_error(FILE_DIMENSIONS_DOESNT_MATCH_MSG);
     }
 
-    for(int i = 0 ; i < other.dimensions.rows * other.dimensions.cols ; i++)
-    {
-        is.read((char *) &other[i], sizeof(float));
-    }
+    is.read((char *) other.pMatrix, matrixSize);
 
     if(is.eof() || !is.good())
     {
-        std::cerr << INVALID_INPUT_FILE_MSG << std::endl;
-        exit(EXIT_STATUS);
+        throw std::runtime_error(INVALID_INPUT_FILE_MSG);
     }
 
     return is;
@@ -377,25 +427,21 @@ std::ostream &operator<<(std::ostream &os, const Matrix &other)
 {
     if(!os.good())
     {
-        std::cerr << INVALID_OUTPUT_STREAM_MSG << std::endl;
-        exit(EXIT_STATUS);
+        throw std::runtime_error(INVALID_OUTPUT_STREAM_MSG);
     }
 
+    std::string line(2 * other.dimensions.cols, ' ');
     for(int i = 0 ; i < other.dimensions.rows ; i++)
     {
+        const float *row = other.row(i);
         for(int j = 0 ; j < other.dimensions.cols ; j++)
         {
-            if(other(i, j) <= 0.1f)
-            {
-                os << "  ";
-            }
-            else
-            {
-                os << "**";
-            }
+            char cell = row[j] <= 0.1f ? ' ' : '*';
+            line[2 * j] = cell;
+            line[2 * j + 1] = cell;
         }
 
-        os << std::endl;
+        os << line << std::endl;
     }
 
     return os;
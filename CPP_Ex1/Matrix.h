@@ -24,6 +24,7 @@
 
 // ------------------------------ includes ------------------------------
 #include <iostream>
+#include <stdexcept>
 
 
 // -------------------------- const definitions -------------------------
@@ -36,10 +37,24 @@
 
 /*
  * @def EXIT_STATUS 1
- * @brief The exit status when we get an error
+ * @brief The exit status of the programs when they catch an error
  */
 #define EXIT_STATUS 1
 
+/*
+ * @def MATRIX_CHECK_BOUNDS
+ * @brief Whether operator() and operator[] check their indices. Both builds set it: cmake
+ *        turns it on for Debug builds or with MLP_CHECK_BOUNDS, make with CHECK_BOUNDS=1,
+ *        and it falls back to NDEBUG elsewhere. at() always checks
+ */
+#ifndef MATRIX_CHECK_BOUNDS
+#ifdef NDEBUG
+#define MATRIX_CHECK_BOUNDS 0
+#else
+#define MATRIX_CHECK_BOUNDS 1
+#endif
+#endif
+
 /*
  * @def INVALID_MATRIX_INIT_DIMENSIONS_MSG "Error: Invalid matrix initialization dimensions"
  * @brief Error msg when trying to initiate matrix with invalid dimensions
@@ -96,6 +111,27 @@
 
 // -------------------------- class definitions -------------------------
 
+class MatrixView;
+
+
+/**
+ * The base of every lazy matrix expression, E is the type of the expression itself. The
+ * expressions are defined in MatrixExpression.h.
+ */
+template <typename E>
+class MatrixExpression
+{
+public:
+
+    /**
+     * The expression as its own type.
+     * @return The derived expression
+     */
+    const E &self() const { return static_cast<const E &>(*this); }
+
+};
+
+
 /**
  * @struct MatrixDims
  * @brief Matrix dimensions container
@@ -108,18 +144,28 @@ typedef struct MatrixDims
 
 /**
  * Set a matrix object including dimensions and values. Override operators and define methods
- * that can be preformed on matrix and will help the program flow.
+ * that can be preformed on matrix and will help the program flow. The arithmetic operators
+ * build lazy expressions, see MatrixExpression.h, that are evaluated on assignment.
  */
-class Matrix
+class Matrix : public MatrixExpression<Matrix>
 {
 private:
     MatrixDims dimensions;
     float *pMatrix;
+    int capacity;
+
+    /**
+     * Take a buffer from the pool for the current dimensions and store it and its capacity.
+     * The previous buffer must already have been released. Throws std::bad_alloc if the
+     * allocation fails.
+     */
+    void _allocate();
 
 public:
 
     /**
-     * Constructor for matrix of rows*cols dimensions. Init all elements to zero.
+     * Constructor for matrix of rows*cols dimensions. Init all elements to zero. The buffer
+     * comes from MatrixPool and is aligned to MATRIX_POOL_ALIGNMENT bytes.
      * @param rows The number of rows
      * @param cols The number of columns
      */
@@ -141,7 +187,30 @@ public:
 
 
     /**
-     * A destructor of matrix. Will delete all allocated memory.
+     * Constructor that copies the values of a view into a new contiguous matrix.
+     * @param view The view to copy, in its own shape
+     */
+    explicit Matrix(const MatrixView &view);
+
+
+    /**
+     * Constructor that evaluates an expression into a new matrix.
+     * @param expr The expression
+     */
+    template <typename E>
+    Matrix(const MatrixExpression<E> &expr);
+
+
+    /**
+     * Move constructor that takes over the buffer of the given matrix without copying it.
+     * The given matrix is left empty and may only be assigned to or destroyed.
+     * @param m The given matrix needed to be moved
+     */
+    Matrix(Matrix &&m) noexcept;
+
+
+    /**
+     * A destructor of matrix. Gives the buffer back to the pool.
      */
     ~Matrix();
 
@@ -160,6 +229,28 @@ public:
     int getCols() const { return dimensions.cols; }
 
 
+    /**
+     * Getter of the number of elements the buffer can hold without reallocating, the size
+     * rounded up to whole MATRIX_POOL_ALIGNMENT blocks.
+     * @return The buffer capacity in elements
+     */
+    int getCapacity() const { return capacity; }
+
+
+    /**
+     * Getter of the underlying row-major buffer, for handing the matrix to the kernels.
+     * @return A pointer to the first element of the matrix
+     */
+    float *data() { return pMatrix; }
+
+
+    /**
+     * Const getter of the underlying row-major buffer, for handing the matrix to the kernels.
+     * @return A pointer to the first element of the matrix
+     */
+    const float *data() const { return pMatrix; }
+
+
     /**
      * Transforms a matrix into a column vector i.e nX1 matrix.
      * Supports function calling concatenation.
@@ -168,6 +259,16 @@ public:
     Matrix &vectorize();
 
 
+    /**
+     * Change the matrix dimensions to rows*cols. The buffer is reused whenever it is large
+     * enough for the new dimensions, otherwise a new zeroed buffer is allocated. A reused
+     * buffer keeps its old values.
+     * @param rows The new number of rows
+     * @param cols The new number of columns
+     */
+    void resize(int rows, int cols);
+
+
     /**
      * Prints matrix elements, no return value. Prints space after each element (incl. last
      * element in the row), prints newline after each row (incl. last row)
@@ -176,7 +277,8 @@ public:
 
 
     /**
-     * Assignment operator overriding of one matrix to another
+     * Assignment operator overriding of one matrix to another. The buffer of *this is kept
+     * whenever it is large enough for the other matrix.
      * @param other The matrix we want to assign to *this
      * @return The matrix after assign it with other matrix
      */
@@ -184,36 +286,38 @@ public:
 
 
     /**
-     * Matrix multiplication operator overriding between two matrix
-     * @param other A matrix we want to multiply ours with
-     * @return Our matrix after multiplication with the given one
+     * Move assignment operator, exchanges the buffers of the two matrices
+     * @param other The matrix we want to move into *this
+     * @return The matrix after taking over the other matrix buffer
      */
-    Matrix operator*(const Matrix &other) const;
+    Matrix &operator=(Matrix &&other) noexcept;
 
 
     /**
-     * Scalar multiplication on the right operator overriding
-     * @param scalar The given scalar we want to multiply our matrix with
-     * @return Our matrix after multiply it with the given scalar from the right
+     * Assignment of an expression, evaluated in one pass into the buffer of *this whenever
+     * the buffer is large enough.
+     * @param expr The expression
+     * @return The matrix after holding the value of the expression
      */
-    Matrix operator*(const float &scalar) const;
+    template <typename E>
+    Matrix &operator=(const MatrixExpression<E> &expr);
 
 
     /**
-     * Scalar multiplication on the left operator overriding
-     * @param scalar The given scalar we want to multiply given matrix with
-     * @param other The given matrix to multiply it from the left
-     * @return A new matrix represents the given matrix multiply be the scalar from the left
+     * Matrix multiplication into an existing matrix, so repeated products reuse its buffer.
+     * The result is resized if needed and must not be one of the operands.
+     * @param other A matrix we want to multiply ours with
+     * @param result The matrix that receives the product
      */
-    friend Matrix operator*(const float &scalar, const Matrix &other);
+    void multiplyInto(const Matrix &other, Matrix &result) const;
 
 
     /**
-     * Matrix addition operator overriding between two matrix
-     * @param other The second matrix we want to add to ours
-     * @return A new matrix represents the addition of our matrix with the given one
+     * Matrix multiplication by a view into an existing matrix, see multiplyInto above.
+     * @param other A view we want to multiply ours with
+     * @param result The matrix that receives the product
      */
-    Matrix operator+(const Matrix &other) const;
+    void multiplyInto(const MatrixView &other, Matrix &result) const;
 
 
     /**
@@ -224,42 +328,119 @@ public:
     Matrix &operator+=(const Matrix &other);
 
 
+    /**
+     * Matrix addition accumulation of the values of a view to ours
+     * @param other The view we want to add to ours
+     * @return Our matrix after addition of the given one
+     */
+    Matrix &operator+=(const MatrixView &other);
+
+
+    /**
+     * Matrix addition accumulation of an expression, evaluated in one pass into our buffer
+     * @param expr The expression we want to add to ours
+     * @return Our matrix after addition of the expression
+     */
+    template <typename E>
+    Matrix &operator+=(const MatrixExpression<E> &expr);
+
+
+    /**
+     * Getter of one row of the underlying row-major buffer, unchecked.
+     * @param i The index of the row
+     * @return A pointer to the getCols() elements of row i
+     */
+    float *row(int i) { return pMatrix + (long int) i * dimensions.cols; }
+
+
+    /**
+     * Const getter of one row of the underlying row-major buffer, unchecked.
+     * @param i The index of the row
+     * @return A pointer to the getCols() elements of row i
+     */
+    const float *row(int i) const { return pMatrix + (long int) i * dimensions.cols; }
+
+
+    /**
+     * The checked access to the m(i,j) element in the matrix, throws std::out_of_range for
+     * indices outside the matrix
+     * @param i The index of the row
+     * @param j The index of the column
+     * @return The i,j element in the matrix
+     */
+    float &at(int i, int j);
+
+
+    /**
+     * The const checked access to the m(i,j) element in the matrix, see at(i, j) above
+     * @param i The index of the row
+     * @param j The index of the column
+     * @return The i,j element in the matrix
+     */
+    const float &at(int i, int j) const;
+
+
+    /**
+     * The checked access to the m[i] element in the matrix, throws std::out_of_range for
+     * an index outside the matrix
+     * @param i The index we want to get excess to
+     * @return The i'th element in the matrix
+     */
+    float &at(int i);
+
+
+    /**
+     * The const checked access to the m[i] element in the matrix, see at(i) above
+     * @param i The index we want to get excess to
+     * @return The i'th element in the matrix
+     */
+    const float &at(int i) const;
+
+
     /**
      * The non-const implementation of parenthesis indexing operator
-     * to get the m(i,j) element in the matrix
+     * to get the m(i,j) element in the matrix. Checked only when MATRIX_CHECK_BOUNDS is set
      * @param i The index of the row
      * @param j The index of the column
      * @return The i,j element in the matrix
      */
-    float &operator()(int i, int j);
+    float &operator()(int i, int j)
+    {
+        return MATRIX_CHECK_BOUNDS ? at(i, j) : pMatrix[(long int) i * dimensions.cols + j];
+    }
 
 
     /**
      * The const implementation of parenthesis indexing operator
-     * to get the m(i,j) element in the matrix
+     * to get the m(i,j) element in the matrix. Checked only when MATRIX_CHECK_BOUNDS is set
      * @param i The index of the row
      * @param j The index of the column
      * @return The i,j element in the matrix
      */
-    const float &operator()(int i, int j) const;
+    const float &operator()(int i, int j) const
+    {
+        return MATRIX_CHECK_BOUNDS ? at(i, j) : pMatrix[(long int) i * dimensions.cols + j];
+    }
 
 
     /**
      * The non-const implementation of brackets indexing operator
-     * give an excess to the m[i] element in the matrix
+     * give an excess to the m[i] element in the matrix. Checked only when
+     * MATRIX_CHECK_BOUNDS is set
      * @param i The index we want to get excess to
      * @return The i'th element in the matrix
      */
-    float &operator[](int i);
+    float &operator[](int i) { return MATRIX_CHECK_BOUNDS ? at(i) : pMatrix[i]; }
 
 
     /**
      * The const implementation of brackets indexing operator
-     * give an excess to the m[i] element in the matrix
+     * give an excess to the m[i] element in the matrix. Checked only when
+     * MATRIX_CHECK_BOUNDS is set
      * @param i The index we want to get excess to
      * @return The i'th element in the matrix
      */
-    const float &operator[](int i) const;
+    const float &operator[](int i) const { return MATRIX_CHECK_BOUNDS ? at(i) : pMatrix[i]; }
 
 
     /**
@@ -282,4 +463,6 @@ public:
 
 };
 
+#include "MatrixExpression.h"
+
 #endif //MATRIX_H
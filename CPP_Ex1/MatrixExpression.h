@@ -0,0 +1,583 @@
+/**
+ * @file MatrixExpression.h
+ * @author  Liron Gershuny <liron.gershuny@mail.huji.ac.il>
+ * @version 1.0
+ * @date 25 Dec 2019
+ *
+ * @brief Define the lazy expressions that the matrix arithmetic operators build.
+ *
+ * @section LICENSE
+ * This program is not a free software; bla bla bla...
+ *
+ * @section DESCRIPTION
+ * The operators +, * by a scalar and * by a matrix don't compute anything, they return a
+ * small node that refers to its operands. Once the expression is assigned to a matrix,
+ * every chain of element wise nodes is evaluated in a single loop straight into the
+ * destination, and every product is handed to the gemm kernel. A product on the left or
+ * the right of a sum, such as W * x + b, is written into the destination and the rest of
+ * the sum is added to it in place, so the whole expression needs no temporary.
+ * The nodes only hold references, so an expression must be assigned to a Matrix within
+ * the statement that builds it and never kept in an auto variable.
+ * Input  : Matrices, scalars and other expressions
+ * Process: Fuses the element wise operations and dispatches the products
+ * Output : The value of the expression, written into a Matrix
+ */
+
+#ifndef MATRIX_EXPRESSION_H
+#define MATRIX_EXPRESSION_H
+
+// ------------------------------ includes ------------------------------
+#include "Matrix.h"
+#include "MatrixKernels.h"
+#include <optional>
+#include <type_traits>
+#include <utility>
+
+
+// ------------------------------ functions -----------------------------
+
+/**
+ * The operations every expression node and Matrix itself answer, so the nodes can treat
+ * their operands alike. A Matrix is always ready and is read directly.
+ */
+namespace expression
+{
+    /**
+     * One value of a matrix operand
+     * @param m The operand
+     * @param i The row-major index of the value
+     * @return The value
+     */
+    inline float element(const Matrix &m, long int i)
+    {
+        return m.data()[i];
+    }
+
+
+    /**
+     * One value of an expression operand, which must be prepared
+     * @param e The operand
+     * @param i The row-major index of the value
+     * @return The value
+     */
+    template <typename E>
+    inline float element(const MatrixExpression<E> &e, long int i)
+    {
+        return e.self().element(i);
+    }
+
+
+    /**
+     * Whether an operand reads the given matrix
+     * @param m The operand
+     * @param dst The matrix
+     * @return true - the operand is dst
+     */
+    inline bool references(const Matrix &m, const Matrix &dst)
+    {
+        return &m == &dst;
+    }
+
+
+    /**
+     * Whether an operand reads the given matrix anywhere
+     * @param e The operand
+     * @param dst The matrix
+     * @return true - dst is one of the matrices of the expression
+     */
+    template <typename E>
+    inline bool references(const MatrixExpression<E> &e, const Matrix &dst)
+    {
+        return e.self().references(dst);
+    }
+
+
+    /**
+     * Get a matrix operand ready to be read, there is nothing to do
+     */
+    inline void prepare(const Matrix &)
+    {
+    }
+
+
+    /**
+     * Get an expression operand ready to be read, its products are computed
+     * @param e The operand
+     */
+    template <typename E>
+    inline void prepare(const MatrixExpression<E> &e)
+    {
+        e.self().prepare();
+    }
+
+
+    /**
+     * A matrix operand of a product, used as is
+     * @param m The operand
+     * @return The operand itself
+     */
+    inline const Matrix &materialize(const Matrix &m, std::optional<Matrix> &)
+    {
+        return m;
+    }
+
+
+    /**
+     * An expression operand of a product, evaluated into a temporary
+     * @param e The operand
+     * @param storage Receives the temporary
+     * @return The value of the operand
+     */
+    template <typename E>
+    inline const Matrix &materialize(const MatrixExpression<E> &e, std::optional<Matrix> &storage)
+    {
+        storage.emplace(e.self());
+        return *storage;
+    }
+
+
+    /**
+     * Throw std::invalid_argument if two operands don't have the same dimensions
+     * @param a The first operand
+     * @param b The second operand
+     */
+    template <typename A, typename B>
+    inline void checkSameDimensions(const A &a, const B &b)
+    {
+        if(a.getRows() != b.getRows() || a.getCols() != b.getCols())
+        {
+            throw std::invalid_argument(INVALID_MATRIX_ADDITION_DIMENSIONS_MSG);
+        }
+    }
+}
+
+
+// -------------------------- class definitions -------------------------
+
+template <typename L, typename R>
+class MatrixProduct;
+
+/**
+ * @brief Whether an expression type is a matrix product, which is written straight into
+ *        the destination instead of being read value by value
+ */
+template <typename E>
+struct IsMatrixProduct : std::false_type
+{
+};
+
+template <typename L, typename R>
+struct IsMatrixProduct<MatrixProduct<L, R>> : std::true_type
+{
+};
+
+
+/**
+ * The element wise sum of two expressions of the same dimensions.
+ */
+template <typename L, typename R>
+class MatrixSum : public MatrixExpression<MatrixSum<L, R>>
+{
+private:
+    const L &lhs;
+    const R &rhs;
+
+public:
+
+    /**
+     * Constructor of the sum node, checks the dimensions of the operands.
+     * @param left The first operand
+     * @param right The second operand
+     */
+    MatrixSum(const L &left, const R &right) : lhs(left), rhs(right)
+    {
+        expression::checkSameDimensions(lhs, rhs);
+    }
+
+
+    /**
+     * Getter of the number of rows of the expression.
+     * @return The number of rows
+     */
+    int getRows() const { return lhs.getRows(); }
+
+
+    /**
+     * Getter of the number of columns of the expression.
+     * @return The number of columns
+     */
+    int getCols() const { return lhs.getCols(); }
+
+
+    /**
+     * One value of the expression, the node must be prepared.
+     * @param i The row-major index of the value
+     * @return The value
+     */
+    float element(long int i) const
+    {
+        return expression::element(lhs, i) + expression::element(rhs, i);
+    }
+
+
+    /**
+     * Whether the expression reads the given matrix.
+     * @param dst The matrix
+     * @return true - dst is one of the matrices of the expression
+     */
+    bool references(const Matrix &dst) const
+    {
+        return expression::references(lhs, dst) || expression::references(rhs, dst);
+    }
+
+
+    /**
+     * Compute the products inside the expression, so its values can be read.
+     */
+    void prepare() const
+    {
+        expression::prepare(lhs);
+        expression::prepare(rhs);
+    }
+
+
+    /**
+     * Write the sum into a matrix. A product operand is computed right into the
+     * destination when the other operand doesn't read it.
+     * @param dst The destination, resized to the sum
+     */
+    void evaluateInto(Matrix &dst) const
+    {
+        long int count = (long int) getRows() * getCols();
+        if constexpr(IsMatrixProduct<L>::value)
+        {
+            if(!expression::references(rhs, dst))
+            {
+                expression::prepare(rhs);
+                lhs.evaluateInto(dst);
+                float *out = dst.data();
+                for(long int i = 0 ; i < count ; i++)
+                {
+                    out[i] += expression::element(rhs, i);
+                }
+                return;
+            }
+        }
+        if constexpr(IsMatrixProduct<R>::value)
+        {
+            if(!expression::references(lhs, dst))
+            {
+                expression::prepare(lhs);
+                rhs.evaluateInto(dst);
+                float *out = dst.data();
+                for(long int i = 0 ; i < count ; i++)
+                {
+                    out[i] += expression::element(lhs, i);
+                }
+                return;
+            }
+        }
+
+        prepare();
+        dst.resize(getRows(), getCols());
+        float *out = dst.data();
+        for(long int i = 0 ; i < count ; i++)
+        {
+            out[i] = element(i);
+        }
+    }
+};
+
+
+/**
+ * An expression multiplied by a scalar.
+ */
+template <typename E>
+class MatrixScaled : public MatrixExpression<MatrixScaled<E>>
+{
+private:
+    const E &operand;
+    float scalar;
+
+public:
+
+    /**
+     * Constructor of the scaling node.
+     * @param e The operand
+     * @param s The scalar
+     */
+    MatrixScaled(const E &e, float s) : operand(e), scalar(s)
+    {
+    }
+
+
+    /**
+     * Getter of the number of rows of the expression.
+     * @return The number of rows
+     */
+    int getRows() const { return operand.getRows(); }
+
+
+    /**
+     * Getter of the number of columns of the expression.
+     * @return The number of columns
+     */
+    int getCols() const { return operand.getCols(); }
+
+
+    /**
+     * One value of the expression, the node must be prepared.
+     * @param i The row-major index of the value
+     * @return The value
+     */
+    float element(long int i) const { return expression::element(operand, i) * scalar; }
+
+
+    /**
+     * Whether the expression reads the given matrix.
+     * @param dst The matrix
+     * @return true - dst is one of the matrices of the expression
+     */
+    bool references(const Matrix &dst) const { return expression::references(operand, dst); }
+
+
+    /**
+     * Compute the products inside the expression, so its values can be read.
+     */
+    void prepare() const { expression::prepare(operand); }
+
+
+    /**
+     * Write the scaled operand into a matrix. A product operand is computed right into the
+     * destination and scaled there.
+     * @param dst The destination, resized to the operand
+     */
+    void evaluateInto(Matrix &dst) const
+    {
+        long int count = (long int) getRows() * getCols();
+        if constexpr(IsMatrixProduct<E>::value)
+        {
+            operand.evaluateInto(dst);
+            kernels::scale(dst.data(), scalar, dst.data(), (int) count);
+            return;
+        }
+
+        prepare();
+        dst.resize(getRows(), getCols());
+        float *out = dst.data();
+        for(long int i = 0 ; i < count ; i++)
+        {
+            out[i] = element(i);
+        }
+    }
+};
+
+
+/**
+ * The matrix product of two expressions. It is computed by the gemm kernel, into the
+ * destination when it is evaluated on its own or as part of a sum, otherwise into a
+ * temporary owned by the node.
+ */
+template <typename L, typename R>
+class MatrixProduct : public MatrixExpression<MatrixProduct<L, R>>
+{
+private:
+    const L &lhs;
+    const R &rhs;
+    mutable std::optional<Matrix> value;
+
+public:
+
+    /**
+     * Constructor of the product node, checks the dimensions of the operands.
+     * @param left The left operand
+     * @param right The right operand
+     */
+    MatrixProduct(const L &left, const R &right) : lhs(left), rhs(right)
+    {
+        if(lhs.getCols() != rhs.getRows())
+        {
+            throw std::invalid_argument(INVALID_MATRIX_MULTIPLICATION_DIMENSIONS_MSG);
+        }
+    }
+
+
+    /**
+     * Getter of the number of rows of the expression.
+     * @return The number of rows
+     */
+    int getRows() const { return lhs.getRows(); }
+
+
+    /**
+     * Getter of the number of columns of the expression.
+     * @return The number of columns
+     */
+    int getCols() const { return rhs.getCols(); }
+
+
+    /**
+     * One value of the expression, the node must be prepared.
+     * @param i The row-major index of the value
+     * @return The value
+     */
+    float element(long int i) const { return value->data()[i]; }
+
+
+    /**
+     * Whether the expression reads the given matrix.
+     * @param dst The matrix
+     * @return true - dst is one of the matrices of the expression
+     */
+    bool references(const Matrix &dst) const
+    {
+        return expression::references(lhs, dst) || expression::references(rhs, dst);
+    }
+
+
+    /**
+     * Compute the products inside the expression, so its values can be read.
+     */
+    void prepare() const
+    {
+        if(!value)
+        {
+            value.emplace(getRows(), getCols());
+            evaluateInto(*value);
+        }
+    }
+
+
+    /**
+     * Write the product into a matrix. Operands that are expressions themselves are
+     * computed first, a destination that is also an operand gets the product through a
+     * temporary.
+     * @param dst The destination, resized to the product
+     */
+    void evaluateInto(Matrix &dst) const
+    {
+        if(value && &dst != &*value)
+        {
+            dst = *value;
+            return;
+        }
+
+        std::optional<Matrix> leftStorage;
+        std::optional<Matrix> rightStorage;
+        const Matrix &a = expression::materialize(lhs, leftStorage);
+        const Matrix &b = expression::materialize(rhs, rightStorage);
+        if(&dst == &a || &dst == &b)
+        {
+            Matrix product(getRows(), getCols());
+            kernels::gemm(a.data(), b.data(), product.data(), getRows(), getCols(), a.getCols());
+            dst = std::move(product);
+            return;
+        }
+
+        dst.resize(getRows(), getCols());
+        kernels::gemm(a.data(), b.data(), dst.data(), getRows(), getCols(), a.getCols());
+    }
+};
+
+
+// ------------------------- function definitions -----------------------
+
+/**
+ * Matrix addition operator overriding between two matrices or expressions
+ * @param a The first operand
+ * @param b The second operand
+ * @return The lazy sum of the two
+ */
+template <typename L, typename R>
+inline MatrixSum<L, R> operator+(const MatrixExpression<L> &a, const MatrixExpression<R> &b)
+{
+    return MatrixSum<L, R>(a.self(), b.self());
+}
+
+
+/**
+ * Matrix multiplication operator overriding between two matrices or expressions
+ * @param a The left operand
+ * @param b The right operand
+ * @return The lazy product of the two
+ */
+template <typename L, typename R>
+inline MatrixProduct<L, R> operator*(const MatrixExpression<L> &a, const MatrixExpression<R> &b)
+{
+    return MatrixProduct<L, R>(a.self(), b.self());
+}
+
+
+/**
+ * Scalar multiplication on the right operator overriding
+ * @param a The matrix or expression to multiply
+ * @param scalar The scalar to multiply it with from the right
+ * @return The lazy scaled operand
+ */
+template <typename E>
+inline MatrixScaled<E> operator*(const MatrixExpression<E> &a, const float &scalar)
+{
+    return MatrixScaled<E>(a.self(), scalar);
+}
+
+
+/**
+ * Scalar multiplication on the left operator overriding
+ * @param scalar The scalar to multiply the operand with from the left
+ * @param a The matrix or expression to multiply
+ * @return The lazy scaled operand
+ */
+template <typename E>
+inline MatrixScaled<E> operator*(const float &scalar, const MatrixExpression<E> &a)
+{
+    return MatrixScaled<E>(a.self(), scalar);
+}
+
+
+// ------------------------ class implementation ------------------------
+
+/**
+* Constructor that evaluates an expression into a new matrix.
+* @param expr The expression
+*/
+template <typename E>
+Matrix::Matrix(const MatrixExpression<E> &expr) : Matrix(expr.self().getRows(),
+                                                           expr.self().getCols())
+{
+    expr.self().evaluateInto(*this);
+}
+
+
+/**
+* Assignment of an expression, evaluated in one pass into the buffer of *this whenever
+* the buffer is large enough.
+* @param expr The expression
+* @return The matrix after holding the value of the expression
+*/
+template <typename E>
+Matrix &Matrix::operator=(const MatrixExpression<E> &expr)
+{
+    expr.self().evaluateInto(*this);
+    return *this;
+}
+
+
+/**
+* Addition accumulation of an expression, evaluated in one pass into our buffer.
+* @param expr The expression
+* @return Our matrix after addition of the expression
+*/
+template <typename E>
+Matrix &Matrix::operator+=(const MatrixExpression<E> &expr)
+{
+    expression::checkSameDimensions(*this, expr.self());
+    expr.self().prepare();
+    long int count = (long int) dimensions.rows * dimensions.cols;
+    for(long int i = 0 ; i < count ; i++)
+    {
+        pMatrix[i] += expr.self().element(i);
+    }
+    return *this;
+}
+
+#endif //MATRIX_EXPRESSION_H
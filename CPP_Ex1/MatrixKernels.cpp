@@ -0,0 +1,1128 @@
+/**
+ * @file MatrixKernels.cpp
+ * @author  Liron Gershuny <liron.gershuny@mail.huji.ac.il>
+ * @version 1.0
+ * @date 25 Dec 2019
+ *
+ * @brief Define the low level numeric kernels that the Matrix operators are built on.
+ *
+ * @section LICENSE
+ * This program is not a free software; bla bla bla...
+ *
+ * @section DESCRIPTION
+ * The kernels work on raw row-major float buffers so they can be shared between Matrix
+ * and the network layers without any copies.
+ * Input  : Raw float buffers and their dimensions
+ * Process: Cache blocked, register tiled and SIMD arithmetic, dispatched at runtime
+ * Output : The result written into a caller supplied buffer
+ */
+
+// ------------------------------ includes ------------------------------
+#include "MatrixKernels.h"
+#include "KernelCommon.h"
+#include <algorithm>
+#include <vector>
+
+
+// -------------------------- const definitions -------------------------
+
+/*
+ * @def GEMM_BLOCKED_MIN_COLS 8
+ * @brief Narrower right operands are matrix-vector like and gain nothing from packing
+ */
+#define GEMM_BLOCKED_MIN_COLS 8
+
+
+// ------------------------ static helpers ------------------------------
+
+/**
+ * Find the widest instruction set that both the CPU and this build support.
+ * @return The detected SIMD level
+ */
+static kernels::SimdLevel detectSimdLevel()
+{
+#ifdef KERNELS_X86
+    __builtin_cpu_init();
+    if(__builtin_cpu_supports("avx512f"))
+    {
+        return kernels::Avx512;
+    }
+    if(__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"))
+    {
+        return kernels::Avx2;
+    }
+    if(__builtin_cpu_supports("sse2"))
+    {
+        return kernels::Sse2;
+    }
+#endif
+    return kernels::Scalar;
+}
+
+
+/**
+ * The SIMD level the kernels dispatch to, detected on first use.
+ * @return A reference to the active level
+ */
+static kernels::SimdLevel &activeLevel()
+{
+    static kernels::SimdLevel level = detectSimdLevel();
+    return level;
+}
+
+
+/**
+ * Scalar dot product of two vectors, the fallback and tail of every gemv path.
+ * @param a The first vector
+ * @param b The second vector
+ * @param n The number of elements
+ * @return The dot product
+ */
+static float dotScalar(const float *a, const float *b, int n)
+{
+    float result = 0;
+    for(int i = 0 ; i < n ; i++)
+    {
+        result += a[i] * b[i];
+    }
+    return result;
+}
+
+
+#ifdef KERNELS_X86
+
+/**
+ * SSE2 elementwise addition out = a + b.
+ */
+__attribute__((target("sse2")))
+static void addSse2(const float *a, const float *b, float *out, int n)
+{
+    int i = 0;
+    for( ; i + 4 <= n ; i += 4)
+    {
+        _mm_storeu_ps(out + i, _mm_add_ps(_mm_loadu_ps(a + i), _mm_loadu_ps(b + i)));
+    }
+    for( ; i < n ; i++)
+    {
+        out[i] = a[i] + b[i];
+    }
+}
+
+
+/**
+ * SSE2 elementwise scaling out = a * scalar.
+ */
+__attribute__((target("sse2")))
+static void scaleSse2(const float *a, float scalar, float *out, int n)
+{
+    __m128 s = _mm_set1_ps(scalar);
+    int i = 0;
+    for( ; i + 4 <= n ; i += 4)
+    {
+        _mm_storeu_ps(out + i, _mm_mul_ps(_mm_loadu_ps(a + i), s));
+    }
+    for( ; i < n ; i++)
+    {
+        out[i] = a[i] * scalar;
+    }
+}
+
+
+/**
+ * SSE2 matrix vector product with the dense layer epilogue, one row at a time.
+ */
+__attribute__((target("sse2")))
+static void gemvSse2(const float *a, const float *x, const float *bias, float *y,
+                     int m, int k, bool relu)
+{
+    for(int i = 0 ; i < m ; i++)
+    {
+        const float *row = a + (long int) i * k;
+        __m128 acc = _mm_setzero_ps();
+        int p = 0;
+        for( ; p + 4 <= k ; p += 4)
+        {
+            acc = _mm_add_ps(acc, _mm_mul_ps(_mm_loadu_ps(row + p), _mm_loadu_ps(x + p)));
+        }
+        float sum = hsumSse2(acc) + dotScalar(row + p, x + p, k - p);
+        y[i] = denseEpilogue(sum, bias, i, relu);
+    }
+}
+
+
+/**
+ * AVX2 elementwise addition out = a + b.
+ */
+__attribute__((target("avx2")))
+static void addAvx2(const float *a, const float *b, float *out, int n)
+{
+    int i = 0;
+    for( ; i + 8 <= n ; i += 8)
+    {
+        _mm256_storeu_ps(out + i, _mm256_add_ps(_mm256_loadu_ps(a + i),
+                                                _mm256_loadu_ps(b + i)));
+    }
+    for( ; i < n ; i++)
+    {
+        out[i] = a[i] + b[i];
+    }
+}
+
+
+/**
+ * AVX2 elementwise scaling out = a * scalar.
+ */
+__attribute__((target("avx2")))
+static void scaleAvx2(const float *a, float scalar, float *out, int n)
+{
+    __m256 s = _mm256_set1_ps(scalar);
+    int i = 0;
+    for( ; i + 8 <= n ; i += 8)
+    {
+        _mm256_storeu_ps(out + i, _mm256_mul_ps(_mm256_loadu_ps(a + i), s));
+    }
+    for( ; i < n ; i++)
+    {
+        out[i] = a[i] * scalar;
+    }
+}
+
+
+/**
+ * AVX2 matrix vector product with the dense layer epilogue. Four rows share every
+ * load of x.
+ */
+__attribute__((target("avx2,fma")))
+static void gemvAvx2(const float *a, const float *x, const float *bias, float *y,
+                     int m, int k, bool relu)
+{
+    int i = 0;
+    for( ; i + 4 <= m ; i += 4)
+    {
+        const float *r0 = a + (long int) i * k;
+        const float *r1 = r0 + k;
+        const float *r2 = r1 + k;
+        const float *r3 = r2 + k;
+        __m256 acc0 = _mm256_setzero_ps();
+        __m256 acc1 = _mm256_setzero_ps();
+        __m256 acc2 = _mm256_setzero_ps();
+        __m256 acc3 = _mm256_setzero_ps();
+        int p = 0;
+        for( ; p + 8 <= k ; p += 8)
+        {
+            __m256 xv = _mm256_loadu_ps(x + p);
+            acc0 = _mm256_fmadd_ps(_mm256_loadu_ps(r0 + p), xv, acc0);
+            acc1 = _mm256_fmadd_ps(_mm256_loadu_ps(r1 + p), xv, acc1);
+            acc2 = _mm256_fmadd_ps(_mm256_loadu_ps(r2 + p), xv, acc2);
+            acc3 = _mm256_fmadd_ps(_mm256_loadu_ps(r3 + p), xv, acc3);
+        }
+        y[i] = denseEpilogue(hsumAvx2(acc0) + dotScalar(r0 + p, x + p, k - p),
+                             bias, i, relu);
+        y[i + 1] = denseEpilogue(hsumAvx2(acc1) + dotScalar(r1 + p, x + p, k - p),
+                                 bias, i + 1, relu);
+        y[i + 2] = denseEpilogue(hsumAvx2(acc2) + dotScalar(r2 + p, x + p, k - p),
+                                 bias, i + 2, relu);
+        y[i + 3] = denseEpilogue(hsumAvx2(acc3) + dotScalar(r3 + p, x + p, k - p),
+                                 bias, i + 3, relu);
+    }
+    for( ; i < m ; i++)
+    {
+        const float *row = a + (long int) i * k;
+        __m256 acc = _mm256_setzero_ps();
+        int p = 0;
+        for( ; p + 8 <= k ; p += 8)
+        {
+            acc = _mm256_fmadd_ps(_mm256_loadu_ps(row + p), _mm256_loadu_ps(x + p), acc);
+        }
+        float sum = hsumAvx2(acc) + dotScalar(row + p, x + p, k - p);
+        y[i] = denseEpilogue(sum, bias, i, relu);
+    }
+}
+
+
+/**
+ * AVX-512 elementwise addition out = a + b, the tail handled by a masked pass.
+ */
+__attribute__((target("avx512f")))
+static void addAvx512(const float *a, const float *b, float *out, int n)
+{
+    int i = 0;
+    for( ; i + 16 <= n ; i += 16)
+    {
+        _mm512_storeu_ps(out + i, _mm512_add_ps(_mm512_loadu_ps(a + i),
+                                                _mm512_loadu_ps(b + i)));
+    }
+    if(i < n)
+    {
+        __mmask16 mask = (__mmask16) ((1u << (n - i)) - 1);
+        _mm512_mask_storeu_ps(out + i, mask, _mm512_add_ps(_mm512_maskz_loadu_ps(mask, a + i),
+                                                           _mm512_maskz_loadu_ps(mask, b + i)));
+    }
+}
+
+
+/**
+ * AVX-512 elementwise scaling out = a * scalar, the tail handled by a masked pass.
+ */
+__attribute__((target("avx512f")))
+static void scaleAvx512(const float *a, float scalar, float *out, int n)
+{
+    __m512 s = _mm512_set1_ps(scalar);
+    int i = 0;
+    for( ; i + 16 <= n ; i += 16)
+    {
+        _mm512_storeu_ps(out + i, _mm512_mul_ps(_mm512_loadu_ps(a + i), s));
+    }
+    if(i < n)
+    {
+        __mmask16 mask = (__mmask16) ((1u << (n - i)) - 1);
+        _mm512_mask_storeu_ps(out + i, mask, _mm512_mul_ps(_mm512_maskz_loadu_ps(mask, a + i), s));
+    }
+}
+
+
+/**
+ * AVX-512 matrix vector product with the dense layer epilogue. Four rows share every
+ * load of x and the row tails are folded into the vector loop with a mask.
+ */
+__attribute__((target("avx512f")))
+static void gemvAvx512(const float *a, const float *x, const float *bias, float *y,
+                       int m, int k, bool relu)
+{
+    int tail = k % 16;
+    int body = k - tail;
+    __mmask16 mask = (__mmask16) ((1u << tail) - 1);
+    int i = 0;
+    for( ; i + 4 <= m ; i += 4)
+    {
+        const float *r0 = a + (long int) i * k;
+        const float *r1 = r0 + k;
+        const float *r2 = r1 + k;
+        const float *r3 = r2 + k;
+        __m512 acc0 = _mm512_setzero_ps();
+        __m512 acc1 = _mm512_setzero_ps();
+        __m512 acc2 = _mm512_setzero_ps();
+        __m512 acc3 = _mm512_setzero_ps();
+        for(int p = 0 ; p < body ; p += 16)
+        {
+            __m512 xv = _mm512_loadu_ps(x + p);
+            acc0 = _mm512_fmadd_ps(_mm512_loadu_ps(r0 + p), xv, acc0);
+            acc1 = _mm512_fmadd_ps(_mm512_loadu_ps(r1 + p), xv, acc1);
+            acc2 = _mm512_fmadd_ps(_mm512_loadu_ps(r2 + p), xv, acc2);
+            acc3 = _mm512_fmadd_ps(_mm512_loadu_ps(r3 + p), xv, acc3);
+        }
+        if(tail)
+        {
+            __m512 xv = _mm512_maskz_loadu_ps(mask, x + body);
+            acc0 = _mm512_fmadd_ps(_mm512_maskz_loadu_ps(mask, r0 + body), xv, acc0);
+            acc1 = _mm512_fmadd_ps(_mm512_maskz_loadu_ps(mask, r1 + body), xv, acc1);
+            acc2 = _mm512_fmadd_ps(_mm512_maskz_loadu_ps(mask, r2 + body), xv, acc2);
+            acc3 = _mm512_fmadd_ps(_mm512_maskz_loadu_ps(mask, r3 + body), xv, acc3);
+        }
+        y[i] = denseEpilogue(hsumAvx512(acc0), bias, i, relu);
+        y[i + 1] = denseEpilogue(hsumAvx512(acc1), bias, i + 1, relu);
+        y[i + 2] = denseEpilogue(hsumAvx512(acc2), bias, i + 2, relu);
+        y[i + 3] = denseEpilogue(hsumAvx512(acc3), bias, i + 3, relu);
+    }
+    for( ; i < m ; i++)
+    {
+        const float *row = a + (long int) i * k;
+        __m512 acc = _mm512_setzero_ps();
+        for(int p = 0 ; p < body ; p += 16)
+        {
+            acc = _mm512_fmadd_ps(_mm512_loadu_ps(row + p), _mm512_loadu_ps(x + p), acc);
+        }
+        if(tail)
+        {
+            acc = _mm512_fmadd_ps(_mm512_maskz_loadu_ps(mask, row + body),
+                                  _mm512_maskz_loadu_ps(mask, x + body), acc);
+        }
+        y[i] = denseEpilogue(hsumAvx512(acc), bias, i, relu);
+    }
+}
+
+#endif //KERNELS_X86
+
+
+/**
+ * Copy a kc*nc block of B into NR wide column panels. Every panel is stored row after row
+ * so the micro kernel reads it sequentially, the last panel is padded with zeros.
+ * @param b The top left corner of the block inside B
+ * @param rs The row stride of B
+ * @param cs The column stride of B, 1 unless B is a transposed view
+ * @param kc The number of rows of the block
+ * @param nc The number of columns of the block
+ * @param packed The output buffer, at least kc * roundUp(nc, NR) floats
+ */
+static void packB(const float *b, int rs, int cs, int kc, int nc, float *packed)
+{
+    for(int j = 0 ; j < nc ; j += GEMM_NR)
+    {
+        int nr = std::min(GEMM_NR, nc - j);
+        for(int p = 0 ; p < kc ; p++)
+        {
+            const float *row = b + (long int) p * rs + (long int) j * cs;
+            int q = 0;
+            for( ; q < nr ; q++)
+            {
+                packed[q] = row[(long int) q * cs];
+            }
+            for( ; q < GEMM_NR ; q++)
+            {
+                packed[q] = 0;
+            }
+            packed += GEMM_NR;
+        }
+    }
+}
+
+
+/**
+ * Copy a mc*kc block of A into MR high row panels stored column after column,
+ * the last panel is padded with zeros.
+ * @param a The top left corner of the block inside A
+ * @param rs The row stride of A
+ * @param cs The column stride of A, 1 unless A is a transposed view
+ * @param mc The number of rows of the block
+ * @param kc The number of columns of the block
+ * @param packed The output buffer, at least kc * roundUp(mc, MR) floats
+ */
+static void packA(const float *a, int rs, int cs, int mc, int kc, float *packed)
+{
+    for(int i = 0 ; i < mc ; i += GEMM_MR)
+    {
+        int mr = std::min(GEMM_MR, mc - i);
+        for(int p = 0 ; p < kc ; p++)
+        {
+            int q = 0;
+            for( ; q < mr ; q++)
+            {
+                packed[q] = a[(long int) (i + q) * rs + (long int) p * cs];
+            }
+            for( ; q < GEMM_MR ; q++)
+            {
+                packed[q] = 0;
+            }
+            packed += GEMM_MR;
+        }
+    }
+}
+
+
+/**
+ * Multiply one MR panel of A by one NR panel of B into a full MR*NR tile of C.
+ * @param kc The shared depth of the panels
+ * @param ap The packed A panel
+ * @param bp The packed B panel
+ * @param c The top left corner of the tile
+ * @param ldc The row stride of the tile
+ * @param accumulate Whether to add the tile to C instead of overwriting it
+ */
+static void microKernelScalar(int kc, const float *ap, const float *bp, float *c, int ldc,
+                              bool accumulate)
+{
+    float acc[GEMM_MR][GEMM_NR] = {};
+
+    for(int p = 0 ; p < kc ; p++)
+    {
+        for(int i = 0 ; i < GEMM_MR ; i++)
+        {
+            float av = ap[i];
+            for(int j = 0 ; j < GEMM_NR ; j++)
+            {
+                acc[i][j] += av * bp[j];
+            }
+        }
+        ap += GEMM_MR;
+        bp += GEMM_NR;
+    }
+
+    for(int i = 0 ; i < GEMM_MR ; i++)
+    {
+        float *row = c + (long int) i * ldc;
+        for(int j = 0 ; j < GEMM_NR ; j++)
+        {
+            row[j] = accumulate ? row[j] + acc[i][j] : acc[i][j];
+        }
+    }
+}
+
+
+#ifdef KERNELS_X86
+
+/**
+ * AVX2 micro kernel, the 6x16 tile lives in twelve ymm accumulators.
+ */
+__attribute__((target("avx2,fma")))
+static void microKernelAvx2(int kc, const float *ap, const float *bp, float *c, int ldc,
+                            bool accumulate)
+{
+    __m256 c00 = _mm256_setzero_ps(), c01 = _mm256_setzero_ps();
+    __m256 c10 = _mm256_setzero_ps(), c11 = _mm256_setzero_ps();
+    __m256 c20 = _mm256_setzero_ps(), c21 = _mm256_setzero_ps();
+    __m256 c30 = _mm256_setzero_ps(), c31 = _mm256_setzero_ps();
+    __m256 c40 = _mm256_setzero_ps(), c41 = _mm256_setzero_ps();
+    __m256 c50 = _mm256_setzero_ps(), c51 = _mm256_setzero_ps();
+
+    for(int p = 0 ; p < kc ; p++)
+    {
+        __m256 b0 = _mm256_loadu_ps(bp);
+        __m256 b1 = _mm256_loadu_ps(bp + 8);
+        __m256 a = _mm256_broadcast_ss(ap);
+        c00 = _mm256_fmadd_ps(a, b0, c00);
+        c01 = _mm256_fmadd_ps(a, b1, c01);
+        a = _mm256_broadcast_ss(ap + 1);
+        c10 = _mm256_fmadd_ps(a, b0, c10);
+        c11 = _mm256_fmadd_ps(a, b1, c11);
+        a = _mm256_broadcast_ss(ap + 2);
+        c20 = _mm256_fmadd_ps(a, b0, c20);
+        c21 = _mm256_fmadd_ps(a, b1, c21);
+        a = _mm256_broadcast_ss(ap + 3);
+        c30 = _mm256_fmadd_ps(a, b0, c30);
+        c31 = _mm256_fmadd_ps(a, b1, c31);
+        a = _mm256_broadcast_ss(ap + 4);
+        c40 = _mm256_fmadd_ps(a, b0, c40);
+        c41 = _mm256_fmadd_ps(a, b1, c41);
+        a = _mm256_broadcast_ss(ap + 5);
+        c50 = _mm256_fmadd_ps(a, b0, c50);
+        c51 = _mm256_fmadd_ps(a, b1, c51);
+        ap += GEMM_MR;
+        bp += GEMM_NR;
+    }
+
+    __m256 tile[GEMM_MR][2] = {{c00, c01}, {c10, c11}, {c20, c21},
+                               {c30, c31}, {c40, c41}, {c50, c51}};
+    for(int i = 0 ; i < GEMM_MR ; i++)
+    {
+        float *row = c + (long int) i * ldc;
+        if(accumulate)
+        {
+            tile[i][0] = _mm256_add_ps(tile[i][0], _mm256_loadu_ps(row));
+            tile[i][1] = _mm256_add_ps(tile[i][1], _mm256_loadu_ps(row + 8));
+        }
+        _mm256_storeu_ps(row, tile[i][0]);
+        _mm256_storeu_ps(row + 8, tile[i][1]);
+    }
+}
+
+
+/**
+ * AVX-512 micro kernel, every row of the 6x16 tile is one zmm accumulator.
+ */
+__attribute__((target("avx512f")))
+static void microKernelAvx512(int kc, const float *ap, const float *bp, float *c, int ldc,
+                              bool accumulate)
+{
+    __m512 c0 = _mm512_setzero_ps();
+    __m512 c1 = _mm512_setzero_ps();
+    __m512 c2 = _mm512_setzero_ps();
+    __m512 c3 = _mm512_setzero_ps();
+    __m512 c4 = _mm512_setzero_ps();
+    __m512 c5 = _mm512_setzero_ps();
+
+    for(int p = 0 ; p < kc ; p++)
+    {
+        __m512 b = _mm512_loadu_ps(bp);
+        c0 = _mm512_fmadd_ps(_mm512_set1_ps(ap[0]), b, c0);
+        c1 = _mm512_fmadd_ps(_mm512_set1_ps(ap[1]), b, c1);
+        c2 = _mm512_fmadd_ps(_mm512_set1_ps(ap[2]), b, c2);
+        c3 = _mm512_fmadd_ps(_mm512_set1_ps(ap[3]), b, c3);
+        c4 = _mm512_fmadd_ps(_mm512_set1_ps(ap[4]), b, c4);
+        c5 = _mm512_fmadd_ps(_mm512_set1_ps(ap[5]), b, c5);
+        ap += GEMM_MR;
+        bp += GEMM_NR;
+    }
+
+    __m512 tile[GEMM_MR] = {c0, c1, c2, c3, c4, c5};
+    for(int i = 0 ; i < GEMM_MR ; i++)
+    {
+        float *row = c + (long int) i * ldc;
+        if(accumulate)
+        {
+            tile[i] = _mm512_add_ps(tile[i], _mm512_loadu_ps(row));
+        }
+        _mm512_storeu_ps(row, tile[i]);
+    }
+}
+
+#endif //KERNELS_X86
+
+
+/**
+ * Multiply one MR panel of A by one NR panel of B, keeping the MR*NR tile in registers,
+ * and store the valid mr*nr part of it into C. Edge tiles are computed into a local
+ * tile first so the SIMD kernels only ever see full tiles.
+ * @param kc The shared depth of the panels
+ * @param ap The packed A panel
+ * @param bp The packed B panel
+ * @param c The top left corner of the tile inside C
+ * @param ldc The row stride of C
+ * @param mr The number of valid rows in the tile
+ * @param nr The number of valid columns in the tile
+ * @param accumulate Whether to add the tile to C instead of overwriting it
+ */
+static void microKernel(int kc, const float *ap, const float *bp, float *c, int ldc,
+                        int mr, int nr, bool accumulate)
+{
+    float edge[GEMM_MR * GEMM_NR];
+    bool full = mr == GEMM_MR && nr == GEMM_NR;
+    float *out = full ? c : edge;
+    int ldo = full ? ldc : GEMM_NR;
+
+    switch(activeLevel())
+    {
+#ifdef KERNELS_X86
+        case kernels::Avx512:
+            microKernelAvx512(kc, ap, bp, out, ldo, full && accumulate);
+            break;
+        case kernels::Avx2:
+            microKernelAvx2(kc, ap, bp, out, ldo, full && accumulate);
+            break;
+#endif
+        default:
+            microKernelScalar(kc, ap, bp, out, ldo, full && accumulate);
+    }
+
+    if(full)
+    {
+        return;
+    }
+
+    for(int i = 0 ; i < mr ; i++)
+    {
+        float *row = c + (long int) i * ldc;
+        for(int j = 0 ; j < nr ; j++)
+        {
+            row[j] = accumulate ? row[j] + edge[i * GEMM_NR + j] : edge[i * GEMM_NR + j];
+        }
+    }
+}
+
+
+/**
+ * Round a dimension up to a whole number of panels.
+ * @param value The dimension
+ * @param panel The panel size
+ * @return The smallest multiple of panel that is at least value
+ */
+static inline int roundUp(int value, int panel)
+{
+    return (value + panel - 1) / panel * panel;
+}
+
+
+/**
+ * The offset of the MR panel starting at row ic of the depth block starting at pc inside
+ * a buffer laid out by kernels::packWeights.
+ * @param m The number of rows of the packed matrix
+ * @param pc The first column of the depth block, a multiple of KC
+ * @param ic The first row of the panel, a multiple of MR
+ * @param kc The depth of the block
+ * @return The offset in floats
+ */
+static inline long int packedOffset(int m, int pc, int ic, int kc)
+{
+    return (long int) pc * roundUp(m, GEMM_MR) + (long int) ic * kc;
+}
+
+
+/**
+ * The blocked product shared by gemmBlocked, gemmStrided and gemmPacked. The operands may
+ * have any strides, they are only read while being packed.
+ * @param a The m*k left operand
+ * @param rsa The row stride of A
+ * @param csa The column stride of A
+ * @param prepacked A laid out by kernels::packWeights, or nullptr to pack it here
+ * @param b The k*n right operand
+ * @param rsb The row stride of B
+ * @param csb The column stride of B
+ * @param c The m*n output buffer, overwritten
+ * @param m The number of rows of A and C
+ * @param n The number of columns of B and C
+ * @param k The number of columns of A and rows of B
+ */
+static void gemmBlockedImpl(const float *a, int rsa, int csa, const float *prepacked,
+                            const float *b, int rsb, int csb, float *c, int m, int n, int k)
+{
+    // The packing buffers live as long as the thread so repeated products do not allocate
+    thread_local std::vector<float> packedA;
+    thread_local std::vector<float> packedB;
+    packedA.resize((size_t) GEMM_MC * GEMM_KC);
+    packedB.resize((size_t) GEMM_KC * GEMM_NC);
+
+    for(int jc = 0 ; jc < n ; jc += GEMM_NC)
+    {
+        int nc = std::min(GEMM_NC, n - jc);
+        for(int pc = 0 ; pc < k ; pc += GEMM_KC)
+        {
+            int kc = std::min(GEMM_KC, k - pc);
+            packB(b + (long int) pc * rsb + (long int) jc * csb, rsb, csb, kc, nc,
+                  packedB.data());
+
+            for(int ic = 0 ; ic < m ; ic += GEMM_MC)
+            {
+                int mc = std::min(GEMM_MC, m - ic);
+                const float *blockA = packedA.data();
+                if(prepacked != nullptr)
+                {
+                    blockA = prepacked + packedOffset(m, pc, ic, kc);
+                }
+                else
+                {
+                    packA(a + (long int) ic * rsa + (long int) pc * csa, rsa, csa, mc, kc,
+                          packedA.data());
+                }
+
+                for(int jr = 0 ; jr < nc ; jr += GEMM_NR)
+                {
+                    for(int ir = 0 ; ir < mc ; ir += GEMM_MR)
+                    {
+                        microKernel(kc, blockA + ir * kc, packedB.data() + jr * kc,
+                                    c + (long int) (ic + ir) * n + jc + jr, n,
+                                    std::min(GEMM_MR, mc - ir), std::min(GEMM_NR, nc - jr),
+                                    pc != 0);
+                    }
+                }
+            }
+        }
+    }
+}
+
+
+/**
+ * The triple loop product C = A * B over strided operands, for shapes too small to pack.
+ * @param a The m*k left operand
+ * @param rsa The row stride of A
+ * @param csa The column stride of A
+ * @param b The k*n right operand
+ * @param rsb The row stride of B
+ * @param csb The column stride of B
+ * @param c The m*n output buffer, overwritten
+ * @param m The number of rows of A and C
+ * @param n The number of columns of B and C
+ * @param k The number of columns of A and rows of B
+ */
+static void gemmNaiveStrided(const float *a, int rsa, int csa, const float *b, int rsb, int csb,
+                             float *c, int m, int n, int k)
+{
+    for(int i = 0 ; i < m ; i++)
+    {
+        for(int j = 0 ; j < n ; j++)
+        {
+            float result = 0;
+            for(int p = 0 ; p < k ; p++)
+            {
+                result = result + a[(long int) i * rsa + (long int) p * csa] *
+                                  b[(long int) p * rsb + (long int) j * csb];
+            }
+            c[(long int) i * n + j] = result;
+        }
+    }
+}
+
+
+/**
+ * The product C = A * B of a row-major A and a few strided columns of B, such as one image
+ * sliced out of a batch. Every column is gathered into a contiguous buffer and multiplied
+ * by the vectorized GEMV, which beats the triple loop even counting the copy.
+ * @param a The m*k row-major left operand
+ * @param b The k*n right operand
+ * @param rsb The row stride of B
+ * @param csb The column stride of B
+ * @param c The m*n output buffer, overwritten
+ * @param m The number of rows of A and C
+ * @param n The number of columns of B and C
+ * @param k The number of columns of A and rows of B
+ */
+static void gemvColumns(const float *a, const float *b, int rsb, int csb, float *c, int m,
+                        int n, int k)
+{
+    // The buffers live as long as the thread so repeated products do not allocate
+    thread_local std::vector<float> column;
+    thread_local std::vector<float> product;
+    column.resize(k);
+    if(n > 1)
+    {
+        product.resize(m);
+    }
+
+    for(int j = 0 ; j < n ; j++)
+    {
+        const float *source = b + (long int) j * csb;
+        for(int p = 0 ; p < k ; p++)
+        {
+            column[p] = source[(long int) p * rsb];
+        }
+        if(n == 1)
+        {
+            kernels::gemv(a, column.data(), c, m, k);
+            continue;
+        }
+
+        kernels::gemv(a, column.data(), product.data(), m, k);
+        for(int i = 0 ; i < m ; i++)
+        {
+            c[(long int) i * n + j] = product[i];
+        }
+    }
+}
+
+
+// ----------------------- function implementation ----------------------
+
+/**
+* Getter of the instruction set the kernels currently dispatch to. On first use it is
+* the widest one both the CPU and the build support.
+* @return The active SIMD level
+*/
+kernels::SimdLevel kernels::getSimdLevel()
+{
+    return activeLevel();
+}
+
+
+/**
+* Limit the kernels to the given instruction set, mostly for comparing the paths against
+* each other. Requests above what the CPU supports are clamped to the detected level.
+* @param level The widest SIMD level the kernels may use
+*/
+void kernels::setSimdLevel(SimdLevel level)
+{
+    activeLevel() = std::min(level, detectSimdLevel());
+}
+
+
+/**
+* Getter of a printable name of a SIMD level
+* @param level The SIMD level
+* @return The name of the level
+*/
+const char *kernels::simdLevelName(SimdLevel level)
+{
+    switch(level)
+    {
+        case Sse2:
+            return "sse2";
+        case Avx2:
+            return "avx2";
+        case Avx512:
+            return "avx512";
+        default:
+            return "scalar";
+    }
+}
+
+
+/**
+* Elementwise addition out = a + b. out may alias a or b.
+* @param a The first operand
+* @param b The second operand
+* @param out The output buffer
+* @param n The number of elements
+*/
+void kernels::add(const float *a, const float *b, float *out, int n)
+{
+    switch(activeLevel())
+    {
+#ifdef KERNELS_X86
+        case Avx512:
+            addAvx512(a, b, out, n);
+            return;
+        case Avx2:
+            addAvx2(a, b, out, n);
+            return;
+        case Sse2:
+            addSse2(a, b, out, n);
+            return;
+#endif
+        default:
+            for(int i = 0 ; i < n ; i++)
+            {
+                out[i] = a[i] + b[i];
+            }
+    }
+}
+
+
+/**
+* Elementwise scaling out = a * scalar. out may alias a.
+* @param a The operand
+* @param scalar The scalar to multiply by
+* @param out The output buffer
+* @param n The number of elements
+*/
+void kernels::scale(const float *a, float scalar, float *out, int n)
+{
+    switch(activeLevel())
+    {
+#ifdef KERNELS_X86
+        case Avx512:
+            scaleAvx512(a, scalar, out, n);
+            return;
+        case Avx2:
+            scaleAvx2(a, scalar, out, n);
+            return;
+        case Sse2:
+            scaleSse2(a, scalar, out, n);
+            return;
+#endif
+        default:
+            for(int i = 0 ; i < n ; i++)
+            {
+                out[i] = a[i] * scalar;
+            }
+    }
+}
+
+
+/**
+* Matrix vector product y = A * x, streaming every row of A once.
+* @param a The m*k row-major matrix
+* @param x The vector of k elements
+* @param y The output vector of m elements, overwritten
+* @param m The number of rows of A
+* @param k The number of columns of A
+*/
+void kernels::gemv(const float *a, const float *x, float *y, int m, int k)
+{
+    denseForward(a, x, nullptr, y, m, k, false);
+}
+
+
+/**
+* A whole dense layer y = act(A * x + bias) in one pass: every output element gets its
+* bias and ReLU while its dot product is still in a register.
+* @param a The m*k row-major weights matrix
+* @param x The input vector of k elements
+* @param bias The bias vector of m elements, or nullptr for none
+* @param y The output vector of m elements, overwritten
+* @param m The number of rows of A
+* @param k The number of columns of A
+* @param relu Whether to apply ReLU to the output
+*/
+void kernels::denseForward(const float *a, const float *x, const float *bias, float *y,
+                           int m, int k, bool relu)
+{
+    switch(activeLevel())
+    {
+#ifdef KERNELS_X86
+        case Avx512:
+            gemvAvx512(a, x, bias, y, m, k, relu);
+            return;
+        case Avx2:
+            gemvAvx2(a, x, bias, y, m, k, relu);
+            return;
+        case Sse2:
+            gemvSse2(a, x, bias, y, m, k, relu);
+            return;
+#endif
+        default:
+            for(int i = 0 ; i < m ; i++)
+            {
+                y[i] = denseEpilogue(dotScalar(a + (long int) i * k, x, k), bias, i, relu);
+            }
+    }
+}
+
+
+/**
+* Broadcast a bias column over a matrix, c[i][j] = act(c[i][j] + bias[i]). This is the
+* epilogue of a dense layer applied to a batch of column inputs.
+* @param c The m*n row-major matrix, updated in place
+* @param bias The bias vector of m elements
+* @param m The number of rows of C
+* @param n The number of columns of C
+* @param relu Whether to apply ReLU to the output
+*/
+void kernels::addBias(float *c, const float *bias, int m, int n, bool relu)
+{
+    for(int i = 0 ; i < m ; i++)
+    {
+        float *row = c + (long int) i * n;
+        float b = bias[i];
+        if(relu)
+        {
+            for(int j = 0 ; j < n ; j++)
+            {
+                float value = row[j] + b;
+                row[j] = value >= 0 ? value : 0;
+            }
+        }
+        else
+        {
+            for(int j = 0 ; j < n ; j++)
+            {
+                row[j] += b;
+            }
+        }
+    }
+}
+
+
+/**
+* The reference triple loop product C = A * B, kept for tiny shapes where packing
+* the operands costs more than it saves.
+* @param a The m*k left operand
+* @param b The k*n right operand
+* @param c The m*n output buffer, overwritten
+* @param m The number of rows of A and C
+* @param n The number of columns of B and C
+* @param k The number of columns of A and rows of B
+*/
+void kernels::gemmNaive(const float *a, const float *b, float *c, int m, int n, int k)
+{
+    for(int i = 0 ; i < m ; i++)
+    {
+        for(int j = 0 ; j < n ; j++)
+        {
+            float result = 0;
+            for(int p = 0 ; p < k ; p++)
+            {
+                result = result + a[(long int) i * k + p] * b[(long int) p * n + j];
+            }
+            c[(long int) i * n + j] = result;
+        }
+    }
+}
+
+
+/**
+* Cache blocked product C = A * B. B is packed into NR wide panels, A into MR high
+* panels, and every MR*NR tile of C is accumulated in registers.
+* @param a The m*k left operand
+* @param b The k*n right operand
+* @param c The m*n output buffer, overwritten
+* @param m The number of rows of A and C
+* @param n The number of columns of B and C
+* @param k The number of columns of A and rows of B
+*/
+void kernels::gemmBlocked(const float *a, const float *b, float *c, int m, int n, int k)
+{
+    gemmBlockedImpl(a, k, 1, nullptr, b, n, 1, c, m, n, k);
+}
+
+
+/**
+* The number of floats packWeights needs for an m*k matrix.
+* @param m The number of rows of the matrix
+* @param k The number of columns of the matrix
+* @return The size of the packed buffer
+*/
+long int kernels::packedWeightsSize(int m, int k)
+{
+    return (long int) roundUp(m, GEMM_MR) * k;
+}
+
+
+/**
+* Pack a left operand once into the exact panel order the blocked product reads it in,
+* so a matrix that multiplies many right operands, such as layer weights, is never
+* packed again.
+* @param a The m*k matrix
+* @param m The number of rows of the matrix
+* @param k The number of columns of the matrix
+* @param packed The output buffer of packedWeightsSize(m, k) floats
+*/
+void kernels::packWeights(const float *a, int m, int k, float *packed)
+{
+    for(int pc = 0 ; pc < k ; pc += GEMM_KC)
+    {
+        int kc = std::min(GEMM_KC, k - pc);
+        packA(a + pc, k, 1, m, kc, packed + packedOffset(m, pc, 0, kc));
+    }
+}
+
+
+/**
+* Compute C = A * B like gemm, taking the left operand from its packWeights layout
+* whenever the blocked implementation is chosen. The right operand may be strided.
+* @param a The m*k left operand
+* @param packedA The same operand as laid out by packWeights
+* @param b The k*n right operand
+* @param rsb The row stride of B
+* @param csb The column stride of B
+* @param c The m*n output buffer, overwritten
+* @param m The number of rows of A and C
+* @param n The number of columns of B and C
+* @param k The number of columns of A and rows of B
+*/
+void kernels::gemmPacked(const float *a, const float *packedA, const float *b, int rsb, int csb,
+                         float *c, int m, int n, int k)
+{
+    if(n < GEMM_BLOCKED_MIN_COLS || (long int) m * n * k <= GEMM_NAIVE_MAX_WORK)
+    {
+        gemmStrided(a, k, 1, b, rsb, csb, c, m, n, k);
+        return;
+    }
+
+    gemmBlockedImpl(a, k, 1, packedA, b, rsb, csb, c, m, n, k);
+}
+
+
+/**
+* Compute C = A * B for operands of any strides, such as slices and transposed views.
+* Plain row-major operands go through gemm, a few strided columns of B times a row-major A
+* are gathered into GEMVs, the others are read in place while packing.
+* @param a The m*k left operand
+* @param rsa The row stride of A
+* @param csa The column stride of A
+* @param b The k*n right operand
+* @param rsb The row stride of B
+* @param csb The column stride of B
+* @param c The m*n output buffer, overwritten
+* @param m The number of rows of A and C
+* @param n The number of columns of B and C
+* @param k The number of columns of A and rows of B
+*/
+void kernels::gemmStrided(const float *a, int rsa, int csa, const float *b, int rsb, int csb,
+                          float *c, int m, int n, int k)
+{
+    bool plainA = (csa == 1 || k == 1) && (rsa == k || m == 1);
+    bool plainB = (csb == 1 || n == 1) && (rsb == n || k == 1);
+    if(plainA && plainB)
+    {
+        gemm(a, b, c, m, n, k);
+        return;
+    }
+
+    if(plainA && n < GEMM_BLOCKED_MIN_COLS)
+    {
+        gemvColumns(a, b, rsb, csb, c, m, n, k);
+        return;
+    }
+
+    if(n < GEMM_BLOCKED_MIN_COLS || (long int) m * n * k <= GEMM_NAIVE_MAX_WORK)
+    {
+        gemmNaiveStrided(a, rsa, csa, b, rsb, csb, c, m, n, k);
+        return;
+    }
+
+    gemmBlockedImpl(a, rsa, csa, nullptr, b, rsb, csb, c, m, n, k);
+}
+
+
+/**
+* Compute C = A * B choosing the gemv, naive or blocked implementation by the shape.
+* @param a The m*k left operand
+* @param b The k*n right operand
+* @param c The m*n output buffer, overwritten
+* @param m The number of rows of A and C
+* @param n The number of columns of B and C
+* @param k The number of columns of A and rows of B
+*/
+void kernels::gemm(const float *a, const float *b, float *c, int m, int n, int k)
+{
+    if(n == 1)
+    {
+        gemv(a, b, c, m, k);
+        return;
+    }
+
+    if(n < GEMM_BLOCKED_MIN_COLS || (long int) m * n * k <= GEMM_NAIVE_MAX_WORK)
+    {
+        gemmNaive(a, b, c, m, n, k);
+        return;
+    }
+
+    gemmBlocked(a, b, c, m, n, k);
+}
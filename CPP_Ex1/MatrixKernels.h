@@ -0,0 +1,257 @@
+/**
+ * @file MatrixKernels.h
+ * @author  Liron Gershuny <liron.gershuny@mail.huji.ac.il>
+ * @version 1.0
+ * @date 25 Dec 2019
+ *
+ * @brief Define the low level numeric kernels that the Matrix operators are built on.
+ *
+ * @section LICENSE
+ * This program is not a free software; bla bla bla...
+ *
+ * @section DESCRIPTION
+ * The kernels work on raw row-major float buffers so they can be shared between Matrix
+ * and the network layers without any copies.
+ * Input  : Raw float buffers and their dimensions
+ * Process: Cache blocked, register tiled and SIMD arithmetic, dispatched at runtime
+ * Output : The result written into a caller supplied buffer
+ */
+
+#ifndef MATRIX_KERNELS_H
+#define MATRIX_KERNELS_H
+
+
+// -------------------------- const definitions -------------------------
+
+/*
+ * @def GEMM_MR 6
+ * @brief The number of rows of C computed at once by the register micro kernel
+ */
+#define GEMM_MR 6
+
+/*
+ * @def GEMM_NR 16
+ * @brief The number of columns of C computed at once by the register micro kernel
+ */
+#define GEMM_NR 16
+
+/*
+ * @def GEMM_MC 72
+ * @brief The number of rows of A packed together, sized so the packed block stays in L2
+ */
+#define GEMM_MC 72
+
+/*
+ * @def GEMM_KC 256
+ * @brief The depth of a packed panel, sized so a B micro panel stays in L1
+ */
+#define GEMM_KC 256
+
+/*
+ * @def GEMM_NC 1024
+ * @brief The number of columns of B packed together
+ */
+#define GEMM_NC 1024
+
+/*
+ * @def GEMM_NAIVE_MAX_WORK 32768
+ * @brief Products with at most this many multiply-adds skip the packed path
+ */
+#define GEMM_NAIVE_MAX_WORK 32768
+
+
+// ------------------------- function definitions -----------------------
+
+namespace kernels
+{
+    /**
+     * @enum SimdLevel
+     * @brief The instruction sets the kernels can be dispatched to, ordered by width.
+     */
+    enum SimdLevel
+    {
+        Scalar,
+        Sse2,
+        Avx2,
+        Avx512
+    };
+
+
+    /**
+     * Getter of the instruction set the kernels currently dispatch to. On first use it is
+     * the widest one both the CPU and the build support.
+     * @return The active SIMD level
+     */
+    SimdLevel getSimdLevel();
+
+
+    /**
+     * Limit the kernels to the given instruction set, mostly for comparing the paths against
+     * each other. Requests above what the CPU supports are clamped to the detected level.
+     * @param level The widest SIMD level the kernels may use
+     */
+    void setSimdLevel(SimdLevel level);
+
+
+    /**
+     * Getter of a printable name of a SIMD level
+     * @param level The SIMD level
+     * @return The name of the level
+     */
+    const char *simdLevelName(SimdLevel level);
+
+
+    /**
+     * Elementwise addition out = a + b. out may alias a or b.
+     * @param a The first operand
+     * @param b The second operand
+     * @param out The output buffer
+     * @param n The number of elements
+     */
+    void add(const float *a, const float *b, float *out, int n);
+
+
+    /**
+     * Elementwise scaling out = a * scalar. out may alias a.
+     * @param a The operand
+     * @param scalar The scalar to multiply by
+     * @param out The output buffer
+     * @param n The number of elements
+     */
+    void scale(const float *a, float scalar, float *out, int n);
+
+
+    /**
+     * Matrix vector product y = A * x, streaming every row of A once.
+     * @param a The m*k row-major matrix
+     * @param x The vector of k elements
+     * @param y The output vector of m elements, overwritten
+     * @param m The number of rows of A
+     * @param k The number of columns of A
+     */
+    void gemv(const float *a, const float *x, float *y, int m, int k);
+
+
+    /**
+     * A whole dense layer y = act(A * x + bias) in one pass: every output element gets its
+     * bias and ReLU while its dot product is still in a register.
+     * @param a The m*k row-major weights matrix
+     * @param x The input vector of k elements
+     * @param bias The bias vector of m elements, or nullptr for none
+     * @param y The output vector of m elements, overwritten
+     * @param m The number of rows of A
+     * @param k The number of columns of A
+     * @param relu Whether to apply ReLU to the output
+     */
+    void denseForward(const float *a, const float *x, const float *bias, float *y,
+                      int m, int k, bool relu);
+
+
+    /**
+     * Broadcast a bias column over a matrix, c[i][j] = act(c[i][j] + bias[i]). This is the
+     * epilogue of a dense layer applied to a batch of column inputs.
+     * @param c The m*n row-major matrix, updated in place
+     * @param bias The bias vector of m elements
+     * @param m The number of rows of C
+     * @param n The number of columns of C
+     * @param relu Whether to apply ReLU to the output
+     */
+    void addBias(float *c, const float *bias, int m, int n, bool relu);
+
+
+    /**
+     * The reference triple loop product C = A * B, kept for tiny shapes where packing
+     * the operands costs more than it saves.
+     * @param a The m*k left operand
+     * @param b The k*n right operand
+     * @param c The m*n output buffer, overwritten
+     * @param m The number of rows of A and C
+     * @param n The number of columns of B and C
+     * @param k The number of columns of A and rows of B
+     */
+    void gemmNaive(const float *a, const float *b, float *c, int m, int n, int k);
+
+
+    /**
+     * Cache blocked product C = A * B. B is packed into NR wide panels, A into MR high
+     * panels, and every MR*NR tile of C is accumulated in registers.
+     * @param a The m*k left operand
+     * @param b The k*n right operand
+     * @param c The m*n output buffer, overwritten
+     * @param m The number of rows of A and C
+     * @param n The number of columns of B and C
+     * @param k The number of columns of A and rows of B
+     */
+    void gemmBlocked(const float *a, const float *b, float *c, int m, int n, int k);
+
+
+    /**
+     * The number of floats packWeights needs for an m*k matrix.
+     * @param m The number of rows of the matrix
+     * @param k The number of columns of the matrix
+     * @return The size of the packed buffer
+     */
+    long int packedWeightsSize(int m, int k);
+
+
+    /**
+     * Pack a left operand once into the exact panel order the blocked product reads it in,
+     * so a matrix that multiplies many right operands, such as layer weights, is never
+     * packed again.
+     * @param a The m*k matrix
+     * @param m The number of rows of the matrix
+     * @param k The number of columns of the matrix
+     * @param packed The output buffer of packedWeightsSize(m, k) floats
+     */
+    void packWeights(const float *a, int m, int k, float *packed);
+
+
+    /**
+     * Compute C = A * B like gemm, taking the left operand from its packWeights layout
+     * whenever the blocked implementation is chosen. The right operand may be strided.
+     * @param a The m*k left operand
+     * @param packedA The same operand as laid out by packWeights
+     * @param b The k*n right operand
+     * @param rsb The row stride of B
+     * @param csb The column stride of B
+     * @param c The m*n output buffer, overwritten
+     * @param m The number of rows of A and C
+     * @param n The number of columns of B and C
+     * @param k The number of columns of A and rows of B
+     */
+    void gemmPacked(const float *a, const float *packedA, const float *b, int rsb, int csb,
+                    float *c, int m, int n, int k);
+
+
+    /**
+     * Compute C = A * B for operands of any strides, such as slices and transposed views.
+     * Plain row-major operands go through gemm, a few strided columns of B times a
+     * row-major A are gathered into GEMVs, the others are read in place while packing.
+     * @param a The m*k left operand
+     * @param rsa The row stride of A
+     * @param csa The column stride of A
+     * @param b The k*n right operand
+     * @param rsb The row stride of B
+     * @param csb The column stride of B
+     * @param c The m*n output buffer, overwritten
+     * @param m The number of rows of A and C
+     * @param n The number of columns of B and C
+     * @param k The number of columns of A and rows of B
+     */
+    void gemmStrided(const float *a, int rsa, int csa, const float *b, int rsb, int csb,
+                     float *c, int m, int n, int k);
+
+
+    /**
+     * Compute C = A * B choosing the gemv, naive or blocked implementation by the shape.
+     * @param a The m*k left operand
+     * @param b The k*n right operand
+     * @param c The m*n output buffer, overwritten
+     * @param m The number of rows of A and C
+     * @param n The number of columns of B and C
+     * @param k The number of columns of A and rows of B
+     */
+    void gemm(const float *a, const float *b, float *c, int m, int n, int k);
+}
+
+#endif //MATRIX_KERNELS_H
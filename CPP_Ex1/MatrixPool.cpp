@@ -0,0 +1,194 @@
+/**
+ * @file MatrixPool.cpp
+ * @author  Liron Gershuny <liron.gershuny@mail.huji.ac.il>
+ * @version 1.0
+ * @date 25 Dec 2019
+ *
+ * @brief Define the allocator that every matrix buffer comes from.
+ *
+ * @section LICENSE
+ * This program is not a free software; bla bla bla...
+ *
+ * @section DESCRIPTION
+ * Buffers are aligned to a cache line and their size is rounded up to whole cache lines.
+ * A released buffer is kept on a free list keyed by its size and handed out again to the
+ * next matrix of the same size.
+ * Input  : The number of floats a matrix needs
+ * Process: Takes a buffer from the free list of its size or allocates a new one
+ * Output : An aligned buffer and its capacity
+ */
+
+// ------------------------------ includes ------------------------------
+#include "MatrixPool.h"
+#include "Profiler.h"
+
+#include <cstdlib>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+#ifdef _WIN32
+#include <malloc.h>
+#endif
+
+
+// -------------------------- const definitions -------------------------
+
+/*
+ * @def FLOATS_PER_LINE (MATRIX_POOL_ALIGNMENT / sizeof(float))
+ * @brief The number of floats in one aligned unit of a buffer
+ */
+#define FLOATS_PER_LINE ((int) (MATRIX_POOL_ALIGNMENT / sizeof(float)))
+
+
+// ------------------------------ functions -----------------------------
+
+/**
+ * @struct FreeLists
+ * @brief The released buffers, keyed by their capacity in floats
+ */
+struct FreeLists
+{
+    std::mutex lock;
+    std::unordered_map<int, std::vector<float *>> buffers;
+};
+
+
+/**
+ * The free lists of the process. They are never destroyed, so matrices that outlive main
+ * can still release their buffers.
+ * @return The free lists
+ */
+static FreeLists &freeLists()
+{
+    static FreeLists *lists = new FreeLists();
+    return *lists;
+}
+
+
+/**
+ * The number of buffers the calling thread has acquired.
+ * @return The counter of the thread
+ */
+static long int &threadAcquisitions()
+{
+    static thread_local long int count = 0;
+    return count;
+}
+
+
+/**
+ * Allocate an aligned buffer.
+ * @param capacity The number of floats, a multiple of FLOATS_PER_LINE
+ * @return The buffer, or nullptr on failure
+ */
+static float *alignedAlloc(int capacity)
+{
+#ifdef _WIN32
+    return (float *) _aligned_malloc(capacity * sizeof(float), MATRIX_POOL_ALIGNMENT);
+#else
+    return (float *) std::aligned_alloc(MATRIX_POOL_ALIGNMENT, capacity * sizeof(float));
+#endif
+}
+
+
+/**
+ * Free a buffer of alignedAlloc.
+ * @param buffer The buffer
+ */
+static void alignedFree(float *buffer)
+{
+#ifdef _WIN32
+    _aligned_free(buffer);
+#else
+    std::free(buffer);
+#endif
+}
+
+
+// ------------------------ class implementation ------------------------
+
+/**
+* Get a buffer for at least count floats. Its contents are unspecified.
+* @param count The number of floats needed, positive
+* @param capacity Receives the number of floats the buffer actually holds
+* @return The buffer, or nullptr if the allocation failed
+*/
+float *MatrixPool::acquire(int count, int &capacity)
+{
+    capacity = (count + FLOATS_PER_LINE - 1) / FLOATS_PER_LINE * FLOATS_PER_LINE;
+    threadAcquisitions()++;
+    PROFILE_ALLOCATION();
+
+    if(capacity <= MATRIX_POOL_MAX_CACHED_FLOATS)
+    {
+        FreeLists &lists = freeLists();
+        std::lock_guard<std::mutex> guard(lists.lock);
+        auto found = lists.buffers.find(capacity);
+        if(found != lists.buffers.end() && !found->second.empty())
+        {
+            float *buffer = found->second.back();
+            found->second.pop_back();
+            return buffer;
+        }
+    }
+
+    return alignedAlloc(capacity);
+}
+
+
+/**
+* Give a buffer back to the pool.
+* @param buffer A buffer returned by acquire, or nullptr
+* @param capacity The capacity acquire reported for it
+*/
+void MatrixPool::release(float *buffer, int capacity)
+{
+    if(buffer == nullptr)
+    {
+        return;
+    }
+
+    if(capacity <= MATRIX_POOL_MAX_CACHED_FLOATS)
+    {
+        FreeLists &lists = freeLists();
+        std::lock_guard<std::mutex> guard(lists.lock);
+        std::vector<float *> &sameSize = lists.buffers[capacity];
+        if(sameSize.size() < MATRIX_POOL_MAX_FREE)
+        {
+            sameSize.push_back(buffer);
+            return;
+        }
+    }
+
+    alignedFree(buffer);
+}
+
+
+/**
+* Free every buffer currently held on the free lists.
+*/
+void MatrixPool::trim()
+{
+    FreeLists &lists = freeLists();
+    std::lock_guard<std::mutex> guard(lists.lock);
+    for(auto &sameSize : lists.buffers)
+    {
+        for(float *buffer : sameSize.second)
+        {
+            alignedFree(buffer);
+        }
+    }
+    lists.buffers.clear();
+}
+
+
+/**
+* Getter of the buffers the calling thread has acquired so far, from the free lists or not,
+* so code that must not touch the pool can be checked for it.
+* @return The count
+*/
+long int MatrixPool::acquisitions()
+{
+    return threadAcquisitions();
+}
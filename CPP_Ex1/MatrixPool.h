@@ -0,0 +1,88 @@
+/**
+ * @file MatrixPool.h
+ * @author  Liron Gershuny <liron.gershuny@mail.huji.ac.il>
+ * @version 1.0
+ * @date 25 Dec 2019
+ *
+ * @brief Define the allocator that every matrix buffer comes from.
+ *
+ * @section LICENSE
+ * This program is not a free software; bla bla bla...
+ *
+ * @section DESCRIPTION
+ * Buffers are aligned to a cache line and their size is rounded up to whole cache lines.
+ * A released buffer is kept on a free list keyed by its size and handed out again to the
+ * next matrix of the same size, so the intermediate matrices of a forward pass, which
+ * recur with the same shapes on every call, stop reaching malloc.
+ * Input  : The number of floats a matrix needs
+ * Process: Takes a buffer from the free list of its size or allocates a new one
+ * Output : An aligned buffer and its capacity
+ */
+
+#ifndef MATRIX_POOL_H
+#define MATRIX_POOL_H
+
+
+// -------------------------- const definitions -------------------------
+
+/*
+ * @def MATRIX_POOL_ALIGNMENT 64
+ * @brief The byte boundary every buffer starts on and its size is a multiple of
+ */
+#define MATRIX_POOL_ALIGNMENT 64
+
+/*
+ * @def MATRIX_POOL_MAX_FREE 8
+ * @brief The most released buffers kept per size, the rest are freed
+ */
+#define MATRIX_POOL_MAX_FREE 8
+
+/*
+ * @def MATRIX_POOL_MAX_CACHED_FLOATS (1 << 20)
+ * @brief Buffers larger than this many floats are freed on release instead of kept
+ */
+#define MATRIX_POOL_MAX_CACHED_FLOATS (1 << 20)
+
+
+// -------------------------- class definitions -------------------------
+
+/**
+ * A process wide, thread safe pool of aligned float buffers with one free list per size.
+ */
+class MatrixPool
+{
+public:
+
+    /**
+     * Get a buffer for at least count floats. Its contents are unspecified.
+     * @param count The number of floats needed, positive
+     * @param capacity Receives the number of floats the buffer actually holds
+     * @return The buffer, or nullptr if the allocation failed
+     */
+    static float *acquire(int count, int &capacity);
+
+
+    /**
+     * Give a buffer back to the pool.
+     * @param buffer A buffer returned by acquire, or nullptr
+     * @param capacity The capacity acquire reported for it
+     */
+    static void release(float *buffer, int capacity);
+
+
+    /**
+     * Free every buffer currently held on the free lists.
+     */
+    static void trim();
+
+
+    /**
+     * Getter of the buffers the calling thread has acquired so far, from the free lists or
+     * not, so code that must not touch the pool can be checked for it.
+     * @return The count
+     */
+    static long int acquisitions();
+
+};
+
+#endif //MATRIX_POOL_H
@@ -0,0 +1,288 @@
+/**
+ * @file MatrixView.cpp
+ * @author  Liron Gershuny <liron.gershuny@mail.huji.ac.il>
+ * @version 1.0
+ * @date 25 Dec 2019
+ *
+ * @brief Define a non-owning, strided view over the values of a matrix.
+ *
+ * @section LICENSE
+ * This program is not a free software; bla bla bla...
+ *
+ * @section DESCRIPTION
+ * Reshapes, slices and transposes only compute a new pointer and new strides. The
+ * arithmetic hands the strides to the kernels, or walks them directly where the kernels
+ * need plain row-major storage.
+ * Input  : A matrix or a buffer of floats
+ * Process: Describes a part or a reshaping of it
+ * Output : Read only access to the described values
+ */
+
+// ------------------------------ includes ------------------------------
+#include "MatrixView.h"
+#include "MatrixKernels.h"
+#include <algorithm>
+
+
+// ------------------------------ functions -----------------------------
+
+/**
+ * Apply an element wise operation to the values of a view into a new matrix
+ * @param a The view
+ * @param op Computes an output element from an input element
+ * @return A new matrix of the results, in the shape of the view
+ */
+template <typename Op>
+static Matrix mapView(const MatrixView &a, const Op &op)
+{
+    Matrix result(a.getRows(), a.getCols());
+    float *out = result.data();
+    for(int i = 0 ; i < a.getRows() ; i++)
+    {
+        const float *in = a.data() + (long int) i * a.getRowStride();
+        for(int j = 0 ; j < a.getCols() ; j++)
+        {
+            *out++ = op(*in);
+            in += a.getColStride();
+        }
+    }
+
+    return result;
+}
+
+
+// ------------------------ class implementation ------------------------
+
+/**
+* Constructor of a view over a whole matrix, in its own shape.
+* @param m The matrix to view
+*/
+MatrixView::MatrixView(const Matrix &m) : pData(m.data()), dimensions({m.getRows(), m.getCols()}),
+rowStride(m.getCols()), colStride(1)
+{
+}
+
+
+/**
+* Constructor of a view over any strided buffer.
+* @param data The first element
+* @param rows The number of rows
+* @param cols The number of columns
+* @param rowStride The distance between two consecutive rows
+* @param colStride The distance between two consecutive columns
+*/
+MatrixView::MatrixView(const float *data, int rows, int cols, int rowStride, int colStride) :
+pData(data), dimensions({rows, cols}), rowStride(rowStride), colStride(colStride)
+{
+    if(rows <= 0 || cols <= 0)
+    {
+        throw std::invalid_argument(INVALID_MATRIX_INIT_DIMENSIONS_MSG);
+    }
+}
+
+
+/**
+* Whether the view is plain row-major storage, the layout of a Matrix.
+* @return true - element (i, j) is at data()[i * getCols() + j]
+*         false - the rows or the columns are strided
+*/
+bool MatrixView::isContiguous() const
+{
+    return (colStride == 1 || dimensions.cols == 1) &&
+           (rowStride == dimensions.cols || dimensions.rows == 1);
+}
+
+
+/**
+* Whether the view shares memory with the given matrix.
+* @param m The matrix
+* @return true - writing into m may change the view
+*         false - the two are disjoint
+*/
+bool MatrixView::overlaps(const Matrix &m) const
+{
+    const float *last = pData + (long int) (dimensions.rows - 1) * rowStride +
+                        (long int) (dimensions.cols - 1) * colStride;
+    const float *first = std::min(pData, last);
+    last = std::max(pData, last);
+
+    return m.data() != nullptr && first < m.data() + m.getCapacity() && m.data() <= last;
+}
+
+
+/**
+* The same values in another shape, row-major order is kept. Only contiguous views can
+* be reshaped.
+* @param rows The new number of rows
+* @param cols The new number of columns
+* @return The reshaped view
+*/
+MatrixView MatrixView::reshape(int rows, int cols) const
+{
+    if(!isContiguous() || (long int) rows * cols != (long int) dimensions.rows * dimensions.cols)
+    {
+        throw std::invalid_argument(INVALID_VIEW_RESHAPE_MSG);
+    }
+
+    return MatrixView(pData, rows, cols, cols, 1);
+}
+
+
+/**
+* A range of rows of the view.
+* @param begin The first row
+* @param count The number of rows
+* @return The view of the rows
+*/
+MatrixView MatrixView::rowSlice(int begin, int count) const
+{
+    if(begin < 0 || count <= 0 || begin + count > dimensions.rows)
+    {
+        throw std::out_of_range(INVALID_VIEW_SLICE_MSG);
+    }
+
+    return MatrixView(pData + (long int) begin * rowStride, count, dimensions.cols, rowStride,
+                      colStride);
+}
+
+
+/**
+* A range of columns of the view, e.g. some samples of a batch.
+* @param begin The first column
+* @param count The number of columns
+* @return The view of the columns
+*/
+MatrixView MatrixView::colSlice(int begin, int count) const
+{
+    if(begin < 0 || count <= 0 || begin + count > dimensions.cols)
+    {
+        throw std::out_of_range(INVALID_VIEW_SLICE_MSG);
+    }
+
+    return MatrixView(pData + (long int) begin * colStride, dimensions.rows, count, rowStride,
+                      colStride);
+}
+
+
+/**
+* The transposed view, it reads the same values with the strides exchanged.
+* @return The cols x rows view
+*/
+MatrixView MatrixView::transpose() const
+{
+    return MatrixView(pData, dimensions.cols, dimensions.rows, colStride, rowStride);
+}
+
+
+/**
+* The checked access to the (i, j) element of the view, throws std::out_of_range for
+* indices out of the view dimensions
+* @param i The index of the row
+* @param j The index of the column
+* @return The i,j element of the view
+*/
+const float &MatrixView::at(int i, int j) const
+{
+    if(i < 0 || i >= dimensions.rows || j < 0 || j >= dimensions.cols)
+    {
+        throw std::out_of_range(INVALID_INPUT_DIMENSIONS_MSG);
+    }
+
+    return pData[(long int) i * rowStride + (long int) j * colStride];
+}
+
+
+// ----------------------- function implementation ----------------------
+
+/**
+* Matrix multiplication of two views, the strides are handled while the operands are
+* packed so no operand is copied first
+* @param a The left operand
+* @param b The right operand
+* @return A new matrix of the product
+*/
+Matrix operator*(const MatrixView &a, const MatrixView &b)
+{
+    if(a.getCols() != b.getRows())
+    {
+        throw std::invalid_argument(INVALID_MATRIX_MULTIPLICATION_DIMENSIONS_MSG);
+    }
+
+    Matrix result(a.getRows(), b.getCols());
+    kernels::gemmStrided(a.data(), a.getRowStride(), a.getColStride(), b.data(),
+                         b.getRowStride(), b.getColStride(), result.data(), a.getRows(),
+                         b.getCols(), a.getCols());
+
+    return result;
+}
+
+
+/**
+* Matrix addition of two views
+* @param a The first operand
+* @param b The second operand
+* @return A new matrix of the sum
+*/
+Matrix operator+(const MatrixView &a, const MatrixView &b)
+{
+    if(a.getRows() != b.getRows() || a.getCols() != b.getCols())
+    {
+        throw std::invalid_argument(INVALID_MATRIX_ADDITION_DIMENSIONS_MSG);
+    }
+
+    Matrix result(a.getRows(), a.getCols());
+    if(a.isContiguous() && b.isContiguous())
+    {
+        kernels::add(a.data(), b.data(), result.data(), a.getRows() * a.getCols());
+        return result;
+    }
+
+    float *out = result.data();
+    for(int i = 0 ; i < a.getRows() ; i++)
+    {
+        const float *rowA = a.data() + (long int) i * a.getRowStride();
+        const float *rowB = b.data() + (long int) i * b.getRowStride();
+        for(int j = 0 ; j < a.getCols() ; j++)
+        {
+            *out++ = *rowA + *rowB;
+            rowA += a.getColStride();
+            rowB += b.getColStride();
+        }
+    }
+
+    return result;
+}
+
+
+/**
+* Scalar multiplication of a view on the right
+* @param a The view
+* @param scalar The scalar
+* @return A new matrix of the scaled values
+*/
+Matrix operator*(const MatrixView &a, const float &scalar)
+{
+    if(a.isContiguous())
+    {
+        Matrix result(a.getRows(), a.getCols());
+        kernels::scale(a.data(), scalar, result.data(), a.getRows() * a.getCols());
+        return result;
+    }
+
+    return mapView(a, [scalar](float value)
+    {
+        return value * scalar;
+    });
+}
+
+
+/**
+* Scalar multiplication of a view on the left
+* @param scalar The scalar
+* @param a The view
+* @return A new matrix of the scaled values
+*/
+Matrix operator*(const float &scalar, const MatrixView &a)
+{
+    return a * scalar;
+}
@@ -0,0 +1,239 @@
+/**
+ * @file MatrixView.h
+ * @author  Liron Gershuny <liron.gershuny@mail.huji.ac.il>
+ * @version 1.0
+ * @date 25 Dec 2019
+ *
+ * @brief Define a non-owning, strided view over the values of a matrix.
+ *
+ * @section LICENSE
+ * This program is not a free software; bla bla bla...
+ *
+ * @section DESCRIPTION
+ * A view is a pointer, dimensions and a stride per dimension, so reshaping a contiguous
+ * matrix, taking a range of its rows or columns and transposing it only build a new view
+ * and never copy a value. Views are accepted wherever a matrix is read: by the matrix
+ * arithmetic, by the layers and by the network.
+ * Input  : A matrix or a buffer of floats
+ * Process: Describes a part or a reshaping of it
+ * Output : Read only access to the described values
+ */
+
+#ifndef MATRIX_VIEW_H
+#define MATRIX_VIEW_H
+
+// ------------------------------ includes ------------------------------
+#include "Matrix.h"
+
+
+// -------------------------- const definitions -------------------------
+
+/*
+ * @def INVALID_VIEW_RESHAPE_MSG "Error: Only a contiguous view of the same size can be
+ *      reshaped"
+ * @brief Error msg when reshaping a strided view or changing its number of elements
+ */
+#define INVALID_VIEW_RESHAPE_MSG "Error: Only a contiguous view of the same size can be reshaped"
+
+/*
+ * @def INVALID_VIEW_SLICE_MSG "Error: The slice is out of the view dimensions"
+ * @brief Error msg when taking rows or columns that the view doesn't have
+ */
+#define INVALID_VIEW_SLICE_MSG "Error: The slice is out of the view dimensions"
+
+
+// -------------------------- class definitions -------------------------
+
+/**
+ * A read only window over rows*cols floats, element (i, j) is at
+ * data()[i * getRowStride() + j * getColStride()]. The view never owns its values, they
+ * must outlive it, and a view of a matrix is invalidated when the matrix is resized.
+ */
+class MatrixView
+{
+private:
+    const float *pData;
+    MatrixDims dimensions;
+    int rowStride;
+    int colStride;
+
+public:
+
+    /**
+     * Constructor of a view over a whole matrix, in its own shape.
+     * @param m The matrix to view
+     */
+    MatrixView(const Matrix &m);
+
+
+    /**
+     * Constructor of a view over any strided buffer.
+     * @param data The first element
+     * @param rows The number of rows
+     * @param cols The number of columns
+     * @param rowStride The distance between two consecutive rows
+     * @param colStride The distance between two consecutive columns
+     */
+    MatrixView(const float *data, int rows, int cols, int rowStride, int colStride = 1);
+
+
+    /**
+     * Getter of the view number of rows.
+     * @return The number of rows
+     */
+    int getRows() const { return dimensions.rows; }
+
+
+    /**
+     * Getter of the view number of columns.
+     * @return The number of columns
+     */
+    int getCols() const { return dimensions.cols; }
+
+
+    /**
+     * Getter of the distance between two consecutive rows.
+     * @return The row stride in elements
+     */
+    int getRowStride() const { return rowStride; }
+
+
+    /**
+     * Getter of the distance between two consecutive columns.
+     * @return The column stride in elements
+     */
+    int getColStride() const { return colStride; }
+
+
+    /**
+     * Getter of the first element of the view.
+     * @return A pointer to element (0, 0)
+     */
+    const float *data() const { return pData; }
+
+
+    /**
+     * Whether the view is plain row-major storage, the layout of a Matrix.
+     * @return true - element (i, j) is at data()[i * getCols() + j]
+     *         false - the rows or the columns are strided
+     */
+    bool isContiguous() const;
+
+
+    /**
+     * Whether the view shares memory with the given matrix.
+     * @param m The matrix
+     * @return true - writing into m may change the view
+     *         false - the two are disjoint
+     */
+    bool overlaps(const Matrix &m) const;
+
+
+    /**
+     * The same values in another shape, row-major order is kept. Only contiguous views can
+     * be reshaped.
+     * @param rows The new number of rows
+     * @param cols The new number of columns
+     * @return The reshaped view
+     */
+    MatrixView reshape(int rows, int cols) const;
+
+
+    /**
+     * A range of rows of the view.
+     * @param begin The first row
+     * @param count The number of rows
+     * @return The view of the rows
+     */
+    MatrixView rowSlice(int begin, int count) const;
+
+
+    /**
+     * A range of columns of the view, e.g. some samples of a batch.
+     * @param begin The first column
+     * @param count The number of columns
+     * @return The view of the columns
+     */
+    MatrixView colSlice(int begin, int count) const;
+
+
+    /**
+     * A single column of the view, e.g. one sample of a batch.
+     * @param j The column
+     * @return The rows x 1 view of the column
+     */
+    MatrixView col(int j) const { return colSlice(j, 1); }
+
+
+    /**
+     * The transposed view, it reads the same values with the strides exchanged.
+     * @return The cols x rows view
+     */
+    MatrixView transpose() const;
+
+
+    /**
+     * The checked access to the (i, j) element of the view, throws std::out_of_range for
+     * indices out of the view dimensions
+     * @param i The index of the row
+     * @param j The index of the column
+     * @return The i,j element of the view
+     */
+    const float &at(int i, int j) const;
+
+
+    /**
+     * The parenthesis indexing operator to get the (i, j) element of the view. Checked only
+     * when MATRIX_CHECK_BOUNDS is set
+     * @param i The index of the row
+     * @param j The index of the column
+     * @return The i,j element of the view
+     */
+    const float &operator()(int i, int j) const
+    {
+        return MATRIX_CHECK_BOUNDS ? at(i, j) :
+               pData[(long int) i * rowStride + (long int) j * colStride];
+    }
+
+};
+
+
+// ------------------------- function definitions -----------------------
+
+/**
+ * Matrix multiplication of two views, the strides are handled while the operands are
+ * packed so no operand is copied first
+ * @param a The left operand
+ * @param b The right operand
+ * @return A new matrix of the product
+ */
+Matrix operator*(const MatrixView &a, const MatrixView &b);
+
+
+/**
+ * Matrix addition of two views
+ * @param a The first operand
+ * @param b The second operand
+ * @return A new matrix of the sum
+ */
+Matrix operator+(const MatrixView &a, const MatrixView &b);
+
+
+/**
+ * Scalar multiplication of a view on the right
+ * @param a The view
+ * @param scalar The scalar
+ * @return A new matrix of the scaled values
+ */
+Matrix operator*(const MatrixView &a, const float &scalar);
+
+
+/**
+ * Scalar multiplication of a view on the left
+ * @param scalar The scalar
+ * @param a The view
+ * @return A new matrix of the scaled values
+ */
+Matrix operator*(const float &scalar, const MatrixView &a);
+
+#endif //MATRIX_VIEW_H
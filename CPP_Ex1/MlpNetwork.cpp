@@ -18,49 +18,467 @@
 
 // ------------------------------ includes ------------------------------
 #include "MlpNetwork.h"
-#include "Dense.h"
+#include "MatrixPool.h"
+#include "Profiler.h"
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <utility>
+
+
+// ------------------------ static helpers ------------------------------
+
+/**
+ * Build the layers of the MNIST network, ReLU on every layer but the last one
+ * @param weights The weights of the MLP_SIZE layers
+ * @param biases The biases of the MLP_SIZE layers
+ * @return The layers, in evaluation order
+ */
+static std::vector<Dense> mnistLayers(const Matrix *weights, const Matrix *biases)
+{
+    std::vector<Dense> layers;
+    layers.reserve(MLP_SIZE);
+    for(int i = 0 ; i < MLP_SIZE ; i++)
+    {
+        PROFILE_SCOPE("copy weights", i, 0, 2.0 * (weights[i].getRows() * weights[i].getCols() +
+                                                    biases[i].getRows()) * sizeof(float));
+        layers.emplace_back(weights[i], biases[i], i == MLP_SIZE - 1 ? Softmax : Relu);
+    }
+    return layers;
+}
 
 
 // ------------------------ class implementation ------------------------
 
 /**
-* A constructor of MlpNetwork. Accepts 2 arrays, size 4 each.
+* A constructor of MlpNetwork from any number of layers. Every layer must accept the
+* output of the one before it. The buffers for a single sample are planned here once.
+* @param denseLayers The layers of the network, in evaluation order
+*/
+MlpNetwork::MlpNetwork(std::vector<Dense> denseLayers) : layers(std::move(denseLayers)), maxWidth(0)
+{
+    for(size_t i = 0 ; i < layers.size() ; i++)
+    {
+        if(i > 0 && layers[i].getInputSize() != layers[i - 1].getOutputSize())
+        {
+            throw std::invalid_argument(INVALID_TOPOLOGY_MSG);
+        }
+        maxWidth = std::max(maxWidth, layers[i].getOutputSize());
+    }
+
+    if(layers.empty())
+    {
+        throw std::invalid_argument(INVALID_TOPOLOGY_MSG);
+    }
+
+    planBuffers(singleBuffers, 1);
+}
+
+
+/**
+* A constructor of the MNIST MlpNetwork. Accepts 2 arrays, size 4 each.
 * one for weights and one for biases.
 * @param weights The weights matrix layer of the network
 * @param biases The bias matrix layer of the network
 */
-MlpNetwork::MlpNetwork(Matrix *weights, Matrix *biases) : weightsLayer(weights),
-biasLayer(biases) {}
+MlpNetwork::MlpNetwork(Matrix *weights, Matrix *biases) :
+MlpNetwork(mnistLayers(weights, biases))
+{
+}
+
+
+/**
+* Switch the weights of every layer to the given precision, see Dense::setPrecision.
+* When layers release their float weights the pool would keep the buffers for later
+* matrices, so it is trimmed once afterwards to give the memory back. Not safe while other
+* threads run the network.
+* @param precision The precision the forward pass should read the weights in
+*/
+void MlpNetwork::setPrecision(WeightPrecision precision)
+{
+    bool released = false;
+    for(Dense &layer : layers)
+    {
+        bool held = layer.hasFloatWeights();
+        layer.setPrecision(precision);
+        released = released || (held && !layer.hasFloatWeights());
+    }
+    if(released)
+    {
+        MatrixPool::trim();
+    }
+}
+
+
+/**
+* Set whether every layer keeps its float weights, see Dense::setTrainable. An inference
+* only network should clear it before setPrecision. Like setPrecision, the pool is trimmed
+* once if layers released their float weights. Not safe while other threads run the
+* network.
+* @param trainable Whether the layers should keep their float weights
+* @throws std::invalid_argument If a layer is made trainable after releasing them
+*/
+void MlpNetwork::setTrainable(bool trainable)
+{
+    bool released = false;
+    for(Dense &layer : layers)
+    {
+        bool held = layer.hasFloatWeights();
+        layer.setTrainable(trainable);
+        released = released || (held && !layer.hasFloatWeights());
+    }
+    if(released)
+    {
+        MatrixPool::trim();
+    }
+}
 
 
 /**
-* Applies the entire network on input.
-* @param other The input matrix represent a handwriting number
+* Getter of how many bytes of weights one forward pass reads.
+* @return The size of the weights of all layers in their current precision
+*/
+long int MlpNetwork::getWeightsBytes() const
+{
+    long int bytes = 0;
+    for(const Dense &layer : layers)
+    {
+        bytes += layer.getWeightsBytes();
+    }
+    return bytes;
+}
+
+
+/**
+* Size the given buffers for batches of up to batchSize samples, so running such
+* batches never allocates.
+* @param buffers The buffers to plan
+* @param batchSize The largest number of samples the buffers will see
+*/
+void MlpNetwork::planBuffers(ForwardBuffers &buffers, int batchSize) const
+{
+    for(Matrix &activation : buffers.activations)
+    {
+        if(activation.getCapacity() < maxWidth * batchSize)
+        {
+            activation.resize(maxWidth, batchSize);
+        }
+    }
+}
+
+
+/**
+* Run every layer on the given input, one sample per column, using caller owned layer
+* buffers. Only the last layer may skip its activation, and only if it is a Softmax.
+* @param input The input of the first layer
+* @param buffers The buffers that receive the layer outputs
+* @param mode Whether a final Softmax is applied
+* @return The output of the last layer, output size x N, stored in one of the buffers
+*/
+const Matrix &MlpNetwork::forward(const MatrixView &input, ForwardBuffers &buffers,
+                                  OutputMode mode) const
+{
+    size_t last = layers.size() - 1;
+    bool activateLast = mode == Probabilities || layers[last].getActivation() != Softmax;
+    PROFILE_SCOPE("forward", PROFILER_NO_LAYER, 0, 0);
+
+    for(size_t i = 0 ; i < layers.size() ; i++)
+    {
+        MatrixView layerInput = i == 0 ? input : MatrixView(buffers.activations[(i - 1) % 2]);
+        PROFILE_SCOPE("layer", (int) i, (2.0 * layers[i].getInputSize() + 1) *
+                      layers[i].getOutputSize() * input.getCols(),
+                      layers[i].getWeightsBytes() + (double) (layers[i].getInputSize() +
+                      layers[i].getOutputSize()) * input.getCols() * sizeof(float));
+        layers[i](layerInput, buffers.activations[i % 2], i != last || activateLast);
+    }
+
+    return buffers.activations[last % 2];
+}
+
+
+/**
+* Applies the entire network on input. The layer outputs are kept between calls so
+* after the first image no memory is allocated.
+* @param other The input column represent a handwriting number, a matrix or a view
+* @param mode Whether a final Softmax is applied
 * @return The max probability digit struct
 */
-Digit MlpNetwork::operator()(const Matrix &other)
+Digit MlpNetwork::operator()(const MatrixView &other, OutputMode mode)
+{
+    prepareWeights();
+    Digit digit;
+    _columnTopK(forward(other, singleBuffers, mode), 0, 1, &digit);
+    return digit;
+}
+
+
+/**
+* Applies the entire network on a batch of images at once, so every layer is a matrix
+* product that reuses the weights from cache across the whole batch.
+* @param images An input size x N matrix, column j holds the j'th vectorized image
+* @param mode Whether a final Softmax is applied
+* @return The max probability digit of every image, in column order
+*/
+std::vector<Digit> MlpNetwork::predictBatch(const MatrixView &images, OutputMode mode)
 {
-    Dense stepOne(weightsLayer[0], biasLayer[0], Relu);
-    Dense stepTwo(weightsLayer[1], biasLayer[1], Relu);
-    Dense stepThree(weightsLayer[2], biasLayer[2], Relu);
-    Dense stepFour(weightsLayer[3], biasLayer[3], Softmax);
+    prepareWeights();
+    std::vector<Digit> digits(images.getCols());
+    planBuffers(batchBuffers, images.getCols());
+    predictBatch(images, batchBuffers, digits.data(), mode);
+
+    return digits;
+}
 
-    Matrix finalMatrix = stepFour(stepThree(stepTwo(stepOne(other))));
-    unsigned int value = 0;
-    float probability = 0;
 
-    for(int i = 0 ; i < finalMatrix.getRows() ; i++)
+/**
+* Applies the entire network on an array of images by gathering them into one batch.
+* @param images The images, each of them holding input size values in any shape
+* @param count The number of images
+* @param mode Whether a final Softmax is applied
+* @return The max probability digit of every image, in array order
+*/
+std::vector<Digit> MlpNetwork::predictBatch(const Matrix *images, int count, OutputMode mode)
+{
+    if(count <= 0)
     {
-        if(finalMatrix[i] > probability)
+        return std::vector<Digit>();
+    }
+
+    int imageSize = getInputSize();
+    batchInput.resize(imageSize, count);
+    float *batch = batchInput.data();
+    for(int j = 0 ; j < count ; j++)
+    {
+        if(images[j].getRows() * images[j].getCols() != imageSize)
         {
-            probability = finalMatrix[i];
-            value = i;
+            throw std::invalid_argument(INVALID_INPUT_DIMENSIONS_MSG);
         }
+
+        const float *image = images[j].data();
+        for(int i = 0 ; i < imageSize ; i++)
+        {
+            batch[(long int) i * count + j] = image[i];
+        }
+    }
+
+    return predictBatch(batchInput, mode);
+}
+
+
+/**
+* Applies the entire network on a batch of images using caller owned layer buffers.
+* The network itself is not modified, so several threads may call this at once as
+* long as each of them passes its own buffers. A view of some columns of a larger
+* batch is read in place.
+* @param images An input size x N matrix, column j holds the j'th vectorized image
+* @param buffers The buffers that receive the layer outputs
+* @param digits Receives the max probability digit of every image, N entries
+* @param mode Whether a final Softmax is applied
+*/
+void MlpNetwork::predictBatch(const MatrixView &images, ForwardBuffers &buffers,
+                              Digit *digits, OutputMode mode) const
+{
+    const Matrix &finalMatrix = forward(images, buffers, mode);
+
+    for(int j = 0 ; j < finalMatrix.getCols() ; j++)
+    {
+        _columnTopK(finalMatrix, j, 1, digits + j);
+    }
+}
+
+
+/**
+* The k most probable digits of every image of a batch.
+* @param images An input size x N matrix, a single image is a batch of one
+* @param k The number of digits per image, clamped to the number of classes
+* @return N groups of k digits, in column order, each most probable first
+*/
+std::vector<Digit> MlpNetwork::predictTopK(const MatrixView &images, int k)
+{
+    prepareWeights();
+    k = std::max(0, std::min(k, getOutputSize()));
+    std::vector<Digit> top((long int) images.getCols() * k);
+    planBuffers(batchBuffers, images.getCols());
+    predictTopK(images, k, batchBuffers, top.data());
+
+    return top;
+}
+
+
+/**
+* The k most probable digits of every image of a batch using caller owned layer
+* buffers, safe to call from several threads like predictBatch.
+* @param images An input size x N matrix
+* @param k The number of digits per image, at most the number of classes
+* @param buffers The buffers that receive the layer outputs
+* @param top Receives N groups of k digits, in column order, each most probable first
+*/
+void MlpNetwork::predictTopK(const MatrixView &images, int k, ForwardBuffers &buffers,
+                             Digit *top) const
+{
+    const Matrix &finalMatrix = forward(images, buffers, Probabilities);
+
+    for(int j = 0 ; j < finalMatrix.getCols() ; j++)
+    {
+        _columnTopK(finalMatrix, j, k, top + (long int) j * k);
+    }
+}
+
+
+/**
+* The whole probability vector of every image of a batch.
+* @param images An input size x N matrix, a single image is a batch of one
+* @return An output size x N matrix, column j holds the probabilities of image j
+*/
+Matrix MlpNetwork::predictProbabilities(const MatrixView &images)
+{
+    prepareWeights();
+    planBuffers(batchBuffers, images.getCols());
+    return forward(images, batchBuffers, Probabilities);
+}
+
+
+/**
+* The logits of every image of a batch, the last layer before its Softmax.
+* @param images An input size x N matrix, a single image is a batch of one
+* @return An output size x N matrix, column j holds the logits of image j
+*/
+Matrix MlpNetwork::predictLogits(const MatrixView &images)
+{
+    prepareWeights();
+    planBuffers(batchBuffers, images.getCols());
+    return forward(images, batchBuffers, Logits);
+}
+
+
+/**
+* Find the k most probable digits of one sample of the final layer output by insertion
+* into a sorted prefix, the number of classes is small enough that this beats a heap
+* @param probabilities The output of the last layer
+* @param col The column of the sample
+* @param k The number of digits, at most the number of rows
+* @param top Receives the k digits, most probable first, ties in class order
+*/
+void MlpNetwork::_columnTopK(const Matrix &probabilities, int col, int k, Digit *top)
+{
+    if(k <= 0)
+    {
+        return;
+    }
+
+    const float *column = probabilities.data() + col;
+    int cols = probabilities.getCols();
+    int found = 0;
+
+    for(int i = 0 ; i < probabilities.getRows() ; i++)
+    {
+        float probability = column[(long int) i * cols];
+        if(found == k && !(probability > top[k - 1].probability))
+        {
+            continue;
+        }
+
+        int position = found < k ? found++ : k - 1;
+        while(position > 0 && probability > top[position - 1].probability)
+        {
+            top[position] = top[position - 1];
+            position--;
+        }
+        top[position] = Digit{(unsigned int) i, probability};
+    }
+}
+
+
+/**
+* Compute the cross entropy loss of a batch and its gradient by the parameters of every
+* layer. The forward pass reads the float weights of every layer, whatever their precision
+* and sparse mode, keeps the output of every layer and leaves the logits of the last one,
+* so the gradient by the logits is simply the probabilities minus the one hot labels. Every
+* layer then turns the gradient by its output into the gradient by its parameters and by
+* its input, back to front.
+* @param images An input size x N matrix or view, column j holds the j'th sample
+* @param labels The class of every sample, N entries
+* @param buffers The buffers that receive the layer outputs, and in layers the gradient of
+*                every layer, summed over the samples
+* @return The loss summed over the samples
+* @throws std::invalid_argument If the last layer isn't a Softmax or an activation can't be
+*         differentiated
+* @throws std::out_of_range If a label isn't a class of the network
+*/
+float MlpNetwork::backward(const MatrixView &images, const int *labels,
+                           TrainingBuffers &buffers) const
+{
+    size_t last = layers.size() - 1;
+    if(layers[last].getActivation() != Softmax)
+    {
+        throw std::invalid_argument(INVALID_TRAINING_OUTPUT_MSG);
+    }
+    int count = images.getCols();
+    int classes = getOutputSize();
+    for(int j = 0 ; j < count ; j++)
+    {
+        if(labels[j] < 0 || labels[j] >= classes)
+        {
+            throw std::out_of_range(INVALID_LABEL_MSG);
+        }
+    }
+
+    PROFILE_SCOPE("backward", PROFILER_NO_LAYER, 0, 0);
+    buffers.outputs.resize(layers.size());
+    buffers.layers.resize(layers.size());
+    for(size_t i = 0 ; i < layers.size() ; i++)
+    {
+        MatrixView layerInput = i == 0 ? images : MatrixView(buffers.outputs[i - 1]);
+        layers[i].applyFloat(layerInput, buffers.outputs[i], i != last);
+    }
+
+    Matrix &gradient = buffers.gradients[last % 2];
+    gradient = buffers.outputs[last];
+    Activation(Softmax).apply(gradient);
+    float loss = 0;
+    for(int j = 0 ; j < count ; j++)
+    {
+        float &probability = gradient.row(labels[j])[j];
+        loss -= std::log(std::max(probability, FLT_MIN));
+        probability -= 1;
+    }
+
+    for(size_t i = last + 1 ; i-- > 0 ; )
+    {
+        MatrixView layerInput = i == 0 ? images : MatrixView(buffers.outputs[i - 1]);
+        Matrix *inputGradient = i == 0 ? nullptr : &buffers.gradients[(i - 1) % 2];
+        PROFILE_SCOPE("layer gradient", (int) i, 0, 0);
+        layers[i].backward(layerInput, buffers.outputs[i], buffers.gradients[i % 2],
+                           buffers.layers[i], inputGradient, i != last);
     }
 
-    Digit finalDigit{value, probability};
+    return loss;
+}
+
 
-    return finalDigit;
+/**
+* Add a step to the parameters of one layer, see Dense::updateParameters. Not safe while
+* other threads run the network.
+* @param i The index of the layer, in evaluation order
+* @param weightsStep The change of every weight
+* @param biasStep The change of every bias
+*/
+void MlpNetwork::updateLayer(int i, const Matrix &weightsStep, const Matrix &biasStep)
+{
+    layers.at(i).updateParameters(weightsStep, biasStep);
 }
 
 
+/**
+* Rebuild the copy of the weights the forward pass reads in every layer a parameter update
+* left stale, see Dense::prepareWeights. The inference calls that own their buffers do it
+* first, the ones that take caller buffers read the float weights of a stale layer. Not safe
+* while other threads run the network.
+*/
+void MlpNetwork::prepareWeights()
+{
+    for(Dense &layer : layers)
+    {
+        layer.prepareWeights();
+    }
+}
@@ -21,25 +21,85 @@
 
 // ------------------------------ includes ------------------------------
 #include "Matrix.h"
+#include "Dense.h"
 #include "Digit.h"
+#include <vector>
 
 // -------------------------- const definitions -------------------------
 
 /*
  * @def MLP_SIZE 4
- * @brief The size of the MlpNetwork that the program work with
+ * @brief The number of layers of the MNIST network that the per layer files describe
  */
 #define MLP_SIZE 4
 
-const MatrixDims imgDims = {28, 28};
-const MatrixDims weightsDims[] = {{128, 784}, {64, 128},
-                                  {20, 64}, {10, 20}};
-const MatrixDims biasDims[]    = {{128, 1}, {64, 1}, {20, 1},
-                                  {10, 1}};
+/*
+ * @def INVALID_TOPOLOGY_MSG "Error: The network layers don't fit one another"
+ * @brief Error msg when a network is built from no layers, or from layers whose shapes
+ *        don't chain
+ */
+#define INVALID_TOPOLOGY_MSG "Error: The network layers don't fit one another"
+
+/*
+ * @def INVALID_TRAINING_OUTPUT_MSG "Error: Only a network that ends with a Softmax can be
+ *      trained"
+ * @brief Error msg when backpropagating the cross entropy loss through a network whose last
+ *        layer doesn't output probabilities
+ */
+#define INVALID_TRAINING_OUTPUT_MSG "Error: Only a network that ends with a Softmax can be trained"
+
+/*
+ * @def INVALID_LABEL_MSG "Error: A label is not a class of the network"
+ * @brief Error msg when a training label is negative or not below the output size
+ */
+#define INVALID_LABEL_MSG "Error: A label is not a class of the network"
+
+constexpr MatrixDims imgDims = {28, 28};
+constexpr MatrixDims weightsDims[] = {{128, 784}, {64, 128},
+                                      {20, 64}, {10, 20}};
+constexpr MatrixDims biasDims[]    = {{128, 1}, {64, 1}, {20, 1},
+                                      {10, 1}};
 
 
 // -------------------------- class definitions -------------------------
 
+/**
+ * @enum OutputMode
+ * @brief What the last layer of the network produces. Logits skips a final Softmax, which
+ *        keeps the most probable class while saving an exponential per class. In that mode
+ *        the probability of every Digit holds the logit of its class instead.
+ */
+enum OutputMode
+{
+    Probabilities,
+    Logits
+};
+
+
+/**
+ * @struct ForwardBuffers
+ * @brief The scratch space of one forward pass. Layers write into the two activations in
+ *        turn, so their size only depends on the widest layer and not on the depth.
+ */
+typedef struct ForwardBuffers
+{
+    Matrix activations[2];
+} ForwardBuffers;
+
+
+/**
+ * @struct TrainingBuffers
+ * @brief The scratch space of one backward pass. Unlike a forward pass it keeps the output
+ *        of every layer, which the gradients of the layer after it are taken from.
+ */
+typedef struct TrainingBuffers
+{
+    std::vector<Matrix> outputs;
+    Matrix gradients[2];
+    std::vector<LayerGradients> layers;
+} TrainingBuffers;
+
+
 /**
  * This class will help to arrange all the layers to network structure.
  * Will allow implement of input to the net and generate the output.
@@ -47,13 +107,33 @@ const MatrixDims biasDims[]    = {{128, 1}, {64, 1}, {20, 1},
 class MlpNetwork
 {
 private:
-    Matrix *weightsLayer;
-    Matrix *biasLayer;
+    std::vector<Dense> layers;
+    int maxWidth;
+    ForwardBuffers singleBuffers;
+    ForwardBuffers batchBuffers;
+    Matrix batchInput;
+
+    /**
+     * Find the k most probable digits of one sample of the final layer output
+     * @param probabilities The output of the last layer
+     * @param col The column of the sample
+     * @param k The number of digits, at most the number of rows
+     * @param top Receives the k digits, most probable first, ties in class order
+     */
+    static void _columnTopK(const Matrix &probabilities, int col, int k, Digit *top);
 
 public:
 
     /**
-     * A constructor of MlpNetwork. Accepts 2 arrays, size 4 each.
+     * A constructor of MlpNetwork from any number of layers. Every layer must accept the
+     * output of the one before it. The buffers for a single sample are planned here once.
+     * @param denseLayers The layers of the network, in evaluation order
+     */
+    explicit MlpNetwork(std::vector<Dense> denseLayers);
+
+
+    /**
+     * A constructor of the MNIST MlpNetwork. Accepts 2 arrays, size 4 each.
      * one for weights and one for biases.
      * @param weights The weights matrix layer of the network
      * @param biases The bias matrix layer of the network
@@ -62,11 +142,204 @@ public:
 
 
     /**
-     * Applies the entire network on input.
-     * @param other The input matrix represent a handwriting number
+     * Getter of the number of layers.
+     * @return The depth of the network
+     */
+    int getLayerCount() const { return (int) layers.size(); }
+
+
+    /**
+     * Getter of one layer.
+     * @param i The index of the layer, in evaluation order
+     * @return The i'th layer
+     */
+    const Dense &getLayer(int i) const { return layers[i]; }
+
+
+    /**
+     * Getter of the number of values in one sample.
+     * @return The number of rows the network input must have
+     */
+    int getInputSize() const { return layers.front().getInputSize(); }
+
+
+    /**
+     * Getter of the number of classes.
+     * @return The number of rows of the network output
+     */
+    int getOutputSize() const { return layers.back().getOutputSize(); }
+
+
+    /**
+     * Switch the weights of every layer to the given precision, see Dense::setPrecision.
+     * The matrix pool is trimmed once if layers released their float weights. Not safe
+     * while other threads run the network.
+     * @param precision The precision the forward pass should read the weights in
+     */
+    void setPrecision(WeightPrecision precision);
+
+
+    /**
+     * Set whether every layer keeps its float weights, see Dense::setTrainable. An inference
+     * only network should clear it before setPrecision. The matrix pool is trimmed once if
+     * layers released their float weights. Not safe while other threads run the network.
+     * @param trainable Whether the layers should keep their float weights
+     * @throws std::invalid_argument If a layer is made trainable after releasing them
+     */
+    void setTrainable(bool trainable);
+
+
+    /**
+     * Getter of the weight precision of the network.
+     * @return The precision of the first layer, all layers share it
+     */
+    WeightPrecision getPrecision() const { return layers.front().getPrecision(); }
+
+
+    /**
+     * Getter of how many bytes of weights one forward pass reads.
+     * @return The size of the weights of all layers in their current precision
+     */
+    long int getWeightsBytes() const;
+
+
+    /**
+     * Size the given buffers for batches of up to batchSize samples, so running such
+     * batches never allocates.
+     * @param buffers The buffers to plan
+     * @param batchSize The largest number of samples the buffers will see
+     */
+    void planBuffers(ForwardBuffers &buffers, int batchSize) const;
+
+
+    /**
+     * Run every layer on the given input, one sample per column, using caller owned layer
+     * buffers. Like the predictBatch overload that takes buffers, it may run on several
+     * threads at once.
+     * @param input The input of the first layer
+     * @param buffers The buffers that receive the layer outputs
+     * @param mode Whether a final Softmax is applied
+     * @return The output of the last layer, output size x N, stored in one of the buffers
+     */
+    const Matrix &forward(const MatrixView &input, ForwardBuffers &buffers,
+                          OutputMode mode = Probabilities) const;
+
+
+    /**
+     * Applies the entire network on input. The layer outputs are kept between calls so
+     * no memory is allocated.
+     * @param other The input column represent a handwriting number, a matrix or a view
+     * @param mode Whether a final Softmax is applied
      * @return The max probability digit struct
      */
-    Digit operator()(const Matrix &other);
+    Digit operator()(const MatrixView &other, OutputMode mode = Probabilities);
+
+
+    /**
+     * Applies the entire network on a batch of images at once, so every layer is a matrix
+     * product that reuses the weights from cache across the whole batch.
+     * @param images An input size x N matrix, column j holds the j'th vectorized image
+     * @param mode Whether a final Softmax is applied
+     * @return The max probability digit of every image, in column order
+     */
+    std::vector<Digit> predictBatch(const MatrixView &images, OutputMode mode = Probabilities);
+
+
+    /**
+     * Applies the entire network on an array of images by gathering them into one batch.
+     * @param images The images, each of them holding input size values in any shape
+     * @param count The number of images
+     * @param mode Whether a final Softmax is applied
+     * @return The max probability digit of every image, in array order
+     */
+    std::vector<Digit> predictBatch(const Matrix *images, int count,
+                                    OutputMode mode = Probabilities);
+
+
+    /**
+     * Applies the entire network on a batch of images using caller owned layer buffers.
+     * The network itself is not modified, so several threads may call this at once as
+     * long as each of them passes its own buffers. A view of some columns of a larger
+     * batch is read in place.
+     * @param images An input size x N matrix, column j holds the j'th vectorized image
+     * @param buffers The buffers that receive the layer outputs
+     * @param digits Receives the max probability digit of every image, N entries
+     * @param mode Whether a final Softmax is applied
+     */
+    void predictBatch(const MatrixView &images, ForwardBuffers &buffers, Digit *digits,
+                      OutputMode mode = Probabilities) const;
+
+
+    /**
+     * The k most probable digits of every image of a batch.
+     * @param images An input size x N matrix, a single image is a batch of one
+     * @param k The number of digits per image, clamped to the number of classes
+     * @return N groups of k digits, in column order, each most probable first
+     */
+    std::vector<Digit> predictTopK(const MatrixView &images, int k);
+
+
+    /**
+     * The k most probable digits of every image of a batch using caller owned layer
+     * buffers, safe to call from several threads like predictBatch.
+     * @param images An input size x N matrix
+     * @param k The number of digits per image, at most the number of classes
+     * @param buffers The buffers that receive the layer outputs
+     * @param top Receives N groups of k digits, in column order, each most probable first
+     */
+    void predictTopK(const MatrixView &images, int k, ForwardBuffers &buffers,
+                     Digit *top) const;
+
+
+    /**
+     * The whole probability vector of every image of a batch.
+     * @param images An input size x N matrix, a single image is a batch of one
+     * @return An output size x N matrix, column j holds the probabilities of image j
+     */
+    Matrix predictProbabilities(const MatrixView &images);
+
+
+    /**
+     * The logits of every image of a batch, the last layer before its Softmax.
+     * @param images An input size x N matrix, a single image is a batch of one
+     * @return An output size x N matrix, column j holds the logits of image j
+     */
+    Matrix predictLogits(const MatrixView &images);
+
+
+    /**
+     * Compute the cross entropy loss of a batch and its gradient by the parameters of every
+     * layer, reading the float weights. The last layer must be a Softmax, its gradient is
+     * taken by its logits. Like the predictBatch overload that takes buffers, it may run on
+     * several threads at once.
+     * @param images An input size x N matrix or view, column j holds the j'th sample
+     * @param labels The class of every sample, N entries
+     * @param buffers The buffers that receive the layer outputs, and in layers the gradient
+     *                of every layer, summed over the samples
+     * @return The loss summed over the samples
+     * @throws std::invalid_argument If the last layer isn't a Softmax or an activation
+     *         can't be differentiated
+     * @throws std::out_of_range If a label isn't a class of the network
+     */
+    float backward(const MatrixView &images, const int *labels, TrainingBuffers &buffers) const;
+
+
+    /**
+     * Add a step to the parameters of one layer, see Dense::updateParameters. Not safe
+     * while other threads run the network.
+     * @param i The index of the layer, in evaluation order
+     * @param weightsStep The change of every weight
+     * @param biasStep The change of every bias
+     */
+    void updateLayer(int i, const Matrix &weightsStep, const Matrix &biasStep);
+
+
+    /**
+     * Rebuild the copy of the weights the forward pass reads in every layer a parameter
+     * update left stale, see Dense::prepareWeights. Not safe while other threads run the
+     * network.
+     */
+    void prepareWeights();
 
 };
 
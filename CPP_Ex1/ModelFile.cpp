@@ -0,0 +1,345 @@
+/**
+ * @file ModelFile.cpp
+ * @author  Liron Gershuny <liron.gershuny@mail.huji.ac.il>
+ * @version 1.0
+ * @date 25 Dec 2019
+ *
+ * @brief Define the single file container that holds a whole MlpNetwork model.
+ *
+ * @section LICENSE
+ * This program is not a free software; bla bla bla...
+ *
+ * @section DESCRIPTION
+ * The container is written in one piece from memory and read back through a memory
+ * mapping, every offset and shape is validated before a tensor is touched.
+ * Input  : A model file, or the layers to write into one
+ * Process: Validates and decodes the container
+ * Output : The layers of the model
+ */
+
+// ------------------------------ includes ------------------------------
+#include "ModelFile.h"
+#include "MappedFile.h"
+#include <cstring>
+#include <fstream>
+#include <utility>
+
+
+// -------------------------- const definitions -------------------------
+
+/*
+ * @def MODEL_FILE_MAGIC "MLPM"
+ * @brief The first four bytes of every model file
+ */
+#define MODEL_FILE_MAGIC "MLPM"
+
+/*
+ * @def FNV_OFFSET_BASIS 14695981039346656037
+ * @brief The initial value of the FNV-1a 64 bit hash
+ */
+#define FNV_OFFSET_BASIS 14695981039346656037ULL
+
+/*
+ * @def FNV_PRIME 1099511628211
+ * @brief The multiplier of the FNV-1a 64 bit hash
+ */
+#define FNV_PRIME 1099511628211ULL
+
+
+// -------------------------- struct definitions ------------------------
+
+/**
+ * @struct ModelHeader
+ * @brief The fixed header at the start of a model file
+ */
+typedef struct ModelHeader
+{
+    char magic[4];
+    uint32_t version;
+    uint32_t layerCount;
+    uint32_t dataType;
+    uint32_t alignment;
+    uint32_t reserved;
+    uint64_t payloadSize;
+    uint64_t checksum;
+} ModelHeader;
+
+/**
+ * @struct ModelLayerEntry
+ * @brief The table entry that describes one layer and where its tensors are
+ */
+typedef struct ModelLayerEntry
+{
+    uint32_t rows;
+    uint32_t cols;
+    uint32_t activation;
+    uint32_t reserved;
+    uint64_t weightsOffset;
+    uint64_t biasOffset;
+} ModelLayerEntry;
+
+static_assert(sizeof(ModelHeader) == 40, "The model header layout must not change");
+static_assert(sizeof(ModelLayerEntry) == 32, "The layer entry layout must not change");
+
+
+// ------------------------ static helpers ------------------------------
+
+/**
+ * FNV-1a 64 bit hash of a byte range
+ * @param bytes The first byte
+ * @param length The number of bytes
+ * @return The hash value
+ */
+static uint64_t checksum(const char *bytes, size_t length)
+{
+    uint64_t hash = FNV_OFFSET_BASIS;
+    for(size_t i = 0 ; i < length ; i++)
+    {
+        hash ^= (unsigned char) bytes[i];
+        hash *= FNV_PRIME;
+    }
+    return hash;
+}
+
+
+/**
+ * Round an offset up to the tensor alignment
+ * @param offset The offset in bytes
+ * @return The first aligned offset that is not before the given one
+ */
+static uint64_t alignOffset(uint64_t offset)
+{
+    return (offset + MODEL_FILE_ALIGNMENT - 1) / MODEL_FILE_ALIGNMENT * MODEL_FILE_ALIGNMENT;
+}
+
+
+/**
+ * Check that a tensor lies on an aligned offset fully inside the file
+ * @param offset The offset of the tensor
+ * @param count The number of floats in the tensor
+ * @param fileSize The size of the file
+ * @return Whether the tensor can be read
+ */
+static bool validTensor(uint64_t offset, uint64_t count, uint64_t fileSize)
+{
+    return offset % MODEL_FILE_ALIGNMENT == 0 && offset <= fileSize &&
+           count <= (fileSize - offset) / sizeof(float);
+}
+
+
+// ------------------------ class implementation ------------------------
+
+/**
+* Write the given layers into a model file.
+* @param path The path of the file to create
+* @param layers The layers of the model, in evaluation order
+* @return boolean status
+*          true - success
+*          false - failure
+*/
+bool ModelFile::save(const std::string &path, const std::vector<ModelLayer> &layers)
+{
+    if(layers.empty())
+    {
+        return false;
+    }
+
+    std::vector<ModelLayerEntry> entries(layers.size());
+    uint64_t offset = sizeof(ModelHeader) + entries.size() * sizeof(ModelLayerEntry);
+    for(size_t i = 0 ; i < layers.size() ; i++)
+    {
+        const ModelLayer &layer = layers[i];
+        entries[i].rows = layer.weights.getRows();
+        entries[i].cols = layer.weights.getCols();
+        entries[i].activation = layer.activation;
+        entries[i].reserved = 0;
+        entries[i].weightsOffset = alignOffset(offset);
+        offset = entries[i].weightsOffset + (uint64_t) entries[i].rows * entries[i].cols *
+                                            sizeof(float);
+        entries[i].biasOffset = alignOffset(offset);
+        offset = entries[i].biasOffset + (uint64_t) entries[i].rows * sizeof(float);
+
+        if(layer.bias.getRows() * layer.bias.getCols() != layer.weights.getRows())
+        {
+            return false;
+        }
+    }
+
+    std::vector<char> image(alignOffset(offset), 0);
+    std::memcpy(image.data() + sizeof(ModelHeader), entries.data(),
+                entries.size() * sizeof(ModelLayerEntry));
+    for(size_t i = 0 ; i < layers.size() ; i++)
+    {
+        std::memcpy(image.data() + entries[i].weightsOffset, layers[i].weights.data(),
+                    (size_t) entries[i].rows * entries[i].cols * sizeof(float));
+        std::memcpy(image.data() + entries[i].biasOffset, layers[i].bias.data(),
+                    (size_t) entries[i].rows * sizeof(float));
+    }
+
+    ModelHeader header;
+    std::memcpy(header.magic, MODEL_FILE_MAGIC, sizeof(header.magic));
+    header.version = MODEL_FILE_VERSION;
+    header.layerCount = (uint32_t) layers.size();
+    header.dataType = ModelFloat32;
+    header.alignment = MODEL_FILE_ALIGNMENT;
+    header.reserved = 0;
+    header.payloadSize = image.size() - sizeof(ModelHeader);
+    header.checksum = checksum(image.data() + sizeof(ModelHeader), header.payloadSize);
+    std::memcpy(image.data(), &header, sizeof(ModelHeader));
+
+    std::ofstream os(path, std::ios::out | std::ios::binary | std::ios::trunc);
+    if(!os.is_open())
+    {
+        return false;
+    }
+    os.write(image.data(), image.size());
+    return os.good();
+}
+
+
+/**
+* Read a model file, checking its header, shapes, offsets and checksum.
+* @param path The path of the model file
+* @param layers Receives the layers of the model, in evaluation order
+* @return boolean status
+*          true - success
+*          false - failure
+*/
+bool ModelFile::load(const std::string &path, std::vector<ModelLayer> &layers)
+{
+    MappedFile file(path);
+    if(!file.isOpen() || file.size() < sizeof(ModelHeader))
+    {
+        return false;
+    }
+
+    ModelHeader header;
+    std::memcpy(&header, file.data(), sizeof(ModelHeader));
+    uint64_t fileSize = file.size();
+    if(std::memcmp(header.magic, MODEL_FILE_MAGIC, sizeof(header.magic)) != 0 ||
+       header.version != MODEL_FILE_VERSION || header.dataType != ModelFloat32 ||
+       header.alignment != MODEL_FILE_ALIGNMENT || header.layerCount == 0 ||
+       header.payloadSize != fileSize - sizeof(ModelHeader) ||
+       header.layerCount > (fileSize - sizeof(ModelHeader)) / sizeof(ModelLayerEntry) ||
+       header.checksum != checksum(file.data() + sizeof(ModelHeader), header.payloadSize))
+    {
+        return false;
+    }
+
+    std::vector<ModelLayerEntry> entries(header.layerCount);
+    std::memcpy(entries.data(), file.data() + sizeof(ModelHeader),
+                entries.size() * sizeof(ModelLayerEntry));
+
+    std::vector<ModelLayer> loaded;
+    loaded.reserve(entries.size());
+    for(size_t i = 0 ; i < entries.size() ; i++)
+    {
+        const ModelLayerEntry &entry = entries[i];
+        bool chained = i == 0 || entry.cols == entries[i - 1].rows;
+        if(entry.rows == 0 || entry.cols == 0 || entry.rows > INT32_MAX / entry.cols ||
+           entry.activation > Gelu || !chained ||
+           !validTensor(entry.weightsOffset, (uint64_t) entry.rows * entry.cols, fileSize) ||
+           !validTensor(entry.biasOffset, entry.rows, fileSize))
+        {
+            return false;
+        }
+
+        ModelLayer layer{Matrix(entry.rows, entry.cols), Matrix(entry.rows, 1),
+                         (ActivationType) entry.activation};
+        std::memcpy(layer.weights.data(), file.data() + entry.weightsOffset,
+                    (size_t) entry.rows * entry.cols * sizeof(float));
+        std::memcpy(layer.bias.data(), file.data() + entry.biasOffset,
+                    (size_t) entry.rows * sizeof(float));
+        loaded.push_back(std::move(layer));
+    }
+
+    layers = std::move(loaded);
+    return true;
+}
+
+
+/**
+* Read a model file straight into layers that are ready to be run.
+* @param path The path of the model file
+* @param layers Receives the layers of the model, in evaluation order
+* @return boolean status
+*          true - success
+*          false - failure
+*/
+bool ModelFile::load(const std::string &path, std::vector<Dense> &layers)
+{
+    std::vector<ModelLayer> model;
+    if(!load(path, model))
+    {
+        return false;
+    }
+
+    std::vector<Dense> loaded;
+    loaded.reserve(model.size());
+    for(ModelLayer &layer : model)
+    {
+        loaded.emplace_back(std::move(layer.weights), std::move(layer.bias), layer.activation);
+    }
+
+    layers = std::move(loaded);
+    return true;
+}
+
+
+/**
+* Read a headerless file of raw floats, the format of the per layer parameter files and
+* of the images, into a matrix. The file must match the matrix in size.
+* @param path The path of the file
+* @param mat The matrix to read the file into
+* @return boolean status
+*          true - success
+*          false - failure
+*/
+bool ModelFile::readRawTensor(const std::string &path, Matrix &mat)
+{
+    return readRawTensor(path, mat.data(), (size_t) mat.getCols() * mat.getRows());
+}
+
+
+/**
+* Read a headerless file of raw floats into a buffer. The file must hold exactly the
+* given number of values.
+* @param path The path of the file
+* @param values The buffer to read the file into
+* @param count The number of floats of the buffer
+* @return boolean status
+*          true - success
+*          false - failure
+*/
+bool ModelFile::readRawTensor(const std::string &path, float *values, size_t count)
+{
+    MappedFile file(path);
+    if(!file.isOpen() || file.size() != count * sizeof(float))
+    {
+        return false;
+    }
+
+    std::memcpy(values, file.data(), count * sizeof(float));
+    return true;
+}
+
+
+/**
+* Write a matrix as a headerless file of raw floats, the format readRawTensor reads.
+* @param path The path of the file, replaced if it exists
+* @param mat The matrix to write
+* @return boolean status
+*          true - success
+*          false - failure
+*/
+bool ModelFile::writeRawTensor(const std::string &path, const Matrix &mat)
+{
+    std::ofstream os(path, std::ios::out | std::ios::binary | std::ios::trunc);
+    if(!os.is_open())
+    {
+        return false;
+    }
+    os.write((const char *) mat.data(),
+             (std::streamsize) ((size_t) mat.getRows() * mat.getCols() * sizeof(float)));
+    return os.good();
+}
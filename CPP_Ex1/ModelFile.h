@@ -0,0 +1,156 @@
+/**
+ * @file ModelFile.h
+ * @author  Liron Gershuny <liron.gershuny@mail.huji.ac.il>
+ * @version 1.0
+ * @date 25 Dec 2019
+ *
+ * @brief Define the single file container that holds a whole MlpNetwork model.
+ *
+ * @section LICENSE
+ * This program is not a free software; bla bla bla...
+ *
+ * @section DESCRIPTION
+ * A model file starts with a fixed header, followed by one table entry per layer and the
+ * weights and bias tensors, each of them starting on a 64 byte boundary so the file can be
+ * mapped and handed to the SIMD kernels as is. All fields are little endian.
+ *
+ *   header   : magic "MLPM", version, layer count, dtype, alignment, reserved,
+ *              payload size, FNV-1a 64 checksum of everything after the header
+ *   layers   : rows, cols, activation, reserved, weights offset, bias offset
+ *   tensors  : rows*cols weights then rows bias values per layer, zero padded
+ *
+ * Input  : A model file, or the layers to write into one
+ * Process: Validates and decodes the container
+ * Output : The layers of the model
+ */
+
+#ifndef MODEL_FILE_H
+#define MODEL_FILE_H
+
+// ------------------------------ includes ------------------------------
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "Matrix.h"
+#include "Activation.h"
+#include "Dense.h"
+
+
+// -------------------------- const definitions -------------------------
+
+/*
+ * @def MODEL_FILE_VERSION 1
+ * @brief The container version written by this code, older readers reject newer files
+ */
+#define MODEL_FILE_VERSION 1
+
+/*
+ * @def MODEL_FILE_ALIGNMENT 64
+ * @brief The byte boundary every tensor starts on
+ */
+#define MODEL_FILE_ALIGNMENT 64
+
+
+// -------------------------- class definitions -------------------------
+
+/**
+ * @enum ModelDataType
+ * @brief The element type of the tensors stored in a model file.
+ */
+enum ModelDataType
+{
+    ModelFloat32 = 0
+};
+
+
+/**
+ * @struct ModelLayer
+ * @brief One dense layer of a model: its weights, its bias column and its activation.
+ */
+typedef struct ModelLayer
+{
+    Matrix weights;
+    Matrix bias;
+    ActivationType activation;
+} ModelLayer;
+
+
+/**
+ * Reads and writes whole models in the single file container format.
+ */
+class ModelFile
+{
+public:
+
+    /**
+     * Write the given layers into a model file.
+     * @param path The path of the file to create
+     * @param layers The layers of the model, in evaluation order
+     * @return boolean status
+     *          true - success
+     *          false - failure
+     */
+    static bool save(const std::string &path, const std::vector<ModelLayer> &layers);
+
+
+    /**
+     * Read a model file, checking its header, shapes, offsets and checksum.
+     * @param path The path of the model file
+     * @param layers Receives the layers of the model, in evaluation order
+     * @return boolean status
+     *          true - success
+     *          false - failure
+     */
+    static bool load(const std::string &path, std::vector<ModelLayer> &layers);
+
+
+    /**
+     * Read a model file straight into layers that are ready to be run.
+     * @param path The path of the model file
+     * @param layers Receives the layers of the model, in evaluation order
+     * @return boolean status
+     *          true - success
+     *          false - failure
+     */
+    static bool load(const std::string &path, std::vector<Dense> &layers);
+
+
+    /**
+     * Read a headerless file of raw floats, the format of the per layer parameter files and
+     * of the images, into a matrix. The file must match the matrix in size.
+     * @param path The path of the file
+     * @param mat The matrix to read the file into
+     * @return boolean status
+     *          true - success
+     *          false - failure
+     */
+    static bool readRawTensor(const std::string &path, Matrix &mat);
+
+
+    /**
+     * Read a headerless file of raw floats into a buffer. The file must hold exactly the
+     * given number of values.
+     * @param path The path of the file
+     * @param values The buffer to read the file into
+     * @param count The number of floats of the buffer
+     * @return boolean status
+     *          true - success
+     *          false - failure
+     */
+    static bool readRawTensor(const std::string &path, float *values, size_t count);
+
+
+    /**
+     * Write a matrix as a headerless file of raw floats, the format readRawTensor reads.
+     * @param path The path of the file, replaced if it exists
+     * @param mat The matrix to write
+     * @return boolean status
+     *          true - success
+     *          false - failure
+     */
+    static bool writeRawTensor(const std::string &path, const Matrix &mat);
+
+};
+
+#endif //MODEL_FILE_H
@@ -0,0 +1,364 @@
+/**
+ * @file Profiler.cpp
+ * @author  Liron Gershuny <liron.gershuny@mail.huji.ac.il>
+ * @version 1.0
+ * @date 25 Dec 2019
+ *
+ * @brief Define the optional instrumentation of the layers and the network.
+ *
+ * @section LICENSE
+ * This program is not a free software; bla bla bla...
+ *
+ * @section DESCRIPTION
+ * Scopes placed in the forward pass record their wall time, an estimate of the floating
+ * point operations and bytes they move, and the matrix buffers they acquire, into a fixed
+ * size ring of events shared by all threads. The events can be summed up per layer and
+ * phase in a table, or written as a Chrome trace.
+ * Input  : The events of the instrumented scopes
+ * Process: Keeps the latest PROFILER_CAPACITY of them
+ * Output : A summary table or a Chrome trace JSON file
+ */
+
+// ------------------------------ includes ------------------------------
+#include "Profiler.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <memory>
+#include <thread>
+
+
+// ------------------------------ functions -----------------------------
+
+/**
+ * @struct ProfileSlot
+ * @brief One event of the ring and its stamp. An even stamp 2 * (n + 1) marks the finished
+ *        event of position n, an odd stamp a slot a thread is writing or reading
+ */
+struct ProfileSlot
+{
+    std::atomic<long int> stamp{0};
+    ProfileEvent event;
+};
+
+
+/**
+ * @struct ProfileRing
+ * @brief The kept events, the number of events ever recorded and the position of the
+ *        first event since the last reset
+ */
+struct ProfileRing
+{
+    std::unique_ptr<ProfileSlot[]> slots;
+    std::atomic<long int> recorded;
+    std::atomic<long int> first;
+    std::atomic<int> threads;
+    std::chrono::steady_clock::time_point epoch;
+
+    ProfileRing() : slots(new ProfileSlot[PROFILER_CAPACITY]), recorded(0), first(0),
+                    threads(0), epoch(std::chrono::steady_clock::now())
+    {
+    }
+};
+
+
+/**
+ * @struct ThreadState
+ * @brief What the profiler tracks about the calling thread
+ */
+struct ThreadState
+{
+    int index = -1;
+    int layer = PROFILER_NO_LAYER;
+    int depth = 0;
+    long int allocations = 0;
+};
+
+
+/**
+ * The ring of the process, allocated on first use. It is never destroyed, so scopes of
+ * threads that outlive main can still record.
+ * @return The ring
+ */
+static ProfileRing &ring()
+{
+    static ProfileRing *events = new ProfileRing();
+    return *events;
+}
+
+
+/**
+ * The state of the calling thread.
+ * @return The state
+ */
+static ThreadState &threadState()
+{
+    static thread_local ThreadState state;
+    return state;
+}
+
+
+/**
+ * @struct ProfileTotal
+ * @brief The sum of the events of one layer and phase
+ */
+struct ProfileTotal
+{
+    const char *name;
+    int layer;
+    long int calls;
+    long int duration;
+    double flops;
+    double bytes;
+    long int allocations;
+};
+
+
+// ------------------------ class implementation ------------------------
+
+/**
+* The time since the profiler started.
+* @return The time in nanoseconds
+*/
+long int Profiler::now()
+{
+    return (long int) std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now() - ring().epoch).count();
+}
+
+
+/**
+* Getter of a small index of the calling thread, the first thread to ask gets 0.
+* @return The index of the thread
+*/
+int Profiler::threadIndex()
+{
+    ThreadState &state = threadState();
+    if(state.index < 0)
+    {
+        state.index = ring().threads.fetch_add(1);
+    }
+    return state.index;
+}
+
+
+/**
+* Count one matrix buffer acquisition of the calling thread.
+*/
+void Profiler::countAllocation()
+{
+    threadState().allocations++;
+}
+
+
+/**
+* Getter of the matrix buffers the calling thread has acquired so far.
+* @return The count
+*/
+long int Profiler::allocations()
+{
+    return threadState().allocations;
+}
+
+
+/**
+* Store an event, overwriting the oldest one if the ring is full. The slot is claimed by
+* swapping its stamp to odd, so the event is never copied while another thread reads or
+* writes it, and the finished stamp is released after the copy. A slot already taken by a
+* later position drops the event, which the ring would overwrite anyway.
+* @param event The event
+*/
+void Profiler::record(const ProfileEvent &event)
+{
+    ProfileRing &events = ring();
+    long int position = events.recorded.fetch_add(1, std::memory_order_relaxed);
+    ProfileSlot &slot = events.slots[position % PROFILER_CAPACITY];
+    long int busy = 2 * position + 1;
+    long int stamp = slot.stamp.load(std::memory_order_relaxed);
+    while(true)
+    {
+        if(stamp > busy)
+        {
+            return;
+        }
+        if(stamp % 2 == 1)
+        {
+            std::this_thread::yield();
+            stamp = slot.stamp.load(std::memory_order_relaxed);
+        }
+        else if(slot.stamp.compare_exchange_weak(stamp, busy, std::memory_order_acquire,
+                                                 std::memory_order_relaxed))
+        {
+            break;
+        }
+    }
+
+    slot.event = event;
+    slot.stamp.store(busy + 1, std::memory_order_release);
+}
+
+
+/**
+* Drop every event, the events recorded from now on are the only ones read.
+*/
+void Profiler::reset()
+{
+    ProfileRing &events = ring();
+    events.first.store(events.recorded.load());
+}
+
+
+/**
+* Getter of the events in the ring. Every slot is claimed with an acquire swap of its
+* finished stamp before it is copied, events still being written or already overwritten
+* are skipped.
+* @return The kept events, oldest first
+*/
+std::vector<ProfileEvent> Profiler::events()
+{
+    ProfileRing &events = ring();
+    long int recorded = events.recorded.load();
+    long int begin = std::max(events.first.load(), recorded - (long int) PROFILER_CAPACITY);
+
+    std::vector<ProfileEvent> ordered;
+    ordered.reserve(std::max(recorded - begin, 0L));
+    for(long int i = begin ; i < recorded ; i++)
+    {
+        ProfileSlot &slot = events.slots[i % PROFILER_CAPACITY];
+        long int finished = 2 * (i + 1);
+        long int stamp = finished;
+        if(slot.stamp.compare_exchange_strong(stamp, finished - 1, std::memory_order_acquire,
+                                              std::memory_order_relaxed))
+        {
+            ordered.push_back(slot.event);
+            slot.stamp.store(finished, std::memory_order_release);
+        }
+    }
+    return ordered;
+}
+
+
+/**
+* Print the time, the throughput and the allocations of every layer and phase, in the
+* order they first ran. The share is of the time of the outermost scopes, so nested
+* phases add up to the share of their layer.
+* @param out The output file
+*/
+void Profiler::printSummary(std::FILE *out)
+{
+    std::vector<ProfileTotal> totals;
+    long int outerDuration = 0;
+    for(const ProfileEvent &event : events())
+    {
+        if(event.depth == 0)
+        {
+            outerDuration += event.duration;
+        }
+
+        auto found = std::find_if(totals.begin(), totals.end(), [&event](const ProfileTotal &t)
+        {
+            return t.layer == event.layer && std::strcmp(t.name, event.name) == 0;
+        });
+        if(found == totals.end())
+        {
+            totals.push_back({event.name, event.layer, 0, 0, 0, 0, 0});
+            found = totals.end() - 1;
+        }
+        found->calls++;
+        found->duration += event.duration;
+        found->flops += event.flops;
+        found->bytes += event.bytes;
+        found->allocations += event.allocations;
+    }
+
+    std::fprintf(out, "%-6s %-12s %10s %12s %10s %8s %10s %10s %8s\n", "layer", "phase",
+                 "calls", "total[ms]", "mean[us]", "share", "GFLOP/s", "GB/s", "allocs");
+    for(const ProfileTotal &total : totals)
+    {
+        double seconds = std::max(total.duration, 1L) * 1e-9;
+        char layer[16] = "-";
+        if(total.layer != PROFILER_NO_LAYER)
+        {
+            std::snprintf(layer, sizeof(layer), "%d", total.layer + 1);
+        }
+        std::fprintf(out, "%-6s %-12s %10ld %12.3f %10.3f %7.1f%% %10.2f %10.2f %8ld\n", layer,
+                     total.name, total.calls, total.duration * 1e-6,
+                     total.duration * 1e-3 / total.calls,
+                     100.0 * total.duration / std::max(outerDuration, 1L),
+                     total.flops / seconds * 1e-9, total.bytes / seconds * 1e-9,
+                     total.allocations);
+    }
+}
+
+
+/**
+* Write the events in the Chrome trace event format, for chrome://tracing or Perfetto.
+* Every event is a complete event on the track of its thread, with its layer, work and
+* allocations as arguments.
+* @param path The path of the JSON file
+* @return boolean status
+*          true - success
+*          false - failure
+*/
+bool Profiler::writeChromeTrace(const std::string &path)
+{
+    std::FILE *out = std::fopen(path.c_str(), "w");
+    if(out == nullptr)
+    {
+        return false;
+    }
+
+    std::vector<ProfileEvent> recorded = events();
+    std::fputs("{\"traceEvents\": [", out);
+    for(size_t i = 0 ; i < recorded.size() ; i++)
+    {
+        const ProfileEvent &event = recorded[i];
+        std::fprintf(out, "%s\n  {\"name\": \"%s\", \"ph\": \"X\", \"pid\": 1, \"tid\": %d, "
+                          "\"ts\": %.3f, \"dur\": %.3f, \"args\": {\"layer\": %d, "
+                          "\"flops\": %.0f, \"bytes\": %.0f, \"allocations\": %ld}}",
+                     i == 0 ? "" : ",", event.name, event.thread, event.start * 1e-3,
+                     event.duration * 1e-3, event.layer == PROFILER_NO_LAYER ? -1 :
+                     event.layer + 1, event.flops, event.bytes, event.allocations);
+    }
+    std::fputs("\n], \"displayTimeUnit\": \"ns\"}\n", out);
+
+    bool written = !std::ferror(out);
+    return std::fclose(out) == 0 && written;
+}
+
+
+/**
+* Constructor that starts the event.
+* @param scopeName The name of the event, a string literal
+* @param scopeLayer The index of the layer, or PROFILER_NO_LAYER
+* @param scopeFlops The floating point operations the scope does
+* @param scopeBytes The bytes the scope reads and writes
+*/
+ProfileScope::ProfileScope(const char *scopeName, int scopeLayer, double scopeFlops,
+                           double scopeBytes) : name(scopeName), flops(scopeFlops),
+                                                bytes(scopeBytes)
+{
+    ThreadState &state = threadState();
+    outerLayer = state.layer;
+    layer = scopeLayer == PROFILER_NO_LAYER ? outerLayer : scopeLayer;
+    state.layer = layer;
+    depth = state.depth++;
+    startAllocations = state.allocations;
+    start = Profiler::now();
+}
+
+
+/**
+* Destructor that records the event.
+*/
+ProfileScope::~ProfileScope()
+{
+    long int end = Profiler::now();
+    ThreadState &state = threadState();
+    state.layer = outerLayer;
+    state.depth--;
+
+    Profiler::record({name, layer, depth, Profiler::threadIndex(), start, end - start, flops,
+                      bytes, state.allocations - startAllocations});
+}
@@ -0,0 +1,211 @@
+/**
+ * @file Profiler.h
+ * @author  Liron Gershuny <liron.gershuny@mail.huji.ac.il>
+ * @version 1.0
+ * @date 25 Dec 2019
+ *
+ * @brief Define the optional instrumentation of the layers and the network.
+ *
+ * @section LICENSE
+ * This program is not a free software; bla bla bla...
+ *
+ * @section DESCRIPTION
+ * Scopes placed in the forward pass record their wall time, an estimate of the floating
+ * point operations and bytes they move, and the matrix buffers they acquire, into a fixed
+ * size ring of events shared by all threads. The events can be summed up per layer and
+ * phase in a table, or written as a Chrome trace. The scopes are only compiled in when
+ * MLP_PROFILE is set, otherwise they expand to nothing.
+ * Input  : The events of the instrumented scopes
+ * Process: Keeps the latest PROFILER_CAPACITY of them
+ * Output : A summary table or a Chrome trace JSON file
+ */
+
+#ifndef PROFILER_H
+#define PROFILER_H
+
+// ------------------------------ includes ------------------------------
+#include <cstdio>
+#include <string>
+#include <vector>
+
+
+// -------------------------- const definitions -------------------------
+
+/*
+ * @def MLP_PROFILE
+ * @brief Whether the forward pass is instrumented, off unless set by the build
+ */
+#ifndef MLP_PROFILE
+#define MLP_PROFILE 0
+#endif
+
+/*
+ * @def PROFILER_CAPACITY (1 << 16)
+ * @brief The number of events the ring keeps, older events are overwritten
+ */
+#define PROFILER_CAPACITY (1 << 16)
+
+/*
+ * @def PROFILER_NO_LAYER -1
+ * @brief The layer of an event outside of any layer, and the layer argument of a scope
+ *        that takes the layer of the scope around it
+ */
+#define PROFILER_NO_LAYER -1
+
+#define PROFILE_CONCAT_(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_(a, b)
+
+/*
+ * @def PROFILE_SCOPE(name, layer, flops, bytes)
+ * @brief Record the rest of the enclosing block as one event. The arguments are not
+ *        evaluated when profiling is compiled out
+ */
+/*
+ * @def PROFILE_ALLOCATION()
+ * @brief Count one matrix buffer acquisition against the scopes of the calling thread
+ */
+#if MLP_PROFILE
+#define PROFILE_SCOPE(name, layer, flops, bytes) \
+        ProfileScope PROFILE_CONCAT(profileScope, __LINE__)(name, layer, flops, bytes)
+#define PROFILE_ALLOCATION() Profiler::countAllocation()
+#else
+#define PROFILE_SCOPE(name, layer, flops, bytes) ((void) 0)
+#define PROFILE_ALLOCATION() ((void) 0)
+#endif
+
+
+// -------------------------- class definitions -------------------------
+
+/**
+ * @struct ProfileEvent
+ * @brief One timed scope: what ran, when, for how long and how much work it did
+ */
+typedef struct ProfileEvent
+{
+    const char *name;
+    int layer;
+    int depth;
+    int thread;
+    long int start;
+    long int duration;
+    double flops;
+    double bytes;
+    long int allocations;
+} ProfileEvent;
+
+
+/**
+ * The process wide event ring. Recording takes one atomic increment and a stamp on its
+ * slot, so any thread may record at any time, and reading the events skips the ones that
+ * are still being written.
+ */
+class Profiler
+{
+public:
+
+    /**
+     * The time since the profiler started.
+     * @return The time in nanoseconds
+     */
+    static long int now();
+
+
+    /**
+     * Getter of a small index of the calling thread, the first thread to ask gets 0.
+     * @return The index of the thread
+     */
+    static int threadIndex();
+
+
+    /**
+     * Count one matrix buffer acquisition of the calling thread.
+     */
+    static void countAllocation();
+
+
+    /**
+     * Getter of the matrix buffers the calling thread has acquired so far.
+     * @return The count
+     */
+    static long int allocations();
+
+
+    /**
+     * Store an event, overwriting the oldest one if the ring is full.
+     * @param event The event
+     */
+    static void record(const ProfileEvent &event);
+
+
+    /**
+     * Drop every event, the events recorded from now on are the only ones read.
+     */
+    static void reset();
+
+
+    /**
+     * Getter of the events in the ring.
+     * @return The kept events, oldest first
+     */
+    static std::vector<ProfileEvent> events();
+
+
+    /**
+     * Print the time, the throughput and the allocations of every layer and phase.
+     * @param out The output file
+     */
+    static void printSummary(std::FILE *out);
+
+
+    /**
+     * Write the events in the Chrome trace event format, for chrome://tracing or Perfetto.
+     * @param path The path of the JSON file
+     * @return boolean status
+     *          true - success
+     *          false - failure
+     */
+    static bool writeChromeTrace(const std::string &path);
+
+};
+
+
+/**
+ * Records the time between its construction and its destruction as one event. Scopes of
+ * the same thread nest, a scope without a layer takes the layer of the scope around it.
+ */
+class ProfileScope
+{
+private:
+    const char *name;
+    int layer;
+    int outerLayer;
+    int depth;
+    double flops;
+    double bytes;
+    long int start;
+    long int startAllocations;
+
+public:
+
+    /**
+     * Constructor that starts the event.
+     * @param scopeName The name of the event, a string literal
+     * @param scopeLayer The index of the layer, or PROFILER_NO_LAYER
+     * @param scopeFlops The floating point operations the scope does
+     * @param scopeBytes The bytes the scope reads and writes
+     */
+    ProfileScope(const char *scopeName, int scopeLayer, double scopeFlops, double scopeBytes);
+
+
+    /**
+     * Destructor that records the event.
+     */
+    ~ProfileScope();
+
+
+    ProfileScope(const ProfileScope &) = delete;
+    ProfileScope &operator=(const ProfileScope &) = delete;
+
+};
+
+#endif //PROFILER_H
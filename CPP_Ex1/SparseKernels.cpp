@@ -0,0 +1,351 @@
+/**
+ * @file SparseKernels.cpp
+ * @author  Liron Gershuny <liron.gershuny@mail.huji.ac.il>
+ * @version 1.0
+ * @date 25 Dec 2019
+ *
+ * @brief Define the dense layer kernels that read pruned weights in compressed rows.
+ *
+ * @section LICENSE
+ * This program is not a free software; bla bla bla...
+ *
+ * @section DESCRIPTION
+ * A pruned weights matrix is stored in the compressed sparse row format: the non zero
+ * values of every row one after the other, the column of each of them, and where every
+ * row starts. The products only touch the stored values, so their cost follows the number
+ * of non zeros rather than the shape of the matrix.
+ * Input  : Compressed weights and a float input
+ * Process: Indexed dot products for one sample, row updates for a batch
+ * Output : The float layer output written into a caller supplied buffer
+ */
+
+// ------------------------------ includes ------------------------------
+#include "SparseKernels.h"
+#include "MatrixKernels.h"
+#include "KernelCommon.h"
+#include <algorithm>
+
+
+// ------------------------ static helpers ------------------------------
+
+/**
+ * Dot product of one compressed row with a vector.
+ * @param cols The columns of the non zeros of the row
+ * @param values The non zeros of the row
+ * @param count The number of non zeros
+ * @param x The vector
+ * @return The dot product
+ */
+static float sparseDotScalar(const int *cols, const float *values, int count, const float *x)
+{
+    float sums[4] = {0, 0, 0, 0};
+    int p = 0;
+    for( ; p + 4 <= count ; p += 4)
+    {
+        sums[0] += values[p] * x[cols[p]];
+        sums[1] += values[p + 1] * x[cols[p + 1]];
+        sums[2] += values[p + 2] * x[cols[p + 2]];
+        sums[3] += values[p + 3] * x[cols[p + 3]];
+    }
+    for( ; p < count ; p++)
+    {
+        sums[0] += values[p] * x[cols[p]];
+    }
+    return (sums[0] + sums[1]) + (sums[2] + sums[3]);
+}
+
+
+/**
+ * Scalar C = A * B with A compressed, for any strides of B.
+ */
+static void sparseGemmScalar(const int *rowStart, const int *cols, const float *values,
+                             const float *b, int rsb, int csb, float *c, int m, int n)
+{
+    for(int i = 0 ; i < m ; i++)
+    {
+        float *row = c + (long int) i * n;
+        std::fill(row, row + n, 0.0f);
+        for(int p = rowStart[i] ; p < rowStart[i + 1] ; p++)
+        {
+            const float *bRow = b + (long int) cols[p] * rsb;
+            float a = values[p];
+            for(int j = 0 ; j < n ; j++)
+            {
+                row[j] += a * bRow[(long int) j * csb];
+            }
+        }
+    }
+}
+
+
+#ifdef KERNELS_X86
+
+/**
+ * Add one non zero of a row of A times its row of B to a tile of 32 columns of C.
+ */
+__attribute__((target("avx2,fma")))
+static inline void rowStepAvx2(float a, const float *bRow, __m256 &c0, __m256 &c1, __m256 &c2,
+                               __m256 &c3)
+{
+    __m256 scale = _mm256_set1_ps(a);
+    c0 = _mm256_fmadd_ps(scale, _mm256_loadu_ps(bRow), c0);
+    c1 = _mm256_fmadd_ps(scale, _mm256_loadu_ps(bRow + 8), c1);
+    c2 = _mm256_fmadd_ps(scale, _mm256_loadu_ps(bRow + 16), c2);
+    c3 = _mm256_fmadd_ps(scale, _mm256_loadu_ps(bRow + 24), c3);
+}
+
+
+/**
+ * AVX2 C = A * B with A compressed and B of unit column stride. A tile of 32 columns of a
+ * row of C stays in registers while every non zero of the row of A adds its row of B, two
+ * non zeros at a time into separate sums so the additions don't wait for each other.
+ */
+__attribute__((target("avx2,fma")))
+static void sparseGemmAvx2(const int *rowStart, const int *cols, const float *values,
+                           const float *b, int rsb, float *c, int m, int n)
+{
+    for(int i = 0 ; i < m ; i++)
+    {
+        float *row = c + (long int) i * n;
+        int begin = rowStart[i];
+        int end = rowStart[i + 1];
+        int j = 0;
+        for( ; j + 32 <= n ; j += 32)
+        {
+            __m256 c0 = _mm256_setzero_ps(), c1 = _mm256_setzero_ps();
+            __m256 c2 = _mm256_setzero_ps(), c3 = _mm256_setzero_ps();
+            __m256 d0 = _mm256_setzero_ps(), d1 = _mm256_setzero_ps();
+            __m256 d2 = _mm256_setzero_ps(), d3 = _mm256_setzero_ps();
+            int p = begin;
+            for( ; p + 2 <= end ; p += 2)
+            {
+                rowStepAvx2(values[p], b + (long int) cols[p] * rsb + j, c0, c1, c2, c3);
+                rowStepAvx2(values[p + 1], b + (long int) cols[p + 1] * rsb + j, d0, d1, d2,
+                            d3);
+            }
+            if(p < end)
+            {
+                rowStepAvx2(values[p], b + (long int) cols[p] * rsb + j, c0, c1, c2, c3);
+            }
+            _mm256_storeu_ps(row + j, _mm256_add_ps(c0, d0));
+            _mm256_storeu_ps(row + j + 8, _mm256_add_ps(c1, d1));
+            _mm256_storeu_ps(row + j + 16, _mm256_add_ps(c2, d2));
+            _mm256_storeu_ps(row + j + 24, _mm256_add_ps(c3, d3));
+        }
+        for( ; j + 8 <= n ; j += 8)
+        {
+            __m256 acc = _mm256_setzero_ps();
+            for(int p = begin ; p < end ; p++)
+            {
+                acc = _mm256_fmadd_ps(_mm256_set1_ps(values[p]),
+                                      _mm256_loadu_ps(b + (long int) cols[p] * rsb + j), acc);
+            }
+            _mm256_storeu_ps(row + j, acc);
+        }
+        for( ; j < n ; j++)
+        {
+            float sum = 0;
+            for(int p = begin ; p < end ; p++)
+            {
+                sum += values[p] * b[(long int) cols[p] * rsb + j];
+            }
+            row[j] = sum;
+        }
+    }
+}
+
+
+/**
+ * Add one non zero of a row of A times its row of B to a tile of 64 columns of C.
+ */
+__attribute__((target("avx512f")))
+static inline void rowStepAvx512(float a, const float *bRow, __m512 &c0, __m512 &c1,
+                                 __m512 &c2, __m512 &c3)
+{
+    __m512 scale = _mm512_set1_ps(a);
+    c0 = _mm512_fmadd_ps(scale, _mm512_loadu_ps(bRow), c0);
+    c1 = _mm512_fmadd_ps(scale, _mm512_loadu_ps(bRow + 16), c1);
+    c2 = _mm512_fmadd_ps(scale, _mm512_loadu_ps(bRow + 32), c2);
+    c3 = _mm512_fmadd_ps(scale, _mm512_loadu_ps(bRow + 48), c3);
+}
+
+
+/**
+ * AVX-512 C = A * B with A compressed and B of unit column stride, see sparseGemmAvx2. The
+ * tile is 64 columns wide and four non zeros are in flight at a time, the last columns of
+ * a row are handled with masked loads and stores.
+ */
+__attribute__((target("avx512f")))
+static void sparseGemmAvx512(const int *rowStart, const int *cols, const float *values,
+                             const float *b, int rsb, float *c, int m, int n)
+{
+    for(int i = 0 ; i < m ; i++)
+    {
+        float *row = c + (long int) i * n;
+        int begin = rowStart[i];
+        int end = rowStart[i + 1];
+        int j = 0;
+        for( ; j + 64 <= n ; j += 64)
+        {
+            __m512 c0 = _mm512_setzero_ps(), c1 = _mm512_setzero_ps();
+            __m512 c2 = _mm512_setzero_ps(), c3 = _mm512_setzero_ps();
+            __m512 d0 = _mm512_setzero_ps(), d1 = _mm512_setzero_ps();
+            __m512 d2 = _mm512_setzero_ps(), d3 = _mm512_setzero_ps();
+            __m512 e0 = _mm512_setzero_ps(), e1 = _mm512_setzero_ps();
+            __m512 e2 = _mm512_setzero_ps(), e3 = _mm512_setzero_ps();
+            __m512 f0 = _mm512_setzero_ps(), f1 = _mm512_setzero_ps();
+            __m512 f2 = _mm512_setzero_ps(), f3 = _mm512_setzero_ps();
+            int p = begin;
+            for( ; p + 4 <= end ; p += 4)
+            {
+                rowStepAvx512(values[p], b + (long int) cols[p] * rsb + j, c0, c1, c2, c3);
+                rowStepAvx512(values[p + 1], b + (long int) cols[p + 1] * rsb + j, d0, d1, d2,
+                              d3);
+                rowStepAvx512(values[p + 2], b + (long int) cols[p + 2] * rsb + j, e0, e1, e2,
+                              e3);
+                rowStepAvx512(values[p + 3], b + (long int) cols[p + 3] * rsb + j, f0, f1, f2,
+                              f3);
+            }
+            for( ; p < end ; p++)
+            {
+                rowStepAvx512(values[p], b + (long int) cols[p] * rsb + j, c0, c1, c2, c3);
+            }
+            _mm512_storeu_ps(row + j, _mm512_add_ps(_mm512_add_ps(c0, d0), _mm512_add_ps(e0, f0)));
+            _mm512_storeu_ps(row + j + 16, _mm512_add_ps(_mm512_add_ps(c1, d1),
+                                                         _mm512_add_ps(e1, f1)));
+            _mm512_storeu_ps(row + j + 32, _mm512_add_ps(_mm512_add_ps(c2, d2),
+                                                         _mm512_add_ps(e2, f2)));
+            _mm512_storeu_ps(row + j + 48, _mm512_add_ps(_mm512_add_ps(c3, d3),
+                                                         _mm512_add_ps(e3, f3)));
+        }
+        for( ; j < n ; j += 16)
+        {
+            __mmask16 mask = (__mmask16) ((1u << std::min(16, n - j)) - 1);
+            __m512 acc = _mm512_setzero_ps();
+            for(int p = begin ; p < end ; p++)
+            {
+                acc = _mm512_fmadd_ps(_mm512_set1_ps(values[p]),
+                                      _mm512_maskz_loadu_ps(mask, b + (long int) cols[p] * rsb
+                                                                  + j), acc);
+            }
+            _mm512_mask_storeu_ps(row + j, mask, acc);
+        }
+    }
+}
+
+#endif
+
+
+// ------------------------ function implementation ---------------------
+
+/**
+* Count the values of a buffer that aren't zero.
+* @param a The values
+* @param n The number of values
+* @return The number of non zeros
+*/
+long int kernels::countNonZeros(const float *a, long int n)
+{
+    long int count = 0;
+    for(long int i = 0 ; i < n ; i++)
+    {
+        count += a[i] != 0;
+    }
+    return count;
+}
+
+
+/**
+* Compress a matrix into its non zero values. The output arrays are sized by the caller,
+* see countNonZeros.
+* @param a The m*k row-major matrix
+* @param m The number of rows of A
+* @param k The number of columns of A
+* @param rowStart The output, m + 1 offsets, row i is [rowStart[i], rowStart[i + 1])
+* @param cols The output, the column of every non zero
+* @param values The output, every non zero, row by row
+*/
+void kernels::compressRows(const float *a, int m, int k, int *rowStart, int *cols,
+                           float *values)
+{
+    int count = 0;
+    for(int i = 0 ; i < m ; i++)
+    {
+        rowStart[i] = count;
+        const float *row = a + (long int) i * k;
+        for(int j = 0 ; j < k ; j++)
+        {
+            if(row[j] != 0)
+            {
+                cols[count] = j;
+                values[count] = row[j];
+                count++;
+            }
+        }
+    }
+    rowStart[m] = count;
+}
+
+
+/**
+* A whole dense layer y = act(A * x + bias) on compressed weights and one contiguous input
+* vector. Every row picks the elements of x its non zeros need one at a time: the vector
+* gathers measured no faster than plain loads on AVX-512 and far slower on AVX2, so this
+* product has a single path.
+* @param rowStart The row offsets of A
+* @param cols The columns of the non zeros of A
+* @param values The non zeros of A
+* @param x The input vector
+* @param bias The bias vector of m elements, or nullptr for none
+* @param y The output vector, overwritten
+* @param yStride The distance between two consecutive elements of y
+* @param m The number of rows of A
+* @param relu Whether to apply ReLU to the output
+*/
+void kernels::sparseDenseForward(const int *rowStart, const int *cols, const float *values,
+                                 const float *x, const float *bias, float *y, int yStride,
+                                 int m, bool relu)
+{
+    for(int i = 0 ; i < m ; i++)
+    {
+        int begin = rowStart[i];
+        float sum = sparseDotScalar(cols + begin, values + begin, rowStart[i + 1] - begin, x);
+        y[(long int) i * yStride] = denseEpilogue(sum, bias, i, relu);
+    }
+}
+
+
+/**
+* C = A * B with A compressed. Every non zero of a row of A adds a scaled row of B to the
+* row of C, so B should have unit column stride, other strides take the scalar path.
+* @param rowStart The row offsets of A
+* @param cols The columns of the non zeros of A
+* @param values The non zeros of A
+* @param b The k*n matrix B
+* @param rsb The row stride of B
+* @param csb The column stride of B
+* @param c The m*n row-major output, overwritten
+* @param m The number of rows of A
+* @param n The number of columns of B
+*/
+void kernels::sparseGemm(const int *rowStart, const int *cols, const float *values,
+                         const float *b, int rsb, int csb, float *c, int m, int n)
+{
+    if(csb == 1)
+    {
+        switch(getSimdLevel())
+        {
+#ifdef KERNELS_X86
+            case Avx512:
+                sparseGemmAvx512(rowStart, cols, values, b, rsb, c, m, n);
+                return;
+            case Avx2:
+                sparseGemmAvx2(rowStart, cols, values, b, rsb, c, m, n);
+                return;
+#endif
+            default:
+                break;
+        }
+    }
+    sparseGemmScalar(rowStart, cols, values, b, rsb, csb, c, m, n);
+}
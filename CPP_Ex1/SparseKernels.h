@@ -0,0 +1,87 @@
+/**
+ * @file SparseKernels.h
+ * @author  Liron Gershuny <liron.gershuny@mail.huji.ac.il>
+ * @version 1.0
+ * @date 25 Dec 2019
+ *
+ * @brief Define the dense layer kernels that read pruned weights in compressed rows.
+ *
+ * @section LICENSE
+ * This program is not a free software; bla bla bla...
+ *
+ * @section DESCRIPTION
+ * A pruned weights matrix is stored in the compressed sparse row format: the non zero
+ * values of every row one after the other, the column of each of them, and where every
+ * row starts. The products only touch the stored values, so their cost follows the number
+ * of non zeros rather than the shape of the matrix.
+ * Input  : Compressed weights and a float input
+ * Process: Indexed dot products for one sample, row updates for a batch
+ * Output : The float layer output written into a caller supplied buffer
+ */
+
+#ifndef SPARSE_KERNELS_H
+#define SPARSE_KERNELS_H
+
+
+// ------------------------- function definitions -----------------------
+
+namespace kernels
+{
+    /**
+     * Count the values of a buffer that aren't zero.
+     * @param a The values
+     * @param n The number of values
+     * @return The number of non zeros
+     */
+    long int countNonZeros(const float *a, long int n);
+
+
+    /**
+     * Compress a matrix into its non zero values. The output arrays are sized by the
+     * caller, see countNonZeros.
+     * @param a The m*k row-major matrix
+     * @param m The number of rows of A
+     * @param k The number of columns of A
+     * @param rowStart The output, m + 1 offsets, row i is [rowStart[i], rowStart[i + 1])
+     * @param cols The output, the column of every non zero
+     * @param values The output, every non zero, row by row
+     */
+    void compressRows(const float *a, int m, int k, int *rowStart, int *cols, float *values);
+
+
+    /**
+     * A whole dense layer y = act(A * x + bias) on compressed weights and one contiguous
+     * input vector.
+     * @param rowStart The row offsets of A
+     * @param cols The columns of the non zeros of A
+     * @param values The non zeros of A
+     * @param x The input vector
+     * @param bias The bias vector of m elements, or nullptr for none
+     * @param y The output vector, overwritten
+     * @param yStride The distance between two consecutive elements of y
+     * @param m The number of rows of A
+     * @param relu Whether to apply ReLU to the output
+     */
+    void sparseDenseForward(const int *rowStart, const int *cols, const float *values,
+                            const float *x, const float *bias, float *y, int yStride, int m,
+                            bool relu);
+
+
+    /**
+     * C = A * B with A compressed. Every non zero of a row of A adds a scaled row of B to
+     * the row of C, so B should have unit column stride.
+     * @param rowStart The row offsets of A
+     * @param cols The columns of the non zeros of A
+     * @param values The non zeros of A
+     * @param b The k*n matrix B
+     * @param rsb The row stride of B
+     * @param csb The column stride of B
+     * @param c The m*n row-major output, overwritten
+     * @param m The number of rows of A
+     * @param n The number of columns of B
+     */
+    void sparseGemm(const int *rowStart, const int *cols, const float *values, const float *b,
+                    int rsb, int csb, float *c, int m, int n);
+}
+
+#endif //SPARSE_KERNELS_H
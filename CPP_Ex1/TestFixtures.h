@@ -0,0 +1,110 @@
+/**
+ * @file TestFixtures.h
+ * @author  Liron Gershuny <liron.gershuny@mail.huji.ac.il>
+ * @version 1.0
+ * @date 25 Dec 2019
+ *
+ * @brief Define the random matrices and layers the test programs share.
+ *
+ * @section LICENSE
+ * This program is not a free software; bla bla bla...
+ *
+ * @section DESCRIPTION
+ * Only the test programs include this header. Every one of them draws from a generator of
+ * the same fixed seed, and builds its matrices and networks with the factories here.
+ * Input  : The shapes and a generator
+ * Process: Draws normally distributed values
+ * Output : Matrices and the layers of a network
+ */
+
+#ifndef TEST_FIXTURES_H
+#define TEST_FIXTURES_H
+
+// ------------------------------ includes ------------------------------
+#include "Matrix.h"
+#include "Dense.h"
+#include "MlpNetwork.h"
+#include <cmath>
+#include <random>
+#include <vector>
+
+
+// -------------------------- const definitions -------------------------
+
+/*
+ * @def RANDOM_SEED 2019
+ * @brief Fixed seed so every run checks the same numbers
+ */
+#define RANDOM_SEED 2019
+
+/*
+ * @def RANDOM_BIAS_DEVIATION 0.1f
+ * @brief The standard deviation of the biases of randomLayers
+ */
+#define RANDOM_BIAS_DEVIATION 0.1f
+
+
+// ------------------------ static helpers ------------------------------
+
+/**
+ * A matrix of normally distributed values, with only a share of them kept.
+ * @param rows The number of rows
+ * @param cols The number of columns
+ * @param deviation The standard deviation of the values
+ * @param generator The source of the values
+ * @param density The share of values that aren't zero
+ * @return The matrix
+ */
+static inline Matrix randomMatrix(int rows, int cols, float deviation, std::mt19937 &generator,
+                                  double density = 1.0)
+{
+    std::normal_distribution<float> values(0.0f, deviation);
+    std::uniform_real_distribution<double> keep(0.0, 1.0);
+    Matrix m(rows, cols);
+    for(int i = 0 ; i < rows * cols ; i++)
+    {
+        m[i] = density >= 1.0 || keep(generator) < density ? values(generator) : 0.0f;
+    }
+    return m;
+}
+
+/**
+ * The input size of the MNIST network followed by the output size of every layer.
+ * @return The sizes, MLP_SIZE + 1 of them
+ */
+static inline std::vector<int> mnistLayerSizes()
+{
+    std::vector<int> sizes = {weightsDims[0].cols};
+    for(int i = 0 ; i < MLP_SIZE ; i++)
+    {
+        sizes.push_back(weightsDims[i].rows);
+    }
+    return sizes;
+}
+
+/**
+ * The layers of a network of random weights, scaled by the input size of every layer,
+ * ending with a Softmax.
+ * @param sizes The input size followed by the output size of every layer
+ * @param hidden The activation of every layer but the last
+ * @param generator The source of the weights
+ * @param density The share of weights that aren't zero
+ * @return The layers
+ */
+static inline std::vector<Dense> randomLayers(const std::vector<int> &sizes,
+                                              ActivationType hidden, std::mt19937 &generator,
+                                              double density = 1.0)
+{
+    std::vector<Dense> layers;
+    int layerCount = (int) sizes.size() - 1;
+    for(int i = 0 ; i < layerCount ; i++)
+    {
+        float deviation = 1.0f / std::sqrt((float) sizes[i]);
+        layers.emplace_back(randomMatrix(sizes[i + 1], sizes[i], deviation, generator, density),
+                            randomMatrix(sizes[i + 1], 1, RANDOM_BIAS_DEVIATION, generator),
+                            i == layerCount - 1 ? Softmax : hidden);
+    }
+    return layers;
+}
+
+#endif //TEST_FIXTURES_H
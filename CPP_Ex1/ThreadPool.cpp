@@ -0,0 +1,236 @@
+/**
+ * @file ThreadPool.cpp
+ * @author  Liron Gershuny <liron.gershuny@mail.huji.ac.il>
+ * @version 1.0
+ * @date 25 Dec 2019
+ *
+ * @brief Define a work stealing thread pool for running loops over many cores.
+ *
+ * @section LICENSE
+ * This program is not a free software; bla bla bla...
+ *
+ * @section DESCRIPTION
+ * The pool splits an index range into fixed size chunks, deals them out to per worker
+ * queues and lets idle workers steal from the others.
+ * Input  : An index range and a task that handles a sub range
+ * Process: Runs the task on every chunk on some worker
+ * Output : Returns once every chunk is done
+ */
+
+// ------------------------------ includes ------------------------------
+#include "ThreadPool.h"
+#include <algorithm>
+#include <utility>
+
+
+// ------------------------ class implementation ------------------------
+
+/**
+* Constructor of the pool. The calling thread takes part in every job, so threadCount - 1
+* threads are spawned.
+* @param threadCount The number of workers, 0 for one per hardware thread
+*/
+ThreadPool::ThreadPool(int threadCount) : currentTask(nullptr), remainingChunks(0),
+generation(0), busyWorkers(0), stopping(false)
+{
+    if(threadCount <= 0)
+    {
+        threadCount = std::max(1, (int) std::thread::hardware_concurrency());
+    }
+
+    for(int i = 0 ; i < threadCount ; i++)
+    {
+        queues.emplace_back(new WorkerQueue());
+    }
+
+    for(int i = 1 ; i < threadCount ; i++)
+    {
+        workers.emplace_back(&ThreadPool::_workerLoop, this, i);
+    }
+}
+
+
+/**
+* Destructor of the pool, stops and joins all the workers.
+*/
+ThreadPool::~ThreadPool()
+{
+    {
+        std::lock_guard<std::mutex> guard(jobLock);
+        stopping = true;
+    }
+    jobReady.notify_all();
+
+    for(std::thread &worker : workers)
+    {
+        worker.join();
+    }
+}
+
+
+/**
+* Run the task on [0, count) split into chunks of grain indices and wait for all of
+* them. Calls from several threads are serialized. If chunks throw, the remaining
+* chunks still run and the first exception is rethrown to the caller.
+* @param count The size of the range
+* @param grain The number of indices in every chunk but the last one
+* @param task The work of one chunk
+*/
+void ThreadPool::parallelFor(int count, int grain, const RangeTask &task)
+{
+    if(count <= 0)
+    {
+        return;
+    }
+
+    grain = std::max(1, grain);
+    int chunkCount = (count + grain - 1) / grain;
+    int threads = getThreadCount();
+    std::lock_guard<std::mutex> submit(submitLock);
+
+    if(threads == 1 || chunkCount == 1)
+    {
+        for(int begin = 0 ; begin < count ; begin += grain)
+        {
+            task(begin, std::min(count, begin + grain), 0);
+        }
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> guard(jobLock);
+        currentTask = &task;
+        remainingChunks = chunkCount;
+    }
+
+    // Every worker starts with a contiguous run of chunks, stealing evens out the rest
+    for(int c = 0 ; c < chunkCount ; c++)
+    {
+        WorkerQueue &queue = *queues[(long int) c * threads / chunkCount];
+        std::lock_guard<std::mutex> guard(queue.lock);
+        queue.chunks.emplace_back(c * grain, std::min(count, (c + 1) * grain));
+    }
+
+    {
+        std::lock_guard<std::mutex> guard(jobLock);
+        generation++;
+    }
+    jobReady.notify_all();
+
+    _runChunks(0);
+
+    std::unique_lock<std::mutex> guard(jobLock);
+    jobDone.wait(guard, [this]() { return remainingChunks == 0 && busyWorkers == 0; });
+    currentTask = nullptr;
+
+    std::exception_ptr error = std::move(failure);
+    failure = nullptr;
+    if(error)
+    {
+        std::rethrow_exception(error);
+    }
+}
+
+
+/**
+* The loop of a spawned worker, waits for jobs and works on them until the pool stops
+* @param index The index of the worker
+*/
+void ThreadPool::_workerLoop(int index)
+{
+    long int seen = 0;
+
+    while(true)
+    {
+        {
+            std::unique_lock<std::mutex> guard(jobLock);
+            jobReady.wait(guard, [this, seen]() { return stopping || generation != seen; });
+            if(stopping)
+            {
+                return;
+            }
+            seen = generation;
+            busyWorkers++;
+        }
+
+        _runChunks(index);
+
+        {
+            std::lock_guard<std::mutex> guard(jobLock);
+            busyWorkers--;
+        }
+        jobDone.notify_all();
+    }
+}
+
+
+/**
+* Run chunks of the current job until no queue has any left
+* @param index The index of the worker
+*/
+void ThreadPool::_runChunks(int index)
+{
+    std::pair<int, int> chunk;
+
+    while(_takeChunk(index, chunk))
+    {
+        try
+        {
+            (*currentTask)(chunk.first, chunk.second, index);
+        }
+        catch(...)
+        {
+            std::lock_guard<std::mutex> guard(jobLock);
+            if(!failure)
+            {
+                failure = std::current_exception();
+            }
+        }
+
+        if(--remainingChunks == 0)
+        {
+            // Taking the lock orders the notification after the waiter checked the counter
+            {
+                std::lock_guard<std::mutex> guard(jobLock);
+            }
+            jobDone.notify_all();
+        }
+    }
+}
+
+
+/**
+* Take the next chunk of the given worker, or steal one from another worker
+* @param index The index of the worker
+* @param chunk Receives the chunk
+* @return Whether a chunk was found
+*/
+bool ThreadPool::_takeChunk(int index, std::pair<int, int> &chunk)
+{
+    int threads = getThreadCount();
+
+    for(int offset = 0 ; offset < threads ; offset++)
+    {
+        WorkerQueue &queue = *queues[(index + offset) % threads];
+        std::lock_guard<std::mutex> guard(queue.lock);
+        if(queue.chunks.empty())
+        {
+            continue;
+        }
+
+        // The owner works front to back, thieves take from the far end of the victim's run
+        if(offset == 0)
+        {
+            chunk = queue.chunks.front();
+            queue.chunks.pop_front();
+        }
+        else
+        {
+            chunk = queue.chunks.back();
+            queue.chunks.pop_back();
+        }
+        return true;
+    }
+
+    return false;
+}
@@ -0,0 +1,139 @@
+/**
+ * @file ThreadPool.h
+ * @author  Liron Gershuny <liron.gershuny@mail.huji.ac.il>
+ * @version 1.0
+ * @date 25 Dec 2019
+ *
+ * @brief Define a work stealing thread pool for running loops over many cores.
+ *
+ * @section LICENSE
+ * This program is not a free software; bla bla bla...
+ *
+ * @section DESCRIPTION
+ * The pool splits an index range into fixed size chunks, deals them out to per worker
+ * queues and lets idle workers steal from the others.
+ * Input  : An index range and a task that handles a sub range
+ * Process: Runs the task on every chunk on some worker
+ * Output : Returns once every chunk is done
+ */
+
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+// ------------------------------ includes ------------------------------
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+
+// -------------------------- class definitions -------------------------
+
+/**
+ * A fixed set of workers that run parallel loops. Every worker owns a queue of chunks,
+ * takes work from its front and, once it is empty, steals from the back of the others.
+ * The chunks only depend on the range and the grain, never on the number of threads, so a
+ * task whose chunks are independent gives the same result on any pool size.
+ */
+class ThreadPool
+{
+public:
+
+    /**
+     * The work of one chunk
+     * @param begin The first index of the chunk
+     * @param end One past the last index of the chunk
+     * @param worker The index of the worker running it, in [0, getThreadCount())
+     */
+    typedef std::function<void(int begin, int end, int worker)> RangeTask;
+
+private:
+
+    /**
+     * @struct WorkerQueue
+     * @brief The chunks waiting for one worker, as [begin, end) pairs
+     */
+    struct WorkerQueue
+    {
+        std::mutex lock;
+        std::deque<std::pair<int, int>> chunks;
+    };
+
+    std::vector<std::thread> workers;
+    std::vector<std::unique_ptr<WorkerQueue>> queues;
+    std::mutex submitLock;
+    std::mutex jobLock;
+    std::condition_variable jobReady;
+    std::condition_variable jobDone;
+    const RangeTask *currentTask;
+    std::atomic<int> remainingChunks;
+    std::exception_ptr failure;
+    long int generation;
+    int busyWorkers;
+    bool stopping;
+
+    /**
+     * The loop of a spawned worker, waits for jobs and works on them until the pool stops
+     * @param index The index of the worker
+     */
+    void _workerLoop(int index);
+
+    /**
+     * Run chunks of the current job until no queue has any left
+     * @param index The index of the worker
+     */
+    void _runChunks(int index);
+
+    /**
+     * Take the next chunk of the given worker, or steal one from another worker
+     * @param index The index of the worker
+     * @param chunk Receives the chunk
+     * @return Whether a chunk was found
+     */
+    bool _takeChunk(int index, std::pair<int, int> &chunk);
+
+public:
+
+    /**
+     * Constructor of the pool. The calling thread takes part in every job, so threadCount - 1
+     * threads are spawned.
+     * @param threadCount The number of workers, 0 for one per hardware thread
+     */
+    explicit ThreadPool(int threadCount = 0);
+
+
+    /**
+     * Destructor of the pool, stops and joins all the workers.
+     */
+    ~ThreadPool();
+
+
+    ThreadPool(const ThreadPool &) = delete;
+    ThreadPool &operator=(const ThreadPool &) = delete;
+
+
+    /**
+     * Getter of the number of workers, including the calling thread.
+     * @return The number of workers
+     */
+    int getThreadCount() const { return (int) queues.size(); }
+
+
+    /**
+     * Run the task on [0, count) split into chunks of grain indices and wait for all of
+     * them. Calls from several threads are serialized. If chunks throw, the remaining
+     * chunks still run and the first exception is rethrown to the caller.
+     * @param count The size of the range
+     * @param grain The number of indices in every chunk but the last one
+     * @param task The work of one chunk
+     */
+    void parallelFor(int count, int grain, const RangeTask &task);
+
+};
+
+#endif //THREAD_POOL_H
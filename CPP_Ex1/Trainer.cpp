@@ -0,0 +1,263 @@
+/**
+ * @file Trainer.cpp
+ * @author  Liron Gershuny <liron.gershuny@mail.huji.ac.il>
+ * @version 1.0
+ * @date 25 Dec 2019
+ *
+ * @brief Define a class that trains an MlpNetwork with mini batch gradient descent.
+ *
+ * @section LICENSE
+ * This program is not a free software; bla bla bla...
+ *
+ * @section DESCRIPTION
+ * The trainer cuts every mini batch into fixed size shards and backpropagates them on a
+ * work stealing thread pool, every shard with its own buffers. The gradients of the shards
+ * are summed in shard order and turn into one step of SGD with momentum or of Adam.
+ * Input  : Images, one per row, and the digit of every image
+ * Process: Shuffles them into mini batches and takes an optimizer step for every batch
+ * Output : The trained network and the mean loss of every epoch
+ */
+
+// ------------------------------ includes ------------------------------
+#include "Trainer.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <numeric>
+#include <stdexcept>
+
+
+// -------------------------- const definitions -------------------------
+
+/*
+ * @def OPTIMIZER_COUNT 2
+ * @brief The number of OptimizerType values
+ */
+#define OPTIMIZER_COUNT 2
+
+static const char *const optimizerNames[OPTIMIZER_COUNT] = {"sgd", "adam"};
+
+
+// ------------------------ function implementation ---------------------
+
+/**
+* Getter of a printable name of an optimizer, the same name parseOptimizer accepts
+* @param optimizer The optimizer
+* @return The name of the optimizer
+*/
+const char *optimizerName(OptimizerType optimizer)
+{
+    return optimizerNames[optimizer];
+}
+
+
+/**
+* Find the optimizer of the given name
+* @param name The name of the optimizer, as returned by optimizerName
+* @param optimizer Receives the optimizer
+* @return true - the name is known
+*         false - no optimizer has that name
+*/
+bool parseOptimizer(const std::string &name, OptimizerType &optimizer)
+{
+    for(int i = 0 ; i < OPTIMIZER_COUNT ; i++)
+    {
+        if(name == optimizerNames[i])
+        {
+            optimizer = (OptimizerType) i;
+            return true;
+        }
+    }
+    return false;
+}
+
+
+// ------------------------ class implementation ------------------------
+
+/**
+* A constructor of Trainer. The moments of every layer start at zero.
+* @param mlp The network to train, must outlive the trainer and not run elsewhere while it
+*            trains
+* @param trainingOptions The optimizer and the sizes, a zero learning rate takes the default
+*                        of the optimizer
+*/
+Trainer::Trainer(MlpNetwork &mlp, const TrainingOptions &trainingOptions) :
+network(mlp), pool(trainingOptions.threads), options(trainingOptions), stepCount(0)
+{
+    options.batchSize = std::max(1, options.batchSize);
+    options.shardSize = std::max(1, options.shardSize);
+    if(options.learningRate <= 0)
+    {
+        options.learningRate = (float) (options.optimizer == Adam ? ADAM_LEARNING_RATE :
+                                        SGD_LEARNING_RATE);
+    }
+
+    states.resize(network.getLayerCount());
+    for(int i = 0 ; i < network.getLayerCount() ; i++)
+    {
+        int rows = network.getLayer(i).getOutputSize();
+        int cols = network.getLayer(i).getInputSize();
+        for(LayerGradients *state : {&states[i].gradient, &states[i].first, &states[i].second,
+                                     &states[i].step})
+        {
+            state->weights = Matrix(rows, cols);
+            state->bias = Matrix(rows, 1);
+        }
+    }
+
+    batchImages.resize(options.batchSize, network.getInputSize());
+    batchLabels.resize(options.batchSize);
+}
+
+
+/**
+* Turn a summed gradient into a step of the parameters, updating the moments. SGD keeps a
+* velocity of the past gradients, Adam divides the mean gradient by its root mean square,
+* both means corrected for starting at zero.
+* @param gradient The gradient summed over the batch
+* @param first The running mean of the gradient, the velocity of SGD
+* @param second The running mean of the squared gradient, unused by SGD
+* @param step Receives the step
+* @param scale The factor that turns the sum into a mean
+*/
+void Trainer::_optimizerStep(const Matrix &gradient, Matrix &first, Matrix &second,
+                             Matrix &step, float scale) const
+{
+    long int size = (long int) gradient.getRows() * gradient.getCols();
+    const float *g = gradient.data();
+    float *m = first.data();
+    float *v = second.data();
+    float *s = step.data();
+    float rate = options.learningRate;
+
+    if(options.optimizer == Sgd)
+    {
+        for(long int i = 0 ; i < size ; i++)
+        {
+            m[i] = (float) SGD_MOMENTUM * m[i] + scale * g[i];
+            s[i] = -rate * m[i];
+        }
+        return;
+    }
+
+    float firstCorrection = 1.0f / (float) (1 - std::pow(ADAM_BETA1, (double) stepCount));
+    float secondCorrection = 1.0f / (float) (1 - std::pow(ADAM_BETA2, (double) stepCount));
+    for(long int i = 0 ; i < size ; i++)
+    {
+        float mean = scale * g[i];
+        m[i] = (float) ADAM_BETA1 * m[i] + (float) (1 - ADAM_BETA1) * mean;
+        v[i] = (float) ADAM_BETA2 * v[i] + (float) (1 - ADAM_BETA2) * mean * mean;
+        s[i] = -rate * m[i] * firstCorrection /
+               (std::sqrt(v[i] * secondCorrection) + (float) ADAM_EPSILON);
+    }
+}
+
+
+/**
+* Take one optimizer step on a mini batch. Every shard of the batch is backpropagated by
+* one worker into its own buffers, then the gradients are summed in shard order, so the
+* sum doesn't depend on which worker finished first.
+* @param images An input size x N matrix or view, column j holds the j'th sample
+* @param labels The digit of every sample, N entries
+* @return The mean cross entropy loss of the batch, before the step
+* @throws std::invalid_argument If the images don't fit the network or the network can't
+*         be trained
+* @throws std::out_of_range If a label isn't a class of the network
+*/
+float Trainer::trainBatch(const MatrixView &images, const int *labels)
+{
+    if(images.getRows() != network.getInputSize())
+    {
+        throw std::invalid_argument(INVALID_TRAINING_SET_MSG);
+    }
+
+    int count = images.getCols();
+    int shardSize = options.shardSize;
+    size_t shardCount = (size_t) ((count + shardSize - 1) / shardSize);
+    if(shards.size() < shardCount)
+    {
+        shards.resize(shardCount);
+        shardLosses.resize(shardCount);
+    }
+
+    pool.parallelFor(count, shardSize, [&](int begin, int end, int)
+    {
+        int shard = begin / shardSize;
+        shardLosses[shard] = network.backward(images.colSlice(begin, end - begin),
+                                              labels + begin, shards[shard]);
+    });
+
+    float loss = 0;
+    for(size_t shard = 0 ; shard < shardCount ; shard++)
+    {
+        loss += shardLosses[shard];
+    }
+
+    stepCount++;
+    float scale = 1.0f / (float) count;
+    for(int i = 0 ; i < network.getLayerCount() ; i++)
+    {
+        LayerState &state = states[i];
+        state.gradient.weights = shards[0].layers[i].weights;
+        state.gradient.bias = shards[0].layers[i].bias;
+        for(size_t shard = 1 ; shard < shardCount ; shard++)
+        {
+            state.gradient.weights += shards[shard].layers[i].weights;
+            state.gradient.bias += shards[shard].layers[i].bias;
+        }
+
+        _optimizerStep(state.gradient.weights, state.first.weights, state.second.weights,
+                       state.step.weights, scale);
+        _optimizerStep(state.gradient.bias, state.first.bias, state.second.bias,
+                       state.step.bias, scale);
+        network.updateLayer(i, state.step.weights, state.step.bias);
+    }
+
+    return loss * scale;
+}
+
+
+/**
+* Take one pass over a training set, in mini batches of a random order. The images of a
+* batch are copied next to one another, so every shard reads them as one strided view. The
+* weights the forward pass reads are rebuilt once at the end of the pass.
+* @param images The images, one vectorized image per row
+* @param labels The digit of every image
+* @param generator The source of the order
+* @return The mean cross entropy loss of the pass
+* @throws std::invalid_argument If the images and the labels don't match or the network
+*         can't be trained
+* @throws std::out_of_range If a label isn't a class of the network
+*/
+float Trainer::trainEpoch(const Matrix &images, const std::vector<int> &labels,
+                          std::mt19937 &generator)
+{
+    int count = images.getRows();
+    int imageSize = network.getInputSize();
+    if(images.getCols() != imageSize || (size_t) count != labels.size())
+    {
+        throw std::invalid_argument(INVALID_TRAINING_SET_MSG);
+    }
+
+    std::vector<int> order(count);
+    std::iota(order.begin(), order.end(), 0);
+    std::shuffle(order.begin(), order.end(), generator);
+
+    double loss = 0;
+    for(int begin = 0 ; begin < count ; begin += options.batchSize)
+    {
+        int batch = std::min(options.batchSize, count - begin);
+        for(int k = 0 ; k < batch ; k++)
+        {
+            std::memcpy(batchImages.row(k), images.row(order[begin + k]),
+                        (size_t) imageSize * sizeof(float));
+            batchLabels[k] = labels[order[begin + k]];
+        }
+
+        MatrixView batchView = MatrixView(batchImages).rowSlice(0, batch);
+        loss += (double) trainBatch(batchView.transpose(), batchLabels.data()) * batch;
+    }
+
+    network.prepareWeights();
+    return (float) (loss / count);
+}
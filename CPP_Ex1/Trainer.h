@@ -0,0 +1,238 @@
+/**
+ * @file Trainer.h
+ * @author  Liron Gershuny <liron.gershuny@mail.huji.ac.il>
+ * @version 1.0
+ * @date 25 Dec 2019
+ *
+ * @brief Define a class that trains an MlpNetwork with mini batch gradient descent.
+ *
+ * @section LICENSE
+ * This program is not a free software; bla bla bla...
+ *
+ * @section DESCRIPTION
+ * The trainer cuts every mini batch into fixed size shards and backpropagates them on a
+ * work stealing thread pool, every shard with its own buffers. The gradients of the shards
+ * are summed in shard order and turn into one step of SGD with momentum or of Adam.
+ * Input  : Images, one per row, and the digit of every image
+ * Process: Shuffles them into mini batches and takes an optimizer step for every batch
+ * Output : The trained network and the mean loss of every epoch
+ */
+
+#ifndef TRAINER_H
+#define TRAINER_H
+
+// ------------------------------ includes ------------------------------
+#include "Matrix.h"
+#include "MlpNetwork.h"
+#include "ThreadPool.h"
+#include <random>
+#include <string>
+#include <vector>
+
+
+// -------------------------- const definitions -------------------------
+
+/*
+ * @def TRAINER_BATCH_SIZE 128
+ * @brief The default number of images of every optimizer step
+ */
+#define TRAINER_BATCH_SIZE 128
+
+/*
+ * @def TRAINER_SHARD_SIZE 32
+ * @brief The default number of images every worker backpropagates at once, wide enough for
+ *        the blocked GEMM
+ */
+#define TRAINER_SHARD_SIZE 32
+
+/*
+ * @def SGD_LEARNING_RATE 0.05
+ * @brief The default learning rate of SGD
+ */
+#define SGD_LEARNING_RATE 0.05
+
+/*
+ * @def SGD_MOMENTUM 0.9
+ * @brief The share of the previous step SGD keeps
+ */
+#define SGD_MOMENTUM 0.9
+
+/*
+ * @def ADAM_LEARNING_RATE 0.001
+ * @brief The default learning rate of Adam
+ */
+#define ADAM_LEARNING_RATE 0.001
+
+/*
+ * @def ADAM_BETA1 0.9
+ * @brief The decay of the running mean of the gradients in Adam
+ */
+#define ADAM_BETA1 0.9
+
+/*
+ * @def ADAM_BETA2 0.999
+ * @brief The decay of the running mean of the squared gradients in Adam
+ */
+#define ADAM_BETA2 0.999
+
+/*
+ * @def ADAM_EPSILON 1e-8
+ * @brief Keeps the Adam step finite for weights whose gradient is always zero
+ */
+#define ADAM_EPSILON 1e-8
+
+/*
+ * @def INVALID_TRAINING_SET_MSG "Error: The images and the labels of the training set don't
+ *      match"
+ * @brief Error msg when the training images don't fit the network or their count differs
+ *        from the count of labels
+ */
+#define INVALID_TRAINING_SET_MSG "Error: The images and the labels of the training set don't match"
+
+
+// -------------------------- class definitions -------------------------
+
+/**
+ * @enum OptimizerType
+ * @brief How the gradient of a mini batch turns into a step of the parameters.
+ */
+enum OptimizerType
+{
+    Sgd,
+    Adam
+};
+
+
+/**
+ * Getter of a printable name of an optimizer, the same name parseOptimizer accepts
+ * @param optimizer The optimizer
+ * @return The name of the optimizer
+ */
+const char *optimizerName(OptimizerType optimizer);
+
+
+/**
+ * Find the optimizer of the given name
+ * @param name The name of the optimizer, as returned by optimizerName
+ * @param optimizer Receives the optimizer
+ * @return true - the name is known
+ *         false - no optimizer has that name
+ */
+bool parseOptimizer(const std::string &name, OptimizerType &optimizer);
+
+
+/**
+ * @struct TrainingOptions
+ * @brief The optimizer and the sizes a Trainer works with
+ */
+typedef struct TrainingOptions
+{
+    OptimizerType optimizer = Sgd;
+    float learningRate = 0;
+    int batchSize = TRAINER_BATCH_SIZE;
+    int shardSize = TRAINER_SHARD_SIZE;
+    int threads = 0;
+} TrainingOptions;
+
+
+/**
+ * Multi threaded mini batch training of an existing MlpNetwork. The shards only depend on
+ * the shard size, so the trained weights are the same for any number of threads.
+ */
+class Trainer
+{
+private:
+
+    /**
+     * @struct LayerState
+     * @brief The summed gradient, the optimizer moments and the step of one layer
+     */
+    struct LayerState
+    {
+        LayerGradients gradient;
+        LayerGradients first;
+        LayerGradients second;
+        LayerGradients step;
+    };
+
+    MlpNetwork &network;
+    ThreadPool pool;
+    TrainingOptions options;
+    std::vector<TrainingBuffers> shards;
+    std::vector<float> shardLosses;
+    std::vector<LayerState> states;
+    long int stepCount;
+    Matrix batchImages;
+    std::vector<int> batchLabels;
+
+    /**
+     * Turn a summed gradient into a step of the parameters, updating the moments
+     * @param gradient The gradient summed over the batch
+     * @param first The running mean of the gradient, the velocity of SGD
+     * @param second The running mean of the squared gradient, unused by SGD
+     * @param step Receives the step
+     * @param scale The factor that turns the sum into a mean
+     */
+    void _optimizerStep(const Matrix &gradient, Matrix &first, Matrix &second, Matrix &step,
+                        float scale) const;
+
+public:
+
+    /**
+     * A constructor of Trainer.
+     * @param mlp The network to train, must outlive the trainer and not run elsewhere while
+     *            it trains
+     * @param trainingOptions The optimizer and the sizes, a zero learning rate takes the
+     *                        default of the optimizer
+     */
+    explicit Trainer(MlpNetwork &mlp, const TrainingOptions &trainingOptions = TrainingOptions());
+
+
+    /**
+     * Getter of the number of worker threads.
+     * @return The number of workers, including the calling thread
+     */
+    int getThreadCount() const { return pool.getThreadCount(); }
+
+
+    /**
+     * Getter of the learning rate in use.
+     * @return The learning rate
+     */
+    float getLearningRate() const { return options.learningRate; }
+
+
+    /**
+     * Getter of the number of optimizer steps taken so far.
+     * @return The count
+     */
+    long int getStepCount() const { return stepCount; }
+
+
+    /**
+     * Take one optimizer step on a mini batch.
+     * @param images An input size x N matrix or view, column j holds the j'th sample
+     * @param labels The digit of every sample, N entries
+     * @return The mean cross entropy loss of the batch, before the step
+     * @throws std::invalid_argument If the network can't be trained
+     * @throws std::out_of_range If a label isn't a class of the network
+     */
+    float trainBatch(const MatrixView &images, const int *labels);
+
+
+    /**
+     * Take one pass over a training set, in mini batches of a random order.
+     * @param images The images, one vectorized image per row
+     * @param labels The digit of every image
+     * @param generator The source of the order
+     * @return The mean cross entropy loss of the pass
+     * @throws std::invalid_argument If the images and the labels don't match or the network
+     *         can't be trained
+     * @throws std::out_of_range If a label isn't a class of the network
+     */
+    float trainEpoch(const Matrix &images, const std::vector<int> &labels,
+                     std::mt19937 &generator);
+
+};
+
+#endif //TRAINER_H
@@ -0,0 +1,291 @@
+/**
+ * @file allocationtest.cpp
+ * @author  Liron Gershuny <liron.gershuny@mail.huji.ac.il>
+ * @version 1.0
+ * @date 25 Dec 2019
+ *
+ * @brief Check that inference allocates nothing once its buffers are warmed up.
+ *
+ * @section LICENSE
+ * This program is not a free software; bla bla bla...
+ *
+ * @section DESCRIPTION
+ * The program replaces the global operator new to count every heap allocation, and reads
+ * the matrix buffers taken from the pool. Every weight precision and the compressed
+ * weights run one warm up inference, then many single image inferences, layer
+ * evaluations into an existing result and batches through planned buffers, and none of
+ * them may allocate.
+ * Input  : None
+ * Process: Counts the allocations of every inference after the warm up
+ * Output : The count of every case, exits with failure if any of them allocated
+ */
+
+// ------------------------------ includes ------------------------------
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+#include <random>
+#include <utility>
+#include <vector>
+
+#include "Matrix.h"
+#include "MatrixPool.h"
+#include "Dense.h"
+#include "MlpNetwork.h"
+#include "TestFixtures.h"
+
+
+// -------------------------- const definitions -------------------------
+
+/*
+ * @def REPEATS 100
+ * @brief How many inferences of every kind are counted after the warm up
+ */
+#define REPEATS 100
+
+/*
+ * @def BATCH_SIZE 64
+ * @brief The batch size the forward buffers are planned for
+ */
+#define BATCH_SIZE 64
+
+/*
+ * @def SMALL_BATCH_SIZE 17
+ * @brief A batch that fits the planned buffers without filling them
+ */
+#define SMALL_BATCH_SIZE 17
+
+/*
+ * @def PRUNED_DENSITY 0.1
+ * @brief The share of non zero weights of the compressed case
+ */
+#define PRUNED_DENSITY 0.1
+
+/**
+ * The number of operator new calls while counting is on
+ */
+static std::atomic<long int> heapAllocations(0);
+
+/**
+ * Whether operator new calls are counted
+ */
+static std::atomic<bool> counting(false);
+
+
+// ------------------------------ functions -----------------------------
+
+/**
+ * Allocate for every replaced operator new, counting the call if asked to.
+ * @param size The number of bytes
+ * @param alignment The alignment, 0 for the default one
+ * @return The memory, or nullptr on failure
+ */
+static void *countedAlloc(std::size_t size, std::size_t alignment)
+{
+    if(counting.load(std::memory_order_relaxed))
+    {
+        heapAllocations.fetch_add(1, std::memory_order_relaxed);
+    }
+    size = size == 0 ? 1 : size;
+    if(alignment == 0)
+    {
+        return std::malloc(size);
+    }
+    return std::aligned_alloc(alignment, (size + alignment - 1) / alignment * alignment);
+}
+
+/**
+ * Free for every replaced operator delete. Kept out of line, so the compiler doesn't pair
+ * the free with the operator new it sees inlined and warn about a mismatch.
+ * @param memory The memory, or nullptr
+ */
+__attribute__((noinline)) static void countedFree(void *memory)
+{
+    std::free(memory);
+}
+
+void *operator new(std::size_t size)
+{
+    void *memory = countedAlloc(size, 0);
+    if(memory == nullptr)
+    {
+        throw std::bad_alloc();
+    }
+    return memory;
+}
+
+void *operator new[](std::size_t size)
+{
+    return operator new(size);
+}
+
+void *operator new(std::size_t size, const std::nothrow_t &) noexcept
+{
+    return countedAlloc(size, 0);
+}
+
+void *operator new[](std::size_t size, const std::nothrow_t &) noexcept
+{
+    return countedAlloc(size, 0);
+}
+
+void *operator new(std::size_t size, std::align_val_t alignment)
+{
+    void *memory = countedAlloc(size, (std::size_t) alignment);
+    if(memory == nullptr)
+    {
+        throw std::bad_alloc();
+    }
+    return memory;
+}
+
+void *operator new[](std::size_t size, std::align_val_t alignment)
+{
+    return operator new(size, alignment);
+}
+
+void operator delete(void *memory) noexcept
+{
+    countedFree(memory);
+}
+
+void operator delete[](void *memory) noexcept
+{
+    countedFree(memory);
+}
+
+void operator delete(void *memory, std::size_t) noexcept
+{
+    countedFree(memory);
+}
+
+void operator delete[](void *memory, std::size_t) noexcept
+{
+    countedFree(memory);
+}
+
+void operator delete(void *memory, std::align_val_t) noexcept
+{
+    countedFree(memory);
+}
+
+void operator delete[](void *memory, std::align_val_t) noexcept
+{
+    countedFree(memory);
+}
+
+void operator delete(void *memory, std::size_t, std::align_val_t) noexcept
+{
+    countedFree(memory);
+}
+
+void operator delete[](void *memory, std::size_t, std::align_val_t) noexcept
+{
+    countedFree(memory);
+}
+
+/**
+ * Run a task REPEATS times and count the heap and pool allocations it made.
+ * @param name The name of the case, printed with the count
+ * @param task The inference to count
+ * @return Whether it allocated nothing
+ */
+template <typename Task>
+static bool expectNoAllocations(const char *name, const Task &task)
+{
+    long int poolBefore = MatrixPool::acquisitions();
+    heapAllocations.store(0);
+    counting.store(true);
+    for(int i = 0 ; i < REPEATS ; i++)
+    {
+        task();
+    }
+    counting.store(false);
+    long int heap = heapAllocations.load();
+    long int pool = MatrixPool::acquisitions() - poolBefore;
+
+    std::printf("%-40s heap %6ld pool %6ld%s\n", name, heap, pool,
+                heap == 0 && pool == 0 ? "" : "  FAIL");
+    return heap == 0 && pool == 0;
+}
+
+/**
+ * Build a network, warm it up and count the allocations of every kind of inference.
+ * @param name The name of the configuration
+ * @param precision The weight precision
+ * @param sparseMode Whether the weights are compressed
+ * @param density The share of non zero weights
+ * @param images The input batch, one image per column
+ * @return The number of cases that allocated
+ */
+static int checkNetwork(const char *name, WeightPrecision precision, SparseMode sparseMode,
+                        double density, const Matrix &images)
+{
+    std::mt19937 generator(RANDOM_SEED);
+    std::vector<Dense> layers = randomLayers(mnistLayerSizes(), Relu, generator, density);
+    for(Dense &layer : layers)
+    {
+        layer.setSparseMode(sparseMode);
+    }
+    MlpNetwork mlp(std::move(layers));
+    mlp.setPrecision(precision);
+    std::printf("%s:\n", name);
+
+    MatrixView batch(images);
+    MatrixView image = batch.col(0);
+    MatrixView smallBatch = batch.colSlice(0, SMALL_BATCH_SIZE);
+    Matrix layerOutput;
+    ForwardBuffers buffers;
+    mlp.planBuffers(buffers, BATCH_SIZE);
+    std::vector<Digit> digits(BATCH_SIZE);
+
+    mlp(image);
+    mlp(image, Logits);
+    mlp.getLayer(0)(image, layerOutput);
+    mlp.getLayer(0)(batch, layerOutput);
+    mlp.predictBatch(batch, buffers, digits.data());
+
+    int failures = 0;
+    failures += !expectNoAllocations("  single image", [&]()
+    {
+        mlp(image);
+    });
+    failures += !expectNoAllocations("  single image logits", [&]()
+    {
+        mlp(image, Logits);
+    });
+    failures += !expectNoAllocations("  layer into result", [&]()
+    {
+        mlp.getLayer(0)(image, layerOutput);
+    });
+    failures += !expectNoAllocations("  predictBatch with planned buffers", [&]()
+    {
+        mlp.predictBatch(batch, buffers, digits.data());
+    });
+    failures += !expectNoAllocations("  smaller batch with planned buffers", [&]()
+    {
+        mlp.predictBatch(smallBatch, buffers, digits.data());
+    });
+    return failures;
+}
+
+/**
+ * Program's main
+ * @return program exit status code
+ */
+int main()
+{
+    std::mt19937 generator(RANDOM_SEED);
+    Matrix images = randomMatrix(weightsDims[0].cols, BATCH_SIZE, 1.0f, generator);
+
+    int failures = 0;
+    failures += checkNetwork("float32", Float32, SparseOff, 1.0, images);
+    failures += checkNetwork("int8", Int8, SparseOff, 1.0, images);
+    failures += checkNetwork("float16", Float16, SparseOff, 1.0, images);
+    failures += checkNetwork("bfloat16", BFloat16, SparseOff, 1.0, images);
+    failures += checkNetwork("compressed rows", Float32, SparseOn, PRUNED_DENSITY, images);
+
+    std::printf("%d failures\n", failures);
+    return failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
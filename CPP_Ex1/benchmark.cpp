@@ -0,0 +1,647 @@
+/**
+ * @file benchmark.cpp
+ * @author  Liron Gershuny <liron.gershuny@mail.huji.ac.il>
+ * @version 1.0
+ * @date 25 Dec 2019
+ *
+ * @brief Micro benchmarks of the MlpNetwork building blocks.
+ *
+ * @section LICENSE
+ * This program is not a free software; bla bla bla...
+ *
+ * @section DESCRIPTION
+ * The program times the matrix product over a range of shapes, every Dense layer of the
+ * MNIST model shapes, once evaluated step by step and once with the fused kernel, a pruned
+ * first layer with dense and compressed weights, every activation, the whole network one
+ * image at a time against batched inference in every weight precision, with logits output
+ * and with the compile time shaped network, how the multi threaded engine scales with the
+ * number of cores and how long a model takes to load.
+ * Every result can also be written as JSON, so runs of different builds can be compared.
+ * Input  : Optional number of iterations and JSON output path
+ * Process: Runs every operation on random weights and inputs
+ * Output : Latency tables on stdout, and optionally a JSON report
+ */
+
+// ------------------------------ includes ------------------------------
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <random>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "Matrix.h"
+#include "MatrixKernels.h"
+#include "Activation.h"
+#include "Dense.h"
+#include "MlpNetwork.h"
+#include "InferenceEngine.h"
+#include "FixedMlpNetwork.h"
+#include "ModelFile.h"
+
+
+// -------------------------- const definitions -------------------------
+
+/*
+ * @def DEFAULT_ITERATIONS 20000
+ * @brief How many times every measured operation is repeated by default
+ */
+#define DEFAULT_ITERATIONS 20000
+
+/*
+ * @def RANDOM_SEED 2019
+ * @brief Fixed seed so every run measures the same numbers
+ */
+#define RANDOM_SEED 2019
+
+/*
+ * @def BATCH_SIZE 256
+ * @brief How many images are classified together in the batched measurements
+ */
+#define BATCH_SIZE 256
+
+/*
+ * @def SCALING_BATCH_SIZE 4096
+ * @brief How many images every call of the multi threaded engine classifies
+ */
+#define SCALING_BATCH_SIZE 4096
+
+/*
+ * @def ACTIVATION_ROWS 128
+ * @brief The number of outputs of the layer every activation is measured on
+ */
+#define ACTIVATION_ROWS 128
+
+/*
+ * @def PRUNED_DENSITY 0.1
+ * @brief The share of non zero weights of the pruned layer measurement
+ */
+#define PRUNED_DENSITY 0.1
+
+/*
+ * @def LOAD_REPEATS 20
+ * @brief How many times the model is loaded in the load time measurement
+ */
+#define LOAD_REPEATS 20
+
+/*
+ * @def LOAD_MODEL_PATH "benchmark_load.mlp"
+ * @brief The model file written and read back by the load time measurement, then removed
+ */
+#define LOAD_MODEL_PATH "benchmark_load.mlp"
+
+#define JSON_FLAG "--json"
+#define ERROR_INVALID_OUTPUT "Error: can't write the JSON report: "
+#define USAGE_MSG "Usage:\n" \
+                  "\t./benchmark [iterations] [--json path]\n" \
+                  "\titerations - how many times every operation is repeated\n" \
+                  "\tpath - where to write every result as JSON"
+
+/**
+ * @struct MatrixShape
+ * @brief The dimensions of a product of an m x k matrix by a k x n matrix
+ */
+typedef struct MatrixShape
+{
+    int m, k, n;
+} MatrixShape;
+
+/**
+ * The products the matrix benchmark measures: every layer of the model on one image and on
+ * a batch, and square products large enough to leave the caches
+ */
+static const MatrixShape productShapes[] = {{128, 784, 1}, {128, 784, BATCH_SIZE},
+                                            {64, 128, BATCH_SIZE}, {10, 20, BATCH_SIZE},
+                                            {256, 256, 256}, {512, 512, 512}};
+
+/**
+ * @struct BenchmarkResult
+ * @brief One measurement of the JSON report, the named values it measured
+ */
+typedef struct BenchmarkResult
+{
+    std::string group;
+    std::string name;
+    std::vector<std::pair<std::string, double>> metrics;
+} BenchmarkResult;
+
+typedef std::vector<BenchmarkResult> BenchmarkReport;
+
+
+// ------------------------------ functions -----------------------------
+
+/**
+ * Fill a matrix with uniform random values in [-1, 1]
+ * @param mat The matrix to fill
+ * @param gen The random generator to draw from
+ */
+void fillRandom(Matrix &mat, std::mt19937 &gen)
+{
+    std::uniform_real_distribution<float> dist(-1, 1);
+    for(int i = 0 ; i < mat.getRows() * mat.getCols() ; i++)
+    {
+        mat[i] = dist(gen);
+    }
+}
+
+/**
+ * Time a callable by running it repeatedly after one untimed warm up call
+ * @param iterations How many timed calls to make
+ * @param func The operation to measure
+ * @return The mean latency of one call in microseconds
+ */
+template <typename Func>
+double timeMicros(int iterations, Func func)
+{
+    func();
+    auto start = std::chrono::steady_clock::now();
+    for(int i = 0 ; i < iterations ; i++)
+    {
+        func();
+    }
+    auto end = std::chrono::steady_clock::now();
+    return std::chrono::duration<double, std::micro>(end - start).count() / iterations;
+}
+
+/**
+ * Time every call of a callable on its own, after one untimed warm up call
+ * @param iterations How many timed calls to make
+ * @param func The operation to measure
+ * @return The latency of every call in microseconds, sorted
+ */
+template <typename Func>
+std::vector<double> sampleMicros(int iterations, Func func)
+{
+    func();
+    std::vector<double> samples(iterations);
+    for(int i = 0 ; i < iterations ; i++)
+    {
+        auto start = std::chrono::steady_clock::now();
+        func();
+        auto end = std::chrono::steady_clock::now();
+        samples[i] = std::chrono::duration<double, std::micro>(end - start).count();
+    }
+    std::sort(samples.begin(), samples.end());
+    return samples;
+}
+
+/**
+ * The nearest rank percentile of sorted samples
+ * @param samples The samples, sorted
+ * @param percent The percentile, in [0, 100]
+ * @return The smallest sample that at least percent of the samples don't exceed
+ */
+double percentile(const std::vector<double> &samples, double percent)
+{
+    size_t rank = (size_t) std::ceil(percent / 100 * samples.size());
+    return samples[std::min(samples.size() - 1, rank > 0 ? rank - 1 : 0)];
+}
+
+/**
+ * The number of billions of floating point operations per second of an operation
+ * @param flops The operations of one call
+ * @param micros The latency of one call in microseconds
+ * @return The throughput in GFLOP/s
+ */
+double gflops(double flops, double micros)
+{
+    return flops / micros / 1e3;
+}
+
+/**
+ * Build the MNIST network on random weights
+ * @param gen The random generator to draw from
+ * @return The network
+ */
+MlpNetwork randomNetwork(std::mt19937 &gen)
+{
+    Matrix weights[MLP_SIZE];
+    Matrix biases[MLP_SIZE];
+    for(int i = 0 ; i < MLP_SIZE ; i++)
+    {
+        weights[i] = Matrix(weightsDims[i].rows, weightsDims[i].cols);
+        biases[i] = Matrix(biasDims[i].rows, biasDims[i].cols);
+        fillRandom(weights[i], gen);
+        fillRandom(biases[i], gen);
+    }
+    return MlpNetwork(weights, biases);
+}
+
+/**
+ * Write a string as a JSON string literal
+ * @param out The output file
+ * @param text The string
+ */
+void writeJsonString(std::FILE *out, const std::string &text)
+{
+    std::fputc('"', out);
+    for(char c : text)
+    {
+        if(c == '"' || c == '\\')
+        {
+            std::fputc('\\', out);
+        }
+        std::fputc(c, out);
+    }
+    std::fputc('"', out);
+}
+
+/**
+ * Write the whole report as one JSON object
+ * @param out The output file
+ * @param iterations The number of iterations of the run
+ * @param report The results
+ */
+void writeJson(std::FILE *out, int iterations, const BenchmarkReport &report)
+{
+    std::fprintf(out, "{\n  \"simd\": \"%s\",\n  \"threads\": %u,\n  \"iterations\": %d,\n"
+                      "  \"results\": [", kernels::simdLevelName(kernels::getSimdLevel()),
+                 std::max(1u, std::thread::hardware_concurrency()), iterations);
+    for(size_t i = 0 ; i < report.size() ; i++)
+    {
+        std::fprintf(out, "%s\n    {\"group\": ", i == 0 ? "" : ",");
+        writeJsonString(out, report[i].group);
+        std::fputs(", \"name\": ", out);
+        writeJsonString(out, report[i].name);
+        for(const std::pair<std::string, double> &metric : report[i].metrics)
+        {
+            std::fputs(", ", out);
+            writeJsonString(out, metric.first);
+            std::fprintf(out, ": %.6g", metric.second);
+        }
+        std::fputc('}', out);
+    }
+    std::fputs("\n  ]\n}\n", out);
+}
+
+/**
+ * Time the matrix product over every shape of productShapes
+ * @param iterations Scales how many products are measured per shape
+ * @param report Receives a result per shape
+ */
+void benchmarkProducts(int iterations, BenchmarkReport &report)
+{
+    std::mt19937 gen(RANDOM_SEED);
+    std::printf("%-8s %-16s %14s %12s\n", "product", "m x k x n", "latency[us]", "GFLOP/s");
+
+    for(const MatrixShape &shape : productShapes)
+    {
+        Matrix a(shape.m, shape.k);
+        Matrix b(shape.k, shape.n);
+        Matrix c(shape.m, shape.n);
+        fillRandom(a, gen);
+        fillRandom(b, gen);
+
+        double flops = 2.0 * shape.m * shape.k * shape.n;
+        int repeats = std::max(1, (int) (iterations * 1e5 / flops));
+        double latency = timeMicros(repeats, [&]() { c = a * b; });
+
+        char name[48];
+        std::snprintf(name, sizeof(name), "%dx%dx%d", shape.m, shape.k, shape.n);
+        std::printf("%-8s %-16s %14.3f %12.2f\n", "", name, latency, gflops(flops, latency));
+        report.push_back({"product", name, {{"latency_us", latency},
+                                            {"gflops", gflops(flops, latency)}}});
+    }
+}
+
+/**
+ * Time every layer of the model shapes in Separate and Fused mode and print a row per layer
+ * @param iterations How many timed calls to make per measurement
+ */
+void benchmarkLayers(int iterations, BenchmarkReport &report)
+{
+    std::mt19937 gen(RANDOM_SEED);
+    std::printf("\n%-8s %-10s %14s %14s %10s %12s\n", "layer", "shape", "separate[us]",
+                "fused[us]", "speedup", "GFLOP/s");
+
+    for(int i = 0 ; i < MLP_SIZE ; i++)
+    {
+        Matrix weights(weightsDims[i].rows, weightsDims[i].cols);
+        Matrix bias(biasDims[i].rows, biasDims[i].cols);
+        Matrix input(weightsDims[i].cols, 1);
+        Matrix output(weightsDims[i].rows, 1);
+        fillRandom(weights, gen);
+        fillRandom(bias, gen);
+        fillRandom(input, gen);
+
+        Dense layer(weights, bias, i == MLP_SIZE - 1 ? Softmax : Relu);
+        layer.setEvaluationMode(Separate);
+        double separate = timeMicros(iterations, [&]() { layer(input, output); });
+        layer.setEvaluationMode(Fused);
+        double fused = timeMicros(iterations, [&]() { layer(input, output); });
+
+        char shape[32];
+        std::snprintf(shape, sizeof(shape), "%dx%d", weightsDims[i].rows, weightsDims[i].cols);
+        double flops = 2.0 * weightsDims[i].rows * weightsDims[i].cols;
+        std::printf("%-8d %-10s %14.3f %14.3f %9.2fx %12.2f\n", i + 1, shape, separate, fused,
+                    separate / fused, gflops(flops, fused));
+
+        char name[48];
+        std::snprintf(name, sizeof(name), "layer %d %s", i + 1, shape);
+        report.push_back({"dense", name, {{"separate_us", separate}, {"fused_us", fused},
+                                          {"gflops", gflops(flops, fused)}}});
+    }
+}
+
+/**
+ * Time the first layer of the model shapes with most of its weights pruned to zero, once
+ * multiplying every weight and once reading only the non zeros, on one image and on a batch
+ * @param iterations How many timed calls to make per measurement
+ * @param report Receives a result per input
+ */
+void benchmarkPruned(int iterations, BenchmarkReport &report)
+{
+    std::mt19937 gen(RANDOM_SEED);
+    std::uniform_real_distribution<float> keep(0, 1);
+    Matrix weights(weightsDims[0].rows, weightsDims[0].cols);
+    Matrix bias(biasDims[0].rows, biasDims[0].cols);
+    fillRandom(weights, gen);
+    fillRandom(bias, gen);
+    for(int i = 0 ; i < weights.getRows() * weights.getCols() ; i++)
+    {
+        if(keep(gen) >= PRUNED_DENSITY)
+        {
+            weights[i] = 0;
+        }
+    }
+
+    Dense dense(weights, bias, Relu);
+    dense.setSparseMode(SparseOff);
+    Dense sparse(weights, bias, Relu);
+    std::printf("\n%-8s %-10s %14s %14s %10s %12s\n", "pruned", "input", "dense[us]",
+                "sparse[us]", "speedup", "bytes");
+    for(int count : {1, BATCH_SIZE})
+    {
+        Matrix input(weightsDims[0].cols, count);
+        Matrix output(weightsDims[0].rows, count);
+        fillRandom(input, gen);
+        int repeats = std::max(1, iterations / count);
+        double denseLatency = timeMicros(repeats, [&]() { dense(input, output); });
+        double sparseLatency = timeMicros(repeats, [&]() { sparse(input, output); });
+
+        char name[32];
+        std::snprintf(name, sizeof(name), "%dx%d", weightsDims[0].cols, count);
+        std::printf("%-8.2f %-10s %14.3f %14.3f %9.2fx %12ld\n", PRUNED_DENSITY, name,
+                    denseLatency, sparseLatency, denseLatency / sparseLatency,
+                    sparse.getWeightsBytes());
+        report.push_back({"pruned", name, {{"dense_us", denseLatency},
+                                           {"sparse_us", sparseLatency},
+                                           {"speedup", denseLatency / sparseLatency}}});
+    }
+}
+
+/**
+ * Time every activation on the outputs of a layer for a batch of images. The values are
+ * restored before every call so every call sees the same inputs, and the time of the copy
+ * is taken out.
+ * @param iterations How many timed calls to make per activation
+ * @param report Receives a result per activation
+ */
+void benchmarkActivations(int iterations, BenchmarkReport &report)
+{
+    std::mt19937 gen(RANDOM_SEED);
+    Matrix values(ACTIVATION_ROWS, BATCH_SIZE);
+    fillRandom(values, gen);
+    Matrix scratch(values);
+
+    double copy = timeMicros(iterations, [&]() { scratch = values; });
+    std::printf("\n%-10s %-10s %12s %14s\n", "activation", "shape", "latency[us]", "Gvalues/s");
+    const std::pair<ActivationType, const char *> activations[] = {
+            {Relu, "relu"}, {Softmax, "softmax"}, {Sigmoid, "sigmoid"}, {Tanh, "tanh"},
+            {Gelu, "gelu"}};
+    for(const std::pair<ActivationType, const char *> &entry : activations)
+    {
+        Activation activation(entry.first);
+        double latency = timeMicros(iterations, [&]()
+        {
+            scratch = values;
+            activation.apply(scratch);
+        }) - copy;
+
+        double count = (double) ACTIVATION_ROWS * BATCH_SIZE;
+        char shape[32];
+        std::snprintf(shape, sizeof(shape), "%dx%d", ACTIVATION_ROWS, BATCH_SIZE);
+        std::printf("%-10s %-10s %12.3f %14.2f\n", entry.second, shape, latency,
+                    count / latency / 1e3);
+        report.push_back({"activation", entry.second, {{"latency_us", latency},
+                                                       {"gvalues_per_s", count / latency / 1e3}}});
+    }
+}
+
+/**
+ * Compare the throughput of classifying images one by one against a single batched call,
+ * in every weight precision. Single images are timed call by call for their percentiles.
+ * @param iterations How many single images to classify, batches are sized to match
+ * @param report Receives a result per mode and precision
+ */
+void benchmarkBatch(int iterations, BenchmarkReport &report)
+{
+    std::mt19937 gen(RANDOM_SEED);
+    MlpNetwork mlp = randomNetwork(gen);
+
+    Matrix batch(imgDims.rows * imgDims.cols, BATCH_SIZE);
+    Matrix image(imgDims.rows * imgDims.cols, 1);
+    fillRandom(batch, gen);
+    fillRandom(image, gen);
+
+    std::printf("\n%-24s %-8s %14s %14s %14s %10s %10s\n", "mode", "weights", "latency[us]",
+                "images/s", "weights[KiB]", "p50[us]", "p99[us]");
+    for(WeightPrecision precision : {Float32, Int8, Float16, BFloat16})
+    {
+        mlp.setPrecision(precision);
+        std::vector<double> samples = sampleMicros(iterations, [&]() { mlp(image); });
+        double single = 0;
+        for(double sample : samples)
+        {
+            single += sample / samples.size();
+        }
+        double p50 = percentile(samples, 50);
+        double p99 = percentile(samples, 99);
+        int batches = iterations / BATCH_SIZE + 1;
+        double batched = timeMicros(batches, [&]() { mlp.predictBatch(batch); }) / BATCH_SIZE;
+        double kib = mlp.getWeightsBytes() / 1024.0;
+
+        std::printf("%-24s %-8s %14.3f %14.0f %14.1f %10.3f %10.3f\n", "single image",
+                    precisionName(precision), single, 1e6 / single, kib, p50, p99);
+        std::printf("batch of %-15d %-8s %14.3f %14.0f %14.1f\n", BATCH_SIZE,
+                    precisionName(precision), batched, 1e6 / batched, kib);
+        report.push_back({"network", std::string("single image ") + precisionName(precision),
+                          {{"latency_us", single}, {"p50_us", p50}, {"p99_us", p99},
+                           {"images_per_s", 1e6 / single}, {"weights_bytes", kib * 1024}}});
+        report.push_back({"network", std::string("batch ") + precisionName(precision),
+                          {{"batch", BATCH_SIZE}, {"latency_us", batched},
+                           {"images_per_s", 1e6 / batched}}});
+    }
+
+    mlp.setPrecision(Float32);
+    int batches = iterations / BATCH_SIZE + 1;
+    double logits = timeMicros(batches, [&]() { mlp.predictBatch(batch, Logits); }) / BATCH_SIZE;
+    char label[32];
+    std::snprintf(label, sizeof(label), "batch of %d, logits", BATCH_SIZE);
+    std::printf("%-24s %-8s %14.3f %14.0f %14.1f\n", label, precisionName(Float32), logits,
+                1e6 / logits, mlp.getWeightsBytes() / 1024.0);
+    report.push_back({"network", "batch logits", {{"batch", BATCH_SIZE}, {"latency_us", logits},
+                                                  {"images_per_s", 1e6 / logits}}});
+
+    std::unique_ptr<MnistFixedNetwork> fixed = std::make_unique<MnistFixedNetwork>(mlp);
+    std::vector<double> samples = sampleMicros(iterations, [&]() { (*fixed)(image); });
+    double single = 0;
+    for(double sample : samples)
+    {
+        single += sample / samples.size();
+    }
+    std::printf("%-24s %-8s %14.3f %14.0f %14.1f %10.3f %10.3f\n", "single image, fixed",
+                precisionName(Float32), single, 1e6 / single, sizeof(MnistFixedNetwork) / 1024.0,
+                percentile(samples, 50), percentile(samples, 99));
+    report.push_back({"network", "single image fixed",
+                      {{"latency_us", single}, {"p50_us", percentile(samples, 50)},
+                       {"p99_us", percentile(samples, 99)}, {"images_per_s", 1e6 / single}}});
+}
+
+/**
+ * Measure the throughput of the multi threaded engine on a large batch for a growing
+ * number of threads, from one up to every hardware thread
+ * @param iterations Scales how many batches are classified per thread count
+ * @param report Receives a result per thread count
+ */
+void benchmarkScaling(int iterations, BenchmarkReport &report)
+{
+    std::mt19937 gen(RANDOM_SEED);
+    MlpNetwork mlp = randomNetwork(gen);
+
+    Matrix batch(imgDims.rows * imgDims.cols, SCALING_BATCH_SIZE);
+    fillRandom(batch, gen);
+
+    int maxThreads = std::max(1, (int) std::thread::hardware_concurrency());
+    int batches = iterations / SCALING_BATCH_SIZE + 1;
+    double baseline = 0;
+
+    std::vector<int> threadCounts;
+    for(int threads = 1 ; threads < maxThreads ; threads *= 2)
+    {
+        threadCounts.push_back(threads);
+    }
+    threadCounts.push_back(maxThreads);
+
+    std::printf("\n%-8s %14s %14s %10s\n", "threads", "latency[us]", "images/s", "scaling");
+    for(int threads : threadCounts)
+    {
+        InferenceEngine engine(mlp, threads);
+        double latency = timeMicros(batches, [&]() { engine.predictBatch(batch); }) /
+                         SCALING_BATCH_SIZE;
+        if(threads == 1)
+        {
+            baseline = latency;
+        }
+        std::printf("%-8d %14.3f %14.0f %9.2fx\n", threads, latency, 1e6 / latency,
+                    baseline / latency);
+        report.push_back({"engine", "threads " + std::to_string(threads),
+                          {{"threads", threads}, {"batch", SCALING_BATCH_SIZE},
+                           {"latency_us", latency}, {"images_per_s", 1e6 / latency},
+                           {"scaling", baseline / latency}}});
+    }
+}
+
+/**
+ * Measure how long the model takes to load, from a model file written for the purpose up
+ * to a network that is ready to run
+ * @param report Receives the result
+ */
+void benchmarkLoad(BenchmarkReport &report)
+{
+    std::mt19937 gen(RANDOM_SEED);
+    std::vector<ModelLayer> model(MLP_SIZE);
+    for(int i = 0 ; i < MLP_SIZE ; i++)
+    {
+        model[i].weights = Matrix(weightsDims[i].rows, weightsDims[i].cols);
+        model[i].bias = Matrix(biasDims[i].rows, biasDims[i].cols);
+        model[i].activation = i == MLP_SIZE - 1 ? Softmax : Relu;
+        fillRandom(model[i].weights, gen);
+        fillRandom(model[i].bias, gen);
+    }
+    if(!ModelFile::save(LOAD_MODEL_PATH, model))
+    {
+        std::fprintf(stderr, "%s%s\n", ERROR_INVALID_OUTPUT, LOAD_MODEL_PATH);
+        return;
+    }
+
+    bool loaded = true;
+    double latency = timeMicros(LOAD_REPEATS, [&]()
+    {
+        std::vector<Dense> layers;
+        loaded = ModelFile::load(LOAD_MODEL_PATH, layers) && loaded;
+        MlpNetwork mlp(std::move(layers));
+    });
+    std::remove(LOAD_MODEL_PATH);
+    if(!loaded)
+    {
+        return;
+    }
+
+    std::printf("\n%-24s %14s\n", "load", "latency[us]");
+    std::printf("%-24s %14.1f\n", "model file", latency);
+    report.push_back({"load", "model file", {{"latency_us", latency}}});
+}
+
+/**
+ * Program's main
+ * @param argc count of args
+ * @param argv args values
+ * @return program exit status code
+ */
+int main(int argc, char **argv)
+{
+    int iterations = DEFAULT_ITERATIONS;
+    bool iterationsGiven = false;
+    const char *jsonPath = nullptr;
+    for(int i = 1 ; i < argc ; i++)
+    {
+        if(std::strcmp(argv[i], JSON_FLAG) == 0 && i + 1 < argc && jsonPath == nullptr)
+        {
+            jsonPath = argv[++i];
+        }
+        else if(iterationsGiven || (iterations = std::atoi(argv[i])) <= 0)
+        {
+            std::puts(USAGE_MSG);
+            return EXIT_FAILURE;
+        }
+        else
+        {
+            iterationsGiven = true;
+        }
+    }
+
+    BenchmarkReport report;
+    std::printf("simd: %s\n", kernels::simdLevelName(kernels::getSimdLevel()));
+    benchmarkProducts(iterations, report);
+    benchmarkLayers(iterations, report);
+    benchmarkPruned(iterations, report);
+    benchmarkActivations(iterations, report);
+    benchmarkBatch(iterations, report);
+    benchmarkScaling(iterations, report);
+    benchmarkLoad(report);
+
+    if(jsonPath != nullptr)
+    {
+        std::FILE *out = std::fopen(jsonPath, "w");
+        if(out == nullptr)
+        {
+            std::fprintf(stderr, "%s%s\n", ERROR_INVALID_OUTPUT, jsonPath);
+            return EXIT_FAILURE;
+        }
+        writeJson(out, iterations, report);
+        if(std::fclose(out) != 0)
+        {
+            std::fprintf(stderr, "%s%s\n", ERROR_INVALID_OUTPUT, jsonPath);
+            return EXIT_FAILURE;
+        }
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,168 @@
+/**
+ * @file fixedtest.cpp
+ * @author  Liron Gershuny <liron.gershuny@mail.huji.ac.il>
+ * @version 1.0
+ * @date 25 Dec 2019
+ *
+ * @brief Check that the compile-time shaped networks classify like MlpNetwork.
+ *
+ * @section LICENSE
+ * This program is not a free software; bla bla bla...
+ *
+ * @section DESCRIPTION
+ * The program copies random networks into FixedMlpNetwork, the MNIST one whose small
+ * layers are unrolled over transposed weights and whose large ones use the dispatched
+ * kernel, a stack of Tanh layers that are all unrolled, a single layer network and one
+ * that ends with a Tanh whose outputs are all negative instead of a Softmax. Every
+ * image is given as a contiguous column and as a strided column of a batch, which goes
+ * through the copying fallback, and must give the digit and the probability of MlpNetwork.
+ * Input  : None
+ * Process: Classifies random images with both networks
+ * Output : The largest probability difference of every network and the failing images,
+ *          exits with failure if any failed
+ */
+
+// ------------------------------ includes ------------------------------
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <utility>
+#include <vector>
+
+#include "Matrix.h"
+#include "MatrixView.h"
+#include "Dense.h"
+#include "MlpNetwork.h"
+#include "FixedMlpNetwork.h"
+#include "TestFixtures.h"
+
+
+// -------------------------- const definitions -------------------------
+
+/*
+ * @def IMAGE_COUNT 32
+ * @brief The number of images every network classifies
+ */
+#define IMAGE_COUNT 32
+
+/*
+ * @def PROBABILITY_TOLERANCE 1e-5
+ * @brief The largest probability difference allowed, the two networks sum the products in
+ *        a different order
+ */
+#define PROBABILITY_TOLERANCE 1e-5
+
+/*
+ * @def NEGATIVE_OUTPUT_SHIFT 3.0f
+ * @brief Taken from the biases of the last Tanh layer, so every output of it is negative
+ */
+#define NEGATIVE_OUTPUT_SHIFT 3.0f
+
+/**
+ * The widths of the network of unrolled Tanh layers
+ */
+typedef FixedMlpNetwork<12, 8, 6, 5> SmallFixedNetwork;
+
+/**
+ * A network of a single Softmax layer
+ */
+typedef FixedMlpNetwork<12, 5> SingleLayerFixedNetwork;
+
+/**
+ * A network of a ReLU layer and a Tanh layer
+ */
+typedef FixedMlpNetwork<12, 8, 5> TanhOutputFixedNetwork;
+
+
+// ------------------------------ functions -----------------------------
+
+/**
+ * Compare one classification of the fixed network with the dynamic one.
+ * @param name The name of the network, printed on failure
+ * @param input How the image was given, printed on failure
+ * @param image The index of the image
+ * @param digit The digit of the fixed network
+ * @param expected The digit of the dynamic network
+ * @param maxError Updated with the largest probability difference
+ * @return Whether the digits are the same and the probabilities within the tolerance
+ */
+static bool compare(const char *name, const char *input, int image, const Digit &digit,
+                    const Digit &expected, double &maxError)
+{
+    double error = std::fabs((double) digit.probability - expected.probability);
+    maxError = std::max(maxError, error);
+    if(digit.value != expected.value || !(error <= PROBABILITY_TOLERANCE))
+    {
+        std::printf("FAIL %s, %s image %d: %u with %g instead of %u with %g\n", name, input,
+                    image, digit.value, digit.probability, expected.value,
+                    expected.probability);
+        return false;
+    }
+    return true;
+}
+
+/**
+ * Classify random images with a dynamic network and its fixed copy, every image as its own
+ * contiguous matrix and as a strided column of a batch.
+ * @param name The name of the network, printed with the result
+ * @param mlp The dynamic network
+ * @param generator The source of the images
+ * @return The number of failing classifications
+ */
+template <typename FIXED>
+static int checkNetwork(const char *name, MlpNetwork &mlp, std::mt19937 &generator)
+{
+    FIXED fixed(mlp);
+    Matrix batch = randomMatrix(FIXED::INPUT_SIZE, IMAGE_COUNT, 1.0f, generator);
+    MatrixView images(batch);
+
+    int failures = 0;
+    double maxError = 0;
+    for(int j = 0 ; j < IMAGE_COUNT ; j++)
+    {
+        MatrixView strided = images.col(j);
+        Matrix contiguous(strided);
+        Digit expected = mlp(contiguous);
+        failures += !compare(name, "contiguous", j, fixed(contiguous), expected, maxError);
+        failures += !compare(name, "strided", j, fixed(strided), expected, maxError);
+        failures += !compare(name, "dynamic strided", j, mlp(strided), expected, maxError);
+    }
+
+    std::printf("%-14s largest probability difference %g%s\n", name, maxError,
+                failures == 0 ? "" : "  FAIL");
+    return failures;
+}
+
+/**
+ * Program's main
+ * @return program exit status code
+ */
+int main()
+{
+    std::mt19937 generator(RANDOM_SEED);
+    int failures = 0;
+
+    MlpNetwork mnist(randomLayers(mnistLayerSizes(), Relu, generator));
+    failures += checkNetwork<MnistFixedNetwork>("mnist relu", mnist, generator);
+
+    MlpNetwork small(randomLayers({12, 8, 6, 5}, Tanh, generator));
+    failures += checkNetwork<SmallFixedNetwork>("small tanh", small, generator);
+
+    MlpNetwork single(randomLayers({12, 5}, Softmax, generator));
+    failures += checkNetwork<SingleLayerFixedNetwork>("single layer", single, generator);
+
+    std::vector<Dense> layers = randomLayers({12, 8, 5}, Relu, generator);
+    Matrix bias = layers.back().getBias();
+    for(int i = 0 ; i < bias.getRows() ; i++)
+    {
+        bias[i] -= NEGATIVE_OUTPUT_SHIFT;
+    }
+    layers.back() = Dense(layers.back().getWeights(), bias, Tanh);
+    MlpNetwork tanhOutput(std::move(layers));
+    failures += checkNetwork<TanhOutputFixedNetwork>("tanh output", tanhOutput, generator);
+
+    std::printf("%d failures\n", failures);
+    return failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,241 @@
+/**
+ * @file gemmtest.cpp
+ * @author  Liron Gershuny <liron.gershuny@mail.huji.ac.il>
+ * @version 1.0
+ * @date 25 Dec 2019
+ *
+ * @brief Check the blocked, packed and strided matrix products against the naive one.
+ *
+ * @section LICENSE
+ * This program is not a free software; bla bla bla...
+ *
+ * @section DESCRIPTION
+ * The program multiplies random matrices of shapes around the register tile and the cache
+ * blocks of the blocked product, where the edge handling of the kernels lives, with every
+ * implementation and at every SIMD level the CPU supports, and compares every product with
+ * the reference triple loop. The strided product is also run on transposed operands and on
+ * columns sliced out of a wider matrix.
+ * Input  : None
+ * Process: Runs every product on every shape and SIMD level
+ * Output : The failing products and the largest error, exits with failure if any failed
+ */
+
+// ------------------------------ includes ------------------------------
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <vector>
+
+#include "MatrixKernels.h"
+#include "TestFixtures.h"
+
+
+// -------------------------- const definitions -------------------------
+
+/*
+ * @def RELATIVE_TOLERANCE 1e-5
+ * @brief The largest error allowed per term of a dot product, the values are in [-1, 1]
+ */
+#define RELATIVE_TOLERANCE 1e-5
+
+/*
+ * @def SLICE_MARGIN 3
+ * @brief The columns around B in the wider matrix it is sliced out of, so its rows are
+ *        strided like a few columns of a batch
+ */
+#define SLICE_MARGIN 3
+
+/**
+ * The sizes every dimension is checked with: one, one around the register tile height and
+ * width, and one past the depth of a cache block
+ */
+static const int edgeSizes[] = {1, GEMM_MR - 1, GEMM_MR + 1, GEMM_NR - 1, GEMM_NR + 1,
+                                GEMM_KC + 1};
+
+/**
+ * @struct ProductShape
+ * @brief The dimensions of a product of an m x k matrix by a k x n matrix
+ */
+typedef struct ProductShape
+{
+    int m, n, k;
+} ProductShape;
+
+/**
+ * Shapes beyond the combinations of edgeSizes, that cross the width of a column block and
+ * the height of a row block
+ */
+static const ProductShape largeShapes[] = {{GEMM_MR + 1, GEMM_NC + 1, GEMM_KC + 1},
+                                           {GEMM_MC + 1, GEMM_NC + 1, GEMM_KC + 1},
+                                           {1, GEMM_NC + 1, GEMM_NR + 1},
+                                           {GEMM_MC + 1, 1, GEMM_KC + 1}};
+
+
+// ------------------------------ functions -----------------------------
+
+/**
+ * Transpose a row-major matrix into another buffer.
+ * @param a The rows*cols matrix
+ * @param rows The number of rows of a
+ * @param cols The number of columns of a
+ * @return The cols*rows transpose
+ */
+static std::vector<float> transposed(const std::vector<float> &a, int rows, int cols)
+{
+    std::vector<float> t(a.size());
+    for(int i = 0 ; i < rows ; i++)
+    {
+        for(int j = 0 ; j < cols ; j++)
+        {
+            t[(size_t) j * rows + i] = a[(size_t) i * cols + j];
+        }
+    }
+    return t;
+}
+
+/**
+ * Compare a product with the reference one.
+ * @param name The name of the product, printed on failure
+ * @param level The SIMD level it ran at
+ * @param shape The shape of the product
+ * @param c The product
+ * @param reference The reference product
+ * @param maxError Updated with the largest relative error
+ * @return Whether every element is within the tolerance
+ */
+static bool compare(const char *name, kernels::SimdLevel level, const ProductShape &shape,
+                    const std::vector<float> &c, const std::vector<float> &reference,
+                    double &maxError)
+{
+    double tolerance = RELATIVE_TOLERANCE * shape.k;
+    for(size_t i = 0 ; i < c.size() ; i++)
+    {
+        double error = std::fabs((double) c[i] - reference[i]);
+        maxError = std::max(maxError, error / shape.k);
+        if(!(error <= tolerance))
+        {
+            std::printf("FAIL %s at %s, m=%d n=%d k=%d: element %zu is %g instead of %g\n",
+                        name, kernels::simdLevelName(level), shape.m, shape.n, shape.k, i,
+                        c[i], reference[i]);
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * Run every product on one shape and compare them with the naive product.
+ * @param shape The shape of the product
+ * @param level The SIMD level the kernels run at
+ * @param generator The source of the operands
+ * @param maxError Updated with the largest relative error
+ * @return The number of failing products
+ */
+static int checkShape(const ProductShape &shape, kernels::SimdLevel level,
+                      std::mt19937 &generator, double &maxError)
+{
+    int m = shape.m;
+    int n = shape.n;
+    int k = shape.k;
+    std::uniform_real_distribution<float> distribution(-1.0f, 1.0f);
+    std::vector<float> a((size_t) m * k);
+    std::vector<float> b((size_t) k * n);
+    for(float &value : a)
+    {
+        value = distribution(generator);
+    }
+    for(float &value : b)
+    {
+        value = distribution(generator);
+    }
+    std::vector<float> at = transposed(a, m, k);
+    std::vector<float> bt = transposed(b, k, n);
+
+    std::vector<float> reference((size_t) m * n);
+    kernels::gemmNaive(a.data(), b.data(), reference.data(), m, n, k);
+
+    int failures = 0;
+    std::vector<float> c((size_t) m * n);
+    kernels::gemmBlocked(a.data(), b.data(), c.data(), m, n, k);
+    failures += !compare("gemmBlocked", level, shape, c, reference, maxError);
+
+    kernels::gemm(a.data(), b.data(), c.data(), m, n, k);
+    failures += !compare("gemm", level, shape, c, reference, maxError);
+
+    std::vector<float> packed(kernels::packedWeightsSize(m, k));
+    kernels::packWeights(a.data(), m, k, packed.data());
+    kernels::gemmPacked(a.data(), packed.data(), b.data(), n, 1, c.data(), m, n, k);
+    failures += !compare("gemmPacked", level, shape, c, reference, maxError);
+
+    kernels::gemmPacked(a.data(), packed.data(), bt.data(), 1, k, c.data(), m, n, k);
+    failures += !compare("gemmPacked B^T", level, shape, c, reference, maxError);
+
+    kernels::gemmStrided(a.data(), k, 1, b.data(), n, 1, c.data(), m, n, k);
+    failures += !compare("gemmStrided", level, shape, c, reference, maxError);
+
+    kernels::gemmStrided(at.data(), 1, m, b.data(), n, 1, c.data(), m, n, k);
+    failures += !compare("gemmStrided A^T", level, shape, c, reference, maxError);
+
+    kernels::gemmStrided(a.data(), k, 1, bt.data(), 1, k, c.data(), m, n, k);
+    failures += !compare("gemmStrided B^T", level, shape, c, reference, maxError);
+
+    kernels::gemmStrided(at.data(), 1, m, bt.data(), 1, k, c.data(), m, n, k);
+    failures += !compare("gemmStrided A^T B^T", level, shape, c, reference, maxError);
+
+    std::vector<float> wide((size_t) k * (n + SLICE_MARGIN));
+    for(int p = 0 ; p < k ; p++)
+    {
+        std::copy(b.begin() + (long int) p * n, b.begin() + (long int) (p + 1) * n,
+                  wide.begin() + (long int) p * (n + SLICE_MARGIN) + 1);
+    }
+    kernels::gemmStrided(a.data(), k, 1, wide.data() + 1, n + SLICE_MARGIN, 1, c.data(), m, n,
+                         k);
+    failures += !compare("gemmStrided B slice", level, shape, c, reference, maxError);
+    return failures;
+}
+
+/**
+ * Program's main
+ * @return program exit status code
+ */
+int main()
+{
+    std::vector<ProductShape> shapes;
+    for(int m : edgeSizes)
+    {
+        for(int n : edgeSizes)
+        {
+            for(int k : edgeSizes)
+            {
+                shapes.push_back({m, n, k});
+            }
+        }
+    }
+    shapes.insert(shapes.end(), std::begin(largeShapes), std::end(largeShapes));
+
+    std::mt19937 generator(RANDOM_SEED);
+    kernels::SimdLevel detected = kernels::getSimdLevel();
+    int failures = 0;
+    int checked = 0;
+    double maxError = 0;
+    for(int level = kernels::Scalar ; level <= detected ; level++)
+    {
+        kernels::setSimdLevel((kernels::SimdLevel) level);
+        if(kernels::getSimdLevel() != level)
+        {
+            continue;
+        }
+        for(const ProductShape &shape : shapes)
+        {
+            failures += checkShape(shape, (kernels::SimdLevel) level, generator, maxError);
+            checked++;
+        }
+    }
+    kernels::setSimdLevel(detected);
+
+    std::printf("%d shapes checked up to %s, largest error per term %g, %d failures\n",
+                checked, kernels::simdLevelName(detected), maxError, failures);
+    return failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
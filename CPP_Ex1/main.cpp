@@ -1,25 +1,78 @@
-#include <fstream>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <exception>
+#include <new>
+#include <utility>
+#include <vector>
 
 #include "Matrix.h"
+#include "ModelFile.h"
 #include "Activation.h"
 #include "Dense.h"
 #include "MlpNetwork.h"
+#include "InferenceEngine.h"
+#include "InferencePipeline.h"
+#include "Profiler.h"
 
 #define QUIT "q"
 #define INSERT_IMAGE_PATH "Please insert image path:"
 #define ERROR_INAVLID_PARAMETER "Error: invalid Parameters file for layer: "
 #define ERROR_INVALID_INPUT "Error: Failed to retrieve input. Exiting.."
 #define ERROR_INVALID_IMG "Error: invalid image path or size: "
+#define ERROR_INVALID_MODEL "Error: invalid model file: "
+#define ERROR_INVALID_PRECISION "Error: unknown weight precision: "
+#define ERROR_INVALID_OPTION "Error: unknown batch option: "
+#define ERROR_INVALID_OUTPUT "Error: can't write the output file: "
 #define USAGE_MSG "Usage:\n" \
                   "\t./mlpnetwork w1 w2 w3 w4 b1 b2 b3 b4\n" \
+                  "\t./mlpnetwork model [precision]\n" \
+                  "\t./mlpnetwork model --manifest|--stream input output [csv|binary] " \
+                  "[precision]\n" \
                   "\twi - the i'th layer's weights\n" \
-                  "\tbi - the i'th layer's biases"
+                  "\tbi - the i'th layer's biases\n" \
+                  "\tmodel - a single file model, see mlpconvert\n" \
+                  "\tprecision - float32 (default), int8, float16 or bfloat16\n" \
+                  "\t--manifest - input is a text file with one image path per line\n" \
+                  "\t--stream - input is raw images written back to back\n" \
+                  "\tinput, output - files, - for the standard input or output\n" \
+                  "\tcsv (default) - writes image,digit,probability lines\n" \
+                  "\tbinary - writes 12 byte records of uint32 index, uint32 digit and " \
+                  "float32 probability"
+
+#define MANIFEST_FLAG "--manifest"
+#define STREAM_FLAG "--stream"
+#define CSV_FORMAT "csv"
+#define BINARY_FORMAT "binary"
+#define STDIO_PATH "-"
+#define PROFILE_TRACE_PATH "mlpnetwork_trace.json"
 
 
 #define ARGS_START_IDX 1
 #define ARGS_COUNT (ARGS_START_IDX + (MLP_SIZE * 2))
 #define WEIGHTS_START_IDX ARGS_START_IDX
 #define BIAS_START_IDX (ARGS_START_IDX + MLP_SIZE)
+#define MODEL_ARGS_COUNT (ARGS_START_IDX + 1)
+#define MODEL_PRECISION_ARGS_COUNT (MODEL_ARGS_COUNT + 1)
+#define BATCH_SOURCE_IDX (ARGS_START_IDX + 1)
+#define BATCH_INPUT_IDX (BATCH_SOURCE_IDX + 1)
+#define BATCH_OUTPUT_IDX (BATCH_INPUT_IDX + 1)
+#define BATCH_OPTIONS_IDX (BATCH_OUTPUT_IDX + 1)
+#define BATCH_MAX_ARGS_COUNT (BATCH_OPTIONS_IDX + 2)
+#define OUTPUT_BUFFER_SIZE (1 << 20)
+
+
+/**
+ * @struct BatchRecord
+ * @brief The result of one image in the binary output of the batch mode, little endian on
+ *        every host
+ */
+typedef struct BatchRecord
+{
+    uint32_t index;
+    uint32_t value;
+    float probability;
+} BatchRecord;
 
 
 
@@ -44,24 +97,7 @@ void usage()
  */
 bool readFileToMatrix(const std::string &filePath, Matrix &mat)
 {
-    std::ifstream is;
-    is.open(filePath, std::ios::in | std::ios::binary | std::ios::ate);
-    if(!is.is_open())
-    {
-        return false;
-    }
-
-    long int matByteSize = (long int) mat.getCols() * mat.getRows() * sizeof(float);
-    if(is.tellg() != matByteSize)
-    {
-        is.close();
-        return false;
-    }
-
-    is.seekg(0, std::ios_base::beg);
-    is >> mat;
-    is.close();
-    return true;
+    return ModelFile::readRawTensor(filePath, mat);
 }
 
 /**
@@ -94,6 +130,26 @@ void loadParameters(char *paths[ARGS_COUNT], Matrix weights[MLP_SIZE], Matrix bi
     }
 }
 
+/**
+ * Builds the network described by a single model file. The model may have any
+ * depth and widths as long as it takes a whole image as its input.
+ * Exits (code == 1) upon failures.
+ * @param path path of the model file
+ * @return The network of the model
+ */
+MlpNetwork loadModel(const std::string &path)
+{
+    std::vector<Dense> layers;
+    if(!ModelFile::load(path, layers) ||
+       layers.front().getInputSize() != imgDims.rows * imgDims.cols)
+    {
+        std::cerr << ERROR_INVALID_MODEL << path << std::endl;
+        exit(EXIT_FAILURE);
+    }
+
+    return MlpNetwork(std::move(layers));
+}
+
 /**
  * This programs Command line interface for the mlp network.
  * Looping on: {
@@ -121,8 +177,7 @@ void mlpCli(MlpNetwork &mlp)
     {
         if(readFileToMatrix(imgPath, img))
         {
-            Matrix imgVec = img;
-            Digit output = mlp(imgVec.vectorize());
+            Digit output = mlp(MatrixView(img).reshape(img.getRows() * img.getCols(), 1));
             std::cout << "Image processed:" << std::endl
                       << img << std::endl;
             std::cout << "Mlp result: " << output.value <<
@@ -144,19 +199,222 @@ void mlpCli(MlpNetwork &mlp)
 }
 
 /**
- * Program's main
+ * Whether the arguments ask for the batch mode.
+ * @param argc count of args
+ * @param argv args values
+ * @return true - the second argument is the kind of a batch input
+ */
+bool isBatchMode(int argc, char **argv)
+{
+    return argc > BATCH_SOURCE_IDX &&
+           (std::strcmp(argv[BATCH_SOURCE_IDX], MANIFEST_FLAG) == 0 ||
+            std::strcmp(argv[BATCH_SOURCE_IDX], STREAM_FLAG) == 0);
+}
+
+/**
+ * Write a manifest path as a CSV field. A path holding a comma, a quote or a line break is
+ * quoted, with its quotes doubled.
+ * @param out The output file
+ * @param name The path
+ */
+void writeCsvName(std::FILE *out, const std::string &name)
+{
+    if(name.find_first_of(",\"\r\n") == std::string::npos)
+    {
+        std::fputs(name.c_str(), out);
+        return;
+    }
+
+    std::fputc('"', out);
+    for(char c : name)
+    {
+        if(c == '"')
+        {
+            std::fputc('"', out);
+        }
+        std::fputc(c, out);
+    }
+    std::fputc('"', out);
+}
+
+/**
+ * Write the results of one batch as CSV lines, the manifest path or the stream index of
+ * every image followed by its digit and probability.
+ * @param out The output file
+ * @param batch The classified batch
+ */
+void writeCsv(std::FILE *out, const ImageBatch &batch)
+{
+    for(int i = 0 ; i < batch.count ; i++)
+    {
+        if(batch.names.empty())
+        {
+            std::fprintf(out, "%ld", batch.first + i);
+        }
+        else
+        {
+            writeCsvName(out, batch.names[i]);
+        }
+        std::fprintf(out, ",%u,%.6f\n", batch.digits[i].value, batch.digits[i].probability);
+    }
+}
+
+/**
+ * Convert a 32 bit value between the host byte order and little endian.
+ * @param value The value
+ * @return The value with its bytes swapped on a big endian host, as is otherwise
+ */
+uint32_t littleEndian(uint32_t value)
+{
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    return __builtin_bswap32(value);
+#else
+    return value;
+#endif
+}
+
+/**
+ * Write the results of one batch as little endian binary records.
+ * @param out The output file
+ * @param batch The classified batch
+ */
+void writeBinary(std::FILE *out, const ImageBatch &batch)
+{
+    std::vector<BatchRecord> records(batch.count);
+    for(int i = 0 ; i < batch.count ; i++)
+    {
+        uint32_t probability;
+        std::memcpy(&probability, &batch.digits[i].probability, sizeof(probability));
+        probability = littleEndian(probability);
+
+        long int index = batch.lines.empty() ? batch.first + i : batch.lines[i];
+        records[i].index = littleEndian((uint32_t) index);
+        records[i].value = littleEndian(batch.digits[i].value);
+        std::memcpy(&records[i].probability, &probability, sizeof(probability));
+    }
+    std::fwrite(records.data(), sizeof(BatchRecord), records.size(), out);
+}
+
+/**
+ * The non interactive mode. Classifies every image of a manifest or of a stream in
+ * batches, with the reading, the inference and the writing of different batches running
+ * at the same time, and writes one compact result per image. Images of the manifest that
+ * can't be read are reported on stderr and left out of the output, and the binary index
+ * of a manifest image is its line in the manifest, so the records still map back to it.
+ * Exits (code == 1) on invalid arguments or an output that can't be written.
+ * @param mlp MlpNetwork to classify the images with
+ * @param argc count of args
+ * @param argv args values
+ */
+void mlpBatch(MlpNetwork &mlp, int argc, char **argv)
+{
+    bool binary = false;
+    WeightPrecision precision = Float32;
+    for(int i = BATCH_OPTIONS_IDX ; i < argc ; i++)
+    {
+        if(std::strcmp(argv[i], CSV_FORMAT) == 0 || std::strcmp(argv[i], BINARY_FORMAT) == 0)
+        {
+            binary = std::strcmp(argv[i], BINARY_FORMAT) == 0;
+        }
+        else if(!parsePrecision(argv[i], precision))
+        {
+            std::cerr << ERROR_INVALID_OPTION << argv[i] << std::endl;
+            exit(EXIT_FAILURE);
+        }
+    }
+    mlp.setTrainable(false);
+    mlp.setPrecision(precision);
+
+    const char *outputPath = argv[BATCH_OUTPUT_IDX];
+    bool toStdout = std::strcmp(outputPath, STDIO_PATH) == 0;
+    std::FILE *out = toStdout ? stdout : std::fopen(outputPath, binary ? "wb" : "w");
+    if(out == nullptr)
+    {
+        std::cerr << ERROR_INVALID_OUTPUT << outputPath << std::endl;
+        exit(EXIT_FAILURE);
+    }
+    static char outBuffer[OUTPUT_BUFFER_SIZE];
+    std::setvbuf(out, outBuffer, _IOFBF, sizeof(outBuffer));
+
+    ImageSource source = std::strcmp(argv[BATCH_SOURCE_IDX], MANIFEST_FLAG) == 0 ?
+                         Manifest : Stream;
+    if(!binary)
+    {
+        std::fprintf(out, "%s,digit,probability\n", source == Manifest ? "image" : "index");
+    }
+
+    InferencePipeline pipeline(mlp);
+    pipeline.run(argv[BATCH_INPUT_IDX], source, [out, binary](const ImageBatch &batch)
+    {
+        for(const std::string &path : batch.failed)
+        {
+            std::cerr << ERROR_INVALID_IMG << path << std::endl;
+        }
+        if(binary)
+        {
+            writeBinary(out, batch);
+        }
+        else
+        {
+            writeCsv(out, batch);
+        }
+    });
+
+    bool written = std::fflush(out) == 0 && !std::ferror(out);
+    if(!toStdout)
+    {
+        written = std::fclose(out) == 0 && written;
+    }
+    if(!written)
+    {
+        std::cerr << ERROR_INVALID_OUTPUT << outputPath << std::endl;
+        exit(EXIT_FAILURE);
+    }
+}
+
+/**
+ * The body of main, the errors of the library reach main as exceptions
  * @param argc count of args
  * @param argv args values
  * @return program exit status code
  */
-int main(int argc, char **argv)
+int run(int argc, char **argv)
 {
-    if(argc != ARGS_COUNT)
+    if(isBatchMode(argc, argv))
+    {
+        if(argc <= BATCH_OUTPUT_IDX || argc > BATCH_MAX_ARGS_COUNT)
+        {
+            usage();
+            exit(EXIT_FAILURE);
+        }
+
+        MlpNetwork mlp = loadModel(argv[ARGS_START_IDX]);
+        mlpBatch(mlp, argc, argv);
+        return EXIT_SUCCESS;
+    }
+
+    if(argc != ARGS_COUNT && argc != MODEL_ARGS_COUNT && argc != MODEL_PRECISION_ARGS_COUNT)
     {
         usage();
         exit(EXIT_FAILURE);
     }
 
+    if(argc == MODEL_ARGS_COUNT || argc == MODEL_PRECISION_ARGS_COUNT)
+    {
+        WeightPrecision precision = Float32;
+        if(argc == MODEL_PRECISION_ARGS_COUNT && !parsePrecision(argv[MODEL_ARGS_COUNT], precision))
+        {
+            std::cerr << ERROR_INVALID_PRECISION << argv[MODEL_ARGS_COUNT] << std::endl;
+            exit(EXIT_FAILURE);
+        }
+
+        MlpNetwork mlp = loadModel(argv[ARGS_START_IDX]);
+        mlp.setTrainable(false);
+        mlp.setPrecision(precision);
+        mlpCli(mlp);
+        return EXIT_SUCCESS;
+    }
+
     Matrix weights[MLP_SIZE];
     Matrix biases[MLP_SIZE];
     loadParameters(argv, weights, biases);
@@ -168,3 +426,34 @@ int main(int argc, char **argv)
 
     return EXIT_SUCCESS;
 }
+
+/**
+ * Program's main, reports the errors the library throws and exits with EXIT_STATUS. A
+ * build with MLP_PROFILE prints the time of every layer on stderr once run returns, and
+ * writes a Chrome trace to PROFILE_TRACE_PATH.
+ * @param argc count of args
+ * @param argv args values
+ * @return program exit status code
+ */
+int main(int argc, char **argv)
+{
+    try
+    {
+        int status = run(argc, argv);
+#if MLP_PROFILE
+        Profiler::printSummary(stderr);
+        Profiler::writeChromeTrace(PROFILE_TRACE_PATH);
+#endif
+        return status;
+    }
+    catch(const std::bad_alloc &)
+    {
+        std::cerr << ALLOCATION_FAILED_MSG << std::endl;
+    }
+    catch(const std::exception &e)
+    {
+        std::cerr << e.what() << std::endl;
+    }
+
+    return EXIT_STATUS;
+}
@@ -0,0 +1,84 @@
+/**
+ * @file mlpconvert.cpp
+ * @author  Liron Gershuny <liron.gershuny@mail.huji.ac.il>
+ * @version 1.0
+ * @date 25 Dec 2019
+ *
+ * @brief Convert the per layer parameter files into a single model file.
+ *
+ * @section LICENSE
+ * This program is not a free software; bla bla bla...
+ *
+ * @section DESCRIPTION
+ * The program reads the eight raw weights and bias files of the MNIST network and writes
+ * them, together with the layer activations, into one checksummed model file.
+ * Input  : The model path followed by the weights and bias files of every layer
+ * Process: Reads and validates every tensor
+ * Output : A model file that mlpnetwork loads in one go
+ */
+
+// ------------------------------ includes ------------------------------
+#include <iostream>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "Matrix.h"
+#include "ModelFile.h"
+#include "MlpNetwork.h"
+
+
+// -------------------------- const definitions -------------------------
+
+#define ERROR_INAVLID_PARAMETER "Error: invalid Parameters file for layer: "
+#define ERROR_WRITE_MODEL "Error: could not write model file: "
+#define USAGE_MSG "Usage:\n" \
+                  "\t./mlpconvert model w1 w2 w3 w4 b1 b2 b3 b4\n" \
+                  "\tmodel - the model file to create\n" \
+                  "\twi - the i'th layer's weights\n" \
+                  "\tbi - the i'th layer's biases"
+
+#define MODEL_PATH_IDX 1
+#define WEIGHTS_START_IDX (MODEL_PATH_IDX + 1)
+#define BIAS_START_IDX (WEIGHTS_START_IDX + MLP_SIZE)
+#define ARGS_COUNT (BIAS_START_IDX + MLP_SIZE)
+
+
+/**
+ * Program's main
+ * @param argc count of args
+ * @param argv args values
+ * @return program exit status code
+ */
+int main(int argc, char **argv)
+{
+    if(argc != ARGS_COUNT)
+    {
+        std::cout << USAGE_MSG << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    std::vector<ModelLayer> layers;
+    for(int i = 0; i < MLP_SIZE; i++)
+    {
+        ModelLayer layer{Matrix(weightsDims[i].rows, weightsDims[i].cols),
+                         Matrix(biasDims[i].rows, biasDims[i].cols),
+                         i == MLP_SIZE - 1 ? Softmax : Relu};
+
+        if(!(ModelFile::readRawTensor(argv[WEIGHTS_START_IDX + i], layer.weights) &&
+             ModelFile::readRawTensor(argv[BIAS_START_IDX + i], layer.bias)))
+        {
+            std::cerr << ERROR_INAVLID_PARAMETER << (i + 1) << std::endl;
+            return EXIT_FAILURE;
+        }
+        layers.push_back(std::move(layer));
+    }
+
+    if(!ModelFile::save(argv[MODEL_PATH_IDX], layers))
+    {
+        std::cerr << ERROR_WRITE_MODEL << argv[MODEL_PATH_IDX] << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
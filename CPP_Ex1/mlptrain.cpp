@@ -0,0 +1,316 @@
+/**
+ * @file mlptrain.cpp
+ * @author  Liron Gershuny <liron.gershuny@mail.huji.ac.il>
+ * @version 1.0
+ * @date 25 Dec 2019
+ *
+ * @brief Train the MNIST network and write its per layer parameter files back.
+ *
+ * @section LICENSE
+ * This program is not a free software; bla bla bla...
+ *
+ * @section DESCRIPTION
+ * The program reads a training set, a stream of raw images written back to back like the
+ * input of the stream batch mode and one byte holding the digit of every image, and trains
+ * the network of the eight weights and bias files on it. After every epoch it prints the
+ * loss and the accuracy on the training set and writes the parameters back to their files.
+ * Input  : The images and labels files, the parameter files and the training options
+ * Process: Mini batch SGD with momentum or Adam, backpropagated on every core
+ * Output : The trained parameter files
+ */
+
+// ------------------------------ includes ------------------------------
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <exception>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "Matrix.h"
+#include "MappedFile.h"
+#include "ModelFile.h"
+#include "MlpNetwork.h"
+#include "InferenceEngine.h"
+#include "Trainer.h"
+
+
+// -------------------------- const definitions -------------------------
+
+#define ERROR_INAVLID_PARAMETER "Error: invalid Parameters file for layer: "
+#define ERROR_INVALID_IMAGES "Error: invalid images file: "
+#define ERROR_INVALID_LABELS "Error: the labels file doesn't match the images: "
+#define ERROR_WRITE_PARAMETER "Error: could not write Parameters file: "
+#define USAGE_MSG "Usage:\n" \
+                  "\t./mlptrain images labels w1 w2 w3 w4 b1 b2 b3 b4 [options]\n" \
+                  "\timages - raw images written back to back\n" \
+                  "\tlabels - one byte holding the digit of every image\n" \
+                  "\twi - the i'th layer's weights, trained in place\n" \
+                  "\tbi - the i'th layer's biases, trained in place\n" \
+                  "options:\n" \
+                  "\t--epochs n - the number of passes over the images, 1 by default\n" \
+                  "\t--batch n - the number of images of every step, 128 by default\n" \
+                  "\t--optimizer sgd|adam - sgd with momentum by default\n" \
+                  "\t--rate r - the learning rate, 0.05 for sgd and 0.001 for adam by default\n" \
+                  "\t--threads n - the number of worker threads, all cores by default\n" \
+                  "\t--seed n - the seed of the order of the images and of --init\n" \
+                  "\t--init - start from random parameters instead of reading the files"
+
+#define EPOCHS_FLAG "--epochs"
+#define BATCH_FLAG "--batch"
+#define OPTIMIZER_FLAG "--optimizer"
+#define RATE_FLAG "--rate"
+#define THREADS_FLAG "--threads"
+#define SEED_FLAG "--seed"
+#define INIT_FLAG "--init"
+#define DEFAULT_EPOCHS 1
+#define DEFAULT_SEED 2019
+
+#define IMAGES_PATH_IDX 1
+#define LABELS_PATH_IDX (IMAGES_PATH_IDX + 1)
+#define WEIGHTS_START_IDX (LABELS_PATH_IDX + 1)
+#define BIAS_START_IDX (WEIGHTS_START_IDX + MLP_SIZE)
+#define OPTIONS_START_IDX (BIAS_START_IDX + MLP_SIZE)
+
+
+// ------------------------------ functions -----------------------------
+
+/**
+ * Parse the options after the parameter files.
+ * @param argc count of args
+ * @param argv args values
+ * @param options Receives the optimizer, the batch size and the threads
+ * @param epochs Receives the number of epochs
+ * @param seed Receives the seed
+ * @param init Receives whether to start from random parameters
+ * @return boolean status
+ *          true - success
+ *          false - an unknown option or a bad value
+ */
+static bool parseOptions(int argc, char **argv, TrainingOptions &options, int &epochs,
+                         unsigned int &seed, bool &init)
+{
+    for(int i = OPTIONS_START_IDX ; i < argc ; i++)
+    {
+        if(std::strcmp(argv[i], INIT_FLAG) == 0)
+        {
+            init = true;
+            continue;
+        }
+        if(i + 1 >= argc)
+        {
+            return false;
+        }
+
+        const char *value = argv[++i];
+        if(std::strcmp(argv[i - 1], EPOCHS_FLAG) == 0)
+        {
+            epochs = std::atoi(value);
+        }
+        else if(std::strcmp(argv[i - 1], BATCH_FLAG) == 0)
+        {
+            options.batchSize = std::atoi(value);
+        }
+        else if(std::strcmp(argv[i - 1], OPTIMIZER_FLAG) == 0)
+        {
+            if(!parseOptimizer(value, options.optimizer))
+            {
+                return false;
+            }
+        }
+        else if(std::strcmp(argv[i - 1], RATE_FLAG) == 0)
+        {
+            options.learningRate = (float) std::atof(value);
+        }
+        else if(std::strcmp(argv[i - 1], THREADS_FLAG) == 0)
+        {
+            options.threads = std::atoi(value);
+        }
+        else if(std::strcmp(argv[i - 1], SEED_FLAG) == 0)
+        {
+            seed = (unsigned int) std::strtoul(value, nullptr, 10);
+        }
+        else
+        {
+            return false;
+        }
+    }
+    return epochs > 0 && options.batchSize > 0 && options.learningRate >= 0 &&
+           options.threads >= 0;
+}
+
+/**
+ * Read the training set. The images are a whole number of images written back to back,
+ * the labels hold one digit byte per image.
+ * @param imagesPath The path of the images file
+ * @param labelsPath The path of the labels file
+ * @param images Receives the images, one per row
+ * @param labels Receives the digit of every image
+ * @return boolean status
+ *          true - success
+ *          false - failure, the error was printed
+ */
+static bool readTrainingSet(const char *imagesPath, const char *labelsPath, Matrix &images,
+                            std::vector<int> &labels)
+{
+    size_t imageBytes = (size_t) weightsDims[0].cols * sizeof(float);
+    MappedFile imagesFile(imagesPath);
+    if(!imagesFile.isOpen() || imagesFile.size() == 0 || imagesFile.size() % imageBytes != 0)
+    {
+        std::fprintf(stderr, "%s%s\n", ERROR_INVALID_IMAGES, imagesPath);
+        return false;
+    }
+
+    int count = (int) (imagesFile.size() / imageBytes);
+    MappedFile labelsFile(labelsPath);
+    if(!labelsFile.isOpen() || labelsFile.size() != (size_t) count)
+    {
+        std::fprintf(stderr, "%s%s\n", ERROR_INVALID_LABELS, labelsPath);
+        return false;
+    }
+
+    images = Matrix(count, weightsDims[0].cols);
+    std::memcpy(images.data(), imagesFile.data(), imagesFile.size());
+    labels.resize(count);
+    for(int i = 0 ; i < count ; i++)
+    {
+        labels[i] = (uint8_t) labelsFile.data()[i];
+    }
+    return true;
+}
+
+/**
+ * Draw every weight uniformly from the He range of its layer, sqrt(6 / inputs) around
+ * zero, and zero every bias.
+ * @param weights The weights of every layer, already shaped
+ * @param biases The bias of every layer, already shaped
+ * @param generator The source of the weights
+ */
+static void initParameters(Matrix weights[MLP_SIZE], Matrix biases[MLP_SIZE],
+                           std::mt19937 &generator)
+{
+    for(int i = 0 ; i < MLP_SIZE ; i++)
+    {
+        float limit = std::sqrt(6.0f / (float) weightsDims[i].cols);
+        std::uniform_real_distribution<float> distribution(-limit, limit);
+        for(int j = 0 ; j < weightsDims[i].rows * weightsDims[i].cols ; j++)
+        {
+            weights[i][j] = distribution(generator);
+        }
+        biases[i] = Matrix(biasDims[i].rows, biasDims[i].cols);
+    }
+}
+
+/**
+ * Write the parameters of every layer back to their files.
+ * @param mlp The trained network
+ * @param argv args values, holding the paths of the files
+ * @return boolean status
+ *          true - success
+ *          false - failure, the error was printed
+ */
+static bool writeParameters(const MlpNetwork &mlp, char **argv)
+{
+    for(int i = 0 ; i < MLP_SIZE ; i++)
+    {
+        for(int idx : {WEIGHTS_START_IDX + i, BIAS_START_IDX + i})
+        {
+            const Dense &layer = mlp.getLayer(i);
+            if(!ModelFile::writeRawTensor(argv[idx], idx == WEIGHTS_START_IDX + i ?
+                                                     layer.getWeights() : layer.getBias()))
+            {
+                std::fprintf(stderr, "%s%s\n", ERROR_WRITE_PARAMETER, argv[idx]);
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+/**
+ * Program's main
+ * @param argc count of args
+ * @param argv args values
+ * @return program exit status code
+ */
+int main(int argc, char **argv)
+{
+    TrainingOptions options;
+    int epochs = DEFAULT_EPOCHS;
+    unsigned int seed = DEFAULT_SEED;
+    bool init = false;
+    if(argc < OPTIONS_START_IDX || !parseOptions(argc, argv, options, epochs, seed, init))
+    {
+        std::puts(USAGE_MSG);
+        return EXIT_FAILURE;
+    }
+
+    Matrix images;
+    std::vector<int> labels;
+    if(!readTrainingSet(argv[IMAGES_PATH_IDX], argv[LABELS_PATH_IDX], images, labels))
+    {
+        return EXIT_FAILURE;
+    }
+
+    std::mt19937 generator(seed);
+    Matrix weights[MLP_SIZE];
+    Matrix biases[MLP_SIZE];
+    for(int i = 0 ; i < MLP_SIZE ; i++)
+    {
+        weights[i] = Matrix(weightsDims[i].rows, weightsDims[i].cols);
+        biases[i] = Matrix(biasDims[i].rows, biasDims[i].cols);
+        if(!init && !(ModelFile::readRawTensor(argv[WEIGHTS_START_IDX + i], weights[i]) &&
+                      ModelFile::readRawTensor(argv[BIAS_START_IDX + i], biases[i])))
+        {
+            std::fprintf(stderr, "%s%d\n", ERROR_INAVLID_PARAMETER, i + 1);
+            return EXIT_FAILURE;
+        }
+    }
+    if(init)
+    {
+        initParameters(weights, biases, generator);
+    }
+
+    try
+    {
+        MlpNetwork mlp(weights, biases);
+        Trainer trainer(mlp, options);
+        InferenceEngine engine(mlp, options.threads);
+        std::printf("training %d images, %s at rate %g, batch %d, %d threads\n",
+                    images.getRows(), optimizerName(options.optimizer),
+                    trainer.getLearningRate(), options.batchSize, trainer.getThreadCount());
+
+        for(int epoch = 1 ; epoch <= epochs ; epoch++)
+        {
+            auto start = std::chrono::steady_clock::now();
+            float loss = trainer.trainEpoch(images, labels, generator);
+            double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() -
+                                                           start).count();
+
+            std::vector<Digit> digits = engine.predictBatch(MatrixView(images).transpose());
+            int correct = 0;
+            for(size_t i = 0 ; i < digits.size() ; i++)
+            {
+                correct += (int) digits[i].value == labels[i];
+            }
+            std::printf("epoch %d: loss %.4f, accuracy %.2f%%, %.2f s\n", epoch, loss,
+                        100.0 * correct / images.getRows(), seconds);
+
+            if(!writeParameters(mlp, argv))
+            {
+                return EXIT_FAILURE;
+            }
+        }
+    }
+    catch(const std::exception &e)
+    {
+        std::fprintf(stderr, "%s\n", e.what());
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
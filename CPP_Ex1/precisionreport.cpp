@@ -0,0 +1,160 @@
+/**
+ * @file precisionreport.cpp
+ * @author  Liron Gershuny <liron.gershuny@mail.huji.ac.il>
+ * @version 1.0
+ * @date 25 Dec 2019
+ *
+ * @brief Compare the reduced precision weights of a model against its float weights.
+ *
+ * @section LICENSE
+ * This program is not a free software; bla bla bla...
+ *
+ * @section DESCRIPTION
+ * The program classifies the given images once with float weights and once with every
+ * other weight precision, and reports how often the digits agree, how far the
+ * probabilities drift and how many bytes of weights every precision reads.
+ * Input  : A model file and a list of images
+ * Process: Runs every image through the network in every precision
+ * Output : A per image table and a summary per precision on stdout
+ */
+
+// ------------------------------ includes ------------------------------
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <exception>
+#include <new>
+#include <utility>
+#include <vector>
+
+#include "Matrix.h"
+#include "ModelFile.h"
+#include "MlpNetwork.h"
+
+
+// -------------------------- const definitions -------------------------
+
+#define ERROR_INVALID_MODEL "Error: invalid model file: "
+#define ERROR_INVALID_IMG "Error: invalid image path or size: "
+#define USAGE_MSG "Usage:\n" \
+                  "\t./precisionreport model image...\n" \
+                  "\tmodel - a single file model, see mlpconvert\n" \
+                  "\timage - the images to classify, e.g. images/im*"
+
+#define MODEL_PATH_IDX 1
+#define IMAGES_START_IDX 2
+
+static const WeightPrecision reducedPrecisions[] = {Int8, Float16, BFloat16};
+
+
+// ------------------------------ functions -----------------------------
+
+/**
+ * Classify every image with the network in its current precision
+ * @param mlp The network
+ * @param images The vectorized images
+ * @return The digit of every image
+ */
+std::vector<Digit> classify(MlpNetwork &mlp, const std::vector<Matrix> &images)
+{
+    std::vector<Digit> digits;
+    for(const Matrix &image : images)
+    {
+        digits.push_back(mlp(image));
+    }
+    return digits;
+}
+
+/**
+ * The body of main, the errors of the library reach main as exceptions
+ * @param argc count of args
+ * @param argv args values
+ * @return program exit status code
+ */
+int run(int argc, char **argv)
+{
+    if(argc <= IMAGES_START_IDX)
+    {
+        std::puts(USAGE_MSG);
+        return EXIT_FAILURE;
+    }
+
+    std::vector<Dense> layers;
+    if(!ModelFile::load(argv[MODEL_PATH_IDX], layers))
+    {
+        std::fprintf(stderr, "%s%s\n", ERROR_INVALID_MODEL, argv[MODEL_PATH_IDX]);
+        return EXIT_FAILURE;
+    }
+    MlpNetwork mlp(std::move(layers));
+
+    std::vector<Matrix> images;
+    for(int i = IMAGES_START_IDX ; i < argc ; i++)
+    {
+        Matrix image(mlp.getInputSize(), 1);
+        if(!ModelFile::readRawTensor(argv[i], image))
+        {
+            std::fprintf(stderr, "%s%s\n", ERROR_INVALID_IMG, argv[i]);
+            return EXIT_FAILURE;
+        }
+        images.push_back(std::move(image));
+    }
+
+    mlp.setPrecision(Float32);
+    long int floatBytes = mlp.getWeightsBytes();
+    std::vector<Digit> reference = classify(mlp, images);
+
+    for(WeightPrecision precision : reducedPrecisions)
+    {
+        mlp.setPrecision(precision);
+        std::vector<Digit> digits = classify(mlp, images);
+
+        std::printf("%-24s %8s %10s %8s %10s %10s\n", "image", precisionName(Float32), "p",
+                    precisionName(precision), "p", "|dp|");
+        int agree = 0;
+        double maxDrift = 0;
+        double sumDrift = 0;
+        for(size_t j = 0 ; j < images.size() ; j++)
+        {
+            double drift = std::fabs(digits[j].probability - reference[j].probability);
+            agree += digits[j].value == reference[j].value;
+            maxDrift = std::max(maxDrift, drift);
+            sumDrift += drift;
+            std::printf("%-24s %8u %10.6f %8u %10.6f %10.2e\n", argv[IMAGES_START_IDX + j],
+                        reference[j].value, reference[j].probability, digits[j].value,
+                        digits[j].probability, drift);
+        }
+
+        long int bytes = mlp.getWeightsBytes();
+        std::printf("\n%s: %d/%zu digits agree, |dp| mean %.2e max %.2e, "
+                    "weights %ld bytes (%.2fx smaller than float32)\n\n",
+                    precisionName(precision), agree, images.size(), sumDrift / images.size(),
+                    maxDrift, bytes, (double) floatBytes / bytes);
+    }
+
+    return EXIT_SUCCESS;
+}
+
+/**
+ * Program's main, reports the errors the library throws and exits with EXIT_STATUS
+ * @param argc count of args
+ * @param argv args values
+ * @return program exit status code
+ */
+int main(int argc, char **argv)
+{
+    try
+    {
+        return run(argc, argv);
+    }
+    catch(const std::bad_alloc &)
+    {
+        std::fprintf(stderr, "%s\n", ALLOCATION_FAILED_MSG);
+    }
+    catch(const std::exception &e)
+    {
+        std::fprintf(stderr, "%s\n", e.what());
+    }
+
+    return EXIT_STATUS;
+}
@@ -0,0 +1,349 @@
+/**
+ * @file trainingtest.cpp
+ * @author  Liron Gershuny <liron.gershuny@mail.huji.ac.il>
+ * @version 1.0
+ * @date 25 Dec 2019
+ *
+ * @brief Check the backward pass against central differences and the stale weights of an
+ *        updated network.
+ *
+ * @section LICENSE
+ * This program is not a free software; bla bla bla...
+ *
+ * @section DESCRIPTION
+ * The program builds small networks whose hidden layers use ReLU, Sigmoid, Tanh or Softmax
+ * before the final Softmax, and compares the gradient of every weight and bias that
+ * MlpNetwork::backward returns with the central difference of its loss. It then updates an
+ * int8 network, which must give the same outputs as the float one until its weights are
+ * prepared again, and the same as a freshly quantized network after. Last, a Trainer must
+ * reach the same weights with one and with several threads.
+ * Input  : None
+ * Process: Runs every check on networks of random weights
+ * Output : The largest gradient error of every stack and the failing checks, exits with
+ *          failure if any failed
+ */
+
+// ------------------------------ includes ------------------------------
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <utility>
+#include <vector>
+
+#include "Matrix.h"
+#include "Dense.h"
+#include "MlpNetwork.h"
+#include "Trainer.h"
+#include "TestFixtures.h"
+
+
+// -------------------------- const definitions -------------------------
+
+/*
+ * @def SAMPLE_COUNT 6
+ * @brief The number of samples every loss is summed over
+ */
+#define SAMPLE_COUNT 6
+
+/*
+ * @def TRAINING_SAMPLE_COUNT 96
+ * @brief The number of samples of the threaded training check, several shards of a batch
+ */
+#define TRAINING_SAMPLE_COUNT 96
+
+/*
+ * @def TRAINING_STEPS 5
+ * @brief The number of optimizer steps of the threaded training check
+ */
+#define TRAINING_STEPS 5
+
+/*
+ * @def DIFFERENCE_STEP 1e-2f
+ * @brief The change of a parameter the central difference is taken over
+ */
+#define DIFFERENCE_STEP 1e-2f
+
+/*
+ * @def GRADIENT_TOLERANCE 2e-2
+ * @brief The largest difference allowed between the two gradients, relative to the larger
+ *        of 1 and the analytic gradient. The float loss and the curvature over the step
+ *        keep the difference from being exact.
+ */
+#define GRADIENT_TOLERANCE 2e-2
+
+/**
+ * The input size and the output size of every layer of the gradient checks
+ */
+static const std::vector<int> layerSizes = {12, 8, 6, 5};
+
+/**
+ * The hidden layer activations every gradient check is run with
+ */
+static const ActivationType hiddenActivations[] = {Relu, Sigmoid, Tanh, Softmax};
+
+/**
+ * The names of hiddenActivations, printed with the results
+ */
+static const char *hiddenActivationNames[] = {"relu", "sigmoid", "tanh", "softmax"};
+
+
+// ------------------------------ functions -----------------------------
+
+/**
+ * A class of the network output for every sample.
+ * @param count The number of samples
+ * @param classes The number of classes
+ * @param generator The source of the labels
+ * @return The labels
+ */
+static std::vector<int> randomLabels(int count, int classes, std::mt19937 &generator)
+{
+    std::uniform_int_distribution<int> distribution(0, classes - 1);
+    std::vector<int> labels(count);
+    for(int &label : labels)
+    {
+        label = distribution(generator);
+    }
+    return labels;
+}
+
+/**
+ * Compare the gradient of one parameter with the central difference of the loss, moving
+ * the parameter back where it was.
+ * @param mlp The network
+ * @param images The samples
+ * @param labels The class of every sample
+ * @param layer The index of the layer of the parameter
+ * @param inBias Whether the parameter is a bias, otherwise a weight
+ * @param at The index of the parameter in its matrix
+ * @param analytic The gradient backward returned for it
+ * @param maxError Updated with the largest relative error
+ * @return Whether the two gradients are within the tolerance
+ */
+static bool checkParameter(MlpNetwork &mlp, const Matrix &images, const std::vector<int> &labels,
+                           int layer, bool inBias, int at, float analytic, double &maxError)
+{
+    const Dense &dense = mlp.getLayer(layer);
+    Matrix weightsStep(dense.getWeights().getRows(), dense.getWeights().getCols());
+    Matrix biasStep(dense.getBias().getRows(), dense.getBias().getCols());
+    Matrix &step = inBias ? biasStep : weightsStep;
+    TrainingBuffers buffers;
+
+    step[at] = DIFFERENCE_STEP;
+    mlp.updateLayer(layer, weightsStep, biasStep);
+    double lossAbove = mlp.backward(images, labels.data(), buffers);
+    step[at] = -2 * DIFFERENCE_STEP;
+    mlp.updateLayer(layer, weightsStep, biasStep);
+    double lossBelow = mlp.backward(images, labels.data(), buffers);
+    step[at] = DIFFERENCE_STEP;
+    mlp.updateLayer(layer, weightsStep, biasStep);
+
+    double numeric = (lossAbove - lossBelow) / (2 * DIFFERENCE_STEP);
+    double error = std::fabs(numeric - analytic) / std::max(1.0, std::fabs((double) analytic));
+    maxError = std::max(maxError, error);
+    if(!(error <= GRADIENT_TOLERANCE))
+    {
+        std::printf("FAIL layer %d %s %d: backward gives %g, the central difference %g\n",
+                    layer, inBias ? "bias" : "weight", at, analytic, numeric);
+        return false;
+    }
+    return true;
+}
+
+/**
+ * Compare every gradient backward returns for a network with the central differences.
+ * @param name The name of the hidden activation, printed with the result
+ * @param hidden The activation of every layer but the last
+ * @param generator The source of the weights, the samples and the labels
+ * @return The number of failing parameters
+ */
+static int checkGradients(const char *name, ActivationType hidden, std::mt19937 &generator)
+{
+    int layerCount = (int) layerSizes.size() - 1;
+    MlpNetwork mlp(randomLayers(layerSizes, hidden, generator));
+    Matrix images = randomMatrix(layerSizes[0], SAMPLE_COUNT, 1.0f, generator);
+    std::vector<int> labels = randomLabels(SAMPLE_COUNT, layerSizes[layerCount], generator);
+
+    TrainingBuffers buffers;
+    mlp.backward(images, labels.data(), buffers);
+    std::vector<LayerGradients> gradients = buffers.layers;
+
+    int failures = 0;
+    double maxError = 0;
+    for(int i = 0 ; i < layerCount ; i++)
+    {
+        const Matrix &weights = gradients[i].weights;
+        for(int at = 0 ; at < weights.getRows() * weights.getCols() ; at++)
+        {
+            failures += !checkParameter(mlp, images, labels, i, false, at, weights[at],
+                                        maxError);
+        }
+        const Matrix &bias = gradients[i].bias;
+        for(int at = 0 ; at < bias.getRows() * bias.getCols() ; at++)
+        {
+            failures += !checkParameter(mlp, images, labels, i, true, at, bias[at], maxError);
+        }
+    }
+
+    std::printf("%-8s gradients: largest relative error %g%s\n", name, maxError,
+                failures == 0 ? "" : "  FAIL");
+    return failures;
+}
+
+/**
+ * Compare the outputs of two networks on a batch, through caller buffers, which leave the
+ * weights of a stale layer as they are.
+ * @param name The name of the check, printed on failure
+ * @param mlp The checked network
+ * @param reference The network it must agree with
+ * @param images The batch
+ * @return Whether every output is the same
+ */
+static bool sameOutputs(const char *name, const MlpNetwork &mlp, const MlpNetwork &reference,
+                        const Matrix &images)
+{
+    int count = images.getCols();
+    ForwardBuffers buffers;
+    ForwardBuffers referenceBuffers;
+    std::vector<Digit> digits(count);
+    std::vector<Digit> referenceDigits(count);
+    mlp.predictBatch(images, buffers, digits.data());
+    reference.predictBatch(images, referenceBuffers, referenceDigits.data());
+    for(int j = 0 ; j < count ; j++)
+    {
+        if(digits[j].value != referenceDigits[j].value ||
+           digits[j].probability != referenceDigits[j].probability)
+        {
+            std::printf("FAIL %s: image %d gives %u with %g instead of %u with %g\n", name, j,
+                        digits[j].value, digits[j].probability, referenceDigits[j].value,
+                        referenceDigits[j].probability);
+            return false;
+        }
+    }
+
+    return true;
+}
+
+/**
+ * Update every layer of an int8 network, and check it reads the float weights until they
+ * are prepared again, then the weights quantized from the updated ones.
+ * @param generator The source of the weights, the steps and the images
+ * @return The number of failing checks
+ */
+static int checkStaleWeights(std::mt19937 &generator)
+{
+    int layerCount = MLP_SIZE;
+    std::vector<int> sizes = mnistLayerSizes();
+    std::vector<Dense> layers = randomLayers(sizes, Relu, generator);
+    MlpNetwork quantized(layers);
+    quantized.setPrecision(Int8);
+    Matrix images = randomMatrix(sizes[0], SAMPLE_COUNT, 1.0f, generator);
+
+    std::vector<Dense> updatedLayers;
+    for(int i = 0 ; i < layerCount ; i++)
+    {
+        const Dense &layer = quantized.getLayer(i);
+        Matrix weightsStep = randomMatrix(layer.getWeights().getRows(),
+                                          layer.getWeights().getCols(), 0.01f, generator);
+        Matrix biasStep = randomMatrix(layer.getBias().getRows(), 1, 0.01f, generator);
+        quantized.updateLayer(i, weightsStep, biasStep);
+        updatedLayers.emplace_back(layer.getWeights(), layer.getBias(), layer.getActivation());
+    }
+    MlpNetwork floatNetwork(updatedLayers);
+    MlpNetwork requantized(updatedLayers);
+    requantized.setPrecision(Int8);
+
+    int failures = 0;
+    failures += !sameOutputs("int8 network while stale", quantized, floatNetwork, images);
+    quantized.prepareWeights();
+    failures += !sameOutputs("int8 network after prepareWeights", quantized, requantized,
+                             images);
+    std::printf("stale weights: %d failures\n", failures);
+    return failures;
+}
+
+/**
+ * Train two copies of a network on the same batches with one and with several threads,
+ * the weights must come out the same.
+ * @param generator The source of the weights, the images and the labels
+ * @return The number of failing checks
+ */
+static int checkThreadedTraining(std::mt19937 &generator)
+{
+    int layerCount = (int) layerSizes.size() - 1;
+    std::vector<Dense> layers = randomLayers(layerSizes, Relu, generator);
+    Matrix images = randomMatrix(layerSizes[0], TRAINING_SAMPLE_COUNT, 1.0f, generator);
+    std::vector<int> labels = randomLabels(TRAINING_SAMPLE_COUNT, layerSizes[layerCount],
+                                           generator);
+
+    MlpNetwork serial(layers);
+    MlpNetwork threaded(layers);
+    TrainingOptions options;
+    options.optimizer = Adam;
+    options.batchSize = TRAINING_SAMPLE_COUNT;
+    options.shardSize = TRAINING_SAMPLE_COUNT / 4;
+    options.threads = 1;
+    Trainer serialTrainer(serial, options);
+    options.threads = 4;
+    Trainer threadedTrainer(threaded, options);
+
+    int failures = 0;
+    float firstLoss = 0;
+    float lastLoss = 0;
+    for(int step = 0 ; step < TRAINING_STEPS ; step++)
+    {
+        lastLoss = serialTrainer.trainBatch(images, labels.data());
+        float threadedLoss = threadedTrainer.trainBatch(images, labels.data());
+        firstLoss = step == 0 ? lastLoss : firstLoss;
+        if(threadedLoss != lastLoss)
+        {
+            std::printf("FAIL step %d: %d threads give a loss of %g instead of %g\n", step,
+                        threadedTrainer.getThreadCount(), threadedLoss, lastLoss);
+            failures++;
+        }
+    }
+    if(!(lastLoss < firstLoss))
+    {
+        std::printf("FAIL the loss went from %g to %g\n", firstLoss, lastLoss);
+        failures++;
+    }
+    for(int i = 0 ; i < layerCount ; i++)
+    {
+        const Matrix &weights = serial.getLayer(i).getWeights();
+        const Matrix &threadedWeights = threaded.getLayer(i).getWeights();
+        for(int at = 0 ; at < weights.getRows() * weights.getCols() ; at++)
+        {
+            if(threadedWeights[at] != weights[at])
+            {
+                std::printf("FAIL layer %d weight %d: %g with several threads, %g with one\n",
+                            i, at, threadedWeights[at], weights[at]);
+                failures++;
+                break;
+            }
+        }
+    }
+    std::printf("threaded training: loss %g to %g, %d failures\n", firstLoss, lastLoss,
+                failures);
+    return failures;
+}
+
+/**
+ * Program's main
+ * @return program exit status code
+ */
+int main()
+{
+    std::mt19937 generator(RANDOM_SEED);
+    int failures = 0;
+    for(size_t i = 0 ; i < sizeof(hiddenActivations) / sizeof(hiddenActivations[0]) ; i++)
+    {
+        failures += checkGradients(hiddenActivationNames[i], hiddenActivations[i], generator);
+    }
+    failures += checkStaleWeights(generator);
+    failures += checkThreadedTraining(generator);
+
+    std::printf("%d failures\n", failures);
+    return failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}